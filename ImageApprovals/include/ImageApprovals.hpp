@@ -5,7 +5,12 @@
 
 #include "ImageApprovals/ImageWriter.hpp"
 #include "ImageApprovals/ImageComparator.hpp"
+#include "ImageApprovals/BatchVerifier.hpp"
+#include "ImageApprovals/AsyncVerifier.hpp"
+#include "ImageApprovals/Conversion.hpp"
+#include "ImageApprovals/PixelFormatTraits.hpp"
 #include "ImageApprovals/Image.hpp"
+#include "ImageApprovals/LayeredImage.hpp"
 
 #include "ImageApprovals/Version.hpp"
 
@@ -0,0 +1,63 @@
+#ifndef IMAGEAPPROVALS_ASYNCVERIFIER_HPP_INCLUDED
+#define IMAGEAPPROVALS_ASYNCVERIFIER_HPP_INCLUDED
+
+#include "CompareStrategy.hpp"
+#include "ImageComparator.hpp"
+#include "Image.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ImageApprovals {
+
+// Verifies images on background threads, so that the caller can carry on, e.g. render the next frame.
+// Each verification writes <pathWithoutExtension>.received<ext>, compares it with
+// <pathWithoutExtension>.approved<ext> and removes the received file if they match.
+class AsyncVerifier
+{
+public:
+    // At most maxQueuedImages images wait for a thread at a time; verify blocks while the queue is full.
+    // A single thread is usually enough, as comparisons are already parallel.
+    explicit AsyncVerifier(
+        std::shared_ptr<CompareStrategy> strategy = std::make_shared<ThresholdCompareStrategy>(),
+        size_t numThreads = 1, size_t maxQueuedImages = 4);
+
+    AsyncVerifier(const AsyncVerifier&) = delete;
+    AsyncVerifier& operator =(const AsyncVerifier&) = delete;
+
+    // Waits for all queued verifications
+    ~AsyncVerifier();
+
+    // The future throws ApprovalTests::ApprovalException (or the codec's error) if the verification fails.
+    // The first overload copies the pixels; the second shares ownership of the image.
+    std::future<void> verify(const ImageView& image, std::string pathWithoutExtension);
+    std::future<void> verify(std::shared_ptr<const Image> image, std::string pathWithoutExtension);
+
+    // Waits until every verification queued so far has finished
+    void join();
+
+private:
+    void runWorker();
+    void stopWorkers();
+
+    ImageComparator m_comparator;
+    size_t m_maxQueuedImages;
+
+    std::mutex m_mutex;
+    std::condition_variable m_stateChanged;
+    std::deque<std::packaged_task<void()>> m_queue;
+    size_t m_numRunning = 0;
+    bool m_stopping = false;
+
+    std::vector<std::thread> m_threads;
+};
+
+}
+
+#endif // IMAGEAPPROVALS_ASYNCVERIFIER_HPP_INCLUDED
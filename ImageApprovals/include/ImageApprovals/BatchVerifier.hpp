@@ -0,0 +1,74 @@
+#ifndef IMAGEAPPROVALS_BATCHVERIFIER_HPP_INCLUDED
+#define IMAGEAPPROVALS_BATCHVERIFIER_HPP_INCLUDED
+
+#include "CompareStrategy.hpp"
+#include "ImageCodec.hpp"
+#include "ImageView.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ImageApprovals {
+
+// Verifies many images against their approved files on a pool of threads.
+// Each entry is written (for images), read, and compared independently; at most
+// getMaxImagesInFlight() entries are processed, and held in memory, at a time.
+class BatchVerifier
+{
+public:
+    struct Failure
+    {
+        std::string receivedPath;
+        std::string approvedPath;
+        std::string message;
+    };
+
+    explicit BatchVerifier(std::shared_ptr<CompareStrategy> strategy = std::make_shared<ThresholdCompareStrategy>());
+
+    // Defaults to the number of hardware threads
+    BatchVerifier& setMaxImagesInFlight(size_t maxImages);
+    size_t getMaxImagesInFlight() const { return m_maxImagesInFlight; }
+
+    // See ImageComparator::setBandMemoryLimit
+    BatchVerifier& setBandMemoryLimit(size_t maxBytes);
+
+    // Writes the image to <pathWithoutExtension>.received<ext>, with the extension of the
+    // best codec for the image, and compares it with <pathWithoutExtension>.approved<ext>.
+    // The pixels are not copied, so the image must stay valid until run() returns.
+    BatchVerifier& add(const ImageView& image, std::string pathWithoutExtension);
+
+    // Compares a received file that already exists with its approved file
+    BatchVerifier& addFiles(std::string receivedPath, std::string approvedPath);
+
+    size_t getNumberOfEntries() const { return m_entries.size(); }
+
+    // Returns the failures in the order in which the entries were added. As with
+    // single approvals, received files written from images are removed when they match.
+    std::vector<Failure> run() const;
+
+    // Runs all entries and throws ApprovalTests::ApprovalException describing every failure
+    void verify() const;
+
+private:
+    struct Entry
+    {
+        // Null for entries added with addFiles
+        const ImageCodec* codec;
+        ImageView image;
+        std::string receivedPath;
+        std::string approvedPath;
+    };
+
+    // Returns false and fills in failure if the entry does not match
+    bool runEntry(const Entry& entry, Failure& failure) const;
+
+    std::shared_ptr<CompareStrategy> m_strategy;
+    size_t m_maxImagesInFlight;
+    size_t m_bandMemoryLimit = 0;
+    std::vector<Entry> m_entries;
+};
+
+}
+
+#endif // IMAGEAPPROVALS_BATCHVERIFIER_HPP_INCLUDED
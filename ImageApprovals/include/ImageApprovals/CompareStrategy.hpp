@@ -1,12 +1,124 @@
 #ifndef IMAGEAPPROVALS_COMPARESTRATEGY_HPP_INCLUDED
 #define IMAGEAPPROVALS_COMPARESTRATEGY_HPP_INCLUDED
 
+#include "FailureMask.hpp"
+#include "Image.hpp"
+#include "PixelFormat.hpp"
+#include "ToleranceMask.hpp"
 #include "Units.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <string>
 
 namespace ImageApprovals {
 
 class ImageView;
+class ImageReader;
+struct Size;
+
+namespace detail {
+
+struct ErrorSums;
+
+}
+
+// Pixel errors measured by a comparison, as absolute differences of channel values
+// normalized to [0, 1], after the alpha handling of the strategy. Strategies with a single
+// error per pixel, such as DepthCompareStrategy, leave channelMaxErrors at 0.
+struct CompareStatistics
+{
+    uint64_t numComparedPixels = 0;
+    uint64_t numFailedPixels = 0;
+
+    // The largest difference in any channel, and the first pixel (in row-major order) where it occurs
+    float maxError = 0.0f;
+    uint32_t worstPixelX = 0;
+    uint32_t worstPixelY = 0;
+
+    // The largest differences per channel; alpha is 0 for images without alpha
+    RGBA channelMaxErrors;
+
+    // Over the color channels, and alpha if the images have it
+    double meanError = 0.0;
+    double rmsError = 0.0;
+
+    // Peak signal-to-noise ratio in dB for a peak value of 1; infinite when the images are equal
+    double psnr = std::numeric_limits<double>::infinity();
+};
+
+// Collects an RGB image of the absolute channel differences found by a comparison, multiplied
+// by amplification, for strategies that render diff images (see CompareStrategy::rendersDiffImages).
+// The image is allocated at the first difference, so equal images cost nothing; it always has the
+// full size, also for banded comparisons, whose memory limit does not cover it.
+class DiffImageRenderer
+{
+public:
+    DiffImageRenderer(const Size& size, float amplification);
+
+    // Called by strategies for the rows in which they find differences; pixels that are not set stay black
+    uint8_t* getRowPointer(uint32_t y)
+    {
+        if (!m_rendered)
+        {
+            allocate();
+        }
+
+        return m_image.getRowPointer(y);
+    }
+
+    void setPixel(uint8_t* row, uint32_t x, float redDiff, float greenDiff, float blueDiff) const
+    {
+        row[3 * x + 0] = toByte(redDiff);
+        row[3 * x + 1] = toByte(greenDiff);
+        row[3 * x + 2] = toByte(blueDiff);
+    }
+
+    // False if the strategy found no differences, or did not get to compare any pixels
+    bool isRendered() const { return m_rendered; }
+
+    Size getSize() const { return m_size; }
+
+    // Empty if nothing was rendered
+    const Image& getImage() const { return m_image; }
+
+private:
+    void allocate();
+
+    // NaN differences are shown at full intensity
+    uint8_t toByte(float diff) const
+    {
+        const float value = diff * m_scale;
+        return !(value < 255.0f) ? 255 : ((value > 0.0f) ? static_cast<uint8_t>(value + 0.5f) : 0);
+    }
+
+    Size m_size;
+    Image m_image;
+    float m_scale;
+    bool m_rendered = false;
+};
+
+// Optional inputs and outputs of a single comparison
+struct CompareOptions
+{
+    // Rendered while the images are compared, if the strategy renders diff images
+    DiffImageRenderer* diff = nullptr;
+
+    // Overrides the pixel fail threshold per pixel; must have the size of the images,
+    // and strategies that do not support tolerance masks throw if one is given
+    const ToleranceMask* toleranceMask = nullptr;
+};
+
+enum class AlphaComparison
+{
+    // Color and alpha channels are compared independently; two premultiplied images are compared as stored
+    Straight,
+    // Colors are multiplied by alpha before comparing, so color differences
+    // in fully transparent pixels are ignored
+    Premultiplied
+};
 
 class CompareStrategy
 {
@@ -14,20 +126,79 @@ public:
     struct Result
     {
         bool passed = false;
-        std::string leftImageInfo;
-        std::string rightImageInfo;
+
+        // Set by strategies that measure pixel errors, whether the comparison passed or not;
+        // comparisons that stop early, like banded ones, have statistics of the pixels compared so far
+        bool hasStatistics = false;
+        CompareStatistics statistics;
+
+        // Set by strategies that locate failed pixels, like the statistics; null otherwise
+        std::shared_ptr<const FailureMask> failureMask;
+
+        // True when the statistics and the failure mask cover only a sample of the rows,
+        // as for failures found by a quick reject (see ThresholdCompareStrategy::setQuickRejectRowStep)
+        bool sampled = false;
+
+        // Descriptions of both images for failure messages, formatted when requested
+        std::string getLeftImageInfo() const;
+        std::string getRightImageInfo() const;
 
         static Result makePassed();
         static Result makeFailed(std::string leftInfo, std::string rightInfo);
+        static Result makeFailedLazy(std::function<std::string()> formatLeftInfo, std::function<std::string()> formatRightInfo);
+
+    private:
+        std::string m_leftInfo;
+        std::string m_rightInfo;
+        std::function<std::string()> m_formatLeftInfo;
+        std::function<std::string()> m_formatRightInfo;
+    };
+
+    // Collects the comparison of two images passed as consecutive bands of rows
+    class BandAccumulator
+    {
+    public:
+        virtual ~BandAccumulator() = default;
+
+        virtual void addBand(uint32_t firstRow, const ImageView& left, const ImageView& right) = 0;
+
+        // Returns true when the remaining bands cannot change the result, so they need not be read
+        virtual bool isDecided() const { return false; }
+
+        virtual Result getResult() const = 0;
     };
 
     virtual ~CompareStrategy() = default;
 
-    Result compare(const ImageView& left, const ImageView& right) const;
+    // If diff is not null and the strategy renders diff images, the differences are
+    // rendered into it while the images are compared
+    Result compare(const ImageView& left, const ImageView& right, DiffImageRenderer* diff = nullptr) const;
+    Result compare(const ImageView& left, const ImageView& right, const CompareOptions& options) const;
+
+    // Compares images read in full-width bands, with at most about maxBandBytes of pixels
+    // of both images in memory at a time, and stops reading once the result is known
+    // (rows after that are left black in diff); strategies without band support read whole images
+    Result compare(ImageReader& left, ImageReader& right, size_t maxBandBytes, DiffImageRenderer* diff = nullptr) const;
+    Result compare(ImageReader& left, ImageReader& right, size_t maxBandBytes, const CompareOptions& options) const;
+
+    virtual bool rendersDiffImages() const { return false; }
+    virtual bool supportsToleranceMasks() const { return false; }
 
 protected:
     virtual Result compareInfos(const ImageView& left, const ImageView& right) const;
     virtual Result compareContents(const ImageView& left, const ImageView& right) const = 0;
+
+    // Returns nullptr if the strategy needs whole images
+    virtual std::unique_ptr<BandAccumulator> makeBandAccumulator(const Size& size) const;
+
+    // Used instead of the above when a diff image or tolerance mask the strategy supports is given;
+    // the defaults ignore the options
+    virtual Result compareContentsWithOptions(const ImageView& left, const ImageView& right, const CompareOptions& options) const;
+    virtual std::unique_ptr<BandAccumulator> makeBandAccumulatorWithOptions(const Size& size, const CompareOptions& options) const;
+
+private:
+    // Drops the options the strategy does not use, and checks the others
+    CompareOptions getUsedOptions(const CompareOptions& options, const Size& size) const;
 };
 
 class ThresholdCompareStrategy : public CompareStrategy
@@ -35,14 +206,90 @@ class ThresholdCompareStrategy : public CompareStrategy
 public:
     explicit ThresholdCompareStrategy(
         AbsThreshold pixelFailThreshold = AbsThreshold(0.004),
-        Percent maxFailedPixelsPercentage = Percent(0.1));
+        Percent maxFailedPixelsPercentage = Percent(0.1),
+        AlphaComparison alphaComparison = AlphaComparison::Straight);
+
+    // Before comparing images of at least minPixels pixels, compares only every rowStep-th row, and
+    // fails right away if those rows alone have more failed pixels than allowed, as with most gross differences.
+    // Otherwise all rows are compared as usual, so the verdict is never affected. Rejected results are marked
+    // as sampled, with statistics and failure masks of the sampled rows. Banded comparisons sample the rows
+    // of their first band. Not used when a diff image is rendered; 0, the default, disables the pre-check.
+    ThresholdCompareStrategy& setQuickRejectRowStep(uint32_t rowStep, uint64_t minPixels = uint64_t(1) << 20);
+
+    bool rendersDiffImages() const override { return true; }
+
+    // Ignored pixels are not compared, and do not count towards the failed pixels percentage
+    bool supportsToleranceMasks() const override { return true; }
 
 protected:
     Result compareContents(const ImageView& left, const ImageView& right) const override;
+    std::unique_ptr<BandAccumulator> makeBandAccumulator(const Size& size) const override;
+
+    Result compareContentsWithOptions(const ImageView& left, const ImageView& right, const CompareOptions& options) const override;
+    std::unique_ptr<BandAccumulator> makeBandAccumulatorWithOptions(const Size& size, const CompareOptions& options) const override;
 
 private:
+    // Counts failed pixels, measures the statistics, adds the failed pixels to mask and renders the rows
+    // into the diff of options in a single pass; row y of the views is row firstRow + y * rowStep of the image
+    detail::ErrorSums measureErrors(
+        const ImageView& left, const ImageView& right, FailureMask* mask, const CompareOptions& options,
+        uint32_t firstRow, uint32_t rowStep = 1) const;
+    Result makeResult(
+        const detail::ErrorSums& sums, uint64_t numComparablePixels, std::shared_ptr<const FailureMask> mask,
+        bool sampled = false) const;
+
+    // Measures the sampled rows of the first rows of images of the given size, if the pre-check
+    // applies, and returns true with the result in rejected if they already fail
+    bool quickReject(const ImageView& left, const ImageView& right, const Size& size, const CompareOptions& options,
+                     Result& rejected) const;
+
     AbsThreshold m_pixelFailThreshold;
     Percent m_maxFailedPixelsPercentage;
+    AlphaComparison m_alphaComparison;
+    uint32_t m_quickRejectRowStep = 0;
+    uint64_t m_quickRejectMinPixels = 0;
+};
+
+struct DepthRange
+{
+    float nearPlane;
+    float farPlane;
+
+    DepthRange(float nearPlane, float farPlane)
+        : nearPlane(nearPlane), farPlane(farPlane)
+    {}
+};
+
+// Compares single-channel float images, such as depth buffers, height maps or distance fields.
+// Pixels where both values are at or beyond the far plane are background and are skipped.
+class DepthCompareStrategy : public CompareStrategy
+{
+public:
+    // Values a and b match when |a - b| <= relativeTolerance * max(|a|, |b|);
+    // the far plane is at infinity
+    explicit DepthCompareStrategy(
+        RelThreshold relativeTolerance = RelThreshold(1e-4),
+        Percent maxFailedPixelsPercentage = Percent(0.0));
+
+    // Values a and b match when |a - b| <= rangeTolerance * (range.farPlane - range.nearPlane)
+    DepthCompareStrategy(
+        RelThreshold rangeTolerance, DepthRange range,
+        Percent maxFailedPixelsPercentage = Percent(0.0));
+
+protected:
+    Result compareInfos(const ImageView& left, const ImageView& right) const override;
+    Result compareContents(const ImageView& left, const ImageView& right) const override;
+    std::unique_ptr<BandAccumulator> makeBandAccumulator(const Size& size) const override;
+
+private:
+    detail::ErrorSums measureErrors(const ImageView& left, const ImageView& right) const;
+    Result makeResult(const detail::ErrorSums& sums, const Size& size) const;
+
+    RelThreshold m_tolerance;
+    float m_absTolerance = 0.0f;
+    float m_relTolerance = 0.0f;
+    float m_farPlane;
+    Percent m_maxFailedPixelsPercentage;
 };
 
 class BitwiseCompareStrategy : public CompareStrategy
@@ -50,8 +297,80 @@ class BitwiseCompareStrategy : public CompareStrategy
 public:
     BitwiseCompareStrategy() = default;
 
+protected:
+    Result compareInfos(const ImageView& left, const ImageView& right) const override;
+    Result compareContents(const ImageView& left, const ImageView& right) const override;
+    std::unique_ptr<BandAccumulator> makeBandAccumulator(const Size& size) const override;
+};
+
+// Compares the structural similarity (SSIM) of the luma of both images in square windows at every
+// pixel position, with colors premultiplied by alpha. Unlike per-pixel thresholds, SSIM tolerates
+// slight blur and noise, but not changes of local structure. Images fail when the mean SSIM of all
+// windows is below minMeanSsim, or when the SSIM of any window is below minWindowSsim.
+class SsimCompareStrategy : public CompareStrategy
+{
+public:
+    // Windows are clipped to the size of smaller images; the default minWindowSsim checks no windows
+    explicit SsimCompareStrategy(double minMeanSsim = 0.99, double minWindowSsim = -1.0, uint32_t windowSize = 8);
+
 protected:
     Result compareContents(const ImageView& left, const ImageView& right) const override;
+
+private:
+    double m_minMeanSsim;
+    double m_minWindowSsim;
+    uint32_t m_windowSize;
+};
+
+enum class DeltaEFormula
+{
+    CIE76,
+    // More uniform perceptually, but several times as expensive; only pixels whose CIE76
+    // difference does not already prove that they pass are measured with it, the others
+    // count with that bound in the statistics
+    CIEDE2000
+};
+
+// Compares the perceptual color difference (Delta E) of pixels in CIE L*a*b* with the D65 white point,
+// after compositing them over black. Pixels fail when their Delta E is above maxDeltaE; about 1 for
+// CIEDE2000 and 2.3 for CIE76 is a just noticeable difference.
+class DeltaECompareStrategy : public CompareStrategy
+{
+public:
+    explicit DeltaECompareStrategy(
+        double maxDeltaE = 1.0,
+        Percent maxFailedPixelsPercentage = Percent(0.1),
+        DeltaEFormula formula = DeltaEFormula::CIEDE2000);
+
+protected:
+    Result compareContents(const ImageView& left, const ImageView& right) const override;
+    std::unique_ptr<BandAccumulator> makeBandAccumulator(const Size& size) const override;
+
+private:
+    detail::ErrorSums measureErrors(const ImageView& left, const ImageView& right) const;
+    Result makeResult(const detail::ErrorSums& sums, const Size& size) const;
+
+    double m_maxDeltaE;
+    Percent m_maxFailedPixelsPercentage;
+    DeltaEFormula m_formula;
+};
+
+// Compares the perceptual distance of colors in YIQ, after blending them over white, like pixelmatch.
+// Pixels fail when the distance is above maxColorDelta, where 1 is the largest possible distance,
+// unless they are anti-aliasing: a pixel between a darker and a brighter neighbour in either image,
+// where the darker or the brighter neighbour lies in a flat area in both images. Anti-aliased pixels
+// are ignored and counted separately.
+class YiqCompareStrategy : public CompareStrategy
+{
+public:
+    explicit YiqCompareStrategy(double maxColorDelta = 0.1, Percent maxFailedPixelsPercentage = Percent(0.1));
+
+protected:
+    Result compareContents(const ImageView& left, const ImageView& right) const override;
+
+private:
+    double m_maxColorDelta;
+    Percent m_maxFailedPixelsPercentage;
 };
 
 }
@@ -0,0 +1,17 @@
+#ifndef IMAGEAPPROVALS_CONVERSION_HPP_INCLUDED
+#define IMAGEAPPROVALS_CONVERSION_HPP_INCLUDED
+
+#include "Image.hpp"
+
+namespace ImageApprovals {
+
+// Converts the image to the given pixel format and color space.
+Image convert(const ImageView& src, const PixelFormat& format, const ColorSpace& colorSpace);
+
+// Converts the image to the pixel format and color space of dst;
+// both images must have the same size.
+void convert(const ImageView& src, Image& dst);
+
+}
+
+#endif // IMAGEAPPROVALS_CONVERSION_HPP_INCLUDED
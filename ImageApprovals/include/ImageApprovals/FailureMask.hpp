@@ -0,0 +1,95 @@
+#ifndef IMAGEAPPROVALS_FAILUREMASK_HPP_INCLUDED
+#define IMAGEAPPROVALS_FAILUREMASK_HPP_INCLUDED
+
+#include "ImageView.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ImageApprovals {
+
+// The failed pixels of a comparison as horizontal runs in row-major order, with their
+// bounding box and the number of failed pixels in each square tile of the image
+class FailureMask
+{
+public:
+    struct Run
+    {
+        uint32_t y;
+        uint32_t x;
+        uint32_t length;
+    };
+
+    struct Rect
+    {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    struct Tile
+    {
+        // In tiles, not pixels
+        uint32_t column;
+        uint32_t row;
+        uint64_t numFailedPixels;
+    };
+
+    static const uint32_t defaultTileSize = 64;
+    static const size_t defaultMaxRuns = 1 << 20;
+
+    FailureMask() = default;
+
+    // Runs over maxRuns are dropped (see isComplete); counts, tiles and the bounding box stay exact
+    explicit FailureMask(const Size& imageSize, uint32_t tileSize = defaultTileSize, size_t maxRuns = defaultMaxRuns);
+
+    // Runs are added in row-major order; a run that continues the previous one is merged into it
+    void addRun(uint32_t y, uint32_t x, uint32_t length);
+
+    bool isEmpty() const { return m_numFailedPixels == 0; }
+    bool isComplete() const { return m_complete; }
+
+    Size getImageSize() const { return m_imageSize; }
+    uint32_t getTileSize() const { return m_tileSize; }
+    uint64_t getNumFailedPixels() const { return m_numFailedPixels; }
+
+    const std::vector<Run>& getRuns() const { return m_runs; }
+
+    // All zero when the mask is empty
+    Rect getBoundingBox() const;
+
+    // Tiles with failed pixels, in row-major order
+    std::vector<Tile> getTiles() const;
+
+    // False for pixels of dropped runs
+    bool contains(uint32_t x, uint32_t y) const;
+
+    // A compact text form, one run or tile per line
+    std::string serialize() const;
+    static FailureMask deserialize(const std::string& text);
+
+private:
+    // Tiles are indexed by row * columns + column
+    uint64_t getNumTileColumns() const;
+
+    Size m_imageSize;
+    uint32_t m_tileSize = defaultTileSize;
+    size_t m_maxRuns = defaultMaxRuns;
+    bool m_complete = true;
+
+    uint64_t m_numFailedPixels = 0;
+    std::vector<Run> m_runs;
+    std::map<uint64_t, uint64_t> m_tileCounts;
+
+    uint32_t m_minX = UINT32_MAX;
+    uint32_t m_maxX = 0;
+    uint32_t m_minY = UINT32_MAX;
+    uint32_t m_maxY = 0;
+};
+
+}
+
+#endif // IMAGEAPPROVALS_FAILUREMASK_HPP_INCLUDED
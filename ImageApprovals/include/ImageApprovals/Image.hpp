@@ -23,6 +23,7 @@ public:
     uint8_t* getPixelData() { return m_data.get(); }
     const uint8_t* getPixelData() const { return m_data.get(); }
 
+    using ImageView::getRowPointer;
     uint8_t* getRowPointer(uint32_t y);
 
     void flipVertically();
@@ -2,6 +2,9 @@
 #define IMAGEAPPROVALS_IMAGECODEC_HPP_INCLUDED
 
 #include "Image.hpp"
+#include "ImageReader.hpp"
+#include "ImageRowWriter.hpp"
+#include "LayeredImage.hpp"
 #include <string>
 #include <memory>
 #include <vector>
@@ -23,6 +26,23 @@ public:
     Image read(const std::string& fileName) const;
     void write(const std::string& fileName, const ImageView& image) const;
 
+    // Opens a file for reading in regions; see ImageReader
+    std::unique_ptr<ImageReader> openReader(const std::string& fileName) const;
+
+    // Opens a file for writing in batches of rows; see ImageRowWriter
+    std::unique_ptr<ImageRowWriter> openRowWriter(
+        const std::string& fileName, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const;
+
+    LayeredImage readLayers(const std::string& fileName) const;
+    void writeLayers(const std::string& fileName, const LayeredImage& image) const;
+
+    // Encode to and decode from memory without touching the file system;
+    // the second overload replaces the contents of data, reusing its capacity
+    std::vector<uint8_t> encode(const ImageView& image) const;
+    void encode(const ImageView& image, std::vector<uint8_t>& data) const;
+    Image decode(const uint8_t* data, size_t size) const;
+
+    // Registration is thread-safe; codec scores must not change once a codec is registered
     static Disposer registerCodec(const std::shared_ptr<ImageCodec>& codec);
     static void unregisterCodec(const std::shared_ptr<ImageCodec>& codec);
 
@@ -35,8 +55,21 @@ protected:
     virtual Image readFromStream(std::istream& stream, const std::string& fileName) const = 0;
     virtual void writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const = 0;
 
-private:
-    static std::vector<std::shared_ptr<ImageCodec>>& getImageCodecs();
+    // Codecs without layer support read a single unnamed layer and write only single-layer images
+    virtual LayeredImage readLayersFromStream(std::istream& stream, const std::string& fileName) const;
+    virtual void writeLayersToStream(const LayeredImage& image, std::ostream& stream, const std::string& fileName) const;
+
+    // The defaults wrap the memory in a string stream; codecs should override them with direct memory sources and sinks
+    virtual Image decodeFromMemory(const uint8_t* data, size_t size) const;
+    virtual void encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const;
+
+    // The default reader decodes the whole image with readFromStream when opened
+    virtual std::unique_ptr<ImageReader> openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const;
+
+    // The default writer collects all rows and writes them with writeToStream when finished
+    virtual std::unique_ptr<ImageRowWriter> openRowWriterForStream(
+        std::unique_ptr<std::ostream> stream, const std::string& fileName,
+        const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const;
 };
 
 class ImageCodec::Disposer
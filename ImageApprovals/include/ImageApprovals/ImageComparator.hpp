@@ -3,6 +3,9 @@
 
 #include "CompareStrategy.hpp"
 #include <ApprovalTests.hpp>
+#include <map>
+#include <memory>
+#include <string>
 
 namespace ImageApprovals {
 
@@ -26,6 +29,20 @@ public:
     ImageComparator();
     explicit ImageComparator(std::shared_ptr<CompareStrategy> comparator);
 
+    // Reads and compares the images in bands of at most about maxBytes of pixels, and stops
+    // reading at the first band that decides a failure; 0, the default, compares whole images
+    ImageComparator& setBandMemoryLimit(size_t maxBytes);
+
+    // When a comparison fails, writes <name>.diff.png next to <name>.received.<ext>, with the absolute
+    // channel differences multiplied by amplification; 0, the default, disables diff images.
+    // The diff is rendered in the comparison pass, by strategies that support it, and only allocated
+    // once a difference is found; it is not covered by the band memory limit (see DiffImageRenderer).
+    ImageComparator& setDiffImageAmplification(float amplification);
+
+    // Per-pixel thresholds and ignored regions for all compared images; when not set, they are read
+    // from <name>.mask.txt next to <name>.approved.<ext>, if it exists (see ToleranceMask::serialize)
+    ImageComparator& setToleranceMask(std::shared_ptr<const ToleranceMask> mask);
+
     bool contentsAreEquivalent(std::string receivedPath, std::string approvedPath) const override;
 
     template<typename ConcreteImageComparator, typename... Arguments>
@@ -48,6 +65,28 @@ public:
 
 private:
     std::shared_ptr<CompareStrategy> m_compareStrategy;
+    size_t m_bandMemoryLimit = 0;
+    float m_diffAmplification = 0.0f;
+    std::shared_ptr<const ToleranceMask> m_toleranceMask;
+};
+
+// Compares every layer of multi-layer files (see LayeredImage) and reports all failing layers at once.
+class LayeredImageComparator : public ApprovalTests::ApprovalComparator
+{
+public:
+    LayeredImageComparator();
+    explicit LayeredImageComparator(std::shared_ptr<CompareStrategy> defaultStrategy);
+
+    // Overrides the strategy for a single layer, e.g. a looser tolerance for a noisy AOV
+    LayeredImageComparator& setLayerStrategy(std::string layerName, std::shared_ptr<CompareStrategy> strategy);
+
+    bool contentsAreEquivalent(std::string receivedPath, std::string approvedPath) const override;
+
+private:
+    const CompareStrategy& getStrategy(const std::string& layerName) const;
+
+    std::shared_ptr<CompareStrategy> m_defaultStrategy;
+    std::map<std::string, std::shared_ptr<CompareStrategy>> m_layerStrategies;
 };
 
 }
@@ -0,0 +1,28 @@
+#ifndef IMAGEAPPROVALS_IMAGEREADER_HPP_INCLUDED
+#define IMAGEAPPROVALS_IMAGEREADER_HPP_INCLUDED
+
+#include "Image.hpp"
+
+namespace ImageApprovals {
+
+// An opened image file whose pixels are read region by region, so that
+// images larger than the available memory can still be processed.
+class ImageReader
+{
+public:
+    virtual ~ImageReader() = default;
+
+    virtual const PixelFormat& getPixelFormat() const = 0;
+    virtual const ColorSpace& getColorSpace() const = 0;
+    virtual Size getSize() const = 0;
+
+    // Reading whole blocks of this many rows is the most efficient, e.g. the tile height of tiled files
+    virtual uint32_t getRowsPerBlock() const { return 1; }
+
+    // Reads the given rectangle; the coordinates are relative to the top-left corner of the image
+    virtual Image readRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) = 0;
+};
+
+}
+
+#endif // IMAGEAPPROVALS_IMAGEREADER_HPP_INCLUDED
@@ -0,0 +1,46 @@
+#ifndef IMAGEAPPROVALS_IMAGEROWWRITER_HPP_INCLUDED
+#define IMAGEAPPROVALS_IMAGEROWWRITER_HPP_INCLUDED
+
+#include "ImageView.hpp"
+
+namespace ImageApprovals {
+
+// Writes an image file in batches of rows, from top to bottom, so that the
+// whole image never has to be in memory.
+class ImageRowWriter
+{
+public:
+    ImageRowWriter(const PixelFormat& format, const ColorSpace& colorSpace, const Size& size);
+    ImageRowWriter(const ImageRowWriter&) = delete;
+    virtual ~ImageRowWriter() = default;
+
+    ImageRowWriter& operator =(const ImageRowWriter&) = delete;
+
+    const PixelFormat& getPixelFormat() const { return *m_format; }
+    const ColorSpace& getColorSpace() const { return *m_colorSpace; }
+    Size getSize() const { return m_size; }
+
+    uint32_t getNumberOfWrittenRows() const { return m_numWrittenRows; }
+
+    // Appends rows below the ones written so far; they must have the pixel format,
+    // color space and width the writer was opened with
+    void writeRows(const ImageView& rows);
+
+    // Completes the file; all rows must have been written
+    void finish();
+
+protected:
+    virtual void appendRows(uint32_t firstRow, const ImageView& rows) = 0;
+    virtual void finishFile() = 0;
+
+private:
+    const PixelFormat* m_format;
+    const ColorSpace* m_colorSpace;
+    Size m_size;
+    uint32_t m_numWrittenRows = 0;
+    bool m_finished = false;
+};
+
+}
+
+#endif // IMAGEAPPROVALS_IMAGEROWWRITER_HPP_INCLUDED
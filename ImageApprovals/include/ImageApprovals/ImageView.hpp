@@ -4,6 +4,7 @@
 #include "ColorSpace.hpp"
 #include "PixelFormat.hpp"
 #include <cstdint>
+#include <cstddef>
 
 namespace ImageApprovals {
 
@@ -42,7 +43,7 @@ public:
     ImageView(const ImageView&) = default;
 
     ImageView(const PixelFormat& format, const ColorSpace& colorSpace,
-              const Size& size, size_t rowStride, const uint8_t* data);
+              const Size& size, std::ptrdiff_t rowStride, const uint8_t* data);
 
     ImageView& operator =(const ImageView&) = default;
 
@@ -54,17 +55,27 @@ public:
     const ColorSpace& getColorSpace() const;
 
     Size getSize() const { return m_size; }
-    size_t getRowStride() const { return m_rowStride; }
+    std::ptrdiff_t getRowStride() const { return m_rowStride; }
+
+    bool isBottomUp() const { return m_rowStride < 0; }
 
     const uint8_t* getRowPointer(uint32_t index) const;
 
+    // Returns a view of the same pixels with the order of rows reversed;
+    // no pixel data is copied.
+    ImageView flippedVertically() const;
+
+    // Returns a view of the rectangular region of this view; no pixel data
+    // is copied.
+    ImageView subView(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+
     RGBA getPixel(uint32_t x, uint32_t y) const;
 
 protected:
     const PixelFormat* m_format = nullptr;
     const ColorSpace* m_colorSpace = nullptr;
     Size m_size;
-    size_t m_rowStride = 0;
+    std::ptrdiff_t m_rowStride = 0;
     const uint8_t* m_dataPtr = nullptr;
 };
 
@@ -39,6 +39,36 @@ private:
     const ImageCodec& m_codec;
 };
 
+// Writes all layers to one file; the layers must outlive the writer
+class LayeredImageWriter : public ApprovalTests::ApprovalWriter
+{
+public:
+    explicit LayeredImageWriter(const LayeredImage& image, const std::string& extensionWithDot = ".exr")
+        : m_image(image), m_codec(ImageCodec::getBestCodec(extensionWithDot))
+    {}
+
+    LayeredImageWriter(const LayeredImageWriter&) = delete;
+
+    std::string getFileExtensionWithDot() const override
+    {
+        return m_codec.getFileExtensionWithDot();
+    }
+
+    void write(std::string path) const override
+    {
+        m_codec.writeLayers(path, m_image);
+    }
+
+    void cleanUpReceived(std::string receivedPath) const override
+    {
+        remove(receivedPath.c_str());
+    }
+
+private:
+    const LayeredImage& m_image;
+    const ImageCodec& m_codec;
+};
+
 }
 
 #endif // IMAGEAPPROVALS_IMAGEWRITER_HPP_INCLUDED
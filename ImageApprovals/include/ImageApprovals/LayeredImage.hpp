@@ -0,0 +1,52 @@
+#ifndef IMAGEAPPROVALS_LAYEREDIMAGE_HPP_INCLUDED
+#define IMAGEAPPROVALS_LAYEREDIMAGE_HPP_INCLUDED
+
+#include "Image.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ImageApprovals {
+
+// A set of named images stored in one file, e.g. the AOVs of a render.
+class LayeredImage
+{
+public:
+    struct Layer
+    {
+        std::string name;
+
+        // Names of the stored channels, in the order of the pixel format channels;
+        // empty if the codec should choose them
+        std::vector<std::string> channelNames;
+
+        ImageView image;
+    };
+
+    LayeredImage() = default;
+    LayeredImage(const LayeredImage&) = delete;
+    LayeredImage(LayeredImage&&) = default;
+
+    LayeredImage& operator =(const LayeredImage&) = delete;
+    LayeredImage& operator =(LayeredImage&&) = default;
+
+    // Adds a layer referring to pixels owned by the caller, which must outlive this object
+    void addLayer(std::string name, const ImageView& image, std::vector<std::string> channelNames = {});
+
+    // Adds a layer that owns its pixels
+    void addLayer(std::string name, Image&& image, std::vector<std::string> channelNames = {});
+
+    size_t getNumberOfLayers() const { return m_layers.size(); }
+    const Layer& getLayer(size_t index) const;
+
+    // Returns nullptr if there is no layer with the given name
+    const Layer* findLayer(const std::string& name) const;
+
+private:
+    std::vector<Layer> m_layers;
+    std::vector<std::unique_ptr<Image>> m_ownedImages;
+};
+
+}
+
+#endif // IMAGEAPPROVALS_LAYEREDIMAGE_HPP_INCLUDED
@@ -49,6 +49,7 @@ public:
     virtual size_t getNumberOfChannels() const = 0;
     virtual size_t getPixelStride() const = 0;
     virtual bool isU8() const = 0;
+    virtual bool isU16() const = 0;
     virtual bool isF32() const = 0;
 
     const uint8_t* decode(const uint8_t* begin, const uint8_t* end, RGBA& outRgba) const;
@@ -58,9 +59,28 @@ public:
 
     static const PixelFormat& getRgbU8();
     static const PixelFormat& getRgbAlphaU8();
+
+    static const PixelFormat& getBgrU8();
+    static const PixelFormat& getBgrAlphaU8();
+    static const PixelFormat& getAlphaRgbU8();
+
+    static const PixelFormat& getGrayAlphaU8Premultiplied();
+    static const PixelFormat& getRgbAlphaU8Premultiplied();
+    static const PixelFormat& getBgrAlphaU8Premultiplied();
+    static const PixelFormat& getAlphaRgbU8Premultiplied();
+
+    static const PixelFormat& getGrayU16();
+    static const PixelFormat& getGrayAlphaU16();
+    static const PixelFormat& getRgbU16();
+    static const PixelFormat& getRgbAlphaU16();
+    static const PixelFormat& getRgbAlphaU16Premultiplied();
     
+    static const PixelFormat& getGrayF32();
+    static const PixelFormat& getGrayAlphaF32();
+
     static const PixelFormat& getRgbF32();
     static const PixelFormat& getRgbAlphaF32();
+    static const PixelFormat& getRgbAlphaF32Premultiplied();
 
 protected:
     virtual void decode(const uint8_t* begin, RGBA& outRgba) const = 0;
@@ -0,0 +1,368 @@
+#ifndef IMAGEAPPROVALS_PIXELFORMATTRAITS_HPP_INCLUDED
+#define IMAGEAPPROVALS_PIXELFORMATTRAITS_HPP_INCLUDED
+
+#include "PixelFormat.hpp"
+#include "Errors.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <typeinfo>
+#include <utility>
+
+namespace ImageApprovals {
+
+template<typename ChannelType>
+struct ChannelTraits;
+
+template<>
+struct ChannelTraits<uint8_t>
+{
+    static float toFloat(uint8_t value)
+    {
+        return static_cast<float>(value) / 255.0f;
+    }
+
+    static uint8_t fromFloat(float value)
+    {
+        return static_cast<uint8_t>(std::min(1.0f, std::max(0.0f, value)) * 255.0f + 0.5f);
+    }
+};
+
+// 16-bit channels are stored in native byte order
+template<>
+struct ChannelTraits<uint16_t>
+{
+    static float toFloat(uint16_t value)
+    {
+        return static_cast<float>(value) / 65535.0f;
+    }
+
+    static uint16_t fromFloat(float value)
+    {
+        return static_cast<uint16_t>(std::min(1.0f, std::max(0.0f, value)) * 65535.0f + 0.5f);
+    }
+};
+
+template<>
+struct ChannelTraits<float>
+{
+    static float toFloat(float value) { return value; }
+    static float fromFloat(float value) { return value; }
+};
+
+inline RGBA premultiply(const RGBA& p)
+{
+    return RGBA(p.r * p.a, p.g * p.a, p.b * p.a, p.a);
+}
+
+// Colors of fully transparent pixels are undefined and decode as black
+inline RGBA unpremultiply(const RGBA& p)
+{
+    if (p.a <= 0.0f)
+    {
+        return RGBA(0.0f, 0.0f, 0.0f, p.a);
+    }
+
+    return RGBA(p.r / p.a, p.g / p.a, p.b / p.a, p.a);
+}
+
+// Compile-time description of a pixel layout. Channel indices give the position
+// of each component within a pixel; gray formats use the same index for red, green
+// and blue, and formats without alpha use -1 as alphaIndex. Premultiplied formats
+// store colors already multiplied by alpha.
+template<typename ChannelT, size_t NumChannels, int RedIndex, int GreenIndex, int BlueIndex, int AlphaIndex,
+         bool Premultiplied = false>
+struct PixelFormatTraits
+{
+    using ChannelType = ChannelT;
+    using Channels = std::array<ChannelT, NumChannels>;
+
+    static constexpr size_t numChannels = NumChannels;
+    static constexpr size_t pixelStride = NumChannels * sizeof(ChannelT);
+
+    static constexpr int redIndex = RedIndex;
+    static constexpr int greenIndex = GreenIndex;
+    static constexpr int blueIndex = BlueIndex;
+    static constexpr int alphaIndex = AlphaIndex;
+
+    static constexpr bool hasAlpha = (AlphaIndex >= 0);
+    static constexpr bool isGray = (RedIndex == GreenIndex) && (GreenIndex == BlueIndex);
+    static constexpr bool isPremultiplied = Premultiplied;
+
+    static Channels load(const uint8_t* src)
+    {
+        Channels channels;
+        std::memcpy(channels.data(), src, pixelStride);
+        return channels;
+    }
+
+    static void store(const Channels& channels, uint8_t* dst)
+    {
+        std::memcpy(dst, channels.data(), pixelStride);
+    }
+
+    // Returns the channels as stored, without unpremultiplying them
+    static RGBA decodeStored(const uint8_t* src)
+    {
+        using CT = ChannelTraits<ChannelT>;
+
+        const Channels c = load(src);
+
+        return RGBA(
+            CT::toFloat(c[RedIndex]),
+            CT::toFloat(c[GreenIndex]),
+            CT::toFloat(c[BlueIndex]),
+            hasAlpha ? CT::toFloat(c[hasAlpha ? AlphaIndex : 0]) : 1.0f);
+    }
+
+    static RGBA decode(const uint8_t* src)
+    {
+        return Premultiplied ? unpremultiply(decodeStored(src)) : decodeStored(src);
+    }
+};
+
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr size_t PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::numChannels;
+
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr size_t PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::pixelStride;
+
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr int PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::redIndex;
+
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr int PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::greenIndex;
+
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr int PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::blueIndex;
+
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr int PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::alphaIndex;
+
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr bool PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::hasAlpha;
+
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr bool PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::isGray;
+
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr bool PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::isPremultiplied;
+
+struct GrayU8Traits : PixelFormatTraits<uint8_t, 1, 0, 0, 0, -1>
+{
+    static const char* getName() { return "GrayU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayU8(); }
+};
+
+struct GrayAlphaU8Traits : PixelFormatTraits<uint8_t, 2, 0, 0, 0, 1>
+{
+    static const char* getName() { return "GrayAlphaU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayAlphaU8(); }
+};
+
+struct RgbU8Traits : PixelFormatTraits<uint8_t, 3, 0, 1, 2, -1>
+{
+    static const char* getName() { return "RgbU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbU8(); }
+};
+
+struct RgbAlphaU8Traits : PixelFormatTraits<uint8_t, 4, 0, 1, 2, 3>
+{
+    static const char* getName() { return "RgbAlphaU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaU8(); }
+};
+
+struct BgrU8Traits : PixelFormatTraits<uint8_t, 3, 2, 1, 0, -1>
+{
+    static const char* getName() { return "BgrU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getBgrU8(); }
+};
+
+struct BgrAlphaU8Traits : PixelFormatTraits<uint8_t, 4, 2, 1, 0, 3>
+{
+    static const char* getName() { return "BgrAlphaU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getBgrAlphaU8(); }
+};
+
+struct AlphaRgbU8Traits : PixelFormatTraits<uint8_t, 4, 1, 2, 3, 0>
+{
+    static const char* getName() { return "AlphaRgbU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getAlphaRgbU8(); }
+};
+
+struct GrayAlphaU8PremultipliedTraits : PixelFormatTraits<uint8_t, 2, 0, 0, 0, 1, true>
+{
+    static const char* getName() { return "GrayAlphaU8Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayAlphaU8Premultiplied(); }
+};
+
+struct RgbAlphaU8PremultipliedTraits : PixelFormatTraits<uint8_t, 4, 0, 1, 2, 3, true>
+{
+    static const char* getName() { return "RgbAlphaU8Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaU8Premultiplied(); }
+};
+
+struct BgrAlphaU8PremultipliedTraits : PixelFormatTraits<uint8_t, 4, 2, 1, 0, 3, true>
+{
+    static const char* getName() { return "BgrAlphaU8Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getBgrAlphaU8Premultiplied(); }
+};
+
+struct AlphaRgbU8PremultipliedTraits : PixelFormatTraits<uint8_t, 4, 1, 2, 3, 0, true>
+{
+    static const char* getName() { return "AlphaRgbU8Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getAlphaRgbU8Premultiplied(); }
+};
+
+struct GrayU16Traits : PixelFormatTraits<uint16_t, 1, 0, 0, 0, -1>
+{
+    static const char* getName() { return "GrayU16"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayU16(); }
+};
+
+struct GrayAlphaU16Traits : PixelFormatTraits<uint16_t, 2, 0, 0, 0, 1>
+{
+    static const char* getName() { return "GrayAlphaU16"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayAlphaU16(); }
+};
+
+struct RgbU16Traits : PixelFormatTraits<uint16_t, 3, 0, 1, 2, -1>
+{
+    static const char* getName() { return "RgbU16"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbU16(); }
+};
+
+struct RgbAlphaU16Traits : PixelFormatTraits<uint16_t, 4, 0, 1, 2, 3>
+{
+    static const char* getName() { return "RgbAlphaU16"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaU16(); }
+};
+
+struct RgbAlphaU16PremultipliedTraits : PixelFormatTraits<uint16_t, 4, 0, 1, 2, 3, true>
+{
+    static const char* getName() { return "RgbAlphaU16Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaU16Premultiplied(); }
+};
+
+struct GrayF32Traits : PixelFormatTraits<float, 1, 0, 0, 0, -1>
+{
+    static const char* getName() { return "GrayF32"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayF32(); }
+};
+
+struct GrayAlphaF32Traits : PixelFormatTraits<float, 2, 0, 0, 0, 1>
+{
+    static const char* getName() { return "GrayAlphaF32"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayAlphaF32(); }
+};
+
+struct RgbF32Traits : PixelFormatTraits<float, 3, 0, 1, 2, -1>
+{
+    static const char* getName() { return "RgbF32"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbF32(); }
+};
+
+struct RgbAlphaF32Traits : PixelFormatTraits<float, 4, 0, 1, 2, 3>
+{
+    static const char* getName() { return "RgbAlphaF32"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaF32(); }
+};
+
+struct RgbAlphaF32PremultipliedTraits : PixelFormatTraits<float, 4, 0, 1, 2, 3, true>
+{
+    static const char* getName() { return "RgbAlphaF32Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaF32Premultiplied(); }
+};
+
+// Calls fn with a default-constructed traits object matching the given format,
+// so that a kernel templated on the traits type is selected once per image.
+template<typename Fn>
+auto dispatchPixelFormat(const PixelFormat& format, Fn&& fn) -> decltype(fn(GrayU8Traits()))
+{
+    if (format == PixelFormat::getGrayU8()) { return fn(GrayU8Traits()); }
+    if (format == PixelFormat::getGrayAlphaU8()) { return fn(GrayAlphaU8Traits()); }
+    if (format == PixelFormat::getRgbU8()) { return fn(RgbU8Traits()); }
+    if (format == PixelFormat::getRgbAlphaU8()) { return fn(RgbAlphaU8Traits()); }
+    if (format == PixelFormat::getBgrU8()) { return fn(BgrU8Traits()); }
+    if (format == PixelFormat::getBgrAlphaU8()) { return fn(BgrAlphaU8Traits()); }
+    if (format == PixelFormat::getAlphaRgbU8()) { return fn(AlphaRgbU8Traits()); }
+    if (format == PixelFormat::getGrayAlphaU8Premultiplied()) { return fn(GrayAlphaU8PremultipliedTraits()); }
+    if (format == PixelFormat::getRgbAlphaU8Premultiplied()) { return fn(RgbAlphaU8PremultipliedTraits()); }
+    if (format == PixelFormat::getBgrAlphaU8Premultiplied()) { return fn(BgrAlphaU8PremultipliedTraits()); }
+    if (format == PixelFormat::getAlphaRgbU8Premultiplied()) { return fn(AlphaRgbU8PremultipliedTraits()); }
+    if (format == PixelFormat::getGrayU16()) { return fn(GrayU16Traits()); }
+    if (format == PixelFormat::getGrayAlphaU16()) { return fn(GrayAlphaU16Traits()); }
+    if (format == PixelFormat::getRgbU16()) { return fn(RgbU16Traits()); }
+    if (format == PixelFormat::getRgbAlphaU16()) { return fn(RgbAlphaU16Traits()); }
+    if (format == PixelFormat::getRgbAlphaU16Premultiplied()) { return fn(RgbAlphaU16PremultipliedTraits()); }
+    if (format == PixelFormat::getGrayF32()) { return fn(GrayF32Traits()); }
+    if (format == PixelFormat::getGrayAlphaF32()) { return fn(GrayAlphaF32Traits()); }
+    if (format == PixelFormat::getRgbF32()) { return fn(RgbF32Traits()); }
+    if (format == PixelFormat::getRgbAlphaF32()) { return fn(RgbAlphaF32Traits()); }
+    if (format == PixelFormat::getRgbAlphaF32Premultiplied()) { return fn(RgbAlphaF32PremultipliedTraits()); }
+
+    throw ImageApprovalsError(std::string("Unsupported pixel format ") + format.getName());
+}
+
+// Runtime counterpart of PixelFormatTraits, used to relate two formats
+// whose channels are the same but stored in a different order or with
+// different alpha premultiplication.
+struct PixelLayout
+{
+    const std::type_info* channelType = nullptr;
+    size_t numChannels = 0;
+
+    int redIndex = -1;
+    int greenIndex = -1;
+    int blueIndex = -1;
+    int alphaIndex = -1;
+
+    bool premultiplied = false;
+
+    bool hasAlpha() const { return alphaIndex >= 0; }
+    bool isGray() const { return (redIndex == greenIndex) && (greenIndex == blueIndex); }
+
+    bool hasSameChannels(const PixelLayout& other) const
+    {
+        return (*channelType == *other.channelType)
+            && (numChannels == other.numChannels)
+            && (hasAlpha() == other.hasAlpha())
+            && (isGray() == other.isGray());
+    }
+
+    template<typename Traits>
+    static PixelLayout fromTraits()
+    {
+        PixelLayout layout;
+        layout.channelType = &typeid(typename Traits::ChannelType);
+        layout.numChannels = Traits::numChannels;
+        layout.redIndex = Traits::redIndex;
+        layout.greenIndex = Traits::greenIndex;
+        layout.blueIndex = Traits::blueIndex;
+        layout.alphaIndex = Traits::alphaIndex;
+        layout.premultiplied = Traits::isPremultiplied;
+        return layout;
+    }
+};
+
+namespace detail {
+
+struct GetPixelLayout
+{
+    template<typename Traits>
+    PixelLayout operator()(Traits) const
+    {
+        return PixelLayout::fromTraits<Traits>();
+    }
+};
+
+}
+
+inline PixelLayout getPixelLayout(const PixelFormat& format)
+{
+    return dispatchPixelFormat(format, detail::GetPixelLayout());
+}
+
+}
+
+#endif // IMAGEAPPROVALS_PIXELFORMATTRAITS_HPP_INCLUDED
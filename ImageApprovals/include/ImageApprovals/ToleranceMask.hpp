@@ -0,0 +1,58 @@
+#ifndef IMAGEAPPROVALS_TOLERANCEMASK_HPP_INCLUDED
+#define IMAGEAPPROVALS_TOLERANCEMASK_HPP_INCLUDED
+
+#include "ImageView.hpp"
+#include "Units.hpp"
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace ImageApprovals {
+
+// Per-pixel overrides of the pixel fail threshold of a strategy, as run-length encoded spans
+// of each row; pixels outside of all spans use the threshold of the strategy
+class ToleranceMask
+{
+public:
+    struct Span
+    {
+        uint32_t x;
+        uint32_t length;
+
+        // Infinite for pixels that are not compared at all
+        float threshold;
+
+        bool isIgnored() const { return threshold == std::numeric_limits<float>::infinity(); }
+    };
+
+    ToleranceMask() = default;
+    explicit ToleranceMask(const Size& size);
+
+    // Regions are clipped to the image; where they overlap, the region set last applies
+    ToleranceMask& ignoreRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    ToleranceMask& setRegionThreshold(uint32_t x, uint32_t y, uint32_t width, uint32_t height, AbsThreshold threshold);
+
+    Size getSize() const { return m_size; }
+
+    // Sorted and not overlapping
+    const std::vector<Span>& getRowSpans(uint32_t y) const { return m_rows[y]; }
+
+    uint64_t getNumIgnoredPixels() const;
+
+    // One region per line, "ignore x y width height" or "threshold x y width height value",
+    // applied in order after a "tolerance-mask width height" header; equal rows are merged.
+    // Reading rejects, naming the line, malformed lines, sizes over 2^18 and regions outside of the mask
+    std::string serialize() const;
+    static ToleranceMask deserialize(const std::string& text);
+
+private:
+    void setRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height, float threshold);
+
+    Size m_size;
+    std::vector<std::vector<Span>> m_rows;
+};
+
+}
+
+#endif // IMAGEAPPROVALS_TOLERANCEMASK_HPP_INCLUDED
@@ -34,9 +34,11 @@ struct Unit
 }
 
 using AbsThreshold = detail::Unit<double, struct AbsThresholdTag>;
+using RelThreshold = detail::Unit<double, struct RelThresholdTag>;
 using Percent = detail::Unit<double, struct PercentTag>;
 
 std::ostream& operator <<(std::ostream& stream, const AbsThreshold& threshold);
+std::ostream& operator <<(std::ostream& stream, const RelThreshold& threshold);
 std::ostream& operator <<(std::ostream& stream, const Percent& percent);
 
 }
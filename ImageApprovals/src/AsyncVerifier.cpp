@@ -0,0 +1,122 @@
+#include <ImageApprovals/AsyncVerifier.hpp>
+#include <ImageApprovals/Errors.hpp>
+#include "VerifyUtils.hpp"
+
+namespace ImageApprovals {
+
+AsyncVerifier::AsyncVerifier(std::shared_ptr<CompareStrategy> strategy, size_t numThreads, size_t maxQueuedImages)
+    : m_comparator(std::move(strategy)), m_maxQueuedImages(maxQueuedImages)
+{
+    if (numThreads == 0 || maxQueuedImages == 0)
+    {
+        throw ImageApprovalsError("AsyncVerifier needs at least one thread and one queued image");
+    }
+
+    m_threads.reserve(numThreads);
+
+    try
+    {
+        for (size_t i = 0; i < numThreads; ++i)
+        {
+            m_threads.emplace_back([this]() { runWorker(); });
+        }
+    }
+    catch (...)
+    {
+        stopWorkers();
+        throw;
+    }
+}
+
+AsyncVerifier::~AsyncVerifier()
+{
+    stopWorkers();
+}
+
+void AsyncVerifier::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_stateChanged.notify_all();
+
+    // Workers drain the queue before they exit
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+std::future<void> AsyncVerifier::verify(const ImageView& image, std::string pathWithoutExtension)
+{
+    return verify(std::make_shared<const Image>(image.copy()), std::move(pathWithoutExtension));
+}
+
+std::future<void> AsyncVerifier::verify(std::shared_ptr<const Image> image, std::string pathWithoutExtension)
+{
+    if (!image || image->isEmpty())
+    {
+        throw ImageApprovalsError("Cannot verify an empty image");
+    }
+
+    const ImageCodec& codec = ImageCodec::getBestCodec(*image);
+    const auto paths = detail::getApprovalPaths(codec, pathWithoutExtension);
+
+    const ImageComparator& comparator = m_comparator;
+
+    std::packaged_task<void()> task([&codec, &comparator, image, paths]() {
+        detail::verifyFiles(&codec, *image, paths.receivedPath, paths.approvedPath, comparator);
+    });
+
+    std::future<void> result = task.get_future();
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stateChanged.wait(lock, [this]() { return m_queue.size() < m_maxQueuedImages; });
+
+        m_queue.push_back(std::move(task));
+    }
+
+    m_stateChanged.notify_all();
+
+    return result;
+}
+
+void AsyncVerifier::join()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stateChanged.wait(lock, [this]() { return m_queue.empty() && (m_numRunning == 0); });
+}
+
+void AsyncVerifier::runWorker()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        m_stateChanged.wait(lock, [this]() { return !m_queue.empty() || m_stopping; });
+
+        if (m_queue.empty())
+        {
+            return;
+        }
+
+        std::packaged_task<void()> task = std::move(m_queue.front());
+        m_queue.pop_front();
+        ++m_numRunning;
+
+        lock.unlock();
+        m_stateChanged.notify_all();
+
+        // Failures are stored in the task's future
+        task();
+
+        lock.lock();
+        --m_numRunning;
+        m_stateChanged.notify_all();
+    }
+}
+
+}
@@ -0,0 +1,121 @@
+#include <ImageApprovals/BatchVerifier.hpp>
+#include <ImageApprovals/ImageComparator.hpp>
+#include <ImageApprovals/Errors.hpp>
+#include "Parallel.hpp"
+#include "VerifyUtils.hpp"
+#include <ApprovalTests.hpp>
+#include <algorithm>
+#include <thread>
+
+namespace ImageApprovals {
+
+BatchVerifier::BatchVerifier(std::shared_ptr<CompareStrategy> strategy)
+    : m_strategy(std::move(strategy))
+    , m_maxImagesInFlight(std::max<size_t>(std::thread::hardware_concurrency(), 1))
+{
+    if (!m_strategy)
+    {
+        throw ImageApprovalsError("Compare strategy must not be null");
+    }
+}
+
+BatchVerifier& BatchVerifier::setMaxImagesInFlight(size_t maxImages)
+{
+    if (maxImages == 0)
+    {
+        throw ImageApprovalsError("At least one image must be allowed in flight");
+    }
+
+    m_maxImagesInFlight = maxImages;
+    return *this;
+}
+
+BatchVerifier& BatchVerifier::setBandMemoryLimit(size_t maxBytes)
+{
+    m_bandMemoryLimit = maxBytes;
+    return *this;
+}
+
+BatchVerifier& BatchVerifier::add(const ImageView& image, std::string pathWithoutExtension)
+{
+    if (image.isEmpty())
+    {
+        throw ImageApprovalsError("Cannot verify an empty image");
+    }
+
+    const ImageCodec& codec = ImageCodec::getBestCodec(image);
+
+    auto paths = detail::getApprovalPaths(codec, pathWithoutExtension);
+
+    m_entries.push_back(Entry{ &codec, image, std::move(paths.receivedPath), std::move(paths.approvedPath) });
+    return *this;
+}
+
+BatchVerifier& BatchVerifier::addFiles(std::string receivedPath, std::string approvedPath)
+{
+    m_entries.push_back(Entry{ nullptr, ImageView(), std::move(receivedPath), std::move(approvedPath) });
+    return *this;
+}
+
+std::vector<BatchVerifier::Failure> BatchVerifier::run() const
+{
+    std::vector<Failure> results(m_entries.size());
+    std::vector<char> failed(m_entries.size(), 0);
+
+    // Each worker holds at most one entry in memory, and failures keep their slots
+    detail::parallelForEach(m_entries.size(), m_maxImagesInFlight,
+        [&](size_t index) { failed[index] = !runEntry(m_entries[index], results[index]); });
+
+    std::vector<Failure> failures;
+
+    for (size_t index = 0; index < results.size(); ++index)
+    {
+        if (failed[index])
+        {
+            failures.push_back(std::move(results[index]));
+        }
+    }
+
+    return failures;
+}
+
+void BatchVerifier::verify() const
+{
+    const auto failures = run();
+    if (failures.empty())
+    {
+        return;
+    }
+
+    std::string msg = std::to_string(failures.size()) + " of " + std::to_string(m_entries.size()) + " images failed verification";
+
+    for (const auto& failure : failures)
+    {
+        msg += "\n\"" + failure.receivedPath + "\": " + failure.message;
+    }
+
+    throw ApprovalTests::ApprovalException(msg);
+}
+
+bool BatchVerifier::runEntry(const Entry& entry, Failure& failure) const
+{
+    failure.receivedPath = entry.receivedPath;
+    failure.approvedPath = entry.approvedPath;
+
+    try
+    {
+        ImageComparator comparator(m_strategy);
+        comparator.setBandMemoryLimit(m_bandMemoryLimit);
+
+        detail::verifyFiles(entry.codec, entry.image, entry.receivedPath, entry.approvedPath, comparator);
+    }
+    catch (const std::exception& exc)
+    {
+        failure.message = exc.what();
+        return false;
+    }
+
+    return true;
+}
+
+}
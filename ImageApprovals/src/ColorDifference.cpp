@@ -0,0 +1,107 @@
+#include "ColorDifference.hpp"
+#include <cmath>
+
+namespace ImageApprovals { namespace detail {
+
+namespace {
+
+const double pi = 3.14159265358979323846;
+
+double toRadians(double degrees)
+{
+    return degrees * (pi / 180.0);
+}
+
+// Hue angle in degrees, in [0, 360)
+double hueAngle(double b, double a)
+{
+    if (a == 0.0 && b == 0.0)
+    {
+        return 0.0;
+    }
+
+    const double h = std::atan2(b, a) * (180.0 / pi);
+    return (h < 0.0) ? h + 360.0 : h;
+}
+
+}
+
+// Following G. Sharma, W. Wu and E. N. Dalal, "The CIEDE2000 color-difference formula:
+// implementation notes, supplementary test data, and mathematical observations", 2005
+double deltaE2000(const Lab& left, const Lab& right)
+{
+    const double l1 = left.l, a1 = left.a, b1 = left.b;
+    const double l2 = right.l, a2 = right.a, b2 = right.b;
+
+    const double meanC = (std::sqrt(a1 * a1 + b1 * b1) + std::sqrt(a2 * a2 + b2 * b2)) / 2.0;
+    const double meanC7 = std::pow(meanC, 7.0);
+    const double g = 0.5 * (1.0 - std::sqrt(meanC7 / (meanC7 + std::pow(25.0, 7.0))));
+
+    const double a1p = (1.0 + g) * a1;
+    const double a2p = (1.0 + g) * a2;
+
+    const double c1p = std::sqrt(a1p * a1p + b1 * b1);
+    const double c2p = std::sqrt(a2p * a2p + b2 * b2);
+
+    const double h1p = hueAngle(b1, a1p);
+    const double h2p = hueAngle(b2, a2p);
+
+    const double dLp = l2 - l1;
+    const double dCp = c2p - c1p;
+
+    double dhp = 0.0;
+    if (c1p * c2p != 0.0)
+    {
+        dhp = h2p - h1p;
+        if (dhp > 180.0)
+        {
+            dhp -= 360.0;
+        }
+        else if (dhp < -180.0)
+        {
+            dhp += 360.0;
+        }
+    }
+
+    const double dHp = 2.0 * std::sqrt(c1p * c2p) * std::sin(toRadians(dhp / 2.0));
+
+    const double meanLp = (l1 + l2) / 2.0;
+    const double meanCp = (c1p + c2p) / 2.0;
+
+    double meanHp = h1p + h2p;
+    if (c1p * c2p != 0.0)
+    {
+        if (std::abs(h1p - h2p) <= 180.0)
+        {
+            meanHp /= 2.0;
+        }
+        else
+        {
+            meanHp = (meanHp < 360.0) ? (meanHp + 360.0) / 2.0 : (meanHp - 360.0) / 2.0;
+        }
+    }
+
+    const double t = 1.0
+        - 0.17 * std::cos(toRadians(meanHp - 30.0))
+        + 0.24 * std::cos(toRadians(2.0 * meanHp))
+        + 0.32 * std::cos(toRadians(3.0 * meanHp + 6.0))
+        - 0.20 * std::cos(toRadians(4.0 * meanHp - 63.0));
+
+    const double dTheta = 30.0 * std::exp(-std::pow((meanHp - 275.0) / 25.0, 2.0));
+    const double meanCp7 = std::pow(meanCp, 7.0);
+    const double rc = 2.0 * std::sqrt(meanCp7 / (meanCp7 + std::pow(25.0, 7.0)));
+
+    const double meanLp50 = (meanLp - 50.0) * (meanLp - 50.0);
+    const double sl = 1.0 + 0.015 * meanLp50 / std::sqrt(20.0 + meanLp50);
+    const double sc = 1.0 + 0.045 * meanCp;
+    const double sh = 1.0 + 0.015 * meanCp * t;
+    const double rt = -std::sin(toRadians(2.0 * dTheta)) * rc;
+
+    const double lTerm = dLp / sl;
+    const double cTerm = dCp / sc;
+    const double hTerm = dHp / sh;
+
+    return std::sqrt(lTerm * lTerm + cTerm * cTerm + hTerm * hTerm + rt * cTerm * hTerm);
+}
+
+} }
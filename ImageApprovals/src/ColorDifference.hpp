@@ -0,0 +1,83 @@
+#ifndef IMAGEAPPROVALS_COLORDIFFERENCE_HPP_INCLUDED
+#define IMAGEAPPROVALS_COLORDIFFERENCE_HPP_INCLUDED
+
+#include <ImageApprovals/PixelFormat.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace ImageApprovals { namespace detail {
+
+// CIE L*a*b* with the D65 white point
+struct Lab
+{
+    float l = 0.0f;
+    float a = 0.0f;
+    float b = 0.0f;
+
+    Lab() = default;
+
+    Lab(float l, float a, float b)
+        : l(l), a(a), b(b)
+    {}
+};
+
+// Cube root of positive values: a first guess from the float bits, refined by Newton steps
+// to about float precision; branch-free, so that loops over it can be vectorized
+inline float fastCbrt(float x)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    bits = bits / 3 + 709921077u;
+
+    float y;
+    std::memcpy(&y, &bits, sizeof(y));
+
+    y = (2.0f * y + x / (y * y)) * (1.0f / 3.0f);
+    y = (2.0f * y + x / (y * y)) * (1.0f / 3.0f);
+    y = (2.0f * y + x / (y * y)) * (1.0f / 3.0f);
+
+    return y;
+}
+
+inline float labCompand(float t)
+{
+    const float epsilon = 216.0f / 24389.0f;
+    const float kappa = 24389.0f / 27.0f;
+
+    return (t > epsilon) ? fastCbrt(t) : (kappa * t + 16.0f) / 116.0f;
+}
+
+// From linear sRGB; alpha is ignored
+inline Lab linearSRgbToLab(const RGBA& p)
+{
+    const float x = (0.4124564f * p.r + 0.3575761f * p.g + 0.1804375f * p.b) * (1.0f / 0.95047f);
+    const float y = 0.2126729f * p.r + 0.7151522f * p.g + 0.0721750f * p.b;
+    const float z = (0.0193339f * p.r + 0.1191920f * p.g + 0.9503041f * p.b) * (1.0f / 1.08883f);
+
+    const float fx = labCompand(x);
+    const float fy = labCompand(y);
+    const float fz = labCompand(z);
+
+    return Lab(116.0f * fy - 16.0f, 500.0f * (fx - fy), 200.0f * (fy - fz));
+}
+
+inline float deltaE76(const Lab& left, const Lab& right)
+{
+    const float dl = left.l - right.l;
+    const float da = left.a - right.a;
+    const float db = left.b - right.b;
+
+    return std::sqrt(dl * dl + da * da + db * db);
+}
+
+double deltaE2000(const Lab& left, const Lab& right);
+
+// deltaE2000 <= deltaE2000Bound * deltaE76 for any pair of colors: the weights S_L, S_C and S_H
+// are at least 1, the rotation term adds at most the chroma and hue terms once more, and a' is at
+// most 1.5 a, so deltaE2000^2 <= dL^2 + 2 * 1.5^2 * (da^2 + db^2); rounded up for float errors
+const float deltaE2000Bound = 2.125f;
+
+} }
+
+#endif // IMAGEAPPROVALS_COLORDIFFERENCE_HPP_INCLUDED
@@ -36,6 +36,10 @@ bool isSRgbIccProfile(uint32_t profLen, const uint8_t* profData);
 
 const ColorSpace* detectColorSpace(const RgbPrimaries& primaries, double gamma);
 
+float sRgbToLinear(float value);
+
+float linearToSRgb(float value);
+
 } }
 
 #endif // IMAGEAPPROVALS_COLORSPACEUTILS_HPP_INCLUDED
\ No newline at end of file
@@ -1,9 +1,22 @@
 #include <ImageApprovals/CompareStrategy.hpp>
+#include <ImageApprovals/Errors.hpp>
+#include <ImageApprovals/ImageReader.hpp>
 #include <ImageApprovals/ImageView.hpp>
+#include <ImageApprovals/PixelFormatTraits.hpp>
+#include "ColorDifference.hpp"
+#include "ColorSpaceUtils.hpp"
+#include "ConversionUtils.hpp"
+#include "Parallel.hpp"
 #include <cstring>
 #define NOMINMAX
 #include <ApprovalTests.hpp>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <vector>
 
 namespace ImageApprovals {
 
@@ -20,12 +33,51 @@ CompareStrategy::Result CompareStrategy::Result::makeFailed(std::string leftInfo
 {
     Result res;
     res.passed = false;
-    res.leftImageInfo = std::move(leftInfo);
-    res.rightImageInfo = std::move(rightInfo);
+    res.m_leftInfo = std::move(leftInfo);
+    res.m_rightInfo = std::move(rightInfo);
     return res;
 }
 
-CompareStrategy::Result CompareStrategy::compare(const ImageView& left, const ImageView& right) const
+CompareStrategy::Result CompareStrategy::Result::makeFailedLazy(
+    std::function<std::string()> formatLeftInfo, std::function<std::string()> formatRightInfo)
+{
+    Result res;
+    res.passed = false;
+    res.m_formatLeftInfo = std::move(formatLeftInfo);
+    res.m_formatRightInfo = std::move(formatRightInfo);
+    return res;
+}
+
+std::string CompareStrategy::Result::getLeftImageInfo() const
+{
+    return m_formatLeftInfo ? m_formatLeftInfo() : m_leftInfo;
+}
+
+std::string CompareStrategy::Result::getRightImageInfo() const
+{
+    return m_formatRightInfo ? m_formatRightInfo() : m_rightInfo;
+}
+
+DiffImageRenderer::DiffImageRenderer(const Size& size, float amplification)
+    : m_size(size)
+    , m_scale(amplification * 255.0f)
+{}
+
+void DiffImageRenderer::allocate()
+{
+    m_image = Image(PixelFormat::getRgbU8(), ColorSpace::getSRgb(), m_size, 1);
+    m_rendered = true;
+}
+
+CompareStrategy::Result CompareStrategy::compare(const ImageView& left, const ImageView& right, DiffImageRenderer* diff) const
+{
+    CompareOptions options;
+    options.diff = diff;
+
+    return compare(left, right, options);
+}
+
+CompareStrategy::Result CompareStrategy::compare(const ImageView& left, const ImageView& right, const CompareOptions& options) const
 {
     Result result;
 
@@ -34,12 +86,283 @@ CompareStrategy::Result CompareStrategy::compare(const ImageView& left, const Im
         return result;
     }
 
-    if (!(result = compareContents(left, right)).passed)
+    const CompareOptions used = getUsedOptions(options, left.getSize());
+    if (used.diff || used.toleranceMask)
+    {
+        return compareContentsWithOptions(left, right, used);
+    }
+
+    return compareContents(left, right);
+}
+
+CompareOptions CompareStrategy::getUsedOptions(const CompareOptions& options, const Size& size) const
+{
+    CompareOptions used;
+
+    if (options.diff && rendersDiffImages())
+    {
+        if (options.diff->getSize() != size)
+        {
+            throw ImageApprovalsError("Size of the diff image does not match the size of the compared images");
+        }
+
+        used.diff = options.diff;
+    }
+
+    if (options.toleranceMask)
+    {
+        if (!supportsToleranceMasks())
+        {
+            throw ImageApprovalsError("The compare strategy does not support tolerance masks");
+        }
+
+        if (options.toleranceMask->getSize() != size)
+        {
+            throw ImageApprovalsError("Size of the tolerance mask does not match the size of the compared images");
+        }
+
+        used.toleranceMask = options.toleranceMask;
+    }
+
+    return used;
+}
+
+namespace detail {
+
+// Full-width bands of both images fit in maxBandBytes, and are aligned to the blocks of the files if possible
+uint32_t getBandHeight(const ImageReader& left, const ImageReader& right, size_t maxBandBytes)
+{
+    const auto sz = left.getSize();
+
+    const uint64_t rowBytes
+        = uint64_t(left.getPixelFormat().getPixelStride() + right.getPixelFormat().getPixelStride()) * sz.width;
+
+    uint64_t numRows = std::max<uint64_t>(maxBandBytes / std::max<uint64_t>(rowBytes, 1), 1);
+
+    const uint64_t rowsPerBlock = std::max(left.getRowsPerBlock(), right.getRowsPerBlock());
+    if (numRows >= rowsPerBlock)
+    {
+        numRows -= numRows % rowsPerBlock;
+    }
+
+    return static_cast<uint32_t>(std::min<uint64_t>(numRows, sz.height));
+}
+
+// Sums of the pixel errors of the rows measured so far
+struct ErrorSums
+{
+    uint64_t numPixels = 0;
+    uint64_t numFailed = 0;
+    size_t numChannels = 3;
+    double sumErrors = 0.0;
+    double sumSquaredErrors = 0.0;
+    float maxError = 0.0f;
+    uint32_t worstX = 0;
+    uint32_t worstY = 0;
+    RGBA channelMaxErrors;
+
+    // Adds the sums of a band of rows starting at firstRow; bands measured in parallel may be added in any order
+    void addBand(const ErrorSums& band, uint32_t firstRow)
+    {
+        numPixels += band.numPixels;
+        numFailed += band.numFailed;
+        numChannels = band.numChannels;
+        sumErrors += band.sumErrors;
+        sumSquaredErrors += band.sumSquaredErrors;
+
+        const uint32_t bandWorstY = firstRow + band.worstY;
+
+        if (band.maxError > maxError
+            || (band.maxError == maxError && (bandWorstY < worstY || (bandWorstY == worstY && band.worstX < worstX))))
+        {
+            maxError = band.maxError;
+            worstX = band.worstX;
+            worstY = bandWorstY;
+        }
+
+        channelMaxErrors.r = std::max(channelMaxErrors.r, band.channelMaxErrors.r);
+        channelMaxErrors.g = std::max(channelMaxErrors.g, band.channelMaxErrors.g);
+        channelMaxErrors.b = std::max(channelMaxErrors.b, band.channelMaxErrors.b);
+        channelMaxErrors.a = std::max(channelMaxErrors.a, band.channelMaxErrors.a);
+    }
+
+    CompareStatistics getStatistics() const
+    {
+        CompareStatistics stats;
+        stats.numComparedPixels = numPixels;
+        stats.numFailedPixels = numFailed;
+        stats.maxError = maxError;
+        stats.worstPixelX = worstX;
+        stats.worstPixelY = worstY;
+        stats.channelMaxErrors = channelMaxErrors;
+
+        const double numValues = static_cast<double>(numPixels) * static_cast<double>(numChannels);
+        if (numValues > 0.0)
+        {
+            stats.meanError = sumErrors / numValues;
+            stats.rmsError = std::sqrt(sumSquaredErrors / numValues);
+        }
+
+        if (stats.rmsError > 0.0)
+        {
+            stats.psnr = -20.0 * std::log10(stats.rmsError);
+        }
+
+        return stats;
+    }
+
+    // Adds row y of single-channel errors, such as depth differences; the row maximum is searched for only when it is a new maximum
+    void addRow(const float* errors, uint32_t width, uint32_t y)
+    {
+        float rowMax = 0.0f;
+        double rowErrors = 0.0;
+        double rowSquaredErrors = 0.0;
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            rowMax = std::max(rowMax, errors[x]);
+            rowErrors += errors[x];
+            rowSquaredErrors += double(errors[x]) * errors[x];
+        }
+
+        numPixels += width;
+        sumErrors += rowErrors;
+        sumSquaredErrors += rowSquaredErrors;
+
+        if (rowMax > maxError)
+        {
+            maxError = rowMax;
+            worstX = static_cast<uint32_t>(std::find(errors, errors + width, rowMax) - errors);
+            worstY = y;
+        }
+    }
+};
+
+// Sums errors over bands; quickReject, if set, may decide a failure from the first band alone before it is measured
+class ErrorSumsAccumulator : public CompareStrategy::BandAccumulator
+{
+public:
+    ErrorSumsAccumulator(
+        std::function<ErrorSums(uint32_t, const ImageView&, const ImageView&)> measure,
+        std::function<CompareStrategy::Result(const ErrorSums&)> makeResult,
+        std::function<bool(const ImageView&, const ImageView&, CompareStrategy::Result&)> quickReject = nullptr)
+        : m_measure(std::move(measure)), m_makeResult(std::move(makeResult)), m_quickReject(std::move(quickReject))
+    {}
+
+    void addBand(uint32_t firstRow, const ImageView& left, const ImageView& right) override
+    {
+        if (m_failed)
+        {
+            return;
+        }
+
+        if (firstRow == 0 && m_quickReject && m_quickReject(left, right, m_rejected))
+        {
+            m_failed = true;
+            m_quickRejected = true;
+            return;
+        }
+
+        const ErrorSums band = m_measure(firstRow, left, right);
+        m_sums.addBand(band, firstRow);
+
+        // Results are formatted lazily, so checking the verdict is cheap
+        if (band.numFailed != 0)
+        {
+            m_failed = !m_makeResult(m_sums).passed;
+        }
+    }
+
+    bool isDecided() const override
+    {
+        return m_failed;
+    }
+
+    CompareStrategy::Result getResult() const override
+    {
+        return m_quickRejected ? m_rejected : m_makeResult(m_sums);
+    }
+
+private:
+    std::function<ErrorSums(uint32_t, const ImageView&, const ImageView&)> m_measure;
+    std::function<CompareStrategy::Result(const ErrorSums&)> m_makeResult;
+    std::function<bool(const ImageView&, const ImageView&, CompareStrategy::Result&)> m_quickReject;
+    ErrorSums m_sums;
+    CompareStrategy::Result m_rejected;
+    bool m_failed = false;
+    bool m_quickRejected = false;
+};
+
+}
+
+CompareStrategy::Result CompareStrategy::compare(ImageReader& left, ImageReader& right, size_t maxBandBytes, DiffImageRenderer* diff) const
+{
+    CompareOptions options;
+    options.diff = diff;
+
+    return compare(left, right, maxBandBytes, options);
+}
+
+CompareStrategy::Result CompareStrategy::compare(ImageReader& left, ImageReader& right, size_t maxBandBytes, const CompareOptions& options) const
+{
+    const auto sz = left.getSize();
+
+    // Views without pixels, so that image properties are checked before anything is read
+    const ImageView leftInfo(left.getPixelFormat(), left.getColorSpace(), sz, 0, nullptr);
+    const ImageView rightInfo(right.getPixelFormat(), right.getColorSpace(), right.getSize(), 0, nullptr);
+
+    Result result;
+
+    if (!(result = compareInfos(leftInfo, rightInfo)).passed)
     {
         return result;
     }
 
-    return Result::makePassed();
+    // The two images are decoded concurrently
+    Image leftBand, rightBand;
+
+    auto readBands = [&](uint32_t y, uint32_t height) {
+        detail::parallelInvoke(
+            [&]() { leftBand = left.readRegion(0, y, sz.width, height); },
+            [&]() { rightBand = right.readRegion(0, y, sz.width, height); });
+    };
+
+    const CompareOptions used = getUsedOptions(options, sz);
+
+    const auto accumulator = (used.diff || used.toleranceMask) ? makeBandAccumulatorWithOptions(sz, used) : makeBandAccumulator(sz);
+    if (!accumulator)
+    {
+        readBands(0, sz.height);
+        return compare(leftBand, rightBand, used);
+    }
+
+    const uint32_t bandHeight = detail::getBandHeight(left, right, maxBandBytes);
+
+    // Both images are decoded in lockstep, and no further than needed for the verdict
+    for (uint32_t y = 0; (y < sz.height) && !accumulator->isDecided(); y += std::min(bandHeight, sz.height - y))
+    {
+        const uint32_t height = std::min(bandHeight, sz.height - y);
+
+        readBands(y, height);
+        accumulator->addBand(y, leftBand, rightBand);
+    }
+
+    return accumulator->getResult();
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> CompareStrategy::makeBandAccumulator(const Size&) const
+{
+    return nullptr;
+}
+
+CompareStrategy::Result CompareStrategy::compareContentsWithOptions(const ImageView& left, const ImageView& right, const CompareOptions&) const
+{
+    return compareContents(left, right);
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> CompareStrategy::makeBandAccumulatorWithOptions(const Size& size, const CompareOptions&) const
+{
+    return makeBandAccumulator(size);
 }
 
 CompareStrategy::Result CompareStrategy::compareInfos(const ImageView& left, const ImageView& right) const
@@ -47,7 +370,8 @@ CompareStrategy::Result CompareStrategy::compareInfos(const ImageView& left, con
     Result result;
     result.passed = false;
 
-    if (left.getPixelFormat() != right.getPixelFormat())
+    if (left.getPixelFormat() != right.getPixelFormat()
+        && !getPixelLayout(left.getPixelFormat()).hasSameChannels(getPixelLayout(right.getPixelFormat())))
     {
         return Result::makeFailed(
             "pixel format = " + StringUtils::toString(left.getPixelFormat()),
@@ -71,8 +395,11 @@ CompareStrategy::Result CompareStrategy::compareInfos(const ImageView& left, con
     return Result::makePassed();
 }
 
-ThresholdCompareStrategy::ThresholdCompareStrategy(AbsThreshold pixelFailThreshold, Percent maxFailedPixelsPercentage)
-    : m_pixelFailThreshold(pixelFailThreshold), m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+ThresholdCompareStrategy::ThresholdCompareStrategy(
+    AbsThreshold pixelFailThreshold, Percent maxFailedPixelsPercentage, AlphaComparison alphaComparison)
+    : m_pixelFailThreshold(pixelFailThreshold)
+    , m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+    , m_alphaComparison(alphaComparison)
 {}
 
 namespace detail {
@@ -86,61 +413,1277 @@ float maxAbsDiff(const RGBA& left, const RGBA& right)
     return result;
 }
 
-}
+// Decodes pixels stored in the channel order of Traits
+template<typename Traits>
+struct NativeOrder
+{
+    bool isPremultiplied() const { return Traits::isPremultiplied; }
 
-CompareStrategy::Result ThresholdCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+    RGBA decodeStored(const uint8_t* src) const
+    {
+        return Traits::decodeStored(src);
+    }
+};
+
+// Decodes pixels with the same channels as Traits, stored in the order given by layout
+template<typename Traits>
+struct SwizzledOrder
 {
-    const auto sz = left.getSize();
+    PixelLayout layout;
+
+    bool isPremultiplied() const { return layout.premultiplied; }
+
+    RGBA decodeStored(const uint8_t* src) const
+    {
+        using CT = ChannelTraits<typename Traits::ChannelType>;
+
+        const auto c = Traits::load(src);
+
+        return RGBA(
+            CT::toFloat(c[layout.redIndex]),
+            CT::toFloat(c[layout.greenIndex]),
+            CT::toFloat(c[layout.blueIndex]),
+            layout.hasAlpha() ? CT::toFloat(c[layout.alphaIndex]) : 1.0f);
+    }
+};
+
+struct MeasureErrors
+{
+    const ImageView& left;
+    const ImageView& right;
+    double threshold;
+    bool comparePremultiplied;
+    FailureMask* mask;
+    DiffImageRenderer* diff;
+    const ToleranceMask* tolerances;
+    uint32_t firstRow;
+    uint32_t rowStep;
+
+    // Sums of a single row, and the run of failed pixels that ends at the last measured pixel
+    struct RowState
+    {
+        const uint8_t* leftRow;
+        const uint8_t* rightRow;
+        // Null until the first difference in the row
+        uint8_t* diffRow;
+        // Relative to firstRow
+        uint32_t y;
+        uint32_t runLength;
+        double errors;
+        double squaredErrors;
+    };
+
+    // Premultiplication is applied or undone per pixel, only when the stored form differs from
+    // the one used for comparison. Two premultiplied images are compared as stored, since
+    // unpremultiplying both would hide their color differences under zero alpha.
+    RGBA toCompared(const RGBA& stored, bool storedPremultiplied, bool otherPremultiplied) const
+    {
+        if (storedPremultiplied == comparePremultiplied || (storedPremultiplied && otherPremultiplied))
+        {
+            return stored;
+        }
+
+        return comparePremultiplied ? premultiply(stored) : unpremultiply(stored);
+    }
+
+    void endRun(RowState& row, uint32_t end) const
+    {
+        if (mask && row.runLength != 0)
+        {
+            mask->addRun(firstRow + row.y, end - row.runLength, row.runLength);
+        }
+
+        row.runLength = 0;
+    }
+
+    template<typename Traits>
+    ErrorSums operator()(Traits) const
+    {
+        if (left.getPixelFormat() == right.getPixelFormat())
+        {
+            return measure<Traits>(NativeOrder<Traits>());
+        }
 
-    uint32_t numAboveThreshold = 0;
+        return measure<Traits>(SwizzledOrder<Traits>{ getPixelLayout(right.getPixelFormat()) });
+    }
 
-    for (uint32_t y = 0; y < sz.height; ++y)
+    // Measures pixels [begin, end) of a row against spanThreshold
+    template<typename Traits, typename RightOrder>
+    void measureSpan(RightOrder rightOrder, ErrorSums& sums, RowState& row, uint32_t begin, uint32_t end, double spanThreshold) const
     {
-        for (uint32_t x = 0; x < sz.width; ++x)
+        const uint8_t* leftPtr = row.leftRow + size_t(begin) * Traits::pixelStride;
+        const uint8_t* rightPtr = row.rightRow + size_t(begin) * Traits::pixelStride;
+
+        RGBA& channelMax = sums.channelMaxErrors;
+
+        sums.numPixels += end - begin;
+
+        for (uint32_t x = begin; x < end; ++x)
         {
-            const auto leftPixel = left.getPixel(x, y);
-            const auto rightPixel = right.getPixel(x, y);
+            const RGBA l = toCompared(Traits::decodeStored(leftPtr), Traits::isPremultiplied, rightOrder.isPremultiplied());
+            const RGBA r = toCompared(rightOrder.decodeStored(rightPtr), rightOrder.isPremultiplied(), Traits::isPremultiplied);
+
+            const float dr = std::abs(l.r - r.r);
+            const float dg = std::abs(l.g - r.g);
+            const float db = std::abs(l.b - r.b);
+            const float da = std::abs(l.a - r.a);
+
+            const float error = maxAbsDiff(l, r);
+            if (error > spanThreshold)
+            {
+                ++sums.numFailed;
+                ++row.runLength;
+            }
+            else if (row.runLength != 0)
+            {
+                endRun(row, x);
+            }
+
+            if (error > sums.maxError)
+            {
+                sums.maxError = error;
+                sums.worstX = x;
+                sums.worstY = row.y;
+            }
 
-            const float diff = detail::maxAbsDiff(leftPixel, rightPixel);
-            if (diff > m_pixelFailThreshold.value)
+            channelMax.r = std::max(channelMax.r, dr);
+            channelMax.g = std::max(channelMax.g, dg);
+            channelMax.b = std::max(channelMax.b, db);
+            channelMax.a = std::max(channelMax.a, da);
+
+            // Only differing pixels are written, the others stay black; NaN differences count as differences
+            if (diff && !(dr == 0.0f && dg == 0.0f && db == 0.0f))
             {
-                ++numAboveThreshold;
+                if (!row.diffRow)
+                {
+                    row.diffRow = diff->getRowPointer(firstRow + row.y);
+                }
+
+                diff->setPixel(row.diffRow, x, dr, dg, db);
             }
+
+            row.errors += double(dr) + dg + db + da;
+            row.squaredErrors += double(dr) * dr + double(dg) * dg + double(db) * db + double(da) * da;
+
+            leftPtr += Traits::pixelStride;
+            rightPtr += Traits::pixelStride;
         }
-    }
 
-    const double numPixels = static_cast<double>(sz.width)* static_cast<double>(sz.height);
-    const auto percentAboveThreshold = Percent((numAboveThreshold / numPixels) * 100.0);
+        endRun(row, end);
+    }
 
-    if (percentAboveThreshold > m_maxFailedPixelsPercentage)
+    template<typename Traits, typename RightOrder>
+    ErrorSums measure(RightOrder rightOrder) const
     {
-        std::string rightInfo
-            = StringUtils::toString(numAboveThreshold) + " pixels (" + StringUtils::toString(percentAboveThreshold)
-            + ") are above threshold = " + StringUtils::toString(m_pixelFailThreshold);
+        const auto sz = left.getSize();
+
+        ErrorSums sums;
+        sums.numChannels = Traits::hasAlpha ? 4 : 3;
+
+        for (uint32_t y = 0; y < sz.height; ++y)
+        {
+            const uint32_t rowY = y * rowStep;
+
+            RowState row{ left.getRowPointer(y), right.getRowPointer(y), nullptr, rowY, 0, 0.0, 0.0 };
+
+            if (!tolerances)
+            {
+                measureSpan<Traits>(rightOrder, sums, row, 0, sz.width, threshold);
+            }
+            else
+            {
+                // Ignored spans are skipped as a whole, the others are measured against their own threshold
+                uint32_t x = 0;
+
+                for (const auto& span : tolerances->getRowSpans(firstRow + rowY))
+                {
+                    measureSpan<Traits>(rightOrder, sums, row, x, span.x, threshold);
+
+                    if (!span.isIgnored())
+                    {
+                        measureSpan<Traits>(rightOrder, sums, row, span.x, span.x + span.length, span.threshold);
+                    }
+
+                    x = span.x + span.length;
+                }
+
+                measureSpan<Traits>(rightOrder, sums, row, x, sz.width, threshold);
+            }
 
-        return Result::makeFailed("reference image", rightInfo);
+            sums.sumErrors += row.errors;
+            sums.sumSquaredErrors += row.squaredErrors;
+        }
+
+        return sums;
     }
+};
 
-    return Result::makePassed();
+template<typename ChannelType>
+bool sameChannelBits(const ChannelType& left, const ChannelType& right)
+{
+    return std::memcmp(&left, &right, sizeof(ChannelType)) == 0;
 }
 
-CompareStrategy::Result BitwiseCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+// Finds the first row in which pixels differ, for images with the same channels
+// stored in different order; returns height if all rows are equal
+struct FindFirstSwizzledDifference
 {
-    const auto sz = left.getSize();
-    const auto rowLen = left.getPixelFormat().getPixelStride() * sz.width;
+    const ImageView& left;
+    const ImageView& right;
 
-    for(uint32_t y = 0; y < sz.height; ++y)
+    template<typename Traits>
+    uint32_t operator()(Traits) const
     {
-        const auto leftRow = left.getRowPointer(y);
-        const auto rightRow = right.getRowPointer(y);
+        const auto sz = left.getSize();
+        const auto layout = getPixelLayout(right.getPixelFormat());
 
-        if(0 != std::memcmp(leftRow, rightRow, rowLen))
+        for (uint32_t y = 0; y < sz.height; ++y)
         {
-            return Result::makeFailed("reference image", "different pixels in row " + std::to_string(y));
+            const uint8_t* leftPtr = left.getRowPointer(y);
+            const uint8_t* rightPtr = right.getRowPointer(y);
+
+            for (uint32_t x = 0; x < sz.width; ++x)
+            {
+                const auto l = Traits::load(leftPtr);
+                const auto r = Traits::load(rightPtr);
+
+                const bool equal
+                    = sameChannelBits(l[Traits::redIndex], r[layout.redIndex])
+                    && sameChannelBits(l[Traits::greenIndex], r[layout.greenIndex])
+                    && sameChannelBits(l[Traits::blueIndex], r[layout.blueIndex])
+                    && (!Traits::hasAlpha || sameChannelBits(l[Traits::hasAlpha ? Traits::alphaIndex : 0], r[layout.alphaIndex]));
+
+                if (!equal)
+                {
+                    return y;
+                }
+
+                leftPtr += Traits::pixelStride;
+                rightPtr += Traits::pixelStride;
+            }
         }
+
+        return sz.height;
     }
+};
 
-    return Result::makePassed();
+}
+
+ThresholdCompareStrategy& ThresholdCompareStrategy::setQuickRejectRowStep(uint32_t rowStep, uint64_t minPixels)
+{
+    m_quickRejectRowStep = rowStep;
+    m_quickRejectMinPixels = minPixels;
+    return *this;
+}
+
+namespace detail {
+
+// Every step-th row of a view, from the middle of the first step rows on
+ImageView sampleRows(const ImageView& view, uint32_t step)
+{
+    const auto sz = view.getSize();
+    const uint32_t first = std::min(step / 2, sz.height - 1);
+
+    return ImageView(
+        view.getPixelFormat(), view.getColorSpace(), Size(sz.width, (sz.height - first + step - 1) / step),
+        view.getRowStride() * static_cast<std::ptrdiff_t>(step), view.getRowPointer(first));
+}
+
+// Ignored pixels do not count towards the failed pixels percentage
+uint64_t getNumComparablePixels(const Size& size, const ToleranceMask* tolerances)
+{
+    const uint64_t numPixels = uint64_t(size.width) * size.height;
+    return tolerances ? (numPixels - tolerances->getNumIgnoredPixels()) : numPixels;
+}
+
+}
+
+CompareStrategy::Result ThresholdCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    return compareContentsWithOptions(left, right, CompareOptions());
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> ThresholdCompareStrategy::makeBandAccumulator(const Size& size) const
+{
+    return makeBandAccumulatorWithOptions(size, CompareOptions());
+}
+
+CompareStrategy::Result ThresholdCompareStrategy::compareContentsWithOptions(
+    const ImageView& left, const ImageView& right, const CompareOptions& options) const
+{
+    const auto sz = left.getSize();
+    const uint64_t numComparable = detail::getNumComparablePixels(sz, options.toleranceMask);
+
+    Result rejected;
+    if (quickReject(left, right, sz, options, rejected))
+    {
+        return rejected;
+    }
+
+    auto mask = std::make_shared<FailureMask>(sz);
+    const auto sums = measureErrors(left, right, mask.get(), options, 0);
+
+    return makeResult(sums, numComparable, mask);
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> ThresholdCompareStrategy::makeBandAccumulatorWithOptions(
+    const Size& size, const CompareOptions& options) const
+{
+    auto mask = std::make_shared<FailureMask>(size);
+    const uint64_t numComparable = detail::getNumComparablePixels(size, options.toleranceMask);
+
+    return std::unique_ptr<BandAccumulator>(new detail::ErrorSumsAccumulator(
+        [this, mask, options](uint32_t firstRow, const ImageView& left, const ImageView& right) {
+            return measureErrors(left, right, mask.get(), options, firstRow);
+        },
+        [this, numComparable, mask](const detail::ErrorSums& sums) { return makeResult(sums, numComparable, mask); },
+        [this, size, options](const ImageView& left, const ImageView& right, Result& rejected) {
+            return quickReject(left, right, size, options, rejected);
+        }));
+}
+
+bool ThresholdCompareStrategy::quickReject(
+    const ImageView& left, const ImageView& right, const Size& size, const CompareOptions& options, Result& rejected) const
+{
+    const auto sz = left.getSize();
+
+    if (m_quickRejectRowStep <= 1 || options.diff || uint64_t(size.width) * size.height < m_quickRejectMinPixels
+        || sz.isZero())
+    {
+        return false;
+    }
+
+    // Failed pixels in a subset of the rows are a lower bound for all failed pixels,
+    // so if the subset already fails, so do the whole images
+    const uint32_t step = m_quickRejectRowStep;
+    const uint32_t first = std::min(step / 2, sz.height - 1);
+
+    auto sampledMask = std::make_shared<FailureMask>(size);
+    auto sampled = measureErrors(
+        detail::sampleRows(left, step), detail::sampleRows(right, step), sampledMask.get(), options, first, step);
+    sampled.worstY += first;
+
+    rejected = makeResult(sampled, detail::getNumComparablePixels(size, options.toleranceMask), sampledMask, true);
+    return !rejected.passed;
+}
+
+detail::ErrorSums ThresholdCompareStrategy::measureErrors(
+    const ImageView& left, const ImageView& right, FailureMask* mask, const CompareOptions& options,
+    uint32_t firstRow, uint32_t rowStep) const
+{
+    return dispatchPixelFormat(
+        left.getPixelFormat(),
+        detail::MeasureErrors{
+            left, right, m_pixelFailThreshold.value, m_alphaComparison == AlphaComparison::Premultiplied,
+            mask, options.diff, options.toleranceMask, firstRow, rowStep });
+}
+
+CompareStrategy::Result ThresholdCompareStrategy::makeResult(
+    const detail::ErrorSums& sums, uint64_t numComparablePixels, std::shared_ptr<const FailureMask> mask, bool sampled) const
+{
+    // All pixels may be ignored, and then none fail
+    const double numPixels = static_cast<double>(std::max<uint64_t>(numComparablePixels, 1));
+    const auto percentAboveThreshold = Percent((sums.numFailed / numPixels) * 100.0);
+
+    const auto stats = sums.getStatistics();
+
+    Result result = Result::makePassed();
+
+    if (percentAboveThreshold > m_maxFailedPixelsPercentage)
+    {
+        const auto threshold = m_pixelFailThreshold;
+
+        result = Result::makeFailedLazy(
+            []() { return std::string("reference image"); },
+            [threshold, percentAboveThreshold, stats, sampled]() {
+                return (sampled ? "at least " : "")
+                    + StringUtils::toString(stats.numFailedPixels) + " pixels (" + StringUtils::toString(percentAboveThreshold)
+                    + ") are above threshold = " + StringUtils::toString(threshold)
+                    + ", max difference = " + StringUtils::toString(stats.maxError)
+                    + " at (" + std::to_string(stats.worstPixelX) + ", " + std::to_string(stats.worstPixelY) + ")";
+            });
+    }
+
+    result.hasStatistics = true;
+    result.statistics = stats;
+    result.failureMask = std::move(mask);
+    result.sampled = sampled;
+
+    return result;
+}
+
+DepthCompareStrategy::DepthCompareStrategy(RelThreshold relativeTolerance, Percent maxFailedPixelsPercentage)
+    : m_tolerance(relativeTolerance)
+    , m_relTolerance(static_cast<float>(relativeTolerance.value))
+    , m_farPlane(std::numeric_limits<float>::infinity())
+    , m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+{}
+
+DepthCompareStrategy::DepthCompareStrategy(RelThreshold rangeTolerance, DepthRange range, Percent maxFailedPixelsPercentage)
+    : m_tolerance(rangeTolerance)
+    , m_absTolerance(static_cast<float>(rangeTolerance.value * (range.farPlane - range.nearPlane)))
+    , m_farPlane(range.farPlane)
+    , m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+{}
+
+namespace detail {
+
+struct MeasureDepthDifferences
+{
+    float absTolerance;
+    float relTolerance;
+    float farPlane;
+
+    // Branch-free, so that the compiler can vectorize the loop; returns the number of failed pixels
+    template<size_t NumChannels>
+    uint64_t measureRow(const uint8_t* leftRow, const uint8_t* rightRow, uint32_t width, float* errors) const
+    {
+        const size_t pixelStride = NumChannels * sizeof(float);
+
+        uint64_t numFailed = 0;
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            float l, r;
+            std::memcpy(&l, leftRow + x * pixelStride, sizeof(float));
+            std::memcpy(&r, rightRow + x * pixelStride, sizeof(float));
+
+            const float diff = std::abs(l - r);
+            const float limit = absTolerance + relTolerance * std::max(std::abs(l), std::abs(r));
+            const bool background = (l >= farPlane) & (r >= farPlane);
+
+            // A finite value never matches an infinite one, even though the relative limit is then infinite
+            const bool match = (diff <= limit) & (diff <= std::numeric_limits<float>::max());
+
+            numFailed += static_cast<uint64_t>(!match & !background);
+
+            // Background has no error, and NaN differences count as infinite ones
+            errors[x] = background ? 0.0f : ((diff <= std::numeric_limits<float>::max()) ? diff : std::numeric_limits<float>::infinity());
+        }
+
+        return numFailed;
+    }
+
+    ErrorSums operator()(const ImageView& left, const ImageView& right) const
+    {
+        const auto sz = left.getSize();
+        const bool hasAlpha = getPixelLayout(left.getPixelFormat()).hasAlpha();
+
+        ErrorSums sums;
+        sums.numChannels = 1;
+        std::mutex mutex;
+
+        parallelFor(sz.height, std::max<size_t>(1, 65536 / std::max<uint32_t>(1, sz.width)), [&](size_t begin, size_t end) {
+            std::vector<float> errors(sz.width);
+
+            ErrorSums rangeSums;
+            rangeSums.numChannels = 1;
+
+            for (size_t y = begin; y < end; ++y)
+            {
+                const auto row = static_cast<uint32_t>(y);
+                rangeSums.numFailed += hasAlpha
+                    ? measureRow<2>(left.getRowPointer(row), right.getRowPointer(row), sz.width, errors.data())
+                    : measureRow<1>(left.getRowPointer(row), right.getRowPointer(row), sz.width, errors.data());
+
+                rangeSums.addRow(errors.data(), sz.width, row);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            sums.addBand(rangeSums, 0);
+        });
+
+        return sums;
+    }
+};
+
+}
+
+CompareStrategy::Result DepthCompareStrategy::compareInfos(const ImageView& left, const ImageView& right) const
+{
+    Result result = CompareStrategy::compareInfos(left, right);
+
+    if (result.passed && left.getPixelFormat() != PixelFormat::getGrayF32() && left.getPixelFormat() != PixelFormat::getGrayAlphaF32())
+    {
+        return Result::makeFailed(
+            "pixel format = " + StringUtils::toString(left.getPixelFormat()),
+            "depth comparison needs GrayF32 or GrayAlphaF32 pixels");
+    }
+
+    return result;
+}
+
+CompareStrategy::Result DepthCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    return makeResult(measureErrors(left, right), left.getSize());
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> DepthCompareStrategy::makeBandAccumulator(const Size& size) const
+{
+    return std::unique_ptr<BandAccumulator>(new detail::ErrorSumsAccumulator(
+        [this](uint32_t, const ImageView& left, const ImageView& right) { return measureErrors(left, right); },
+        [this, size](const detail::ErrorSums& sums) { return makeResult(sums, size); }));
+}
+
+detail::ErrorSums DepthCompareStrategy::measureErrors(const ImageView& left, const ImageView& right) const
+{
+    return detail::MeasureDepthDifferences{ m_absTolerance, m_relTolerance, m_farPlane }(left, right);
+}
+
+CompareStrategy::Result DepthCompareStrategy::makeResult(const detail::ErrorSums& sums, const Size& sz) const
+{
+    const double numPixels = static_cast<double>(sz.width) * static_cast<double>(sz.height);
+    const auto percentFailed = Percent((sums.numFailed / numPixels) * 100.0);
+
+    Result result = Result::makePassed();
+
+    if (percentFailed > m_maxFailedPixelsPercentage)
+    {
+        const auto numFailed = sums.numFailed;
+        const auto tolerance = m_tolerance;
+
+        result = Result::makeFailedLazy(
+            []() { return std::string("reference image"); },
+            [numFailed, percentFailed, tolerance]() {
+                return StringUtils::toString(numFailed) + " pixels (" + StringUtils::toString(percentFailed)
+                    + ") differ by more than tolerance = " + StringUtils::toString(tolerance);
+            });
+    }
+
+    result.hasStatistics = true;
+    result.statistics = sums.getStatistics();
+
+    return result;
+}
+
+CompareStrategy::Result BitwiseCompareStrategy::compareInfos(const ImageView& left, const ImageView& right) const
+{
+    Result result = CompareStrategy::compareInfos(left, right);
+
+    if (result.passed
+        && getPixelLayout(left.getPixelFormat()).premultiplied != getPixelLayout(right.getPixelFormat()).premultiplied)
+    {
+        return Result::makeFailed(
+            "pixel format = " + StringUtils::toString(left.getPixelFormat()),
+            "pixel format = " + StringUtils::toString(right.getPixelFormat()));
+    }
+
+    return result;
+}
+
+namespace detail {
+
+// Returns height if all rows are equal
+uint32_t findFirstDifferentRow(const ImageView& left, const ImageView& right)
+{
+    const auto sz = left.getSize();
+
+    if (left.getPixelFormat() != right.getPixelFormat())
+    {
+        return dispatchPixelFormat(left.getPixelFormat(), FindFirstSwizzledDifference{ left, right });
+    }
+
+    const auto rowLen = left.getPixelFormat().getPixelStride() * sz.width;
+
+    for(uint32_t y = 0; y < sz.height; ++y)
+    {
+        const auto leftRow = left.getRowPointer(y);
+        const auto rightRow = right.getRowPointer(y);
+
+        if(0 != std::memcmp(leftRow, rightRow, rowLen))
+        {
+            return y;
+        }
+    }
+
+    return sz.height;
+}
+
+CompareStrategy::Result makeBitwiseResult(uint32_t firstDifferentRow, uint32_t height)
+{
+    if (firstDifferentRow != height)
+    {
+        return CompareStrategy::Result::makeFailed(
+            "reference image", "different pixels in row " + std::to_string(firstDifferentRow));
+    }
+
+    return CompareStrategy::Result::makePassed();
+}
+
+class BitwiseBandAccumulator : public CompareStrategy::BandAccumulator
+{
+public:
+    explicit BitwiseBandAccumulator(uint32_t height)
+        : m_height(height), m_firstDifferentRow(height)
+    {}
+
+    void addBand(uint32_t firstRow, const ImageView& left, const ImageView& right) override
+    {
+        if (isDecided())
+        {
+            return;
+        }
+
+        const uint32_t y = findFirstDifferentRow(left, right);
+        if (y != left.getSize().height)
+        {
+            m_firstDifferentRow = firstRow + y;
+        }
+    }
+
+    bool isDecided() const override
+    {
+        return m_firstDifferentRow != m_height;
+    }
+
+    CompareStrategy::Result getResult() const override
+    {
+        return makeBitwiseResult(m_firstDifferentRow, m_height);
+    }
+
+private:
+    uint32_t m_height;
+    uint32_t m_firstDifferentRow;
+};
+
+}
+
+CompareStrategy::Result BitwiseCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    return detail::makeBitwiseResult(detail::findFirstDifferentRow(left, right), left.getSize().height);
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> BitwiseCompareStrategy::makeBandAccumulator(const Size& size) const
+{
+    return std::unique_ptr<BandAccumulator>(new detail::BitwiseBandAccumulator(size.height));
+}
+
+SsimCompareStrategy::SsimCompareStrategy(double minMeanSsim, double minWindowSsim, uint32_t windowSize)
+    : m_minMeanSsim(minMeanSsim)
+    , m_minWindowSsim(minWindowSsim)
+    , m_windowSize(windowSize)
+{
+    if (windowSize == 0)
+    {
+        throw ImageApprovalsError("SSIM window size must not be zero");
+    }
+}
+
+namespace detail {
+
+// Rec. 709 luma of colors premultiplied by alpha, so that transparent regions compare as black
+struct ComputeLuma
+{
+    const ImageView& image;
+    float* luma;
+
+    template<typename Traits>
+    void operator()(Traits) const
+    {
+        const auto sz = image.getSize();
+
+        parallelFor(sz.height, std::max<size_t>(1, 65536 / std::max<uint32_t>(1, sz.width)), [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y)
+            {
+                const uint8_t* src = image.getRowPointer(static_cast<uint32_t>(y));
+                float* dst = luma + y * sz.width;
+
+                for (uint32_t x = 0; x < sz.width; ++x)
+                {
+                    RGBA p = Traits::decodeStored(src);
+                    if (Traits::hasAlpha && !Traits::isPremultiplied)
+                    {
+                        p = premultiply(p);
+                    }
+
+                    dst[x] = 0.2126f * p.r + 0.7152f * p.g + 0.0722f * p.b;
+                    src += Traits::pixelStride;
+                }
+            }
+        });
+    }
+};
+
+struct SsimSums
+{
+    double sum = 0.0;
+    uint64_t numWindows = 0;
+
+    // Of the first window in row-major order with the lowest SSIM; NaN wins over everything
+    double min = std::numeric_limits<double>::infinity();
+    uint32_t minX = 0;
+    uint32_t minY = 0;
+
+    void addWindow(double ssim, uint32_t x, uint32_t y)
+    {
+        sum += ssim;
+        ++numWindows;
+
+        if ((ssim < min) || (std::isnan(ssim) && !std::isnan(min)))
+        {
+            min = ssim;
+            minX = x;
+            minY = y;
+        }
+    }
+
+    void add(const SsimSums& other)
+    {
+        sum += other.sum;
+        numWindows += other.numWindows;
+
+        const bool lower = (other.min < min) || (std::isnan(other.min) && !std::isnan(min));
+        const bool tieFirst = (other.min == min) && ((other.minY < minY) || ((other.minY == minY) && (other.minX < minX)));
+
+        if (lower || tieFirst)
+        {
+            min = other.min;
+            minX = other.minX;
+            minY = other.minY;
+        }
+    }
+};
+
+// Slides a window over both luma planes with running sums: the sums of each column over the window rows
+// are updated by one row in and one row out, and the window sums by one column in and one column out.
+// Bands of window rows are measured on separate threads.
+SsimSums measureSsim(const float* left, const float* right, uint32_t width, uint32_t height, uint32_t windowSize)
+{
+    const uint32_t win = std::min(windowSize, std::min(width, height));
+    const uint32_t numX = width - win + 1;
+    const uint32_t numY = height - win + 1;
+
+    const double n = static_cast<double>(win) * win;
+    const double c1 = 0.01 * 0.01;
+    const double c2 = 0.03 * 0.03;
+
+    std::mutex mutex;
+    SsimSums total;
+
+    parallelFor(numY, std::max<size_t>(1, 65536 / width), [&](size_t begin, size_t end) {
+        std::vector<double> sx(width), sy(width), sxx(width), syy(width), sxy(width);
+
+        auto addRow = [&](size_t row, double sign) {
+            const float* l = left + row * width;
+            const float* r = right + row * width;
+
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const double a = l[x];
+                const double b = r[x];
+
+                sx[x] += sign * a;
+                sy[x] += sign * b;
+                sxx[x] += sign * a * a;
+                syy[x] += sign * b * b;
+                sxy[x] += sign * a * b;
+            }
+        };
+
+        for (size_t row = begin; row < begin + win; ++row)
+        {
+            addRow(row, 1.0);
+        }
+
+        SsimSums sums;
+
+        for (size_t y = begin; y < end; ++y)
+        {
+            if (y != begin)
+            {
+                addRow(y + win - 1, 1.0);
+                addRow(y - 1, -1.0);
+            }
+
+            double wx = 0.0, wy = 0.0, wxx = 0.0, wyy = 0.0, wxy = 0.0;
+
+            for (uint32_t x = 0; x < win; ++x)
+            {
+                wx += sx[x];
+                wy += sy[x];
+                wxx += sxx[x];
+                wyy += syy[x];
+                wxy += sxy[x];
+            }
+
+            for (uint32_t x = 0; x < numX; ++x)
+            {
+                if (x != 0)
+                {
+                    const uint32_t in = x + win - 1;
+                    const uint32_t out = x - 1;
+
+                    wx += sx[in] - sx[out];
+                    wy += sy[in] - sy[out];
+                    wxx += sxx[in] - sxx[out];
+                    wyy += syy[in] - syy[out];
+                    wxy += sxy[in] - sxy[out];
+                }
+
+                const double mx = wx / n;
+                const double my = wy / n;
+                const double vx = std::max(wxx / n - mx * mx, 0.0);
+                const double vy = std::max(wyy / n - my * my, 0.0);
+                const double cov = wxy / n - mx * my;
+
+                const double ssim
+                    = ((2.0 * mx * my + c1) * (2.0 * cov + c2))
+                    / ((mx * mx + my * my + c1) * (vx + vy + c2));
+
+                sums.addWindow(ssim, x, static_cast<uint32_t>(y));
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        total.add(sums);
+    });
+
+    return total;
+}
+
+}
+
+CompareStrategy::Result SsimCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    const auto sz = left.getSize();
+    if (sz.isZero())
+    {
+        return Result::makePassed();
+    }
+
+    std::vector<float> leftLuma(size_t(sz.width) * sz.height);
+    std::vector<float> rightLuma(leftLuma.size());
+
+    dispatchPixelFormat(left.getPixelFormat(), detail::ComputeLuma{ left, leftLuma.data() });
+    dispatchPixelFormat(right.getPixelFormat(), detail::ComputeLuma{ right, rightLuma.data() });
+
+    const auto sums = detail::measureSsim(leftLuma.data(), rightLuma.data(), sz.width, sz.height, m_windowSize);
+    const double mean = sums.sum / static_cast<double>(sums.numWindows);
+
+    if ((mean >= m_minMeanSsim) && (sums.min >= m_minWindowSsim))
+    {
+        return Result::makePassed();
+    }
+
+    const double minMean = m_minMeanSsim;
+    const double minWindow = m_minWindowSsim;
+
+    return Result::makeFailedLazy(
+        []() { return std::string("reference image"); },
+        [sums, mean, minMean, minWindow]() {
+            return "mean SSIM = " + StringUtils::toString(mean) + " (minimum " + StringUtils::toString(minMean)
+                + "), lowest window SSIM = " + StringUtils::toString(sums.min) + " (minimum " + StringUtils::toString(minWindow)
+                + ") at (" + std::to_string(sums.minX) + ", " + std::to_string(sums.minY) + ")";
+        });
+}
+
+DeltaECompareStrategy::DeltaECompareStrategy(double maxDeltaE, Percent maxFailedPixelsPercentage, DeltaEFormula formula)
+    : m_maxDeltaE(maxDeltaE)
+    , m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+    , m_formula(formula)
+{}
+
+namespace detail {
+
+struct MeasureDeltaEDifferences
+{
+    float maxDeltaE;
+    DeltaEFormula formula;
+
+    // Decodes a row to linear sRGB (U8 rows through a lookup table) composited over black
+    static void decodeComposited(const ImageView& image, uint32_t y, RGBA* dst)
+    {
+        const auto width = image.getSize().width;
+        const auto transfer = (image.getColorSpace() == ColorSpace::getSRgb()) ? Transfer::SRgbToLinear : Transfer::None;
+
+        getDecodeRowFn(image.getPixelFormat())(image.getRowPointer(y), width, dst, transfer);
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            dst[x] = premultiply(dst[x]);
+        }
+    }
+
+    ErrorSums operator()(const ImageView& left, const ImageView& right) const
+    {
+        const auto sz = left.getSize();
+
+        ErrorSums sums;
+        sums.numChannels = 1;
+        std::mutex mutex;
+
+        parallelFor(sz.height, std::max<size_t>(1, 16384 / std::max<uint32_t>(1, sz.width)), [&](size_t begin, size_t end) {
+            std::vector<RGBA> leftRow(sz.width), rightRow(sz.width);
+            std::vector<float> errors(sz.width);
+            std::vector<uint32_t> candidates;
+            candidates.reserve(sz.width);
+
+            ErrorSums rangeSums;
+            rangeSums.numChannels = 1;
+
+            for (size_t y = begin; y < end; ++y)
+            {
+                decodeComposited(left, static_cast<uint32_t>(y), leftRow.data());
+                decodeComposited(right, static_cast<uint32_t>(y), rightRow.data());
+                std::fill(errors.begin(), errors.end(), 0.0f);
+
+                // Equal colors, the vast majority in approval tests, are never converted to Lab
+                candidates.clear();
+                for (uint32_t x = 0; x < sz.width; ++x)
+                {
+                    const RGBA& l = leftRow[x];
+                    const RGBA& r = rightRow[x];
+
+                    if (!((l.r == r.r) && (l.g == r.g) && (l.b == r.b)))
+                    {
+                        candidates.push_back(x);
+                    }
+                }
+
+                for (const uint32_t x : candidates)
+                {
+                    const Lab l = linearSRgbToLab(leftRow[x]);
+                    const Lab r = linearSRgbToLab(rightRow[x]);
+                    const float distance = deltaE76(l, r);
+
+                    float& error = errors[x];
+
+                    if (formula == DeltaEFormula::CIE76)
+                    {
+                        error = distance;
+                    }
+                    else
+                    {
+                        // Far enough below the threshold in CIE76 to pass in CIEDE2000 as well;
+                        // the bound then stands in for the CIEDE2000 difference
+                        error = distance * deltaE2000Bound;
+                        error = (error <= maxDeltaE) ? error : deltaE2000(l, r);
+                    }
+
+                    rangeSums.numFailed += (error <= maxDeltaE) ? 0 : 1;
+                }
+
+                rangeSums.addRow(errors.data(), sz.width, static_cast<uint32_t>(y));
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            sums.addBand(rangeSums, 0);
+        });
+
+        return sums;
+    }
+};
+
+}
+
+CompareStrategy::Result DeltaECompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    return makeResult(measureErrors(left, right), left.getSize());
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> DeltaECompareStrategy::makeBandAccumulator(const Size& size) const
+{
+    return std::unique_ptr<BandAccumulator>(new detail::ErrorSumsAccumulator(
+        [this](uint32_t, const ImageView& left, const ImageView& right) { return measureErrors(left, right); },
+        [this, size](const detail::ErrorSums& sums) { return makeResult(sums, size); }));
+}
+
+detail::ErrorSums DeltaECompareStrategy::measureErrors(const ImageView& left, const ImageView& right) const
+{
+    return detail::MeasureDeltaEDifferences{ static_cast<float>(m_maxDeltaE), m_formula }(left, right);
+}
+
+CompareStrategy::Result DeltaECompareStrategy::makeResult(const detail::ErrorSums& sums, const Size& sz) const
+{
+    const double numPixels = static_cast<double>(sz.width) * static_cast<double>(sz.height);
+    const auto percentFailed = Percent((sums.numFailed / numPixels) * 100.0);
+
+    Result result = Result::makePassed();
+
+    if (percentFailed > m_maxFailedPixelsPercentage)
+    {
+        const auto numFailed = sums.numFailed;
+        const auto maxDeltaE = m_maxDeltaE;
+        const auto formula = m_formula;
+
+        result = Result::makeFailedLazy(
+            []() { return std::string("reference image"); },
+            [numFailed, percentFailed, maxDeltaE, formula]() {
+                return StringUtils::toString(numFailed) + " pixels (" + StringUtils::toString(percentFailed)
+                    + ") differ by more than "
+                    + ((formula == DeltaEFormula::CIE76) ? "CIE76" : "CIEDE2000")
+                    + " Delta E = " + StringUtils::toString(maxDeltaE);
+            });
+    }
+
+    result.hasStatistics = true;
+    result.statistics = sums.getStatistics();
+
+    return result;
+}
+
+YiqCompareStrategy::YiqCompareStrategy(double maxColorDelta, Percent maxFailedPixelsPercentage)
+    : m_maxColorDelta(maxColorDelta)
+    , m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+{}
+
+namespace detail {
+
+// The largest squared YIQ distance of two colors with the weights below
+const float maxYiqDelta = 35215.0f / (255.0f * 255.0f);
+
+struct YiqCounts
+{
+    // Errors are the distances of all pixels, anti-aliased ones included, relative to the largest possible distance
+    ErrorSums sums;
+    uint64_t numAntiAliased = 0;
+};
+
+// True when at least three of the neighbours of the pixel (with pixels outside of the image
+// counting as one) have exactly the same value as the pixel itself
+bool hasManySiblings(const ImageView& image, uint32_t x, uint32_t y)
+{
+    const auto sz = image.getSize();
+    const size_t stride = image.getPixelFormat().getPixelStride();
+
+    const uint32_t x0 = (x > 0) ? x - 1 : 0;
+    const uint32_t y0 = (y > 0) ? y - 1 : 0;
+    const uint32_t x1 = std::min(x + 1, sz.width - 1);
+    const uint32_t y1 = std::min(y + 1, sz.height - 1);
+
+    const uint8_t* pixel = image.getRowPointer(y) + x * stride;
+    int numEqual = (x == x0 || x == x1 || y == y0 || y == y1) ? 1 : 0;
+
+    for (uint32_t ny = y0; ny <= y1; ++ny)
+    {
+        for (uint32_t nx = x0; nx <= x1; ++nx)
+        {
+            if ((nx != x || ny != y) && std::memcmp(pixel, image.getRowPointer(ny) + nx * stride, stride) == 0
+                && ++numEqual > 2)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// The test of pixelmatch: the pixel must have both a darker and a brighter neighbour in image, few
+// neighbours of equal brightness, and either the darkest or the brightest neighbour must have
+// many siblings in both images, that is, be part of a flat area on one side of an edge
+bool isAntiAliased(const ImageView& image, const float* luma, const ImageView& other, uint32_t x, uint32_t y)
+{
+    const auto sz = image.getSize();
+
+    const uint32_t x0 = (x > 0) ? x - 1 : 0;
+    const uint32_t y0 = (y > 0) ? y - 1 : 0;
+    const uint32_t x1 = std::min(x + 1, sz.width - 1);
+    const uint32_t y1 = std::min(y + 1, sz.height - 1);
+
+    const float center = luma[size_t(y) * sz.width + x];
+    int numEqual = (x == x0 || x == x1 || y == y0 || y == y1) ? 1 : 0;
+
+    float minDelta = 0.0f, maxDelta = 0.0f;
+    uint32_t minX = 0, minY = 0, maxX = 0, maxY = 0;
+
+    for (uint32_t ny = y0; ny <= y1; ++ny)
+    {
+        for (uint32_t nx = x0; nx <= x1; ++nx)
+        {
+            if (nx == x && ny == y)
+            {
+                continue;
+            }
+
+            const float delta = center - luma[size_t(ny) * sz.width + nx];
+
+            if (delta == 0.0f)
+            {
+                if (++numEqual > 2)
+                {
+                    return false;
+                }
+            }
+            else if (delta < minDelta)
+            {
+                minDelta = delta;
+                minX = nx;
+                minY = ny;
+            }
+            else if (delta > maxDelta)
+            {
+                maxDelta = delta;
+                maxX = nx;
+                maxY = ny;
+            }
+        }
+    }
+
+    if (minDelta == 0.0f || maxDelta == 0.0f)
+    {
+        return false;
+    }
+
+    return (hasManySiblings(image, minX, minY) && hasManySiblings(other, minX, minY))
+        || (hasManySiblings(image, maxX, maxY) && hasManySiblings(other, maxX, maxY));
+}
+
+struct MeasureYiqDifferences
+{
+    float maxDelta;
+
+    // Decodes a row to gamma-encoded colors blended over white
+    static void decodeBlended(const ImageView& image, uint32_t y, RGBA* dst)
+    {
+        const auto width = image.getSize().width;
+        const bool linear = (image.getColorSpace() == ColorSpace::getLinearSRgb());
+
+        getDecodeRowFn(image.getPixelFormat())(image.getRowPointer(y), width, dst, Transfer::None);
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            RGBA& p = dst[x];
+
+            if (linear)
+            {
+                p.r = linearToSRgb(p.r);
+                p.g = linearToSRgb(p.g);
+                p.b = linearToSRgb(p.b);
+            }
+
+            p.r = 1.0f + (p.r - 1.0f) * p.a;
+            p.g = 1.0f + (p.g - 1.0f) * p.a;
+            p.b = 1.0f + (p.b - 1.0f) * p.a;
+        }
+    }
+
+    YiqCounts operator()(const ImageView& left, const ImageView& right) const
+    {
+        const auto sz = left.getSize();
+
+        // Brightness of both images, for the neighbourhoods of the anti-aliasing test
+        std::vector<float> leftLuma(size_t(sz.width) * sz.height), rightLuma(leftLuma.size());
+
+        YiqCounts counts;
+        counts.sums.numChannels = 1;
+
+        std::mutex mutex;
+        std::vector<std::pair<uint32_t, uint32_t>> candidates;
+
+        parallelFor(sz.height, std::max<size_t>(1, 65536 / std::max<uint32_t>(1, sz.width)), [&](size_t begin, size_t end) {
+            std::vector<RGBA> leftRow(sz.width), rightRow(sz.width);
+            std::vector<float> deltas(sz.width), errors(sz.width);
+            std::vector<std::pair<uint32_t, uint32_t>> rangeCandidates;
+
+            ErrorSums rangeSums;
+            rangeSums.numChannels = 1;
+
+            for (size_t y = begin; y < end; ++y)
+            {
+                decodeBlended(left, static_cast<uint32_t>(y), leftRow.data());
+                decodeBlended(right, static_cast<uint32_t>(y), rightRow.data());
+
+                float* leftY = leftLuma.data() + y * sz.width;
+                float* rightY = rightLuma.data() + y * sz.width;
+
+                // Branch-free, so that the compiler can vectorize it
+                for (uint32_t x = 0; x < sz.width; ++x)
+                {
+                    const RGBA& l = leftRow[x];
+                    const RGBA& r = rightRow[x];
+
+                    leftY[x] = 0.29889531f * l.r + 0.58662247f * l.g + 0.11448223f * l.b;
+                    rightY[x] = 0.29889531f * r.r + 0.58662247f * r.g + 0.11448223f * r.b;
+
+                    const float dr = l.r - r.r;
+                    const float dg = l.g - r.g;
+                    const float db = l.b - r.b;
+
+                    const float dy = leftY[x] - rightY[x];
+                    const float di = 0.59597799f * dr - 0.27417610f * dg - 0.32180189f * db;
+                    const float dq = 0.21147017f * dr - 0.52261711f * dg + 0.31114694f * db;
+
+                    deltas[x] = 0.5053f * dy * dy + 0.299f * di * di + 0.1957f * dq * dq;
+                    errors[x] = std::sqrt(deltas[x] / maxYiqDelta);
+                }
+
+                rangeSums.addRow(errors.data(), sz.width, static_cast<uint32_t>(y));
+
+                for (uint32_t x = 0; x < sz.width; ++x)
+                {
+                    if (!(deltas[x] <= maxDelta))
+                    {
+                        rangeCandidates.emplace_back(x, static_cast<uint32_t>(y));
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            candidates.insert(candidates.end(), rangeCandidates.begin(), rangeCandidates.end());
+            counts.sums.addBand(rangeSums, 0);
+        });
+
+        // Only the pixels failing the color test have their neighbourhoods analyzed
+        std::atomic<uint64_t> numAntiAliased(0);
+
+        parallelFor(candidates.size(), 4096, [&](size_t begin, size_t end) {
+            uint64_t rangeAntiAliased = 0;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                const uint32_t x = candidates[i].first;
+                const uint32_t y = candidates[i].second;
+
+                const bool antiAliased
+                    = isAntiAliased(left, leftLuma.data(), right, x, y)
+                    || isAntiAliased(right, rightLuma.data(), left, x, y);
+
+                rangeAntiAliased += antiAliased ? 1 : 0;
+            }
+
+            numAntiAliased += rangeAntiAliased;
+        });
+
+        counts.numAntiAliased = numAntiAliased;
+        counts.sums.numFailed = candidates.size() - counts.numAntiAliased;
+        return counts;
+    }
+};
+
+}
+
+CompareStrategy::Result YiqCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    const auto sz = left.getSize();
+
+    const float maxDelta = detail::maxYiqDelta * static_cast<float>(m_maxColorDelta * m_maxColorDelta);
+    const detail::YiqCounts counts = detail::MeasureYiqDifferences{ maxDelta }(left, right);
+
+    const double numPixels = static_cast<double>(sz.width) * static_cast<double>(sz.height);
+    const auto percentFailed = Percent((counts.sums.numFailed / numPixels) * 100.0);
+
+    Result result = Result::makePassed();
+
+    if (percentFailed > m_maxFailedPixelsPercentage)
+    {
+        const auto numFailed = counts.sums.numFailed;
+        const auto numAntiAliased = counts.numAntiAliased;
+        const auto maxColorDelta = m_maxColorDelta;
+
+        result = Result::makeFailedLazy(
+            []() { return std::string("reference image"); },
+            [numFailed, numAntiAliased, percentFailed, maxColorDelta]() {
+                return StringUtils::toString(numFailed) + " pixels (" + StringUtils::toString(percentFailed)
+                    + ") differ by more than YIQ delta " + StringUtils::toString(maxColorDelta)
+                    + ", " + StringUtils::toString(numAntiAliased) + " anti-aliased pixels ignored";
+            });
+    }
+
+    result.hasStatistics = true;
+    result.statistics = counts.sums.getStatistics();
+
+    return result;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include <ImageApprovals/Conversion.hpp>
+#include <ImageApprovals/Errors.hpp>
+#include "ConversionUtils.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace ImageApprovals {
+
+Image convert(const ImageView& src, const PixelFormat& format, const ColorSpace& colorSpace)
+{
+    if (src.isEmpty())
+    {
+        throw ImageApprovalsError("Cannot convert an empty image");
+    }
+
+    Image dst(format, colorSpace, src.getSize());
+    convert(src, dst);
+    return dst;
+}
+
+void convert(const ImageView& src, Image& dst)
+{
+    if (src.isEmpty() || dst.isEmpty())
+    {
+        throw ImageApprovalsError("Cannot convert an empty image");
+    }
+
+    const auto sz = src.getSize();
+    if (sz != dst.getSize())
+    {
+        throw ImageApprovalsError("Source and destination images have different sizes");
+    }
+
+    const auto& srcFormat = src.getPixelFormat();
+    const auto& dstFormat = dst.getPixelFormat();
+
+    if (srcFormat == dstFormat && src.getColorSpace() == dst.getColorSpace())
+    {
+        const size_t rowSize = srcFormat.getPixelStride() * sz.width;
+
+        for (uint32_t y = 0; y < sz.height; ++y)
+        {
+            std::memcpy(dst.getRowPointer(y), src.getRowPointer(y), rowSize);
+        }
+
+        return;
+    }
+
+    const detail::PixelConverter converter(
+        srcFormat, src.getColorSpace(),
+        dstFormat, dst.getColorSpace());
+
+    const size_t minRowsPerThread = std::max<size_t>(1, (64 * 1024) / sz.width);
+
+    detail::parallelFor(sz.height, minRowsPerThread, [&](size_t begin, size_t end) {
+        std::vector<RGBA> buffer(sz.width);
+
+        for (size_t y = begin; y < end; ++y)
+        {
+            const auto row = static_cast<uint32_t>(y);
+            converter.convertRow(src.getRowPointer(row), sz.width, buffer.data(), dst.getRowPointer(row));
+        }
+    });
+}
+
+}
@@ -0,0 +1,333 @@
+#include "ConversionUtils.hpp"
+#include "ColorSpaceUtils.hpp"
+#include <ImageApprovals/PixelFormatTraits.hpp>
+#include <ImageApprovals/Errors.hpp>
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace ImageApprovals { namespace detail {
+
+namespace {
+
+struct U8Tables
+{
+    std::array<float, 256> normalized;
+    std::array<float, 256> sRgbToLinear;
+
+    // sRgbThresholds[i] is the smallest linear value encoded as sRGB code i + 1
+    std::array<float, 255> sRgbThresholds;
+
+    // sRgbCodes[i] is the sRGB code of linear value i / (sRgbCodes.size() - 1)
+    std::array<uint8_t, 4097> sRgbCodes;
+
+    U8Tables()
+    {
+        for (size_t i = 0; i < 256; ++i)
+        {
+            normalized[i] = static_cast<float>(i) / 255.0f;
+            sRgbToLinear[i] = detail::sRgbToLinear(normalized[i]);
+        }
+
+        for (size_t i = 0; i < 255; ++i)
+        {
+            sRgbThresholds[i] = detail::sRgbToLinear((static_cast<float>(i) + 0.5f) / 255.0f);
+        }
+
+        const float maxIndex = static_cast<float>(sRgbCodes.size() - 1);
+        for (size_t i = 0; i < sRgbCodes.size(); ++i)
+        {
+            const float value = static_cast<float>(i) / maxIndex;
+            const auto pos = std::upper_bound(sRgbThresholds.begin(), sRgbThresholds.end(), value);
+            sRgbCodes[i] = static_cast<uint8_t>(pos - sRgbThresholds.begin());
+        }
+    }
+};
+
+const U8Tables& getU8Tables()
+{
+    static const U8Tables tables;
+    return tables;
+}
+
+float clampUnit(float value)
+{
+    return std::min(1.0f, std::max(0.0f, value));
+}
+
+uint8_t quantizeSRgbU8(float linearValue, const U8Tables& tables)
+{
+    const float value = clampUnit(linearValue);
+
+    // Start from the code at the beginning of the table cell containing the value,
+    // then step over the (at most few) thresholds inside that cell
+    const float maxIndex = static_cast<float>(tables.sRgbCodes.size() - 1);
+    size_t code = tables.sRgbCodes[static_cast<size_t>(value * maxIndex)];
+
+    while (code < tables.sRgbThresholds.size() && tables.sRgbThresholds[code] <= value)
+    {
+        ++code;
+    }
+
+    return static_cast<uint8_t>(code);
+}
+
+float toGray(const RGBA& p)
+{
+    if (p.r == p.g && p.g == p.b)
+    {
+        return p.r;
+    }
+
+    return 0.2126f * p.r + 0.7152f * p.g + 0.0722f * p.b;
+}
+
+void applyTransfer(RGBA* pixels, uint32_t width, Transfer transfer)
+{
+    if (transfer == Transfer::None)
+    {
+        return;
+    }
+
+    float (*fn)(float) = (transfer == Transfer::SRgbToLinear) ? &detail::sRgbToLinear : &detail::linearToSRgb;
+
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        pixels[x].r = fn(pixels[x].r);
+        pixels[x].g = fn(pixels[x].g);
+        pixels[x].b = fn(pixels[x].b);
+    }
+}
+
+template<typename Traits>
+constexpr size_t alphaIndexOf()
+{
+    return Traits::hasAlpha ? static_cast<size_t>(Traits::alphaIndex) : 0;
+}
+
+template<typename Traits>
+void decodeRowU8(const uint8_t* src, uint32_t width, RGBA* dst, Transfer transfer)
+{
+    const auto& tables = getU8Tables();
+
+    const float* alphaLut = tables.normalized.data();
+    const float* colorLut = (transfer == Transfer::SRgbToLinear) ? tables.sRgbToLinear.data() : alphaLut;
+
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        dst[x] = RGBA(
+            colorLut[src[Traits::redIndex]],
+            colorLut[src[Traits::greenIndex]],
+            colorLut[src[Traits::blueIndex]],
+            Traits::hasAlpha ? alphaLut[src[alphaIndexOf<Traits>()]] : 1.0f);
+
+        src += Traits::pixelStride;
+    }
+}
+
+template<typename Traits>
+void decodeRowGeneric(const uint8_t* src, uint32_t width, RGBA* dst, Transfer transfer)
+{
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        dst[x] = Traits::decode(src);
+        src += Traits::pixelStride;
+    }
+
+    applyTransfer(dst, width, transfer);
+}
+
+template<typename Traits, typename EncodeColor, typename EncodeAlpha>
+void storeChannels(const RGBA& p, typename Traits::Channels& c,
+                   EncodeColor encodeColor, EncodeAlpha encodeAlpha)
+{
+    if (Traits::isGray)
+    {
+        c[Traits::redIndex] = encodeColor(toGray(p));
+    }
+    else
+    {
+        c[Traits::redIndex] = encodeColor(p.r);
+        c[Traits::greenIndex] = encodeColor(p.g);
+        c[Traits::blueIndex] = encodeColor(p.b);
+    }
+
+    if (Traits::hasAlpha)
+    {
+        c[alphaIndexOf<Traits>()] = encodeAlpha(p.a);
+    }
+}
+
+struct EncodeU8
+{
+    uint8_t operator()(float value) const
+    {
+        return ChannelTraits<uint8_t>::fromFloat(value);
+    }
+};
+
+struct EncodeSRgbU8
+{
+    const U8Tables& tables;
+
+    uint8_t operator()(float value) const
+    {
+        return quantizeSRgbU8(value, tables);
+    }
+};
+
+template<typename Traits, typename EncodeColor>
+void encodeRowU8Impl(const RGBA* src, uint32_t width, uint8_t* dst, EncodeColor encodeColor)
+{
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        typename Traits::Channels c;
+        storeChannels<Traits>(src[x], c, encodeColor, EncodeU8());
+        Traits::store(c, dst);
+
+        dst += Traits::pixelStride;
+    }
+}
+
+template<typename Traits>
+void encodeRowU8(const RGBA* src, uint32_t width, uint8_t* dst, Transfer transfer)
+{
+    if (transfer == Transfer::LinearToSRgb)
+    {
+        encodeRowU8Impl<Traits>(src, width, dst, EncodeSRgbU8{ getU8Tables() });
+    }
+    else
+    {
+        encodeRowU8Impl<Traits>(src, width, dst, EncodeU8());
+    }
+}
+
+template<typename Traits>
+void encodeRowGeneric(const RGBA* src, uint32_t width, uint8_t* dst, Transfer transfer)
+{
+    using CT = ChannelTraits<typename Traits::ChannelType>;
+
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        RGBA pixel = src[x];
+        applyTransfer(&pixel, 1, transfer);
+
+        if (Traits::isPremultiplied)
+        {
+            pixel = premultiply(pixel);
+        }
+
+        typename Traits::Channels c;
+        storeChannels<Traits>(pixel, c, &CT::fromFloat, &CT::fromFloat);
+        Traits::store(c, dst);
+
+        dst += Traits::pixelStride;
+    }
+}
+
+template<typename ChannelType>
+struct RowKernels
+{
+    template<typename Traits>
+    static DecodeRowFn getDecode() { return &decodeRowGeneric<Traits>; }
+
+    template<typename Traits>
+    static EncodeRowFn getEncode() { return &encodeRowGeneric<Traits>; }
+};
+
+// The lookup-table kernels work on stored values; premultiplied formats need the
+// transfer function applied to unpremultiplied colors, so they use the generic ones
+template<>
+struct RowKernels<uint8_t>
+{
+    template<typename Traits>
+    static DecodeRowFn getDecode()
+    {
+        return Traits::isPremultiplied ? &decodeRowGeneric<Traits> : &decodeRowU8<Traits>;
+    }
+
+    template<typename Traits>
+    static EncodeRowFn getEncode()
+    {
+        return Traits::isPremultiplied ? &encodeRowGeneric<Traits> : &encodeRowU8<Traits>;
+    }
+};
+
+struct SelectDecodeRowFn
+{
+    template<typename Traits>
+    DecodeRowFn operator()(Traits) const
+    {
+        return RowKernels<typename Traits::ChannelType>::template getDecode<Traits>();
+    }
+};
+
+struct SelectEncodeRowFn
+{
+    template<typename Traits>
+    EncodeRowFn operator()(Traits) const
+    {
+        return RowKernels<typename Traits::ChannelType>::template getEncode<Traits>();
+    }
+};
+
+Transfer getTransfer(const ColorSpace& from, const ColorSpace& to)
+{
+    if (from == to)
+    {
+        return Transfer::None;
+    }
+
+    if (from == ColorSpace::getSRgb() && to == ColorSpace::getLinearSRgb())
+    {
+        return Transfer::SRgbToLinear;
+    }
+
+    if (from == ColorSpace::getLinearSRgb() && to == ColorSpace::getSRgb())
+    {
+        return Transfer::LinearToSRgb;
+    }
+
+    throw ImageApprovalsError("Unsupported color space conversion");
+}
+
+}
+
+DecodeRowFn getDecodeRowFn(const PixelFormat& format)
+{
+    return dispatchPixelFormat(format, SelectDecodeRowFn());
+}
+
+EncodeRowFn getEncodeRowFn(const PixelFormat& format)
+{
+    return dispatchPixelFormat(format, SelectEncodeRowFn());
+}
+
+void decodeRow(const PixelFormat& format, const uint8_t* src, uint32_t width, RGBA* dst)
+{
+    getDecodeRowFn(format)(src, width, dst, Transfer::None);
+}
+
+PixelConverter::PixelConverter(const PixelFormat& srcFormat, const ColorSpace& srcColorSpace,
+                               const PixelFormat& dstFormat, const ColorSpace& dstColorSpace)
+    : m_decode(getDecodeRowFn(srcFormat)), m_encode(getEncodeRowFn(dstFormat))
+{
+    const Transfer transfer = getTransfer(srcColorSpace, dstColorSpace);
+
+    if (transfer == Transfer::SRgbToLinear)
+    {
+        m_decodeTransfer = transfer;
+    }
+    else
+    {
+        m_encodeTransfer = transfer;
+    }
+}
+
+void PixelConverter::convertRow(const uint8_t* src, uint32_t width, RGBA* buffer, uint8_t* dst) const
+{
+    m_decode(src, width, buffer, m_decodeTransfer);
+    m_encode(buffer, width, dst, m_encodeTransfer);
+}
+
+} }
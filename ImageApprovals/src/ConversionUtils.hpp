@@ -0,0 +1,44 @@
+#ifndef IMAGEAPPROVALS_CONVERSIONUTILS_HPP_INCLUDED
+#define IMAGEAPPROVALS_CONVERSIONUTILS_HPP_INCLUDED
+
+#include <ImageApprovals/PixelFormat.hpp>
+#include <ImageApprovals/ColorSpace.hpp>
+#include <cstdint>
+
+namespace ImageApprovals { namespace detail {
+
+enum class Transfer
+{
+    None,
+    SRgbToLinear,
+    LinearToSRgb
+};
+
+using DecodeRowFn = void (*)(const uint8_t* src, uint32_t width, RGBA* dst, Transfer transfer);
+using EncodeRowFn = void (*)(const RGBA* src, uint32_t width, uint8_t* dst, Transfer transfer);
+
+DecodeRowFn getDecodeRowFn(const PixelFormat& format);
+EncodeRowFn getEncodeRowFn(const PixelFormat& format);
+
+// Decodes width pixels into normalized RGBA values, without changing the color space
+void decodeRow(const PixelFormat& format, const uint8_t* src, uint32_t width, RGBA* dst);
+
+class PixelConverter
+{
+public:
+    PixelConverter(const PixelFormat& srcFormat, const ColorSpace& srcColorSpace,
+                   const PixelFormat& dstFormat, const ColorSpace& dstColorSpace);
+
+    // buffer must have room for at least width elements
+    void convertRow(const uint8_t* src, uint32_t width, RGBA* buffer, uint8_t* dst) const;
+
+private:
+    DecodeRowFn m_decode = nullptr;
+    EncodeRowFn m_encode = nullptr;
+    Transfer m_decodeTransfer = Transfer::None;
+    Transfer m_encodeTransfer = Transfer::None;
+};
+
+} }
+
+#endif // IMAGEAPPROVALS_CONVERSIONUTILS_HPP_INCLUDED
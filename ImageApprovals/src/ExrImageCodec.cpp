@@ -1,9 +1,18 @@
 #ifdef ImageApprovals_CONFIG_WITH_OPENEXR
 
 #include "ExrImageCodec.hpp"
+#include "ConversionUtils.hpp"
+#include "Parallel.hpp"
+#include <ImageApprovals/Conversion.hpp>
+#include <ImageApprovals/PixelFormatTraits.hpp>
 #include <ImageApprovals/Errors.hpp>
 #include <cstring>
+#include <algorithm>
 #include <array>
+#include <initializer_list>
+#include <iterator>
+#include <utility>
+#include <vector>
 
 #ifdef _MSC_VER
 # pragma warning(push)
@@ -11,6 +20,17 @@
 #endif
 
 #include <OpenEXR/ImfRgbaFile.h>
+#include <OpenEXR/ImfInputFile.h>
+#include <OpenEXR/ImfTiledInputFile.h>
+#include <OpenEXR/ImfOutputFile.h>
+#include <OpenEXR/ImfChannelList.h>
+#include <OpenEXR/ImfFrameBuffer.h>
+#include <OpenEXR/ImfHeader.h>
+#include <OpenEXR/ImfMultiPartInputFile.h>
+#include <OpenEXR/ImfMultiPartOutputFile.h>
+#include <OpenEXR/ImfInputPart.h>
+#include <OpenEXR/ImfOutputPart.h>
+#include <OpenEXR/ImfPartType.h>
 #include <OpenEXR/ImfIO.h>
 #include <OpenEXR/ImfArray.h>
 #include <OpenEXR/half.h>
@@ -77,6 +97,84 @@ private:
     std::ostream& m_stream;
 };
 
+// Lets several threads read the same file contents through separate EXR file objects
+class MemoryInputStream : public Imf::IStream
+{
+public:
+    MemoryInputStream(const std::string& fileName, const char* data, size_t size)
+        : Imf::IStream(fileName.c_str()), m_data(data), m_size(size)
+    {}
+
+    bool isMemoryMapped() const override { return true; }
+
+    bool read(char* c, int n) override
+    {
+        std::memcpy(c, readMemoryMapped(n), static_cast<size_t>(n));
+        return m_pos < m_size;
+    }
+
+    char* readMemoryMapped(int n) override
+    {
+        if (n < 0 || m_pos > m_size || static_cast<size_t>(n) > m_size - m_pos)
+        {
+            throw ImageApprovalsError("Not enough data");
+        }
+
+        char* ptr = const_cast<char*>(m_data) + m_pos;
+        m_pos += static_cast<size_t>(n);
+        return ptr;
+    }
+
+    Imf::Int64 tellg() override { return m_pos; }
+
+    // Positions come from offsets in the file, so they are checked like reads
+    void seekg(Imf::Int64 pos) override
+    {
+        if (pos > m_size)
+        {
+            throw ImageApprovalsError("Not enough data");
+        }
+
+        m_pos = static_cast<size_t>(pos);
+    }
+
+private:
+    const char* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+};
+
+// Appends the written file to a byte vector; seeking back overwrites what was appended
+class MemoryOutputStream : public Imf::OStream
+{
+public:
+    MemoryOutputStream(const std::string& fileName, std::vector<uint8_t>& data)
+        : Imf::OStream(fileName.c_str()), m_data(data), m_start(data.size()), m_pos(data.size())
+    {}
+
+    void write(const char* c, int n) override
+    {
+        const auto count = static_cast<size_t>(n);
+
+        if (m_pos + count > m_data.size())
+        {
+            m_data.resize(m_pos + count);
+        }
+
+        std::memcpy(m_data.data() + m_pos, c, count);
+        m_pos += count;
+    }
+
+    Imf::Int64 tellp() override { return m_pos - m_start; }
+
+    void seekp(Imf::Int64 p) override { m_pos = m_start + static_cast<size_t>(p); }
+
+private:
+    std::vector<uint8_t>& m_data;
+    size_t m_start;
+    size_t m_pos;
+};
+
 }
 
 namespace {
@@ -87,7 +185,7 @@ void copyPixels(size_t numChannels, const Size& sz, const Imf::Array2D<Imf::Rgba
     {
         for (uint32_t x = 0; x < sz.width; ++x)
         {
-            const auto srcPixel = src[x][y];
+            const auto srcPixel = src[y][x];
 
             const float value[]{
                 static_cast<float>(srcPixel.r),
@@ -102,45 +200,535 @@ void copyPixels(size_t numChannels, const Size& sz, const Imf::Array2D<Imf::Rgba
     }
 }
 
+// Returns the channel holding the data of a single-channel file,
+// or nullptr if the file stores colors
+const char* findGrayChannel(const Imf::ChannelList& channels)
+{
+    for (const char* colorChannel : { "R", "G", "B", "RY", "BY" })
+    {
+        if (channels.findChannel(colorChannel))
+        {
+            return nullptr;
+        }
+    }
+
+    for (const char* grayChannel : { "Y", "Z" })
+    {
+        if (channels.findChannel(grayChannel))
+        {
+            return grayChannel;
+        }
+    }
+
+    return nullptr;
 }
 
-std::string ExrImageCodec::getFileExtensionWithDot() const
+// Single-channel data is read and written as 32-bit floats, so that depth values keep their precision
+Image readGrayPixels(Imf::InputFile& file, const char* grayChannel)
 {
-    return ".exr";
+    const Imath::Box2i dw = file.header().dataWindow();
+    const bool hasAlpha = (file.header().channels().findChannel("A") != nullptr);
+
+    const PixelFormat& fmt = hasAlpha ? PixelFormat::getGrayAlphaF32() : PixelFormat::getGrayF32();
+    const Size imgSize(static_cast<uint32_t>(dw.max.x - dw.min.x + 1), static_cast<uint32_t>(dw.max.y - dw.min.y + 1));
+
+    Image image(fmt, ColorSpace::getLinearSRgb(), imgSize, 4);
+
+    const auto xStride = static_cast<std::ptrdiff_t>(fmt.getPixelStride());
+    const auto yStride = image.getRowStride();
+
+    char* origin
+        = reinterpret_cast<char*>(image.getPixelData())
+        - static_cast<std::ptrdiff_t>(dw.min.x) * xStride
+        - static_cast<std::ptrdiff_t>(dw.min.y) * yStride;
+
+    Imf::FrameBuffer frameBuffer;
+    frameBuffer.insert(grayChannel, Imf::Slice(Imf::FLOAT, origin, xStride, yStride));
+
+    if (hasAlpha)
+    {
+        frameBuffer.insert("A", Imf::Slice(Imf::FLOAT, origin + sizeof(float), xStride, yStride));
+    }
+
+    file.setFrameBuffer(frameBuffer);
+    file.readPixels(dw.min.y, dw.max.y);
+
+    return image;
 }
 
-int ExrImageCodec::getScore(const std::string& extensionWithDot) const
+struct ExrLayer
 {
-    if(extensionWithDot == ".exr")
+    std::string name;
+
+    // Channel names within the layer, in pixel format order
+    std::vector<std::string> channelNames;
+
+    // Full names of the same channels in the file
+    std::vector<std::string> fileChannels;
+};
+
+std::string joinExrName(const std::string& parent, const std::string& child)
+{
+    if (parent.empty())
     {
-        return 100;
+        return child;
     }
-    
-    return -1;
+
+    if (child.empty())
+    {
+        return parent;
+    }
+
+    return parent + "." + child;
 }
 
-int ExrImageCodec::getScore(const PixelFormat& pf, const ColorSpace& cs) const
+// Orders channels as the pixel formats store them: colors or vector components first, alpha last
+void sortExrChannels(std::vector<std::string>& names)
 {
-    if(!pf.isF32() || cs != ColorSpace::getLinearSRgb())
+    const auto rank = [](const std::string& name) {
+        static const std::array<const char*, 9> order{ { "R", "G", "B", "X", "Y", "Z", "U", "V", "W" } };
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            if (name == order[i])
+            {
+                return static_cast<int>(i);
+            }
+        }
+
+        return (name == "A") ? 100 : 50;
+    };
+
+    std::stable_sort(names.begin(), names.end(), [&](const std::string& a, const std::string& b) {
+        const int rankA = rank(a);
+        const int rankB = rank(b);
+        return (rankA != rankB) ? (rankA < rankB) : (a < b);
+    });
+}
+
+ExrLayer makeExrLayer(const std::string& name, const std::string& prefix, std::vector<std::string> channelNames)
+{
+    ExrLayer layer;
+    layer.name = name;
+
+    for (const auto& channel : channelNames)
     {
-        return -1;
+        layer.fileChannels.push_back(joinExrName(prefix, channel));
     }
 
-    return 100;
+    layer.channelNames = std::move(channelNames);
+    return layer;
 }
 
-Image ExrImageCodec::readFromStream(std::istream& stream, const std::string& fileName) const
+// Layers have alpha only when their last channel, in the order of sortExrChannels, is A. Returns nullptr
+// for channels that match no pixel format, such as the vector components U and V, or X, Y, Z and W.
+const PixelFormat* findExrLayerFormat(const std::vector<std::string>& channelNames)
 {
-    InputStramAdapter streamAdapter(fileName, stream);
+    const bool hasAlpha = !channelNames.empty() && channelNames.back() == "A";
+
+    switch (channelNames.size())
+    {
+    case 1:
+        return &PixelFormat::getGrayF32();
+    case 2:
+        return hasAlpha ? &PixelFormat::getGrayAlphaF32() : nullptr;
+    case 3:
+        return hasAlpha ? nullptr : &PixelFormat::getRgbF32();
+    case 4:
+        return hasAlpha ? &PixelFormat::getRgbAlphaF32() : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+// The format in which pixels of the given format are stored in files and read back
+const PixelFormat& getStoredExrFormat(const PixelFormat& format, ExrAlphaStorage alphaStorage)
+{
+    if (format.getNumberOfChannels() == 4)
+    {
+        return (alphaStorage == ExrAlphaStorage::Premultiplied)
+            ? PixelFormat::getRgbAlphaF32Premultiplied()
+            : PixelFormat::getRgbAlphaF32();
+    }
+
+    return format;
+}
+
+// Channels sharing a prefix form one layer, named after the part and the prefix, if a pixel format
+// matches them; otherwise each channel becomes a layer of its own. Groups of more than four channels
+// keep R, G, B and A together and split off the other channels.
+std::vector<ExrLayer> getExrLayers(const Imf::Header& header)
+{
+    const std::string partName = header.hasName() ? header.name() : std::string();
+
+    std::vector<std::pair<std::string, std::vector<std::string>>> groups;
+
+    for (auto it = header.channels().begin(); it != header.channels().end(); ++it)
+    {
+        if (it.channel().xSampling != 1 || it.channel().ySampling != 1)
+        {
+            throw ImageApprovalsError(std::string("Subsampled EXR channel ") + it.name() + " is not supported");
+        }
+
+        const std::string fullName = it.name();
+        const auto dot = fullName.rfind('.');
+        const std::string prefix = (dot == std::string::npos) ? std::string() : fullName.substr(0, dot);
+        const std::string channel = (dot == std::string::npos) ? fullName : fullName.substr(dot + 1);
+
+        auto group = std::find_if(groups.begin(), groups.end(),
+            [&](const std::pair<std::string, std::vector<std::string>>& g) { return g.first == prefix; });
+
+        if (group == groups.end())
+        {
+            groups.emplace_back(prefix, std::vector<std::string>());
+            group = std::prev(groups.end());
+        }
+
+        group->second.push_back(channel);
+    }
+
+    std::vector<ExrLayer> layers;
+
+    const auto addLayers = [&layers](const std::string& layerName, const std::string& prefix, const std::vector<std::string>& channels) {
+        if (findExrLayerFormat(channels))
+        {
+            layers.push_back(makeExrLayer(layerName, prefix, channels));
+            return;
+        }
+
+        for (const auto& channel : channels)
+        {
+            layers.push_back(makeExrLayer(joinExrName(layerName, channel), prefix, { channel }));
+        }
+    };
+
+    for (auto& group : groups)
+    {
+        const std::string layerName = joinExrName(partName, group.first);
+        auto& channels = group.second;
+
+        sortExrChannels(channels);
+
+        if (channels.size() <= 4)
+        {
+            addLayers(layerName, group.first, channels);
+            continue;
+        }
+
+        std::vector<std::string> rgba;
+
+        for (const auto& channel : channels)
+        {
+            if (channel == "R" || channel == "G" || channel == "B" || channel == "A")
+            {
+                rgba.push_back(channel);
+            }
+            else
+            {
+                layers.push_back(makeExrLayer(joinExrName(layerName, channel), group.first, { channel }));
+            }
+        }
+
+        if (!rgba.empty())
+        {
+            addLayers(layerName, group.first, rgba);
+        }
+    }
+
+    return layers;
+}
+
+std::vector<std::string> getDefaultExrChannelNames(const PixelFormat& format)
+{
+    const auto layout = getPixelLayout(format);
+
+    if (layout.isGray())
+    {
+        return layout.hasAlpha() ? std::vector<std::string>{ "Y", "A" } : std::vector<std::string>{ "Y" };
+    }
+
+    return layout.hasAlpha() ? std::vector<std::string>{ "R", "G", "B", "A" } : std::vector<std::string>{ "R", "G", "B" };
+}
+
+// Channel c of the slices is the c-th float of each pixel; origin is the address of pixel (0, 0)
+void insertExrSlices(Imf::FrameBuffer& frameBuffer, const std::vector<std::string>& fileChannels,
+                     char* origin, size_t xStride, size_t yStride)
+{
+    for (size_t c = 0; c < fileChannels.size(); ++c)
+    {
+        frameBuffer.insert(fileChannels[c], Imf::Slice(Imf::FLOAT, origin + c * sizeof(float), xStride, yStride));
+    }
+}
+
+// Returns the channels of a single image in pixel format order, or an empty list
+// for files that only RgbaInputFile can read, such as luminance-chroma images
+std::vector<std::string> getRegionReaderChannels(const Imf::ChannelList& channels)
+{
+    std::vector<std::string> names;
+
+    if (const char* grayChannel = findGrayChannel(channels))
+    {
+        names.push_back(grayChannel);
+    }
+    else if (channels.findChannel("R") && channels.findChannel("G") && channels.findChannel("B"))
+    {
+        names = { "R", "G", "B" };
+    }
+    else
+    {
+        return names;
+    }
+
+    if (channels.findChannel("A"))
+    {
+        names.push_back("A");
+    }
+
+    return names;
+}
+
+// Reads tiled files tile by tile, so that a region only decodes the tiles overlapping it,
+// and scanline files block by block
+class ExrImageReader : public ImageReader
+{
+public:
+    ExrImageReader(std::unique_ptr<std::istream> stream, const std::string& fileName,
+                   std::vector<std::string> channels, bool tiled, ExrAlphaStorage alphaStorage)
+        : m_stream(std::move(stream))
+        , m_streamAdapter(fileName, *m_stream)
+        , m_channels(std::move(channels))
+        , m_format(&getStoredExrFormat(*findExrLayerFormat(m_channels), alphaStorage))
+    {
+        if (tiled)
+        {
+            m_tiledFile.reset(new Imf::TiledInputFile(m_streamAdapter));
+            m_dataWindow = m_tiledFile->header().dataWindow();
+        }
+        else
+        {
+            m_file.reset(new Imf::InputFile(m_streamAdapter));
+            m_dataWindow = m_file->header().dataWindow();
+        }
+
+        m_size = Size(
+            static_cast<uint32_t>(m_dataWindow.max.x - m_dataWindow.min.x + 1),
+            static_cast<uint32_t>(m_dataWindow.max.y - m_dataWindow.min.y + 1));
+    }
+
+    const PixelFormat& getPixelFormat() const override { return *m_format; }
+    const ColorSpace& getColorSpace() const override { return ColorSpace::getLinearSRgb(); }
+    Size getSize() const override { return m_size; }
+
+    uint32_t getRowsPerBlock() const override
+    {
+        return m_tiledFile ? static_cast<uint32_t>(m_tiledFile->tileYSize()) : 1;
+    }
+
+    Image readRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) override
+    {
+        if (x > m_size.width || width > m_size.width - x || y > m_size.height || height > m_size.height - y)
+        {
+            throw ImageApprovalsError("Region exceeds the image");
+        }
+
+        if (!m_tiledFile)
+        {
+            // Scanline files always decode whole rows
+            Image rows(*m_format, ColorSpace::getLinearSRgb(), Size(m_size.width, height), 4);
+
+            m_file->setFrameBuffer(makeFrameBuffer(rows, 0, y));
+            m_file->readPixels(m_dataWindow.min.y + static_cast<int>(y), m_dataWindow.min.y + static_cast<int>(y + height) - 1);
+
+            return crop(std::move(rows), x, 0, width, height);
+        }
+
+        const auto tileWidth = static_cast<uint32_t>(m_tiledFile->tileXSize());
+        const auto tileHeight = static_cast<uint32_t>(m_tiledFile->tileYSize());
+
+        const uint32_t firstTileX = x / tileWidth;
+        const uint32_t lastTileX = (x + width - 1) / tileWidth;
+        const uint32_t firstTileY = y / tileHeight;
+        const uint32_t lastTileY = (y + height - 1) / tileHeight;
 
-    Imf::RgbaInputFile file(streamAdapter);
+        const uint32_t tilesX = firstTileX * tileWidth;
+        const uint32_t tilesY = firstTileY * tileHeight;
+        const uint32_t tilesWidth = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(lastTileX + 1) * tileWidth, m_size.width) - tilesX);
+        const uint32_t tilesHeight = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(lastTileY + 1) * tileHeight, m_size.height) - tilesY);
+
+        Image tiles(*m_format, ColorSpace::getLinearSRgb(), Size(tilesWidth, tilesHeight), 4);
+
+        m_tiledFile->setFrameBuffer(makeFrameBuffer(tiles, tilesX, tilesY));
+        m_tiledFile->readTiles(
+            static_cast<int>(firstTileX), static_cast<int>(lastTileX),
+            static_cast<int>(firstTileY), static_cast<int>(lastTileY), 0, 0);
+
+        return crop(std::move(tiles), x - tilesX, y - tilesY, width, height);
+    }
+
+private:
+    // Slices for pixels starting at (x, y) of the image stored in the given buffer
+    Imf::FrameBuffer makeFrameBuffer(Image& buffer, uint32_t x, uint32_t y) const
+    {
+        const auto xStride = static_cast<std::ptrdiff_t>(m_format->getPixelStride());
+        const auto yStride = buffer.getRowStride();
+
+        char* origin
+            = reinterpret_cast<char*>(buffer.getPixelData())
+            - (static_cast<std::ptrdiff_t>(m_dataWindow.min.x) + static_cast<std::ptrdiff_t>(x)) * xStride
+            - (static_cast<std::ptrdiff_t>(m_dataWindow.min.y) + static_cast<std::ptrdiff_t>(y)) * yStride;
+
+        Imf::FrameBuffer frameBuffer;
+        insertExrSlices(frameBuffer, m_channels, origin, static_cast<size_t>(xStride), static_cast<size_t>(yStride));
+        return frameBuffer;
+    }
+
+    static Image crop(Image buffer, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+    {
+        if (x == 0 && y == 0 && buffer.getSize() == Size(width, height))
+        {
+            return buffer;
+        }
+
+        return buffer.subView(x, y, width, height).copy();
+    }
+
+    std::unique_ptr<std::istream> m_stream;
+    InputStramAdapter m_streamAdapter;
+    std::vector<std::string> m_channels;
+    const PixelFormat* m_format;
+    std::unique_ptr<Imf::InputFile> m_file;
+    std::unique_ptr<Imf::TiledInputFile> m_tiledFile;
+    Imath::Box2i m_dataWindow;
+    Size m_size;
+};
+
+// Writes scanlines as they come; colors are stored as half floats, single channels as 32-bit floats
+class ExrRowWriter : public ImageRowWriter
+{
+public:
+    // ownedStream, if any, is the stream the adapter writes to
+    ExrRowWriter(std::unique_ptr<Imf::OStream> stream, std::unique_ptr<std::ostream> ownedStream,
+                 const PixelFormat& format, const ColorSpace& colorSpace, const Size& size, const std::string& grayChannelName,
+                 ExrAlphaStorage alphaStorage)
+        : ImageRowWriter(format, colorSpace, size)
+        , m_ownedStream(std::move(ownedStream))
+        , m_stream(std::move(stream))
+        , m_storedFormat(&getStoredExrFormat(format, alphaStorage))
+    {
+        if (!format.isF32())
+        {
+            throw ImageApprovalsError("EXR codec cannot write non-float pixels");
+        }
+
+        if (colorSpace != ColorSpace::getLinearSRgb())
+        {
+            throw ImageApprovalsError("EXR codec can write only images with linear color space");
+        }
+
+        Imf::PixelType pixelType = Imf::HALF;
+
+        if (format == PixelFormat::getGrayF32() || format == PixelFormat::getGrayAlphaF32())
+        {
+            m_channels.push_back(grayChannelName);
+            pixelType = Imf::FLOAT;
+        }
+        else if (format == PixelFormat::getRgbF32()
+                 || format == PixelFormat::getRgbAlphaF32()
+                 || format == PixelFormat::getRgbAlphaF32Premultiplied())
+        {
+            m_channels = { "R", "G", "B" };
+        }
+        else
+        {
+            throw ImageApprovalsError("Unexpected pixel format");
+        }
+
+        if (getPixelLayout(format).hasAlpha())
+        {
+            m_channels.push_back("A");
+        }
+
+        const int width = static_cast<int>(size.width);
+        const int height = static_cast<int>(size.height);
+
+        Imf::Header header(width, height, static_cast<float>(width) / height);
+
+        for (const auto& channel : m_channels)
+        {
+            header.channels().insert(channel, Imf::Channel(pixelType));
+        }
+
+        m_file.reset(new Imf::OutputFile(*m_stream, header));
+    }
+
+protected:
+    void appendRows(uint32_t firstRow, const ImageView& rows) override
+    {
+        // Colors with alpha are stored as the codec reads them back
+        if (rows.getPixelFormat() != *m_storedFormat)
+        {
+            appendRows(firstRow, convert(rows, *m_storedFormat, rows.getColorSpace()));
+            return;
+        }
+
+        if (rows.isBottomUp())
+        {
+            appendRows(firstRow, convert(rows, rows.getPixelFormat(), rows.getColorSpace()));
+            return;
+        }
+
+        // Slices address the whole image, of which only the rows of this batch are read
+        char* origin
+            = const_cast<char*>(reinterpret_cast<const char*>(rows.getRowPointer(0)))
+            - static_cast<std::ptrdiff_t>(firstRow) * rows.getRowStride();
+
+        Imf::FrameBuffer frameBuffer;
+        insertExrSlices(frameBuffer, m_channels, origin,
+                        rows.getPixelFormat().getPixelStride(), static_cast<size_t>(rows.getRowStride()));
+
+        m_file->setFrameBuffer(frameBuffer);
+        m_file->writePixels(static_cast<int>(rows.getSize().height));
+    }
+
+    void finishFile() override
+    {
+        // The offsets of the scanlines are written when the file is closed
+        m_file.reset();
+    }
+
+private:
+    std::unique_ptr<std::ostream> m_ownedStream;
+    std::unique_ptr<Imf::OStream> m_stream;
+    const PixelFormat* m_storedFormat;
+    std::vector<std::string> m_channels;
+    std::unique_ptr<Imf::OutputFile> m_file;
+};
+
+// Reads the gray channel if there is one, otherwise RGB(A) through the RGBA interface
+Image readExrImage(Imf::IStream& stream, ExrAlphaStorage alphaStorage)
+{
+    const auto start = stream.tellg();
+
+    {
+        Imf::InputFile grayFile(stream);
+
+        if (const char* grayChannel = findGrayChannel(grayFile.header().channels()))
+        {
+            return readGrayPixels(grayFile, grayChannel);
+        }
+    }
+
+    stream.clear();
+    stream.seekg(start);
+
+    Imf::RgbaInputFile file(stream);
     Imath::Box2i dw = file.dataWindow();
 
     const auto width = dw.max.x - dw.min.x + 1;
     const auto height = dw.max.y - dw.min.y + 1;
 
     Imf::Array2D<Imf::Rgba> pixels;
-    pixels.resizeErase(width, height);
+    pixels.resizeErase(height, width);
 
     file.setFrameBuffer(pixels[0] - dw.min.x - dw.min.y * width, 1, width);
     file.readPixels(dw.min.y, dw.max.y);
@@ -153,7 +741,7 @@ Image ExrImageCodec::readFromStream(std::istream& stream, const std::string& fil
         fmt = &PixelFormat::getRgbF32();
         break;
     case Imf::WRITE_RGBA:
-        fmt = &PixelFormat::getRgbAlphaF32();
+        fmt = &getStoredExrFormat(PixelFormat::getRgbAlphaF32(), alphaStorage);
         break;
     default:
         throw ImageApprovalsError("Unsupported pixel format");
@@ -167,68 +755,322 @@ Image ExrImageCodec::readFromStream(std::istream& stream, const std::string& fil
     return image;
 }
 
+struct ExrOutputLayer
+{
+    const LayeredImage::Layer* layer;
+    ImageView pixels;
+    std::vector<std::string> channelNames;
+};
+
+}
+
+ExrImageCodec::ExrImageCodec(std::string grayChannelName, ExrAlphaStorage alphaStorage)
+    : m_grayChannelName(std::move(grayChannelName))
+    , m_alphaStorage(alphaStorage)
+{}
+
+std::string ExrImageCodec::getFileExtensionWithDot() const
+{
+    return ".exr";
+}
+
+int ExrImageCodec::getScore(const std::string& extensionWithDot) const
+{
+    if(extensionWithDot == ".exr")
+    {
+        return 100;
+    }
+    
+    return -1;
+}
+
+int ExrImageCodec::getScore(const PixelFormat& pf, const ColorSpace& cs) const
+{
+    if(!pf.isF32() || cs != ColorSpace::getLinearSRgb())
+    {
+        return -1;
+    }
+
+    return 100;
+}
+
+Image ExrImageCodec::readFromStream(std::istream& stream, const std::string& fileName) const
+{
+    InputStramAdapter streamAdapter(fileName, stream);
+    return readExrImage(streamAdapter, m_alphaStorage);
+}
+
+Image ExrImageCodec::decodeFromMemory(const uint8_t* data, size_t size) const
+{
+    MemoryInputStream stream("<memory>", reinterpret_cast<const char*>(data), size);
+    return readExrImage(stream, m_alphaStorage);
+}
+
+void ExrImageCodec::encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const
+{
+    ExrRowWriter writer(
+        std::unique_ptr<Imf::OStream>(new MemoryOutputStream("<memory>", data)), nullptr,
+        image.getPixelFormat(), image.getColorSpace(), image.getSize(), m_grayChannelName, m_alphaStorage);
+
+    writer.writeRows(image);
+    writer.finish();
+}
+
 void ExrImageCodec::writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const
 {
-    const auto& fmt = image.getPixelFormat();
+    ExrRowWriter writer(
+        std::unique_ptr<Imf::OStream>(new OutputStreamAdapter(fileName, stream)), nullptr,
+        image.getPixelFormat(), image.getColorSpace(), image.getSize(), m_grayChannelName, m_alphaStorage);
+
+    writer.writeRows(image);
+    writer.finish();
+}
+
+std::unique_ptr<ImageRowWriter> ExrImageCodec::openRowWriterForStream(
+    std::unique_ptr<std::ostream> stream, const std::string& fileName,
+    const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const
+{
+    std::unique_ptr<Imf::OStream> streamAdapter(new OutputStreamAdapter(fileName, *stream));
+
+    return std::unique_ptr<ImageRowWriter>(new ExrRowWriter(
+        std::move(streamAdapter), std::move(stream), format, colorSpace, size, m_grayChannelName, m_alphaStorage));
+}
+
+std::unique_ptr<ImageReader> ExrImageCodec::openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const
+{
+    const auto start = stream->tellg();
+
+    std::vector<std::string> channels;
+    bool tiled = false;
 
-    if (!fmt.isF32())
     {
-        throw ImageApprovalsError("EXR codec cannot write non-float pixels");
+        InputStramAdapter headerAdapter(fileName, *stream);
+        Imf::InputFile headerFile(headerAdapter);
+
+        channels = getRegionReaderChannels(headerFile.header().channels());
+        tiled = headerFile.header().hasTileDescription();
     }
 
-    if (image.getColorSpace() != ColorSpace::getLinearSRgb())
+    stream->clear();
+    stream->seekg(start);
+
+    if (channels.empty())
     {
-        throw ImageApprovalsError("EXR codec can write only images with linear color space");
+        return ImageCodec::openReaderForStream(std::move(stream), fileName);
     }
 
-    Imf::RgbaChannels channels{};
+    return std::unique_ptr<ImageReader>(new ExrImageReader(std::move(stream), fileName, std::move(channels), tiled, m_alphaStorage));
+}
+
+LayeredImage ExrImageCodec::readLayersFromStream(std::istream& stream, const std::string& fileName) const
+{
+    const std::vector<char> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    MemoryInputStream headerStream(fileName, data.data(), data.size());
+    Imf::MultiPartInputFile file(headerStream, 0);
 
-    if (fmt == PixelFormat::getRgbF32())
+    LayeredImage result;
+
+    for (int part = 0; part < file.parts(); ++part)
     {
-        channels = Imf::WRITE_RGB;
+        const Imf::Header& header = file.header(part);
+
+        if (header.hasType() && Imf::isDeepData(header.type()))
+        {
+            throw ImageApprovalsError("Deep EXR images are not supported");
+        }
+
+        const Imath::Box2i dw = header.dataWindow();
+        const Size size(static_cast<uint32_t>(dw.max.x - dw.min.x + 1), static_cast<uint32_t>(dw.max.y - dw.min.y + 1));
+
+        const std::vector<ExrLayer> layers = getExrLayers(header);
+
+        std::vector<Image> images;
+        images.reserve(layers.size());
+
+        for (const auto& layer : layers)
+        {
+            images.emplace_back(
+                getStoredExrFormat(*findExrLayerFormat(layer.channelNames), m_alphaStorage), ColorSpace::getLinearSRgb(), size, 4);
+        }
+
+        // Each thread decodes a range of rows through its own file object
+        parallelFor(size.height, 64, [&](size_t begin, size_t end) {
+            MemoryInputStream partStream(fileName, data.data(), data.size());
+            Imf::MultiPartInputFile partFile(partStream, 0);
+            Imf::InputPart input(partFile, part);
+
+            Imf::FrameBuffer frameBuffer;
+
+            for (size_t i = 0; i < layers.size(); ++i)
+            {
+                const auto xStride = static_cast<std::ptrdiff_t>(images[i].getPixelFormat().getPixelStride());
+                const auto yStride = images[i].getRowStride();
+
+                char* origin
+                    = reinterpret_cast<char*>(images[i].getPixelData())
+                    - static_cast<std::ptrdiff_t>(dw.min.x) * xStride
+                    - static_cast<std::ptrdiff_t>(dw.min.y) * yStride;
+
+                insertExrSlices(frameBuffer, layers[i].fileChannels, origin,
+                                static_cast<size_t>(xStride), static_cast<size_t>(yStride));
+            }
+
+            input.setFrameBuffer(frameBuffer);
+            input.readPixels(dw.min.y + static_cast<int>(begin), dw.min.y + static_cast<int>(end) - 1);
+        });
+
+        for (size_t i = 0; i < layers.size(); ++i)
+        {
+            result.addLayer(layers[i].name, std::move(images[i]), layers[i].channelNames);
+        }
     }
-    else if (fmt == PixelFormat::getRgbAlphaF32())
+
+    return result;
+}
+
+void ExrImageCodec::writeLayersToStream(const LayeredImage& image, std::ostream& stream, const std::string& fileName) const
+{
+    if (image.getNumberOfLayers() == 0)
     {
-        channels = Imf::WRITE_RGBA;
+        throw ImageApprovalsError("Cannot write an image without layers");
     }
-    else
+
+    // Layers are stored as top-down 32-bit float pixels, converted if needed
+    std::vector<Image> converted;
+    std::vector<ExrOutputLayer> layers;
+
+    converted.reserve(image.getNumberOfLayers());
+
+    bool sameSizes = true;
+
+    for (size_t i = 0; i < image.getNumberOfLayers(); ++i)
     {
-        throw ImageApprovalsError("Unexpected pixel format");
+        const auto& layer = image.getLayer(i);
+        const auto& view = layer.image;
+
+        if (view.getColorSpace() != ColorSpace::getLinearSRgb())
+        {
+            throw ImageApprovalsError("EXR codec can write only images with linear color space");
+        }
+
+        ExrOutputLayer output{ &layer, view, layer.channelNames };
+
+        if (output.channelNames.empty())
+        {
+            output.channelNames = getDefaultExrChannelNames(view.getPixelFormat());
+        }
+
+        const PixelFormat* format = findExrLayerFormat(output.channelNames);
+
+        // Without an A channel no channel is alpha, so the values are written as they are stored
+        if (format)
+        {
+            format = &getStoredExrFormat(*format, m_alphaStorage);
+        }
+        else
+        {
+            const auto layout = getPixelLayout(view.getPixelFormat());
+
+            if (layout.numChannels == 4)
+            {
+                format = layout.premultiplied ? &PixelFormat::getRgbAlphaF32Premultiplied() : &PixelFormat::getRgbAlphaF32();
+            }
+            else if (layout.premultiplied)
+            {
+                throw ImageApprovalsError("Premultiplied layer \"" + layer.name + "\" needs an A channel");
+            }
+            else
+            {
+                format = (layout.numChannels == 2) ? &PixelFormat::getGrayAlphaF32() : &PixelFormat::getRgbF32();
+            }
+        }
+
+        if (view.getPixelFormat() != *format || view.isBottomUp())
+        {
+            converted.push_back(convert(view, *format, view.getColorSpace()));
+            output.pixels = converted.back();
+        }
+
+        sameSizes = sameSizes && (view.getSize() == image.getLayer(0).image.getSize());
+        layers.push_back(std::move(output));
     }
 
     OutputStreamAdapter streamAdapter(fileName, stream);
 
-    const auto sz = image.getSize();
-    int width = static_cast<int>(sz.width);
-    int height = static_cast<int>(sz.height);
+    const auto makeHeader = [](const Size& size) {
+        return Imf::Header(static_cast<int>(size.width), static_cast<int>(size.height));
+    };
 
-    const Imf::Header hdr(
-        width, height,
-        static_cast<float>(width) / height);
+    const auto makeFrameBuffer = [](const ExrOutputLayer& layer, const std::string& prefix, Imf::FrameBuffer& frameBuffer) {
+        std::vector<std::string> fileChannels;
 
-    Imf::RgbaOutputFile file(streamAdapter, hdr, channels);
+        for (const auto& channel : layer.channelNames)
+        {
+            fileChannels.push_back(joinExrName(prefix, channel));
+        }
 
-    Imf::Array2D<Imf::Rgba> pixels;
-    pixels.resizeErase(width, height);
+        insertExrSlices(
+            frameBuffer, fileChannels,
+            const_cast<char*>(reinterpret_cast<const char*>(layer.pixels.getRowPointer(0))),
+            layer.pixels.getPixelFormat().getPixelStride(),
+            static_cast<size_t>(layer.pixels.getRowStride()));
+    };
 
-    for (uint32_t y = 0; y < sz.height; ++y)
+    // Layers of the same size become channel groups of a single part, others get a part each
+    if (sameSizes)
     {
-        for (uint32_t x = 0; x < sz.width; ++x)
+        Imf::Header header = makeHeader(layers.front().pixels.getSize());
+        Imf::FrameBuffer frameBuffer;
+
+        for (const auto& layer : layers)
+        {
+            for (const auto& channel : layer.channelNames)
+            {
+                header.channels().insert(joinExrName(layer.layer->name, channel), Imf::Channel(Imf::FLOAT));
+            }
+
+            makeFrameBuffer(layer, layer.layer->name, frameBuffer);
+        }
+
+        Imf::OutputFile file(streamAdapter, header);
+        file.setFrameBuffer(frameBuffer);
+        file.writePixels(static_cast<int>(layers.front().pixels.getSize().height));
+        return;
+    }
+
+    std::vector<Imf::Header> headers;
+
+    for (const auto& layer : layers)
+    {
+        if (layer.layer->name.empty())
         {
-            const auto srcPixel = image.getPixel(x, y);
+            throw ImageApprovalsError("Layers of different sizes must have names");
+        }
 
-            Imf::Rgba dstPixel;
-            dstPixel.r = half(srcPixel.r);
-            dstPixel.g = half(srcPixel.g);
-            dstPixel.b = half(srcPixel.b);
-            dstPixel.a = half(srcPixel.a);
+        Imf::Header header = makeHeader(layer.pixels.getSize());
+        header.setName(layer.layer->name);
+        header.setType(Imf::SCANLINEIMAGE);
 
-            pixels[x][y] = dstPixel;
+        for (const auto& channel : layer.channelNames)
+        {
+            header.channels().insert(channel, Imf::Channel(Imf::FLOAT));
         }
+
+        headers.push_back(header);
     }
 
-    file.setFrameBuffer(pixels[0], 1, width);
-    file.writePixels(height);
+    Imf::MultiPartOutputFile file(streamAdapter, headers.data(), static_cast<int>(headers.size()));
+
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        Imf::FrameBuffer frameBuffer;
+        makeFrameBuffer(layers[i], std::string(), frameBuffer);
+
+        Imf::OutputPart part(file, static_cast<int>(i));
+        part.setFrameBuffer(frameBuffer);
+        part.writePixels(static_cast<int>(layers[i].pixels.getSize().height));
+    }
 }
 
 } }
@@ -7,9 +7,24 @@
 
 namespace ImageApprovals { namespace detail {
 
+// How the colors of RGBA images are stored in EXR files
+enum class ExrAlphaStorage
+{
+    // Colors are written and read back as RgbAlphaF32, unchanged
+    Straight,
+    // Colors are premultiplied, as most EXR tools expect, and read back as RgbAlphaF32Premultiplied.
+    // Approved files written with straight alpha then fail where alpha is not 1; to migrate them,
+    // read them with a Straight codec and write them again with a Premultiplied one.
+    Premultiplied
+};
+
 class ExrImageCodec : public ImageCodec
 {
 public:
+    // Single-channel images are written to the channel with the given name,
+    // e.g. "Y" for luminance or "Z" for depth
+    explicit ExrImageCodec(std::string grayChannelName = "Y", ExrAlphaStorage alphaStorage = ExrAlphaStorage::Straight);
+
     std::string getFileExtensionWithDot() const override;
 
     int getScore(const std::string& extensionWithDot) const override;
@@ -18,6 +33,22 @@ public:
 protected:
     Image readFromStream(std::istream& stream, const std::string& fileName) const override;
     void writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const override;
+
+    Image decodeFromMemory(const uint8_t* data, size_t size) const override;
+    void encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const override;
+
+    // Reads every channel of every part; see getExrLayers for how channels are grouped
+    LayeredImage readLayersFromStream(std::istream& stream, const std::string& fileName) const override;
+    void writeLayersToStream(const LayeredImage& image, std::ostream& stream, const std::string& fileName) const override;
+
+    std::unique_ptr<ImageReader> openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const override;
+    std::unique_ptr<ImageRowWriter> openRowWriterForStream(
+        std::unique_ptr<std::ostream> stream, const std::string& fileName,
+        const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const override;
+
+private:
+    std::string m_grayChannelName;
+    ExrAlphaStorage m_alphaStorage;
 };
 
 } }
@@ -0,0 +1,233 @@
+#include <ImageApprovals/FailureMask.hpp>
+#include <ImageApprovals/Errors.hpp>
+#include <algorithm>
+#include <sstream>
+
+namespace ImageApprovals {
+
+const uint32_t FailureMask::defaultTileSize;
+const size_t FailureMask::defaultMaxRuns;
+
+FailureMask::FailureMask(const Size& imageSize, uint32_t tileSize, size_t maxRuns)
+    : m_imageSize(imageSize)
+    , m_tileSize(tileSize)
+    , m_maxRuns(maxRuns)
+{
+    if (tileSize == 0)
+    {
+        throw ImageApprovalsError("Tile size of a failure mask must not be zero");
+    }
+}
+
+void FailureMask::addRun(uint32_t y, uint32_t x, uint32_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    const uint32_t end = x + length;
+
+    m_numFailedPixels += length;
+
+    m_minX = std::min(m_minX, x);
+    m_maxX = std::max(m_maxX, end - 1);
+    m_minY = std::min(m_minY, y);
+    m_maxY = std::max(m_maxY, y);
+
+    const uint32_t tileRow = y / m_tileSize;
+    for (uint32_t column = x / m_tileSize; column <= (end - 1) / m_tileSize; ++column)
+    {
+        const uint32_t tileBegin = std::max(x, column * m_tileSize);
+        const uint32_t tileEnd = std::min(end, (column + 1) * m_tileSize);
+
+        m_tileCounts[uint64_t(tileRow) * getNumTileColumns() + column] += tileEnd - tileBegin;
+    }
+
+    if (!m_runs.empty() && m_runs.back().y == y && m_runs.back().x + m_runs.back().length == x)
+    {
+        m_runs.back().length += length;
+    }
+    else if (m_runs.size() < m_maxRuns)
+    {
+        m_runs.push_back(Run{ y, x, length });
+    }
+    else
+    {
+        m_complete = false;
+    }
+}
+
+FailureMask::Rect FailureMask::getBoundingBox() const
+{
+    Rect rect;
+
+    if (!isEmpty())
+    {
+        rect.x = m_minX;
+        rect.y = m_minY;
+        rect.width = m_maxX - m_minX + 1;
+        rect.height = m_maxY - m_minY + 1;
+    }
+
+    return rect;
+}
+
+std::vector<FailureMask::Tile> FailureMask::getTiles() const
+{
+    const uint64_t numColumns = getNumTileColumns();
+
+    std::vector<Tile> tiles;
+    tiles.reserve(m_tileCounts.size());
+
+    for (const auto& entry : m_tileCounts)
+    {
+        tiles.push_back(Tile{
+            static_cast<uint32_t>(entry.first % numColumns),
+            static_cast<uint32_t>(entry.first / numColumns),
+            entry.second });
+    }
+
+    return tiles;
+}
+
+bool FailureMask::contains(uint32_t x, uint32_t y) const
+{
+    // The last run starting at or before (x, y)
+    const auto it = std::upper_bound(m_runs.begin(), m_runs.end(), Run{ y, x, 0 }, [](const Run& lhs, const Run& rhs) {
+        return (lhs.y < rhs.y) || ((lhs.y == rhs.y) && (lhs.x < rhs.x));
+    });
+
+    if (it == m_runs.begin())
+    {
+        return false;
+    }
+
+    const Run& run = *(it - 1);
+    return (run.y == y) && (x - run.x < run.length);
+}
+
+std::string FailureMask::serialize() const
+{
+    std::ostringstream stream;
+
+    const Rect box = getBoundingBox();
+
+    stream << "failure-mask " << m_imageSize.width << " " << m_imageSize.height << " " << m_tileSize
+           << " " << m_numFailedPixels << " " << (m_complete ? 1 : 0) << "\n";
+    stream << "bounds " << box.x << " " << box.y << " " << box.width << " " << box.height << "\n";
+
+    const auto tiles = getTiles();
+    stream << "tiles " << tiles.size() << "\n";
+    for (const auto& tile : tiles)
+    {
+        stream << tile.column << " " << tile.row << " " << tile.numFailedPixels << "\n";
+    }
+
+    stream << "runs " << m_runs.size() << "\n";
+    for (const auto& run : m_runs)
+    {
+        stream << run.y << " " << run.x << " " << run.length << "\n";
+    }
+
+    return stream.str();
+}
+
+FailureMask FailureMask::deserialize(const std::string& text)
+{
+    std::istringstream stream(text);
+
+    auto expect = [&](const char* keyword) {
+        std::string word;
+        if (!(stream >> word) || word != keyword)
+        {
+            throw ImageApprovalsError(std::string("Invalid failure mask: expected \"") + keyword + "\"");
+        }
+    };
+
+    auto check = [&]() {
+        if (!stream)
+        {
+            throw ImageApprovalsError("Invalid failure mask: truncated or malformed numbers");
+        }
+    };
+
+    FailureMask mask;
+    Rect box;
+    int complete = 1;
+    size_t numTiles = 0, numRuns = 0;
+
+    expect("failure-mask");
+    stream >> mask.m_imageSize.width >> mask.m_imageSize.height >> mask.m_tileSize >> mask.m_numFailedPixels >> complete;
+    expect("bounds");
+    stream >> box.x >> box.y >> box.width >> box.height;
+    expect("tiles");
+    stream >> numTiles;
+    check();
+
+    if (mask.m_tileSize == 0)
+    {
+        throw ImageApprovalsError("Invalid failure mask: tile size is zero");
+    }
+
+    const uint64_t numColumns = mask.getNumTileColumns();
+
+    for (size_t i = 0; i < numTiles; ++i)
+    {
+        Tile tile;
+        stream >> tile.column >> tile.row >> tile.numFailedPixels;
+        check();
+
+        mask.m_tileCounts[uint64_t(tile.row) * numColumns + tile.column] = tile.numFailedPixels;
+    }
+
+    expect("runs");
+    stream >> numRuns;
+    check();
+
+    for (size_t i = 0; i < numRuns; ++i)
+    {
+        Run run;
+        stream >> run.y >> run.x >> run.length;
+        check();
+
+        if (run.length == 0 || run.y >= mask.m_imageSize.height || run.x > mask.m_imageSize.width
+            || run.length > mask.m_imageSize.width - run.x)
+        {
+            throw ImageApprovalsError("Invalid failure mask: run " + std::to_string(i) + " is empty or outside of the image");
+        }
+
+        // contains() relies on runs in row-major order that do not overlap
+        if (!mask.m_runs.empty())
+        {
+            const Run& previous = mask.m_runs.back();
+
+            if (run.y < previous.y || (run.y == previous.y && run.x < previous.x + previous.length))
+            {
+                throw ImageApprovalsError("Invalid failure mask: run " + std::to_string(i) + " overlaps or precedes the previous run");
+            }
+        }
+
+        mask.m_runs.push_back(run);
+    }
+
+    mask.m_complete = (complete != 0);
+    mask.m_maxRuns = std::max(defaultMaxRuns, mask.m_runs.size());
+
+    if (box.width != 0 && box.height != 0)
+    {
+        mask.m_minX = box.x;
+        mask.m_minY = box.y;
+        mask.m_maxX = box.x + box.width - 1;
+        mask.m_maxY = box.y + box.height - 1;
+    }
+
+    return mask;
+}
+
+uint64_t FailureMask::getNumTileColumns() const
+{
+    return std::max<uint64_t>((uint64_t(m_imageSize.width) + m_tileSize - 1) / m_tileSize, 1);
+}
+
+}
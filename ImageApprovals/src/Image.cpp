@@ -1,26 +1,38 @@
 #include <ImageApprovals/Image.hpp>
 #include <ImageApprovals/Errors.hpp>
+#include <algorithm>
 #include <cstring>
 #include <fstream>
+#include <limits>
 
 namespace ImageApprovals {
 
 namespace detail {
 
-size_t alignedSize(size_t baseSize, size_t alignment)
+uint64_t alignedSize(uint64_t baseSize, uint64_t alignment)
 {
     return ((baseSize + alignment - 1) / alignment) * alignment;
 }
 
-size_t rowStride(const PixelFormat& fmt, const Size& sz, size_t rowAlignment)
+std::ptrdiff_t rowStride(const PixelFormat& fmt, const Size& sz, size_t rowAlignment)
 {
     if (rowAlignment == 0)
     {
         return 0;
     }
 
-    const auto rowSize = fmt.getPixelStride() * sz.width;
-    return alignedSize(rowSize, rowAlignment);
+    // Sizes are computed in 64 bits, so that only images that cannot be addressed are rejected
+    const uint64_t rowSize = alignedSize(uint64_t(fmt.getPixelStride()) * sz.width, rowAlignment);
+    const uint64_t imageSize = rowSize * sz.height;
+
+    if (rowSize > uint64_t(std::numeric_limits<std::ptrdiff_t>::max())
+        || imageSize / std::max<uint64_t>(rowSize, 1) != sz.height
+        || imageSize > uint64_t(std::numeric_limits<std::ptrdiff_t>::max()))
+    {
+        throw ImageApprovalsError("Image is too large to be addressed");
+    }
+
+    return static_cast<std::ptrdiff_t>(rowSize);
 }
 
 }
@@ -43,7 +55,7 @@ Image::Image(const PixelFormat& format, const ColorSpace& colorSpace, const Size
         throw ImageApprovalsError("Image row alignment must be greater than 0");
     }
 
-    const size_t rowStride = getRowStride();
+    const auto rowStride = static_cast<size_t>(getRowStride());
 
     m_data.reset(new uint8_t[rowStride * m_size.height]);
     m_dataPtr = m_data.get();
@@ -91,25 +103,20 @@ uint8_t* Image::getRowPointer(uint32_t y)
         throw ImageApprovalsError("Row index out of range");
     }
 
-    const auto rowStride = getRowStride();
+    const auto rowStride = static_cast<size_t>(getRowStride());
     return &m_data[rowStride * y];
 }
 
 void Image::flipVertically()
 {
-    const auto rowStride = getRowStride();
-
-    std::unique_ptr<uint8_t[]> rowBuffer;
-    rowBuffer.reset(new uint8_t[rowStride]);
+    const auto rowSize = getPixelFormat().getPixelStride() * m_size.width;
 
     for (uint32_t y = 0; y < m_size.height / 2; ++y)
     {
         auto upperRow = getRowPointer(y);
         auto lowerRow = getRowPointer(m_size.height - y - 1);
 
-        std::memcpy(rowBuffer.get(), upperRow, rowStride);
-        std::memcpy(upperRow, lowerRow, rowStride);
-        std::memcpy(lowerRow, rowBuffer.get(), rowStride);
+        std::swap_ranges(upperRow, upperRow + rowSize, lowerRow);
     }
 }
 
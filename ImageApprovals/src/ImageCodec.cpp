@@ -2,8 +2,14 @@
 #include <ImageApprovals/Errors.hpp>
 #include <ApprovalTests.hpp>
 #include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "ExrImageCodec.hpp"
@@ -49,6 +55,162 @@ const ImageCodec* findBestMatch(const std::vector<std::shared_ptr<ImageCodec>>&
     return bestCodec;
 }
 
+using CodecList = std::vector<std::shared_ptr<ImageCodec>>;
+
+// Immutable state of the registry; lookups of the extensions of registered codecs
+// and of the built-in pixel formats are answered from the precomputed maps
+struct CodecSnapshot
+{
+    CodecList codecs;
+    std::unordered_map<std::string, const ImageCodec*> byExtension;
+    std::map<std::pair<const PixelFormat*, const ColorSpace*>, const ImageCodec*> byFormat;
+};
+
+std::shared_ptr<const CodecSnapshot> makeCodecSnapshot(CodecList codecs)
+{
+    static const PixelFormat* const builtInFormats[] = {
+        &PixelFormat::getGrayU8(), &PixelFormat::getGrayAlphaU8(),
+        &PixelFormat::getRgbU8(), &PixelFormat::getRgbAlphaU8(),
+        &PixelFormat::getBgrU8(), &PixelFormat::getBgrAlphaU8(), &PixelFormat::getAlphaRgbU8(),
+        &PixelFormat::getGrayAlphaU8Premultiplied(), &PixelFormat::getRgbAlphaU8Premultiplied(),
+        &PixelFormat::getBgrAlphaU8Premultiplied(), &PixelFormat::getAlphaRgbU8Premultiplied(),
+        &PixelFormat::getGrayU16(), &PixelFormat::getGrayAlphaU16(),
+        &PixelFormat::getRgbU16(), &PixelFormat::getRgbAlphaU16(), &PixelFormat::getRgbAlphaU16Premultiplied(),
+        &PixelFormat::getGrayF32(), &PixelFormat::getGrayAlphaF32(),
+        &PixelFormat::getRgbF32(), &PixelFormat::getRgbAlphaF32(), &PixelFormat::getRgbAlphaF32Premultiplied()
+    };
+
+    static const ColorSpace* const builtInColorSpaces[] = {
+        &ColorSpace::getLinearSRgb(), &ColorSpace::getSRgb()
+    };
+
+    std::shared_ptr<CodecSnapshot> snapshot = std::make_shared<CodecSnapshot>();
+    snapshot->codecs = std::move(codecs);
+
+    for (const auto& codec : snapshot->codecs)
+    {
+        const std::string extension = codec->getFileExtensionWithDot();
+        snapshot->byExtension[extension] = findBestMatch(snapshot->codecs, extension);
+    }
+
+    for (const PixelFormat* pf : builtInFormats)
+    {
+        for (const ColorSpace* cs : builtInColorSpaces)
+        {
+            snapshot->byFormat[std::make_pair(pf, cs)] = findBestMatch(snapshot->codecs, *pf, *cs);
+        }
+    }
+
+    return snapshot;
+}
+
+// Lookups load the current snapshot without locking; changes are serialized
+// and publish a modified copy
+class CodecRegistry
+{
+public:
+    CodecRegistry()
+        : m_snapshot(makeCodecSnapshot(initCodecs()))
+    {}
+
+    std::shared_ptr<const CodecSnapshot> getSnapshot() const
+    {
+        return std::atomic_load(&m_snapshot);
+    }
+
+    void modify(const std::function<void(CodecList&)>& change)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        CodecList codecs = getSnapshot()->codecs;
+        change(codecs);
+
+        std::atomic_store(&m_snapshot, makeCodecSnapshot(std::move(codecs)));
+    }
+
+private:
+    std::mutex m_mutex;
+    std::shared_ptr<const CodecSnapshot> m_snapshot;
+};
+
+CodecRegistry& getCodecRegistry()
+{
+    static CodecRegistry registry;
+    return registry;
+}
+
+class WholeImageReader : public ImageReader
+{
+public:
+    explicit WholeImageReader(Image image)
+        : m_format(&image.getPixelFormat())
+        , m_colorSpace(&image.getColorSpace())
+        , m_size(image.getSize())
+        , m_image(std::move(image))
+    {}
+
+    const PixelFormat& getPixelFormat() const override { return *m_format; }
+    const ColorSpace& getColorSpace() const override { return *m_colorSpace; }
+    Size getSize() const override { return m_size; }
+
+    // Reading the whole image hands over the decoded image instead of copying it,
+    // after which the reader is exhausted
+    Image readRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) override
+    {
+        if (m_image.isEmpty())
+        {
+            throw ImageApprovalsError("The whole image was already read from this reader");
+        }
+
+        if (x == 0 && y == 0 && width == m_size.width && height == m_size.height)
+        {
+            return std::move(m_image);
+        }
+
+        return m_image.subView(x, y, width, height).copy();
+    }
+
+private:
+    const PixelFormat* m_format;
+    const ColorSpace* m_colorSpace;
+    Size m_size;
+    Image m_image;
+};
+
+class BufferedRowWriter : public ImageRowWriter
+{
+public:
+    BufferedRowWriter(
+        std::unique_ptr<std::ostream> stream, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size,
+        std::function<void(const ImageView&, std::ostream&)> write)
+        : ImageRowWriter(format, colorSpace, size)
+        , m_stream(std::move(stream))
+        , m_image(format, colorSpace, size)
+        , m_write(std::move(write))
+    {}
+
+protected:
+    void appendRows(uint32_t firstRow, const ImageView& rows) override
+    {
+        const auto rowSize = getPixelFormat().getPixelStride() * getSize().width;
+
+        for (uint32_t y = 0; y < rows.getSize().height; ++y)
+        {
+            std::memcpy(m_image.getRowPointer(firstRow + y), rows.getRowPointer(y), rowSize);
+        }
+    }
+
+    void finishFile() override
+    {
+        m_write(m_image, *m_stream);
+    }
+
+private:
+    std::unique_ptr<std::ostream> m_stream;
+    Image m_image;
+    std::function<void(const ImageView&, std::ostream&)> m_write;
+};
+
 }
 
 Image ImageCodec::read(const std::string& fileName) const
@@ -77,11 +239,138 @@ void ImageCodec::write(const std::string& fileName, const ImageView& image) cons
     writeToStream(image, fileStream, fileName);
 }
 
+LayeredImage ImageCodec::readLayers(const std::string& fileName) const
+{
+    std::ifstream fileStream(fileName.c_str(), std::ios::binary);
+    if (!fileStream)
+    {
+        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for reading");
+    }
+
+    fileStream.exceptions(std::ios::failbit | std::ios::badbit);
+
+    return readLayersFromStream(fileStream, fileName);
+}
+
+void ImageCodec::writeLayers(const std::string& fileName, const LayeredImage& image) const
+{
+    std::ofstream fileStream(fileName.c_str(), std::ios::binary);
+    if (!fileStream)
+    {
+        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for writing");
+    }
+
+    fileStream.exceptions(std::ios::badbit | std::ios::failbit);
+
+    writeLayersToStream(image, fileStream, fileName);
+}
+
+std::vector<uint8_t> ImageCodec::encode(const ImageView& image) const
+{
+    std::vector<uint8_t> data;
+    encodeToMemory(image, data);
+    return data;
+}
+
+void ImageCodec::encode(const ImageView& image, std::vector<uint8_t>& data) const
+{
+    data.clear();
+    encodeToMemory(image, data);
+}
+
+Image ImageCodec::decode(const uint8_t* data, size_t size) const
+{
+    if (!data && (size != 0))
+    {
+        throw ImageApprovalsError("Cannot decode image from null data");
+    }
+
+    return decodeFromMemory(data, size);
+}
+
+std::unique_ptr<ImageReader> ImageCodec::openReader(const std::string& fileName) const
+{
+    std::unique_ptr<std::ifstream> fileStream(new std::ifstream(fileName.c_str(), std::ios::binary));
+    if (!*fileStream)
+    {
+        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for reading");
+    }
+
+    fileStream->exceptions(std::ios::failbit | std::ios::badbit);
+
+    return openReaderForStream(std::move(fileStream), fileName);
+}
+
+std::unique_ptr<ImageRowWriter> ImageCodec::openRowWriter(
+    const std::string& fileName, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const
+{
+    std::unique_ptr<std::ofstream> fileStream(new std::ofstream(fileName.c_str(), std::ios::binary));
+    if (!*fileStream)
+    {
+        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for writing");
+    }
+
+    fileStream->exceptions(std::ios::badbit | std::ios::failbit);
+
+    return openRowWriterForStream(std::move(fileStream), fileName, format, colorSpace, size);
+}
+
+LayeredImage ImageCodec::readLayersFromStream(std::istream& stream, const std::string& fileName) const
+{
+    LayeredImage image;
+    image.addLayer("", readFromStream(stream, fileName));
+    return image;
+}
+
+void ImageCodec::writeLayersToStream(const LayeredImage& image, std::ostream& stream, const std::string& fileName) const
+{
+    if (image.getNumberOfLayers() != 1)
+    {
+        throw ImageApprovalsError("Codec for " + getFileExtensionWithDot() + " files can only write a single layer");
+    }
+
+    writeToStream(image.getLayer(0).image, stream, fileName);
+}
+
+Image ImageCodec::decodeFromMemory(const uint8_t* data, size_t size) const
+{
+    std::istringstream stream(std::string(reinterpret_cast<const char*>(data), size), std::ios::binary);
+    stream.exceptions(std::ios::failbit | std::ios::badbit);
+
+    return readFromStream(stream, "<memory>");
+}
+
+void ImageCodec::encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const
+{
+    std::ostringstream stream(std::ios::binary);
+    stream.exceptions(std::ios::badbit | std::ios::failbit);
+
+    writeToStream(image, stream, "<memory>");
+
+    const std::string bytes = stream.str();
+    data.insert(data.end(), bytes.begin(), bytes.end());
+}
+
+std::unique_ptr<ImageReader> ImageCodec::openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const
+{
+    return std::unique_ptr<ImageReader>(new detail::WholeImageReader(readFromStream(*stream, fileName)));
+}
+
+std::unique_ptr<ImageRowWriter> ImageCodec::openRowWriterForStream(
+    std::unique_ptr<std::ostream> stream, const std::string& fileName,
+    const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const
+{
+    return std::unique_ptr<ImageRowWriter>(new detail::BufferedRowWriter(
+        std::move(stream), format, colorSpace, size,
+        [this, fileName](const ImageView& image, std::ostream& stream) { writeToStream(image, stream, fileName); }));
+}
+
 ImageCodec::Disposer ImageCodec::registerCodec(const std::shared_ptr<ImageCodec>& codec)
 {
     if (codec)
     {
-        getImageCodecs().insert(getImageCodecs().begin(), codec);
+        detail::getCodecRegistry().modify(
+            [&codec](detail::CodecList& codecs) { codecs.insert(codecs.begin(), codec); });
     }
 
     return Disposer(codec);
@@ -94,18 +383,20 @@ void ImageCodec::unregisterCodec(const std::shared_ptr<ImageCodec>& codec)
         return;
     }
 
-    auto& codecs = getImageCodecs();
-
-    auto pos = std::find(codecs.begin(), codecs.end(), codec);
-    if (pos != codecs.end())
+    detail::getCodecRegistry().modify([&codec](detail::CodecList& codecs)
     {
-        codecs.erase(pos);
-    }
+        auto pos = std::find(codecs.begin(), codecs.end(), codec);
+        if (pos != codecs.end())
+        {
+            codecs.erase(pos);
+        }
+    });
 }
 
 std::vector<std::string> ImageCodec::getRegisteredExtensions()
 {
-    auto& codecs = getImageCodecs();
+    const auto snapshot = detail::getCodecRegistry().getSnapshot();
+    const auto& codecs = snapshot->codecs;
 
     std::vector<std::string> extensions;
     extensions.resize(codecs.size());
@@ -121,7 +412,19 @@ const ImageCodec& ImageCodec::getBestCodec(const ImageView& image)
     const auto& pf = image.getPixelFormat();
     const auto& cs = image.getColorSpace();
 
-    const ImageCodec* codec = detail::findBestMatch(getImageCodecs(), pf, cs);
+    const auto snapshot = detail::getCodecRegistry().getSnapshot();
+
+    const ImageCodec* codec = nullptr;
+
+    auto pos = snapshot->byFormat.find(std::make_pair(&pf, &cs));
+    if (pos != snapshot->byFormat.end())
+    {
+        codec = pos->second;
+    }
+    else
+    {
+        codec = detail::findBestMatch(snapshot->codecs, pf, cs);
+    }
 
     if(!codec)
     {
@@ -138,7 +441,19 @@ const ImageCodec& ImageCodec::getBestCodec(const std::string& filePath)
     using namespace ApprovalTests;
     const std::string extWithDot = FileUtils::getExtensionWithDot(filePath);
 
-    const ImageCodec* codec = detail::findBestMatch(getImageCodecs(), extWithDot);
+    const auto snapshot = detail::getCodecRegistry().getSnapshot();
+
+    const ImageCodec* codec = nullptr;
+
+    auto pos = snapshot->byExtension.find(extWithDot);
+    if (pos != snapshot->byExtension.end())
+    {
+        codec = pos->second;
+    }
+    else
+    {
+        codec = detail::findBestMatch(snapshot->codecs, extWithDot);
+    }
 
     if(!codec)
     {
@@ -150,12 +465,6 @@ const ImageCodec& ImageCodec::getBestCodec(const std::string& filePath)
     return *codec;
 }
 
-std::vector<std::shared_ptr<ImageCodec>>& ImageCodec::getImageCodecs()
-{
-    static std::vector<std::shared_ptr<ImageCodec>> imageCodecs = detail::initCodecs();
-    return imageCodecs;
-}
-
 ImageCodec::Disposer::Disposer(std::shared_ptr<ImageCodec> codec)
     : m_codec(std::move(codec))
 {}
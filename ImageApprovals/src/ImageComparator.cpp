@@ -1,5 +1,10 @@
 #include <ImageApprovals/ImageComparator.hpp>
 #include <ImageApprovals/ImageCodec.hpp>
+#include <ImageApprovals/Errors.hpp>
+#include "Parallel.hpp"
+#include "PngImageCodec.hpp"
+#include <fstream>
+#include <limits>
 #include <sstream>
 #include <iterator>
 #include <stdexcept>
@@ -20,12 +25,12 @@ ImageComparator::ImageComparator(std::shared_ptr<CompareStrategy> comparator)
 
 namespace detail {
 
-Image readImage(const std::string& which, const std::string& path)
+std::unique_ptr<ImageReader> openImageReader(const std::string& which, const std::string& path)
 {
     try
     {
         const auto& codec = ImageCodec::getBestCodec(path);
-        return codec.read(path);
+        return codec.openReader(path);
     }
     catch (const std::exception & exc)
     {
@@ -37,17 +42,229 @@ Image readImage(const std::string& which, const std::string& path)
     }
 }
 
+LayeredImage readLayeredImage(const std::string& which, const std::string& path)
+{
+    try
+    {
+        const auto& codec = ImageCodec::getBestCodec(path);
+        return codec.readLayers(path);
+    }
+    catch (const std::exception & exc)
+    {
+        const auto msg =
+            "Failed to read " + which + " image from \""
+            + path + "\": " + exc.what();
+
+        throw ApprovalTests::ApprovalException(msg);
+    }
+}
+
+// name.<tag>.ext -> name<suffix>, e.g. name.received.png -> name.diff.png
+std::string getSiblingPath(const std::string& path, const std::string& tag, const std::string& suffix)
+{
+    const std::string extension = ApprovalTests::FileUtils::getExtensionWithDot(path);
+    std::string base = path.substr(0, path.size() - extension.size());
+
+    if (base.size() >= tag.size() && base.compare(base.size() - tag.size(), tag.size(), tag) == 0)
+    {
+        base.erase(base.size() - tag.size());
+    }
+
+    return base + suffix;
+}
+
+// Returns a note for the failure message
+std::string writeDiffImage(const std::string& receivedPath, const ImageView& diff)
+{
+    const std::string path = getSiblingPath(receivedPath, ".received", ".diff.png");
+
+    try
+    {
+#ifdef ImageApprovals_CONFIG_WITH_LIBPNG
+        PngImageCodec(PngCompression::Fastest).write(path, diff);
+#else
+        ImageCodec::getBestCodec(path).write(path, diff);
+#endif
+    }
+    catch (const std::exception& exc)
+    {
+        return " (could not write diff image: " + std::string(exc.what()) + ")";
+    }
+
+    return " (diff image: \"" + path + "\")";
+}
+
+// Reads name.mask.txt next to name.approved.ext; returns nullptr if there is no such file
+std::shared_ptr<const ToleranceMask> readToleranceMask(const std::string& approvedPath)
+{
+    const std::string path = getSiblingPath(approvedPath, ".approved", ".mask.txt");
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return nullptr;
+    }
+
+    try
+    {
+        std::ostringstream text;
+        text << file.rdbuf();
+
+        return std::make_shared<ToleranceMask>(ToleranceMask::deserialize(text.str()));
+    }
+    catch (const std::exception& exc)
+    {
+        throw ApprovalTests::ApprovalException("Failed to read tolerance mask from \"" + path + "\": " + exc.what());
+    }
+}
+
+std::string getLayerNames(const LayeredImage& image)
+{
+    std::string names;
+
+    for (size_t i = 0; i < image.getNumberOfLayers(); ++i)
+    {
+        names += (i == 0) ? "" : ", ";
+        names += "\"" + image.getLayer(i).name + "\"";
+    }
+
+    return "layers: " + names;
+}
+
+}
+
+ImageComparator& ImageComparator::setBandMemoryLimit(size_t maxBytes)
+{
+    m_bandMemoryLimit = maxBytes;
+    return *this;
+}
+
+ImageComparator& ImageComparator::setDiffImageAmplification(float amplification)
+{
+    if (!(amplification >= 0.0f))
+    {
+        throw ImageApprovalsError("Diff image amplification must not be negative");
+    }
+
+    m_diffAmplification = amplification;
+    return *this;
+}
+
+ImageComparator& ImageComparator::setToleranceMask(std::shared_ptr<const ToleranceMask> mask)
+{
+    m_toleranceMask = std::move(mask);
+    return *this;
 }
 
 bool ImageComparator::contentsAreEquivalent(std::string receivedPath, std::string approvedPath) const
 {
-    const Image receivedImg = detail::readImage("received", receivedPath);
-    const Image approvedImg = detail::readImage("approved", approvedPath);
+    // Both files are opened concurrently; the headers are compared before any pixels are read,
+    // and the pixels of both images are then decoded concurrently as well
+    std::unique_ptr<ImageReader> receivedReader, approvedReader;
+
+    detail::parallelInvoke(
+        [&]() { receivedReader = detail::openImageReader("received", receivedPath); },
+        [&]() { approvedReader = detail::openImageReader("approved", approvedPath); });
 
-    const auto result = m_compareStrategy->compare(approvedImg, receivedImg);
+    const size_t bandBytes
+        = (m_bandMemoryLimit != 0) ? m_bandMemoryLimit : std::numeric_limits<size_t>::max();
+
+    std::unique_ptr<DiffImageRenderer> diff;
+    if (m_diffAmplification > 0.0f && m_compareStrategy->rendersDiffImages()
+        && approvedReader->getSize() == receivedReader->getSize())
+    {
+        diff.reset(new DiffImageRenderer(approvedReader->getSize(), m_diffAmplification));
+    }
+
+    const auto toleranceMask = m_toleranceMask ? m_toleranceMask : detail::readToleranceMask(approvedPath);
+
+    CompareOptions options;
+    options.diff = diff.get();
+    options.toleranceMask = toleranceMask.get();
+
+    const auto result = m_compareStrategy->compare(*approvedReader, *receivedReader, bandBytes, options);
     if (!result.passed)
     {
-        throw ApprovalTests::ApprovalMismatchException(result.rightImageInfo, result.leftImageInfo);
+        std::string receivedInfo = result.getRightImageInfo();
+
+        if (diff && diff->isRendered())
+        {
+            receivedInfo += detail::writeDiffImage(receivedPath, diff->getImage());
+        }
+
+        throw ApprovalTests::ApprovalMismatchException(receivedInfo, result.getLeftImageInfo());
+    }
+
+    return true;
+}
+
+LayeredImageComparator::LayeredImageComparator()
+    : m_defaultStrategy(std::make_shared<ThresholdCompareStrategy>())
+{}
+
+LayeredImageComparator::LayeredImageComparator(std::shared_ptr<CompareStrategy> defaultStrategy)
+    : m_defaultStrategy(std::move(defaultStrategy))
+{}
+
+LayeredImageComparator& LayeredImageComparator::setLayerStrategy(
+    std::string layerName, std::shared_ptr<CompareStrategy> strategy)
+{
+    if (!strategy)
+    {
+        throw ImageApprovalsError("Layer compare strategy must not be null");
+    }
+
+    m_layerStrategies[std::move(layerName)] = std::move(strategy);
+    return *this;
+}
+
+const CompareStrategy& LayeredImageComparator::getStrategy(const std::string& layerName) const
+{
+    const auto it = m_layerStrategies.find(layerName);
+    return (it != m_layerStrategies.end()) ? *it->second : *m_defaultStrategy;
+}
+
+bool LayeredImageComparator::contentsAreEquivalent(std::string receivedPath, std::string approvedPath) const
+{
+    LayeredImage received, approved;
+
+    detail::parallelInvoke(
+        [&]() { received = detail::readLayeredImage("received", receivedPath); },
+        [&]() { approved = detail::readLayeredImage("approved", approvedPath); });
+
+    bool sameLayers = (received.getNumberOfLayers() == approved.getNumberOfLayers());
+
+    for (size_t i = 0; sameLayers && (i < approved.getNumberOfLayers()); ++i)
+    {
+        sameLayers = (received.findLayer(approved.getLayer(i).name) != nullptr);
+    }
+
+    if (!sameLayers)
+    {
+        throw ApprovalTests::ApprovalMismatchException(detail::getLayerNames(received), detail::getLayerNames(approved));
+    }
+
+    // Strategies split each image across threads, so layers are compared one after another
+    std::string receivedInfo;
+    std::string approvedInfo;
+
+    for (size_t i = 0; i < approved.getNumberOfLayers(); ++i)
+    {
+        const auto& approvedLayer = approved.getLayer(i);
+        const auto& receivedLayer = *received.findLayer(approvedLayer.name);
+
+        const auto result = getStrategy(approvedLayer.name).compare(approvedLayer.image, receivedLayer.image);
+        if (!result.passed)
+        {
+            const std::string separator = receivedInfo.empty() ? "" : "; ";
+            receivedInfo += separator + "layer \"" + approvedLayer.name + "\": " + result.getRightImageInfo();
+            approvedInfo += separator + "layer \"" + approvedLayer.name + "\": " + result.getLeftImageInfo();
+        }
+    }
+
+    if (!receivedInfo.empty())
+    {
+        throw ApprovalTests::ApprovalMismatchException(receivedInfo, approvedInfo);
     }
 
     return true;
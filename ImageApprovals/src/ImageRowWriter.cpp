@@ -0,0 +1,64 @@
+#include <ImageApprovals/ImageRowWriter.hpp>
+#include <ImageApprovals/Errors.hpp>
+
+namespace ImageApprovals {
+
+ImageRowWriter::ImageRowWriter(const PixelFormat& format, const ColorSpace& colorSpace, const Size& size)
+    : m_format(&format), m_colorSpace(&colorSpace), m_size(size)
+{
+    if (m_size.isZero())
+    {
+        throw ImageApprovalsError("Image size cannot be zero");
+    }
+}
+
+void ImageRowWriter::writeRows(const ImageView& rows)
+{
+    if (m_finished)
+    {
+        throw ImageApprovalsError("Cannot write rows after the image is finished");
+    }
+
+    if (rows.getPixelFormat() != *m_format || rows.getColorSpace() != *m_colorSpace)
+    {
+        throw ImageApprovalsError("Rows must have the pixel format and color space of the image");
+    }
+
+    const auto rowsSize = rows.getSize();
+
+    if (rowsSize.width != m_size.width)
+    {
+        throw ImageApprovalsError("Rows must have the width of the image");
+    }
+
+    if (rowsSize.height > m_size.height - m_numWrittenRows)
+    {
+        throw ImageApprovalsError("Too many rows written to the image");
+    }
+
+    if (rowsSize.height == 0)
+    {
+        return;
+    }
+
+    appendRows(m_numWrittenRows, rows);
+    m_numWrittenRows += rowsSize.height;
+}
+
+void ImageRowWriter::finish()
+{
+    if (m_finished)
+    {
+        return;
+    }
+
+    if (m_numWrittenRows != m_size.height)
+    {
+        throw ImageApprovalsError("Cannot finish an image before all rows are written");
+    }
+
+    finishFile();
+    m_finished = true;
+}
+
+}
@@ -14,7 +14,7 @@ std::ostream& operator <<(std::ostream& stream, const Size& size)
 }
 
 ImageView::ImageView(const PixelFormat& format, const ColorSpace& colorSpace,
-                     const Size& size, size_t rowStride, const uint8_t* data)
+                     const Size& size, std::ptrdiff_t rowStride, const uint8_t* data)
     : m_format(&format), m_colorSpace(&colorSpace), m_size(size),
       m_rowStride(rowStride), m_dataPtr(data)
 {}
@@ -75,7 +75,39 @@ const uint8_t* ImageView::getRowPointer(uint32_t index) const
         throw ImageApprovalsError("Row index out of range");
     }
 
-    return m_dataPtr + m_rowStride * index;
+    return m_dataPtr + m_rowStride * static_cast<std::ptrdiff_t>(index);
+}
+
+ImageView ImageView::flippedVertically() const
+{
+    if (isEmpty() || m_size.isZero())
+    {
+        return *this;
+    }
+
+    const auto lastRow = getRowPointer(m_size.height - 1);
+    return ImageView(*m_format, *m_colorSpace, m_size, -m_rowStride, lastRow);
+}
+
+ImageView ImageView::subView(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const
+{
+    if (x > m_size.width || width > m_size.width - x)
+    {
+        throw ImageApprovalsError("Sub-view exceeds the width of the view");
+    }
+
+    if (y > m_size.height || height > m_size.height - y)
+    {
+        throw ImageApprovalsError("Sub-view exceeds the height of the view");
+    }
+
+    const auto& fmt = getPixelFormat();
+
+    const uint8_t* dataPtr = m_dataPtr
+        + m_rowStride * static_cast<std::ptrdiff_t>(y)
+        + fmt.getPixelStride() * x;
+
+    return ImageView(fmt, getColorSpace(), Size(width, height), m_rowStride, dataPtr);
 }
 
 RGBA ImageView::getPixel(uint32_t x, uint32_t y) const
@@ -91,7 +123,7 @@ RGBA ImageView::getPixel(uint32_t x, uint32_t y) const
     const auto pixelStride = fmt.getPixelStride();
 
     RGBA value;
-    fmt.decode(rowPtr + pixelStride * x, rowPtr + m_rowStride, value);
+    fmt.decode(rowPtr + pixelStride * x, rowPtr + pixelStride * m_size.width, value);
     return value;
 }
 
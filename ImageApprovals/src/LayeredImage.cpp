@@ -0,0 +1,69 @@
+#include <ImageApprovals/LayeredImage.hpp>
+#include <ImageApprovals/Errors.hpp>
+
+namespace ImageApprovals {
+
+void LayeredImage::addLayer(std::string name, const ImageView& image, std::vector<std::string> channelNames)
+{
+    if (image.isEmpty())
+    {
+        throw ImageApprovalsError("Layer \"" + name + "\" is empty");
+    }
+
+    if (findLayer(name))
+    {
+        throw ImageApprovalsError("Duplicate layer \"" + name + "\"");
+    }
+
+    if (!channelNames.empty() && channelNames.size() != image.getPixelFormat().getNumberOfChannels())
+    {
+        throw ImageApprovalsError("Number of channel names does not match the pixel format of layer \"" + name + "\"");
+    }
+
+    Layer layer;
+    layer.name = std::move(name);
+    layer.channelNames = std::move(channelNames);
+    layer.image = image;
+
+    m_layers.push_back(std::move(layer));
+}
+
+void LayeredImage::addLayer(std::string name, Image&& image, std::vector<std::string> channelNames)
+{
+    m_ownedImages.emplace_back(new Image(std::move(image)));
+
+    try
+    {
+        addLayer(std::move(name), static_cast<const ImageView&>(*m_ownedImages.back()), std::move(channelNames));
+    }
+    catch (...)
+    {
+        m_ownedImages.pop_back();
+        throw;
+    }
+}
+
+const LayeredImage::Layer& LayeredImage::getLayer(size_t index) const
+{
+    if (index >= m_layers.size())
+    {
+        throw ImageApprovalsError("Layer index out of range");
+    }
+
+    return m_layers[index];
+}
+
+const LayeredImage::Layer* LayeredImage::findLayer(const std::string& name) const
+{
+    for (const auto& layer : m_layers)
+    {
+        if (layer.name == name)
+        {
+            return &layer;
+        }
+    }
+
+    return nullptr;
+}
+
+}
@@ -0,0 +1,237 @@
+#include "Parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace ImageApprovals { namespace detail {
+
+namespace {
+
+size_t getMaxNumThreads()
+{
+    const size_t numThreads = std::thread::hardware_concurrency();
+    return std::max<size_t>(numThreads, 1);
+}
+
+thread_local bool inParallelRegion = false;
+
+// Marks the current thread as running parallel work while the object lives
+class ParallelRegion
+{
+public:
+    ParallelRegion()
+        : m_outer(inParallelRegion)
+    {
+        inParallelRegion = true;
+    }
+
+    ~ParallelRegion() { inParallelRegion = m_outer; }
+
+    ParallelRegion(const ParallelRegion&) = delete;
+    ParallelRegion& operator =(const ParallelRegion&) = delete;
+
+private:
+    bool m_outer;
+};
+
+}
+
+void parallelFor(size_t count, size_t minRangeSize, const std::function<void(size_t, size_t)>& fn)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    minRangeSize = std::max<size_t>(minRangeSize, 1);
+
+    const size_t numRanges = std::min(getMaxNumThreads(), (count + minRangeSize - 1) / minRangeSize);
+    if (numRanges <= 1 || inParallelRegion)
+    {
+        fn(0, count);
+        return;
+    }
+
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+
+    auto runRange = [&](size_t rangeIndex) {
+        ParallelRegion region;
+
+        const size_t begin = (count * rangeIndex) / numRanges;
+        const size_t end = (count * (rangeIndex + 1)) / numRanges;
+
+        try
+        {
+            fn(begin, end);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!firstError)
+            {
+                firstError = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numRanges - 1);
+
+    for (size_t rangeIndex = 1; rangeIndex < numRanges; ++rangeIndex)
+    {
+        try
+        {
+            threads.emplace_back(runRange, rangeIndex);
+        }
+        catch (const std::system_error&)
+        {
+            runRange(rangeIndex);
+        }
+    }
+
+    runRange(0);
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    if (firstError)
+    {
+        std::rethrow_exception(firstError);
+    }
+}
+
+void parallelForEach(size_t count, size_t maxThreads, const std::function<void(size_t)>& fn)
+{
+    const size_t numThreads = std::min(std::max<size_t>(maxThreads, 1), count);
+    if (numThreads <= 1 || inParallelRegion)
+    {
+        for (size_t index = 0; index < count; ++index)
+        {
+            fn(index);
+        }
+
+        return;
+    }
+
+    std::atomic<size_t> nextIndex(0);
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+
+    auto runWorker = [&]() {
+        ParallelRegion region;
+
+        for (size_t index = nextIndex++; index < count; index = nextIndex++)
+        {
+            try
+            {
+                fn(index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!firstError)
+                {
+                    firstError = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+
+    for (size_t threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+    {
+        try
+        {
+            threads.emplace_back(runWorker);
+        }
+        catch (const std::system_error&)
+        {
+            break;
+        }
+    }
+
+    runWorker();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    if (firstError)
+    {
+        std::rethrow_exception(firstError);
+    }
+}
+
+void parallelInvoke(const std::function<void()>& first, const std::function<void()>& second)
+{
+    if (getMaxNumThreads() <= 1 || inParallelRegion)
+    {
+        first();
+        second();
+        return;
+    }
+
+    std::exception_ptr firstError;
+    std::exception_ptr secondError;
+
+    auto runSecond = [&]() {
+        ParallelRegion region;
+
+        try
+        {
+            second();
+        }
+        catch (...)
+        {
+            secondError = std::current_exception();
+        }
+    };
+
+    std::thread thread;
+
+    try
+    {
+        thread = std::thread(runSecond);
+    }
+    catch (const std::system_error&)
+    {
+        runSecond();
+    }
+
+    try
+    {
+        ParallelRegion region;
+        first();
+    }
+    catch (...)
+    {
+        firstError = std::current_exception();
+    }
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+
+    if (firstError)
+    {
+        std::rethrow_exception(firstError);
+    }
+
+    if (secondError)
+    {
+        std::rethrow_exception(secondError);
+    }
+}
+
+} }
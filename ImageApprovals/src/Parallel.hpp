@@ -0,0 +1,30 @@
+#ifndef IMAGEAPPROVALS_PARALLEL_HPP_INCLUDED
+#define IMAGEAPPROVALS_PARALLEL_HPP_INCLUDED
+
+#include <cstddef>
+#include <functional>
+
+namespace ImageApprovals { namespace detail {
+
+// All functions below run their work on the calling thread alone when called from work they
+// are already running in parallel, e.g. a compare inside a batch of verifications, so that
+// nested calls do not multiply the number of threads.
+
+// Splits [0, count) into contiguous ranges of at least minRangeSize items
+// and calls fn(begin, end) for each of them, on multiple threads if there
+// is enough work. The first exception thrown by fn is rethrown.
+void parallelFor(size_t count, size_t minRangeSize, const std::function<void(size_t, size_t)>& fn);
+
+// Calls fn(index) for every index in [0, count) on at most maxThreads threads,
+// each of which takes the next index as soon as it is done with the previous
+// one. The first exception thrown by fn is rethrown.
+void parallelForEach(size_t count, size_t maxThreads, const std::function<void(size_t)>& fn);
+
+// Calls first on the calling thread while second runs on another one, and
+// waits for both. An exception thrown by first takes precedence over one
+// thrown by second.
+void parallelInvoke(const std::function<void()>& first, const std::function<void()>& second);
+
+} }
+
+#endif // IMAGEAPPROVALS_PARALLEL_HPP_INCLUDED
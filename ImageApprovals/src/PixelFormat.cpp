@@ -1,163 +1,169 @@
 #include <ImageApprovals/PixelFormat.hpp>
+#include <ImageApprovals/PixelFormatTraits.hpp>
 #include <ImageApprovals/Errors.hpp>
-#include <algorithm>
 #include <stdexcept>
-#include <cstring>
 #include <ostream>
-#include <array>
+#include <type_traits>
 
 namespace ImageApprovals {
 
 namespace detail {
 
-float clamp(float x, float minX, float maxX)
+template<typename Traits>
+struct TraitsPixelFormat : PixelFormat
 {
-    return std::min(maxX, std::max(minX, x));
-}
+    const char* getName() const override { return Traits::getName(); }
 
-template<typename T, size_t N>
-std::array<float, N> normalize(const std::array<T, N>& src, float maxValue)
-{
-    std::array<float, N> dst;
+    size_t getNumberOfChannels() const override { return Traits::numChannels; }
+    size_t getPixelStride() const override { return Traits::pixelStride; }
+
+    bool isU8() const override { return std::is_same<typename Traits::ChannelType, uint8_t>::value; }
+    bool isU16() const override { return std::is_same<typename Traits::ChannelType, uint16_t>::value; }
+    bool isF32() const override { return std::is_same<typename Traits::ChannelType, float>::value; }
 
-    for (size_t i = 0; i < N; ++i)
+    void decode(const uint8_t* begin, RGBA& outRgba) const override
     {
-        dst[i] = clamp(src[i] / maxValue, 0.0f, 1.0f);
+        outRgba = Traits::decode(begin);
     }
+};
 
-    return dst;
 }
 
-template<size_t NumChannels, typename ChannelType>
-struct GenericPixelFormat : PixelFormat
+const uint8_t* PixelFormat::decode(const uint8_t* begin, const uint8_t* end, RGBA& outRgba) const
 {
-    size_t getNumberOfChannels() const override { return NumChannels; }
-    size_t getPixelStride() const override { return NumChannels * sizeof(ChannelType); }
-
-    bool isU8() const override { return std::is_same<ChannelType, uint8_t>::value; }
-    bool isF32() const override { return std::is_same<ChannelType, float>::value; }
-
-    std::array<ChannelType, NumChannels> decodeBytes(const uint8_t* src) const
+    const auto stride = getPixelStride();
+    if (begin + stride > end)
     {
-        std::array<ChannelType, NumChannels> dst;
-        std::memcpy(dst.data(), src, NumChannels * sizeof(ChannelType));
-        return dst;
+        throw ImageApprovalsError("begin + stride > end");
     }
-};
 
-struct GrayU8PixelFormat : GenericPixelFormat<1, uint8_t>
-{
-    const char* getName() const override { return "GrayU8"; }
+    decode(begin, outRgba);
+    return begin + stride;
+}
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
-    {
-        const auto v = normalize(decodeBytes(begin), 255.0f)[0];
-        outRgba = RGBA(v, v, v, 1);
-    }
-};
+const PixelFormat& PixelFormat::getGrayU8()
+{
+    static const detail::TraitsPixelFormat<GrayU8Traits> instance;
+    return instance;
+}
 
-struct GrayAlphaU8PixelFormat : GenericPixelFormat<2, uint8_t>
+const PixelFormat& PixelFormat::getGrayAlphaU8()
 {
-    const char* getName() const override { return "GrayAlphaU8"; }
+    static const detail::TraitsPixelFormat<GrayAlphaU8Traits> instance;
+    return instance;
+}
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
-    {
-        const auto v = normalize(decodeBytes(begin), 255.0f);
-        outRgba = RGBA(v[0], v[0], v[0], v[1]);
-    }
-};
+const PixelFormat& PixelFormat::getRgbU8()
+{
+    static const detail::TraitsPixelFormat<RgbU8Traits> instance;
+    return instance;
+}
 
-struct RgbU8PixelFormat : GenericPixelFormat<3, uint8_t>
+const PixelFormat& PixelFormat::getRgbAlphaU8()
 {
-    const char* getName() const override { return "RgbU8"; }
+    static const detail::TraitsPixelFormat<RgbAlphaU8Traits> instance;
+    return instance;
+}
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
-    {
-        const auto v = normalize(decodeBytes(begin), 255.0f);
-        outRgba = RGBA(v[0], v[1], v[2], 1);
-    }
-};
+const PixelFormat& PixelFormat::getBgrU8()
+{
+    static const detail::TraitsPixelFormat<BgrU8Traits> instance;
+    return instance;
+}
 
-struct RgbAlphaU8PixelFormat : GenericPixelFormat<4, uint8_t>
+const PixelFormat& PixelFormat::getBgrAlphaU8()
 {
-    const char* getName() const override { return "RgbAlphaU8"; }
+    static const detail::TraitsPixelFormat<BgrAlphaU8Traits> instance;
+    return instance;
+}
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
-    {
-        const auto v = normalize(decodeBytes(begin), 255.0f);
-        outRgba = RGBA(v[0], v[1], v[2], v[3]);
-    }
-};
+const PixelFormat& PixelFormat::getAlphaRgbU8()
+{
+    static const detail::TraitsPixelFormat<AlphaRgbU8Traits> instance;
+    return instance;
+}
 
-struct RgbF32PixelFormat : GenericPixelFormat<3, float>
+const PixelFormat& PixelFormat::getGrayAlphaU8Premultiplied()
 {
-    const char* getName() const override { return "RgbF32"; }
+    static const detail::TraitsPixelFormat<GrayAlphaU8PremultipliedTraits> instance;
+    return instance;
+}
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
-    {
-        const auto v = decodeBytes(begin);
-        outRgba = RGBA(v[0], v[1], v[2], 1);
-    }
-};
+const PixelFormat& PixelFormat::getRgbAlphaU8Premultiplied()
+{
+    static const detail::TraitsPixelFormat<RgbAlphaU8PremultipliedTraits> instance;
+    return instance;
+}
 
-struct RgbAlphaF32PixelFormat : GenericPixelFormat<4, float>
+const PixelFormat& PixelFormat::getBgrAlphaU8Premultiplied()
 {
-    const char* getName() const override { return "RgbAlphaF32"; }
+    static const detail::TraitsPixelFormat<BgrAlphaU8PremultipliedTraits> instance;
+    return instance;
+}
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
-    {
-        const auto v = decodeBytes(begin);
-        outRgba = RGBA(v[0], v[1], v[2], v[3]);
-    }
-};
+const PixelFormat& PixelFormat::getAlphaRgbU8Premultiplied()
+{
+    static const detail::TraitsPixelFormat<AlphaRgbU8PremultipliedTraits> instance;
+    return instance;
+}
 
+const PixelFormat& PixelFormat::getGrayU16()
+{
+    static const detail::TraitsPixelFormat<GrayU16Traits> instance;
+    return instance;
 }
 
-const uint8_t* PixelFormat::decode(const uint8_t* begin, const uint8_t* end, RGBA& outRgba) const
+const PixelFormat& PixelFormat::getGrayAlphaU16()
 {
-    const auto stride = getPixelStride();
-    if (begin + stride > end)
-    {
-        throw ImageApprovalsError("begin + stride > end");
-    }
+    static const detail::TraitsPixelFormat<GrayAlphaU16Traits> instance;
+    return instance;
+}
 
-    decode(begin, outRgba);
-    return begin + stride;
+const PixelFormat& PixelFormat::getRgbU16()
+{
+    static const detail::TraitsPixelFormat<RgbU16Traits> instance;
+    return instance;
 }
 
-const PixelFormat& PixelFormat::getGrayU8()
+const PixelFormat& PixelFormat::getRgbAlphaU16()
 {
-    static const detail::GrayU8PixelFormat instance;
+    static const detail::TraitsPixelFormat<RgbAlphaU16Traits> instance;
     return instance;
 }
 
-const PixelFormat& PixelFormat::getGrayAlphaU8()
+const PixelFormat& PixelFormat::getRgbAlphaU16Premultiplied()
 {
-    static const detail::GrayAlphaU8PixelFormat instance;
+    static const detail::TraitsPixelFormat<RgbAlphaU16PremultipliedTraits> instance;
     return instance;
 }
 
-const PixelFormat& PixelFormat::getRgbU8()
+const PixelFormat& PixelFormat::getGrayF32()
 {
-    static const detail::RgbU8PixelFormat instance;
+    static const detail::TraitsPixelFormat<GrayF32Traits> instance;
     return instance;
 }
 
-const PixelFormat& PixelFormat::getRgbAlphaU8()
+const PixelFormat& PixelFormat::getGrayAlphaF32()
 {
-    static const detail::RgbAlphaU8PixelFormat instance;
+    static const detail::TraitsPixelFormat<GrayAlphaF32Traits> instance;
     return instance;
 }
 
 const PixelFormat& PixelFormat::getRgbF32()
 {
-    static const detail::RgbF32PixelFormat instance;
+    static const detail::TraitsPixelFormat<RgbF32Traits> instance;
     return instance;
 }
 
 const PixelFormat& PixelFormat::getRgbAlphaF32()
 {
-    static const detail::RgbAlphaF32PixelFormat instance;
+    static const detail::TraitsPixelFormat<RgbAlphaF32Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getRgbAlphaF32Premultiplied()
+{
+    static const detail::TraitsPixelFormat<RgbAlphaF32PremultipliedTraits> instance;
     return instance;
 }
 
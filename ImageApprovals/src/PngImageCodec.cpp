@@ -2,12 +2,16 @@
 
 #include "PngImageCodec.hpp"
 #include "ColorSpaceUtils.hpp"
+#include <ImageApprovals/Conversion.hpp>
 #include <ImageApprovals/Errors.hpp>
 #include <png.h>
+#include <zlib.h>
 #include <functional>
 #include <cstring>
 #include <istream>
+#include <memory>
 #include <ostream>
+#include <vector>
 
 namespace ImageApprovals { namespace detail {
 
@@ -50,6 +54,32 @@ void PNGCBAPI flush(png_struct* png)
     stream.flush();
 }
 
+struct MemorySource
+{
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+};
+
+void PNGCBAPI readMemoryBytes(png_struct* png, png_byte* data, size_t len)
+{
+    auto& source = *reinterpret_cast<MemorySource*>(png_get_io_ptr(png));
+
+    if (len > source.size - source.pos)
+    {
+        png_error(png, "Not enough data");
+    }
+
+    std::memcpy(data, source.data + source.pos, len);
+    source.pos += len;
+}
+
+void PNGCBAPI appendBytes(png_struct* png, png_byte* data, size_t len)
+{
+    auto& sink = *reinterpret_cast<std::vector<uint8_t>*>(png_get_io_ptr(png));
+    sink.insert(sink.end(), data, data + len);
+}
+
 const ColorSpace* detectColorSpace(png_struct* png, png_info* info)
 {
     int intent = -1;
@@ -113,145 +143,465 @@ void writePngComment(png_struct* png, png_info* info)
     png_set_text(png, info, &text, 1);
 }
 
+// PNG stores 16-bit samples in big-endian order, 16-bit pixel formats use native order
+bool isHostLittleEndian()
+{
+    const uint16_t probe = 1;
+    uint8_t firstByte = 0;
+    std::memcpy(&firstByte, &probe, 1);
+    return firstByte == 1;
 }
 
-std::string PngImageCodec::getFileExtensionWithDot() const
+// PNG stores straight alpha, so premultiplied images are written through their straight counterpart
+const PixelFormat* getPngStraightAlphaFormat(const PixelFormat& fmt)
 {
-    return ".png";
+    if (fmt == PixelFormat::getGrayAlphaU8Premultiplied())
+    {
+        return &PixelFormat::getGrayAlphaU8();
+    }
+
+    if (fmt == PixelFormat::getRgbAlphaU8Premultiplied())
+    {
+        return &PixelFormat::getRgbAlphaU8();
+    }
+
+    if (fmt == PixelFormat::getBgrAlphaU8Premultiplied())
+    {
+        return &PixelFormat::getBgrAlphaU8();
+    }
+
+    if (fmt == PixelFormat::getAlphaRgbU8Premultiplied())
+    {
+        return &PixelFormat::getAlphaRgbU8();
+    }
+
+    if (fmt == PixelFormat::getRgbAlphaU16Premultiplied())
+    {
+        return &PixelFormat::getRgbAlphaU16();
+    }
+
+    return nullptr;
 }
 
-int PngImageCodec::getScore(const std::string& extensionWithDot) const
+// Returns the color type of PNG files storing the format, and the transforms mapping its channel order
+void getPngColorType(const PixelFormat& fmt, int& pngColorType, int& pngTransforms)
 {
-    if(extensionWithDot == ".png")
+    pngTransforms = PNG_TRANSFORM_IDENTITY;
+
+    if (fmt == PixelFormat::getGrayU8() || fmt == PixelFormat::getGrayU16())
     {
-        return 100;
+        pngColorType = PNG_COLOR_TYPE_GRAY;
+    }
+    else if (fmt == PixelFormat::getGrayAlphaU8() || fmt == PixelFormat::getGrayAlphaU16())
+    {
+        pngColorType = PNG_COLOR_TYPE_GRAY_ALPHA;
+    }
+    else if (fmt == PixelFormat::getRgbU8() || fmt == PixelFormat::getRgbU16())
+    {
+        pngColorType = PNG_COLOR_TYPE_RGB;
+    }
+    else if (fmt == PixelFormat::getRgbAlphaU8() || fmt == PixelFormat::getRgbAlphaU16())
+    {
+        pngColorType = PNG_COLOR_TYPE_RGB_ALPHA;
+    }
+    else if (fmt == PixelFormat::getBgrU8())
+    {
+        pngColorType = PNG_COLOR_TYPE_RGB;
+        pngTransforms = PNG_TRANSFORM_BGR;
+    }
+    else if (fmt == PixelFormat::getBgrAlphaU8())
+    {
+        pngColorType = PNG_COLOR_TYPE_RGB_ALPHA;
+        pngTransforms = PNG_TRANSFORM_BGR;
+    }
+    else if (fmt == PixelFormat::getAlphaRgbU8())
+    {
+        pngColorType = PNG_COLOR_TYPE_RGB_ALPHA;
+        pngTransforms = PNG_TRANSFORM_SWAP_ALPHA;
+    }
+    else
+    {
+        throw ImageApprovalsError("Unexpected pixel format");
     }
 
-    return -1;
+    if (fmt.isU16() && isHostLittleEndian())
+    {
+        pngTransforms |= PNG_TRANSFORM_SWAP_ENDIAN;
+    }
 }
 
-int PngImageCodec::getScore(const PixelFormat& pf, const ColorSpace& cs) const
+const PixelFormat& getPngPixelFormat(int pngBitDepth, int pngColorType)
 {
-    if(!pf.isU8())
+    if (pngBitDepth != 8 && pngBitDepth != 16)
     {
-        return -1;
+        throw ImageApprovalsError("Unsupported PNG bit depth");
     }
 
-    if(cs != ColorSpace::getSRgb() && cs != ColorSpace::getLinearSRgb())
+    const bool is16Bit = (pngBitDepth == 16);
+
+    switch (pngColorType)
     {
-        return -1;
+    case PNG_COLOR_TYPE_GRAY:
+        return is16Bit ? PixelFormat::getGrayU16() : PixelFormat::getGrayU8();
+    case PNG_COLOR_TYPE_GRAY_ALPHA:
+        return is16Bit ? PixelFormat::getGrayAlphaU16() : PixelFormat::getGrayAlphaU8();
+    case PNG_COLOR_TYPE_RGB:
+        return is16Bit ? PixelFormat::getRgbU16() : PixelFormat::getRgbU8();
+    case PNG_COLOR_TYPE_RGB_ALPHA:
+        return is16Bit ? PixelFormat::getRgbAlphaU16() : PixelFormat::getRgbAlphaU8();
+    default:
+        throw ImageApprovalsError("Unsupported PNG color type");
     }
-
-    return 100;
 }
 
-Image PngImageCodec::readFromStream(std::istream& stream, const std::string&) const
+struct PngReadStructs
 {
-    Image image;
     png_struct* png = nullptr;
     png_info* info = nullptr;
 
-    OnExit onExit([&]() {
-        if (png)
+    PngReadStructs()
+    {
+        if (!(png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr)))
         {
-            png_destroy_read_struct(&png, info ? &info : nullptr, nullptr);
+            throw ImageApprovalsError("Failed to allocate PNG read struct");
         }
-    });
 
-    if (!(png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr)))
+        if (!(info = png_create_info_struct(png)))
+        {
+            png_destroy_read_struct(&png, nullptr, nullptr);
+            throw ImageApprovalsError("Failed to allocate PNG info struct");
+        }
+    }
+
+    PngReadStructs(const PngReadStructs&) = delete;
+
+    ~PngReadStructs() noexcept
     {
-        throw ImageApprovalsError("Failed to allocate PNG read struct");
+        png_destroy_read_struct(&png, &info, nullptr);
     }
-        
-    if (!(info = png_create_info_struct(png)))
+};
+
+struct PngWriteStructs
+{
+    png_struct* png = nullptr;
+    png_info* info = nullptr;
+
+    PngWriteStructs()
     {
-        throw ImageApprovalsError("Failed to allocate PNG info struct");
+        if (!(png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr)))
+        {
+            throw ImageApprovalsError("Failed to allocate PNG write struct");
+        }
+
+        if (!(info = png_create_info_struct(png)))
+        {
+            png_destroy_write_struct(&png, nullptr);
+            throw ImageApprovalsError("Failed to allocate PNG info struct");
+        }
     }
 
-    if (setjmp(png_jmpbuf(png)))
+    PngWriteStructs(const PngWriteStructs&) = delete;
+
+    ~PngWriteStructs() noexcept
     {
-        throw ImageApprovalsError("Failed to read PNG image");
+        png_destroy_write_struct(&png, &info);
     }
+};
 
-    png_set_read_fn(png, &stream, &readBytes);
+// Decodes rows with png_read_row; reading rows above the last one read starts over from the beginning of the file
+class PngRowReader : public ImageReader
+{
+public:
+    explicit PngRowReader(std::unique_ptr<std::istream> stream)
+        : m_stream(std::move(stream)), m_start(m_stream->tellg())
+    {
+        start();
+    }
 
-    png_read_png(png, info, 0, nullptr);
+    bool isInterlaced() const { return m_interlaced; }
 
-    const PixelFormat* format = nullptr;
-    const Size imgSize{ png_get_image_width(png, info), png_get_image_height(png, info) };
+    // Returns the stream positioned at the start of the file
+    std::unique_ptr<std::istream> releaseStream()
+    {
+        m_structs.reset();
+        m_stream->clear();
+        m_stream->seekg(m_start);
+        return std::move(m_stream);
+    }
 
-    const int pngBitDepth = png_get_bit_depth(png, info);
-    const int pngColorType = png_get_color_type(png, info);
+    const PixelFormat& getPixelFormat() const override { return *m_format; }
+    const ColorSpace& getColorSpace() const override { return *m_colorSpace; }
+    Size getSize() const override { return m_size; }
 
-    if (pngBitDepth != 8)
+    Image readRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) override
     {
-        throw ImageApprovalsError("Unsupported PNG bit depth");
+        if (x > m_size.width || width > m_size.width - x || y > m_size.height || height > m_size.height - y)
+        {
+            throw ImageApprovalsError("Region exceeds the image");
+        }
+
+        if (y < m_nextRow)
+        {
+            start();
+        }
+
+        Image rows(*m_format, *m_colorSpace, Size(m_size.width, height));
+        png_struct* png = m_structs->png;
+
+        if (setjmp(png_jmpbuf(png)))
+        {
+            throw ImageApprovalsError("Failed to read PNG image");
+        }
+
+        for (; m_nextRow < y; ++m_nextRow)
+        {
+            png_read_row(png, m_skippedRow.data(), nullptr);
+        }
+
+        for (uint32_t row = 0; row < height; ++row, ++m_nextRow)
+        {
+            png_read_row(png, rows.getRowPointer(row), nullptr);
+        }
+
+        if (x == 0 && width == m_size.width)
+        {
+            return rows;
+        }
+
+        return rows.subView(x, 0, width, height).copy();
     }
 
-    switch (pngColorType)
+private:
+    void start()
     {
-    case PNG_COLOR_TYPE_GRAY:
-        format = &PixelFormat::getGrayU8();
-        break;
-    case PNG_COLOR_TYPE_GRAY_ALPHA:
-        format = &PixelFormat::getGrayAlphaU8();
-        break;
-    case PNG_COLOR_TYPE_RGB:
-        format = &PixelFormat::getRgbU8();
-        break;
-    case PNG_COLOR_TYPE_RGB_ALPHA:
-        format = &PixelFormat::getRgbAlphaU8();
-        break;
-    default:
-        throw ImageApprovalsError("Unsupported PNG color type");
+        m_structs.reset();
+        m_stream->clear();
+        m_stream->seekg(m_start);
+
+        m_structs.reset(new PngReadStructs());
+        m_nextRow = 0;
+
+        png_struct* png = m_structs->png;
+        png_info* info = m_structs->info;
+
+        if (setjmp(png_jmpbuf(png)))
+        {
+            throw ImageApprovalsError("Failed to read PNG image");
+        }
+
+        png_set_read_fn(png, m_stream.get(), &readBytes);
+        png_read_info(png, info);
+
+        m_format = &getPngPixelFormat(png_get_bit_depth(png, info), png_get_color_type(png, info));
+        m_size = Size(png_get_image_width(png, info), png_get_image_height(png, info));
+        m_interlaced = (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE);
+
+        if (!(m_colorSpace = detectColorSpace(png, info)))
+        {
+            throw ImageApprovalsError("Unknown color space");
+        }
+
+        if (m_format->isU16() && isHostLittleEndian())
+        {
+            png_set_swap(png);
+        }
+
+        png_read_update_info(png, info);
+
+        m_skippedRow.resize(m_format->getPixelStride() * m_size.width);
     }
 
-    const ColorSpace* colorSpace = detectColorSpace(png, info);
-    if (!colorSpace)
+    std::unique_ptr<std::istream> m_stream;
+    std::streampos m_start;
+    std::unique_ptr<PngReadStructs> m_structs;
+    const PixelFormat* m_format = nullptr;
+    const ColorSpace* m_colorSpace = nullptr;
+    Size m_size;
+    bool m_interlaced = false;
+    uint32_t m_nextRow = 0;
+    std::vector<png_byte> m_skippedRow;
+};
+
+class PngRowWriter : public ImageRowWriter
+{
+public:
+    PngRowWriter(std::ostream& stream, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size,
+                 PngCompression compression)
+        : ImageRowWriter(format, colorSpace, size), m_ioPtr(&stream), m_writeFn(&writeBytes), m_flushFn(&flush)
     {
-        throw ImageApprovalsError("Unknown color space");
+        start(compression);
     }
 
-    image = Image(*format, *colorSpace, imgSize);
+    PngRowWriter(std::unique_ptr<std::ostream> stream, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size,
+                 PngCompression compression)
+        : ImageRowWriter(format, colorSpace, size), m_ownedStream(std::move(stream))
+        , m_ioPtr(m_ownedStream.get()), m_writeFn(&writeBytes), m_flushFn(&flush)
+    {
+        start(compression);
+    }
 
-    png_byte** rowPointers = png_get_rows(png, info);
-    const size_t rowSize = format->getPixelStride() * imgSize.width;
-    for (uint32_t y = 0; y < imgSize.height; ++y)
+    // Appends the encoded file to data
+    PngRowWriter(std::vector<uint8_t>& data, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size,
+                 PngCompression compression)
+        : ImageRowWriter(format, colorSpace, size), m_ioPtr(&data), m_writeFn(&appendBytes), m_flushFn(nullptr)
     {
-        const png_byte* srcRow = rowPointers[y];
-        uint8_t* dstRow = image.getRowPointer(y);
-        std::memcpy(dstRow, srcRow, rowSize);
+        start(compression);
     }
 
-    return image;
-}
+protected:
+    void appendRows(uint32_t, const ImageView& rows) override
+    {
+        // PNG stores straight alpha, so premultiplied rows are written through their straight counterpart
+        if (m_straightFormat)
+        {
+            writePngRows(convert(rows, *m_straightFormat, rows.getColorSpace()));
+            return;
+        }
 
-void PngImageCodec::writeToStream(const ImageView& image, std::ostream& stream, const std::string&) const
-{
-    const auto& fmt = image.getPixelFormat();
+        writePngRows(rows);
+    }
 
-    if (!fmt.isU8())
+    void finishFile() override
     {
-        throw ImageApprovalsError("Unable to write the image to PNG file");
+        png_struct* png = m_structs.png;
+
+        if (setjmp(png_jmpbuf(png)))
+        {
+            throw ImageApprovalsError("Failed to write PNG image");
+        }
+
+        png_write_end(png, nullptr);
+
+        if (m_flushFn)
+        {
+            m_flushFn(png);
+        }
     }
 
+private:
+    void start(PngCompression compression)
+    {
+        const auto& fmt = getPixelFormat();
+
+        if (!fmt.isU8() && !fmt.isU16())
+        {
+            throw ImageApprovalsError("Unable to write the image to PNG file");
+        }
+
+        m_straightFormat = getPngStraightAlphaFormat(fmt);
+
+        int pngColorType = 0;
+        int pngTransforms = PNG_TRANSFORM_IDENTITY;
+        getPngColorType(m_straightFormat ? *m_straightFormat : fmt, pngColorType, pngTransforms);
+
+        png_struct* png = m_structs.png;
+        png_info* info = m_structs.info;
+
+        if (setjmp(png_jmpbuf(png)))
+        {
+            throw ImageApprovalsError("Failed to write PNG image");
+        }
+
+        png_set_write_fn(png, m_ioPtr, m_writeFn, m_flushFn);
+
+        if (compression == PngCompression::Fastest)
+        {
+            // Without filtering, run-length encoding is enough for mostly uniform images, such as diff images
+            png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+            png_set_compression_level(png, Z_BEST_SPEED);
+            png_set_compression_strategy(png, Z_RLE);
+        }
+
+        const auto sz = getSize();
+        png_set_IHDR(
+            png, info, sz.width, sz.height,
+            fmt.isU16() ? 16 : 8, pngColorType,
+            PNG_INTERLACE_NONE,
+            PNG_COMPRESSION_TYPE_DEFAULT,
+            PNG_FILTER_TYPE_DEFAULT);
+
+        if (getColorSpace() == ColorSpace::getSRgb())
+        {
+            png_set_sRGB_gAMA_and_cHRM(png, info, PNG_sRGB_INTENT_RELATIVE);
+        }
+        else if (getColorSpace() == ColorSpace::getLinearSRgb())
+        {
+            png_set_gAMA(png, info, 1.0);
+
+            const auto p = RgbPrimaries::getSRgbPrimaries();
+            png_set_cHRM(
+                png, info,
+                0.3127, 0.3291,
+                p.r.x, p.r.y,
+                p.g.x, p.g.y,
+                p.b.x, p.b.y);
+        }
+        else
+        {
+            throw ImageApprovalsError("Unsupported ColorSpace");
+        }
+
+        writePngComment(png, info);
+
+        png_write_info(png, info);
+
+        if (pngTransforms & PNG_TRANSFORM_BGR)
+        {
+            png_set_bgr(png);
+        }
+
+        if (pngTransforms & PNG_TRANSFORM_SWAP_ALPHA)
+        {
+            png_set_swap_alpha(png);
+        }
+
+        if (pngTransforms & PNG_TRANSFORM_SWAP_ENDIAN)
+        {
+            png_set_swap(png);
+        }
+    }
+
+    void writePngRows(const ImageView& rows)
+    {
+        png_struct* png = m_structs.png;
+
+        if (setjmp(png_jmpbuf(png)))
+        {
+            throw ImageApprovalsError("Failed to write PNG image");
+        }
+
+        for (uint32_t y = 0; y < rows.getSize().height; ++y)
+        {
+            png_write_row(png, rows.getRowPointer(y));
+        }
+    }
+
+    std::unique_ptr<std::ostream> m_ownedStream;
+    void* m_ioPtr;
+    png_rw_ptr m_writeFn;
+    png_flush_ptr m_flushFn;
+    PngWriteStructs m_structs;
+    const PixelFormat* m_straightFormat = nullptr;
+};
+
+Image readPng(void* ioPtr, png_rw_ptr readFn)
+{
+    Image image;
     png_struct* png = nullptr;
     png_info* info = nullptr;
-        
-    std::unique_ptr<png_const_bytep[]> rowPointers;
 
     OnExit onExit([&]() {
         if (png)
         {
-            png_destroy_write_struct(&png, info ? &info : nullptr);
+            png_destroy_read_struct(&png, info ? &info : nullptr, nullptr);
         }
     });
 
-    if (!(png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr)))
+    if (!(png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr)))
     {
-        throw ImageApprovalsError("Failed to allocate PNG write struct");
+        throw ImageApprovalsError("Failed to allocate PNG read struct");
     }
-
+        
     if (!(info = png_create_info_struct(png)))
     {
         throw ImageApprovalsError("Failed to allocate PNG info struct");
@@ -259,73 +609,114 @@ void PngImageCodec::writeToStream(const ImageView& image, std::ostream& stream,
 
     if (setjmp(png_jmpbuf(png)))
     {
-        throw ImageApprovalsError("Failed to write PNG image");
+        throw ImageApprovalsError("Failed to read PNG image");
     }
 
-    png_set_write_fn(png, &stream, &writeBytes, &flush);
+    png_set_read_fn(png, ioPtr, readFn);
 
-    int pngColorType = 0;
-    if (fmt == PixelFormat::getGrayU8())
-    {
-        pngColorType = PNG_COLOR_TYPE_GRAY;
-    }
-    else if (fmt == PixelFormat::getGrayAlphaU8())
-    {
-        pngColorType = PNG_COLOR_TYPE_GRAY_ALPHA;
-    }
-    else if (fmt == PixelFormat::getRgbU8())
+    png_read_png(png, info, isHostLittleEndian() ? PNG_TRANSFORM_SWAP_ENDIAN : PNG_TRANSFORM_IDENTITY, nullptr);
+
+    const Size imgSize{ png_get_image_width(png, info), png_get_image_height(png, info) };
+    const PixelFormat* format = &getPngPixelFormat(png_get_bit_depth(png, info), png_get_color_type(png, info));
+
+    const ColorSpace* colorSpace = detectColorSpace(png, info);
+    if (!colorSpace)
     {
-        pngColorType = PNG_COLOR_TYPE_RGB;
+        throw ImageApprovalsError("Unknown color space");
     }
-    else if (fmt == PixelFormat::getRgbAlphaU8())
+
+    image = Image(*format, *colorSpace, imgSize);
+
+    png_byte** rowPointers = png_get_rows(png, info);
+    const size_t rowSize = format->getPixelStride() * imgSize.width;
+    for (uint32_t y = 0; y < imgSize.height; ++y)
     {
-        pngColorType = PNG_COLOR_TYPE_RGB_ALPHA;
+        const png_byte* srcRow = rowPointers[y];
+        uint8_t* dstRow = image.getRowPointer(y);
+        std::memcpy(dstRow, srcRow, rowSize);
     }
-    else
+
+    return image;
+}
+}
+
+PngImageCodec::PngImageCodec(PngCompression compression)
+    : m_compression(compression)
+{}
+
+std::string PngImageCodec::getFileExtensionWithDot() const
+{
+    return ".png";
+}
+
+int PngImageCodec::getScore(const std::string& extensionWithDot) const
+{
+    if(extensionWithDot == ".png")
     {
-        throw ImageApprovalsError("Unexpected pixel format");
+        return 100;
     }
 
-    const auto sz = image.getSize();
-    png_set_IHDR(
-        png, info, sz.width, sz.height,
-        8, pngColorType,
-        PNG_INTERLACE_NONE,
-        PNG_COMPRESSION_TYPE_DEFAULT,
-        PNG_FILTER_TYPE_DEFAULT);
+    return -1;
+}
 
-    if (image.getColorSpace() == ColorSpace::getSRgb())
+int PngImageCodec::getScore(const PixelFormat& pf, const ColorSpace& cs) const
+{
+    if(!pf.isU8() && !pf.isU16())
     {
-        png_set_sRGB_gAMA_and_cHRM(png, info, PNG_sRGB_INTENT_RELATIVE);
+        return -1;
     }
-    else if (image.getColorSpace() == ColorSpace::getLinearSRgb())
-    {
-        png_set_gAMA(png, info, 1.0);
 
-        const auto p = RgbPrimaries::getSRgbPrimaries();
-        png_set_cHRM(
-            png, info,
-            0.3127, 0.3291,
-            p.r.x, p.r.y,
-            p.g.x, p.g.y,
-            p.b.x, p.b.y);
-    }
-    else
+    if(cs != ColorSpace::getSRgb() && cs != ColorSpace::getLinearSRgb())
     {
-        throw ImageApprovalsError("Unsupported ColorSpace");
+        return -1;
     }
 
-    writePngComment(png, info);
+    return 100;
+}
+
+Image PngImageCodec::readFromStream(std::istream& stream, const std::string&) const
+{
+    return readPng(&stream, &readBytes);
+}
 
-    rowPointers.reset(new png_const_bytep[sz.height]);
-    for (uint32_t y = 0; y < sz.height; ++y)
+Image PngImageCodec::decodeFromMemory(const uint8_t* data, size_t size) const
+{
+    MemorySource source{ data, size, 0 };
+    return readPng(&source, &readMemoryBytes);
+}
+
+void PngImageCodec::encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const
+{
+    PngRowWriter writer(data, image.getPixelFormat(), image.getColorSpace(), image.getSize(), m_compression);
+    writer.writeRows(image);
+    writer.finish();
+}
+
+void PngImageCodec::writeToStream(const ImageView& image, std::ostream& stream, const std::string&) const
+{
+    PngRowWriter writer(stream, image.getPixelFormat(), image.getColorSpace(), image.getSize(), m_compression);
+    writer.writeRows(image);
+    writer.finish();
+}
+
+std::unique_ptr<ImageReader> PngImageCodec::openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const
+{
+    std::unique_ptr<PngRowReader> reader(new PngRowReader(std::move(stream)));
+
+    // Rows of interlaced images are complete only after the last pass
+    if (reader->isInterlaced())
     {
-        rowPointers[y] = reinterpret_cast<const png_byte*>(image.getRowPointer(y));
+        return ImageCodec::openReaderForStream(reader->releaseStream(), fileName);
     }
 
-    png_set_rows(png, info, const_cast<png_bytepp>(rowPointers.get()));
+    return std::unique_ptr<ImageReader>(reader.release());
+}
 
-    png_write_png(png, info, 0, nullptr);
+std::unique_ptr<ImageRowWriter> PngImageCodec::openRowWriterForStream(
+    std::unique_ptr<std::ostream> stream, const std::string&,
+    const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const
+{
+    return std::unique_ptr<ImageRowWriter>(new PngRowWriter(std::move(stream), format, colorSpace, size, m_compression));
 }
 
 } }
@@ -7,9 +7,18 @@
 
 namespace ImageApprovals { namespace detail {
 
+enum class PngCompression
+{
+    Default,
+    // For files written on every failure, such as diff images
+    Fastest
+};
+
 class PngImageCodec : public ImageCodec
 {
 public:
+    explicit PngImageCodec(PngCompression compression = PngCompression::Default);
+
     std::string getFileExtensionWithDot() const override;
 
     int getScore(const std::string& extensionWithDot) const override;
@@ -18,6 +27,18 @@ public:
 protected:
     Image readFromStream(std::istream& stream, const std::string& fileName) const override;
     void writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const override;
+
+    Image decodeFromMemory(const uint8_t* data, size_t size) const override;
+    void encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const override;
+
+    // Reads and writes row by row with png_read_row and png_write_row
+    std::unique_ptr<ImageReader> openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const override;
+    std::unique_ptr<ImageRowWriter> openRowWriterForStream(
+        std::unique_ptr<std::ostream> stream, const std::string& fileName,
+        const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const override;
+
+private:
+    PngCompression m_compression;
 };
 
 } }
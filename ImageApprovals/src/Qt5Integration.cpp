@@ -10,6 +10,9 @@ namespace detail {
 
 const PixelFormat* fromQt5PixelFormat(const QImage& image)
 {
+    // 32-bit formats store 0xAARRGGBB words, so their byte order depends on the host
+    const bool littleEndian = (Q_BYTE_ORDER == Q_LITTLE_ENDIAN);
+
     switch (image.format())
     {
         case QImage::Format_Grayscale8:
@@ -20,6 +23,36 @@ const PixelFormat* fromQt5PixelFormat(const QImage& image)
         case QImage::Format_RGBA8888:
         case QImage::Format_RGBX8888:
             return &PixelFormat::getRgbAlphaU8();
+        case QImage::Format_RGBA8888_Premultiplied:
+            return &PixelFormat::getRgbAlphaU8Premultiplied();
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+            return littleEndian ? &PixelFormat::getBgrAlphaU8() : &PixelFormat::getAlphaRgbU8();
+        case QImage::Format_ARGB32_Premultiplied:
+            return littleEndian ? &PixelFormat::getBgrAlphaU8Premultiplied() : &PixelFormat::getAlphaRgbU8Premultiplied();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+        case QImage::Format_RGBX64:
+        case QImage::Format_RGBA64:
+            return &PixelFormat::getRgbAlphaU16();
+        case QImage::Format_RGBA64_Premultiplied:
+            return &PixelFormat::getRgbAlphaU16Premultiplied();
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+        case QImage::Format_Grayscale16:
+            return &PixelFormat::getGrayU16();
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        case QImage::Format_BGR888:
+            return &PixelFormat::getBgrU8();
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+        // Half-float formats have no matching PixelFormat and still need convertToFormat
+        case QImage::Format_RGBX32FPx4:
+        case QImage::Format_RGBA32FPx4:
+            return &PixelFormat::getRgbAlphaF32();
+        case QImage::Format_RGBA32FPx4_Premultiplied:
+            return &PixelFormat::getRgbAlphaF32Premultiplied();
+#endif
         default:
             break;
     }
@@ -0,0 +1,263 @@
+#include <ImageApprovals/ToleranceMask.hpp>
+#include <ImageApprovals/Errors.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace ImageApprovals {
+
+namespace detail {
+
+// Masks are read from hand-edited files, so their size is limited before anything is allocated
+const uint32_t maxMaskDimension = 1u << 18;
+
+ImageApprovalsError makeMaskLineError(size_t lineNumber, const std::string& message)
+{
+    return ImageApprovalsError("Invalid tolerance mask, line " + std::to_string(lineNumber) + ": " + message);
+}
+
+// Digits only, so that signs and trailing characters are not silently accepted
+uint32_t parseMaskNumber(const std::string& token, size_t lineNumber)
+{
+    uint64_t value = 0;
+
+    for (const char c : token)
+    {
+        if (c < '0' || c > '9')
+        {
+            throw makeMaskLineError(lineNumber, "\"" + token + "\" is not a non-negative integer");
+        }
+
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+
+        if (value > UINT32_MAX)
+        {
+            throw makeMaskLineError(lineNumber, "\"" + token + "\" is too large");
+        }
+    }
+
+    return static_cast<uint32_t>(value);
+}
+
+float parseMaskThreshold(const std::string& token, size_t lineNumber)
+{
+    std::istringstream stream(token);
+    double value = 0.0;
+    char rest = 0;
+
+    if (!(stream >> value) || (stream >> rest) || !(value >= 0.0) || !std::isfinite(static_cast<float>(value)))
+    {
+        throw makeMaskLineError(lineNumber, "\"" + token + "\" is not a non-negative threshold");
+    }
+
+    return static_cast<float>(value);
+}
+
+bool sameSpans(const std::vector<ToleranceMask::Span>& lhs, const std::vector<ToleranceMask::Span>& rhs)
+{
+    return (lhs.size() == rhs.size())
+        && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](const ToleranceMask::Span& l, const ToleranceMask::Span& r) {
+               return (l.x == r.x) && (l.length == r.length) && (l.threshold == r.threshold);
+           });
+}
+
+}
+
+ToleranceMask::ToleranceMask(const Size& size)
+    : m_size(size)
+    , m_rows(size.height)
+{}
+
+ToleranceMask& ToleranceMask::ignoreRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    setRegion(x, y, width, height, std::numeric_limits<float>::infinity());
+    return *this;
+}
+
+ToleranceMask& ToleranceMask::setRegionThreshold(uint32_t x, uint32_t y, uint32_t width, uint32_t height, AbsThreshold threshold)
+{
+    if (!(threshold.value >= 0.0))
+    {
+        throw ImageApprovalsError("Region threshold must not be negative");
+    }
+
+    setRegion(x, y, width, height, static_cast<float>(threshold.value));
+    return *this;
+}
+
+void ToleranceMask::setRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height, float threshold)
+{
+    const uint32_t begin = std::min(x, m_size.width);
+    const uint32_t end = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(x) + width, m_size.width));
+    const uint32_t endRow = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(y) + height, m_size.height));
+
+    if (begin >= end)
+    {
+        return;
+    }
+
+    for (uint32_t row = y; row < endRow; ++row)
+    {
+        std::vector<Span> spans;
+        spans.reserve(m_rows[row].size() + 2);
+
+        bool inserted = false;
+
+        // Keeps the parts of the existing spans outside of [begin, end)
+        for (const Span& span : m_rows[row])
+        {
+            const uint32_t spanEnd = span.x + span.length;
+
+            if (span.x < begin)
+            {
+                spans.push_back(Span{ span.x, std::min(spanEnd, begin) - span.x, span.threshold });
+            }
+
+            if (spanEnd > end)
+            {
+                if (!inserted)
+                {
+                    spans.push_back(Span{ begin, end - begin, threshold });
+                    inserted = true;
+                }
+
+                const uint32_t rest = std::max(span.x, end);
+                spans.push_back(Span{ rest, spanEnd - rest, span.threshold });
+            }
+        }
+
+        if (!inserted)
+        {
+            spans.push_back(Span{ begin, end - begin, threshold });
+        }
+
+        m_rows[row] = std::move(spans);
+    }
+}
+
+uint64_t ToleranceMask::getNumIgnoredPixels() const
+{
+    uint64_t numIgnored = 0;
+
+    for (const auto& row : m_rows)
+    {
+        for (const Span& span : row)
+        {
+            numIgnored += span.isIgnored() ? span.length : 0;
+        }
+    }
+
+    return numIgnored;
+}
+
+std::string ToleranceMask::serialize() const
+{
+    std::ostringstream stream;
+    stream << std::setprecision(9);
+
+    stream << "tolerance-mask " << m_size.width << " " << m_size.height << "\n";
+
+    for (uint32_t y = 0; y < m_size.height;)
+    {
+        uint32_t height = 1;
+        while ((y + height < m_size.height) && detail::sameSpans(m_rows[y], m_rows[y + height]))
+        {
+            ++height;
+        }
+
+        for (const Span& span : m_rows[y])
+        {
+            if (span.isIgnored())
+            {
+                stream << "ignore " << span.x << " " << y << " " << span.length << " " << height << "\n";
+            }
+            else
+            {
+                stream << "threshold " << span.x << " " << y << " " << span.length << " " << height << " " << span.threshold << "\n";
+            }
+        }
+
+        y += height;
+    }
+
+    return stream.str();
+}
+
+ToleranceMask ToleranceMask::deserialize(const std::string& text)
+{
+    std::istringstream stream(text);
+
+    ToleranceMask mask;
+    bool hasHeader = false;
+
+    std::string line;
+    size_t lineNumber = 0;
+
+    while (std::getline(stream, line))
+    {
+        ++lineNumber;
+
+        std::istringstream lineStream(line);
+        std::vector<std::string> tokens;
+
+        for (std::string token; lineStream >> token;)
+        {
+            tokens.push_back(token);
+        }
+
+        if (tokens.empty())
+        {
+            continue;
+        }
+
+        if (!hasHeader)
+        {
+            if (tokens.size() != 3 || tokens[0] != "tolerance-mask")
+            {
+                throw detail::makeMaskLineError(lineNumber, "expected \"tolerance-mask width height\"");
+            }
+
+            const Size size(detail::parseMaskNumber(tokens[1], lineNumber), detail::parseMaskNumber(tokens[2], lineNumber));
+
+            if (size.width == 0 || size.height == 0 || size.width > detail::maxMaskDimension || size.height > detail::maxMaskDimension)
+            {
+                throw detail::makeMaskLineError(lineNumber, "size must be between 1 and " + std::to_string(detail::maxMaskDimension));
+            }
+
+            mask = ToleranceMask(size);
+            hasHeader = true;
+            continue;
+        }
+
+        const bool ignore = (tokens[0] == "ignore");
+
+        if (!(ignore && tokens.size() == 5) && !(tokens[0] == "threshold" && tokens.size() == 6))
+        {
+            throw detail::makeMaskLineError(lineNumber, "expected \"ignore x y width height\" or \"threshold x y width height value\"");
+        }
+
+        const uint32_t x = detail::parseMaskNumber(tokens[1], lineNumber);
+        const uint32_t y = detail::parseMaskNumber(tokens[2], lineNumber);
+        const uint32_t width = detail::parseMaskNumber(tokens[3], lineNumber);
+        const uint32_t height = detail::parseMaskNumber(tokens[4], lineNumber);
+
+        if (width == 0 || height == 0 || x > mask.m_size.width || width > mask.m_size.width - x
+            || y > mask.m_size.height || height > mask.m_size.height - y)
+        {
+            throw detail::makeMaskLineError(lineNumber, "region is empty or outside of the mask");
+        }
+
+        mask.setRegion(x, y, width, height,
+            ignore ? std::numeric_limits<float>::infinity() : detail::parseMaskThreshold(tokens[5], lineNumber));
+    }
+
+    if (!hasHeader)
+    {
+        throw ImageApprovalsError("Invalid tolerance mask: expected \"tolerance-mask width height\"");
+    }
+
+    return mask;
+}
+
+}
@@ -9,6 +9,12 @@ std::ostream& operator <<(std::ostream& stream, const AbsThreshold& threshold)
     return stream;
 }
 
+std::ostream& operator <<(std::ostream& stream, const RelThreshold& threshold)
+{
+    stream << threshold.value;
+    return stream;
+}
+
 std::ostream& operator <<(std::ostream& stream, const Percent& percent)
 {
     stream << percent.value << "%";
@@ -0,0 +1,35 @@
+#include "VerifyUtils.hpp"
+#include <ApprovalTests.hpp>
+#include <cstdio>
+#include <fstream>
+
+namespace ImageApprovals { namespace detail {
+
+ApprovalPaths getApprovalPaths(const ImageCodec& codec, const std::string& pathWithoutExtension)
+{
+    const std::string extensionWithDot = codec.getFileExtensionWithDot();
+    return ApprovalPaths{ pathWithoutExtension + ".received" + extensionWithDot, pathWithoutExtension + ".approved" + extensionWithDot };
+}
+
+void verifyFiles(const ImageCodec* codec, const ImageView& image,
+                 const std::string& receivedPath, const std::string& approvedPath, const ImageComparator& comparator)
+{
+    if (codec)
+    {
+        codec->write(receivedPath, image);
+    }
+
+    if (!std::ifstream(approvedPath.c_str()))
+    {
+        throw ApprovalTests::ApprovalException("Approved file \"" + approvedPath + "\" does not exist");
+    }
+
+    comparator.contentsAreEquivalent(receivedPath, approvedPath);
+
+    if (codec)
+    {
+        std::remove(receivedPath.c_str());
+    }
+}
+
+} }
@@ -0,0 +1,26 @@
+#ifndef IMAGEAPPROVALS_VERIFYUTILS_HPP_INCLUDED
+#define IMAGEAPPROVALS_VERIFYUTILS_HPP_INCLUDED
+
+#include <ImageApprovals/ImageCodec.hpp>
+#include <ImageApprovals/ImageComparator.hpp>
+#include <string>
+
+namespace ImageApprovals { namespace detail {
+
+struct ApprovalPaths
+{
+    std::string receivedPath;
+    std::string approvedPath;
+};
+
+// <pathWithoutExtension>.received<ext> and <pathWithoutExtension>.approved<ext>
+ApprovalPaths getApprovalPaths(const ImageCodec& codec, const std::string& pathWithoutExtension);
+
+// Writes image to receivedPath if codec is not null, compares the received and approved files
+// and removes the written file if they match; throws an exception describing any failure
+void verifyFiles(const ImageCodec* codec, const ImageView& image,
+                 const std::string& receivedPath, const std::string& approvedPath, const ImageComparator& comparator);
+
+} }
+
+#endif // IMAGEAPPROVALS_VERIFYUTILS_HPP_INCLUDED
@@ -149,6 +149,7 @@ public:
     virtual size_t getNumberOfChannels() const = 0;
     virtual size_t getPixelStride() const = 0;
     virtual bool isU8() const = 0;
+    virtual bool isU16() const = 0;
     virtual bool isF32() const = 0;
 
     const uint8_t* decode(const uint8_t* begin, const uint8_t* end, RGBA& outRgba) const;
@@ -158,9 +159,28 @@ public:
 
     static const PixelFormat& getRgbU8();
     static const PixelFormat& getRgbAlphaU8();
+
+    static const PixelFormat& getBgrU8();
+    static const PixelFormat& getBgrAlphaU8();
+    static const PixelFormat& getAlphaRgbU8();
+
+    static const PixelFormat& getGrayAlphaU8Premultiplied();
+    static const PixelFormat& getRgbAlphaU8Premultiplied();
+    static const PixelFormat& getBgrAlphaU8Premultiplied();
+    static const PixelFormat& getAlphaRgbU8Premultiplied();
+
+    static const PixelFormat& getGrayU16();
+    static const PixelFormat& getGrayAlphaU16();
+    static const PixelFormat& getRgbU16();
+    static const PixelFormat& getRgbAlphaU16();
+    static const PixelFormat& getRgbAlphaU16Premultiplied();
     
+    static const PixelFormat& getGrayF32();
+    static const PixelFormat& getGrayAlphaF32();
+
     static const PixelFormat& getRgbF32();
     static const PixelFormat& getRgbAlphaF32();
+    static const PixelFormat& getRgbAlphaF32Premultiplied();
 
 protected:
     virtual void decode(const uint8_t* begin, RGBA& outRgba) const = 0;
@@ -206,9 +226,11 @@ struct Unit
 }
 
 using AbsThreshold = detail::Unit<double, struct AbsThresholdTag>;
+using RelThreshold = detail::Unit<double, struct RelThresholdTag>;
 using Percent = detail::Unit<double, struct PercentTag>;
 
 std::ostream& operator <<(std::ostream& stream, const AbsThreshold& threshold);
+std::ostream& operator <<(std::ostream& stream, const RelThreshold& threshold);
 std::ostream& operator <<(std::ostream& stream, const Percent& percent);
 
 }
@@ -221,65 +243,10 @@ std::ostream& operator <<(std::ostream& stream, const Percent& percent);
 
 #define ImageApprovals_VERSION_STR "0.1.0"
 
-// include/ImageApprovals/CompareStrategy.hpp
-
-#include <string>
-
-namespace ImageApprovals {
-
-class ImageView;
-
-class CompareStrategy
-{
-public:
-    struct Result
-    {
-        bool passed = false;
-        std::string leftImageInfo;
-        std::string rightImageInfo;
-
-        static Result makePassed();
-        static Result makeFailed(std::string leftInfo, std::string rightInfo);
-    };
-
-    virtual ~CompareStrategy() = default;
-
-    Result compare(const ImageView& left, const ImageView& right) const;
-
-protected:
-    virtual Result compareInfos(const ImageView& left, const ImageView& right) const;
-    virtual Result compareContents(const ImageView& left, const ImageView& right) const = 0;
-};
-
-class ThresholdCompareStrategy : public CompareStrategy
-{
-public:
-    explicit ThresholdCompareStrategy(
-        AbsThreshold pixelFailThreshold = AbsThreshold(0.004),
-        Percent maxFailedPixelsPercentage = Percent(0.1));
-
-protected:
-    Result compareContents(const ImageView& left, const ImageView& right) const override;
-
-private:
-    AbsThreshold m_pixelFailThreshold;
-    Percent m_maxFailedPixelsPercentage;
-};
-
-class BitwiseCompareStrategy : public CompareStrategy
-{
-public:
-    BitwiseCompareStrategy() = default;
-
-protected:
-    Result compareContents(const ImageView& left, const ImageView& right) const override;
-};
-
-}
-
 // include/ImageApprovals/ImageView.hpp
 
 #include <cstdint>
+#include <cstddef>
 
 namespace ImageApprovals {
 
@@ -318,7 +285,7 @@ public:
     ImageView(const ImageView&) = default;
 
     ImageView(const PixelFormat& format, const ColorSpace& colorSpace,
-              const Size& size, size_t rowStride, const uint8_t* data);
+              const Size& size, std::ptrdiff_t rowStride, const uint8_t* data);
 
     ImageView& operator =(const ImageView&) = default;
 
@@ -330,1764 +297,8292 @@ public:
     const ColorSpace& getColorSpace() const;
 
     Size getSize() const { return m_size; }
-    size_t getRowStride() const { return m_rowStride; }
+    std::ptrdiff_t getRowStride() const { return m_rowStride; }
+
+    bool isBottomUp() const { return m_rowStride < 0; }
 
     const uint8_t* getRowPointer(uint32_t index) const;
 
+    // Returns a view of the same pixels with the order of rows reversed;
+    // no pixel data is copied.
+    ImageView flippedVertically() const;
+
+    // Returns a view of the rectangular region of this view; no pixel data
+    // is copied.
+    ImageView subView(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+
     RGBA getPixel(uint32_t x, uint32_t y) const;
 
 protected:
     const PixelFormat* m_format = nullptr;
     const ColorSpace* m_colorSpace = nullptr;
     Size m_size;
-    size_t m_rowStride = 0;
+    std::ptrdiff_t m_rowStride = 0;
     const uint8_t* m_dataPtr = nullptr;
 };
 
 }
 
-// include/ImageApprovals/Image.hpp
+// include/ImageApprovals/PixelFormatTraits.hpp
 
-#include <memory>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <typeinfo>
+#include <utility>
 
 namespace ImageApprovals {
 
-class Image : public ImageView
-{
-public:
-    Image() = default;
-    Image(const Image&) = delete;
-    Image(Image&& other) noexcept;
-    Image(const PixelFormat& format, const ColorSpace& colorSpace, const Size& size, size_t rowAlignment = 4);
-    ~Image() noexcept;
+template<typename ChannelType>
+struct ChannelTraits;
 
-    Image& operator =(const Image&) = delete;
-    Image& operator =(Image&& rhs) noexcept;
-
-    size_t getRowAlignment() const { return m_rowAlignment; }
+template<>
+struct ChannelTraits<uint8_t>
+{
+    static float toFloat(uint8_t value)
+    {
+        return static_cast<float>(value) / 255.0f;
+    }
 
-    uint8_t* getPixelData() { return m_data.get(); }
-    const uint8_t* getPixelData() const { return m_data.get(); }
+    static uint8_t fromFloat(float value)
+    {
+        return static_cast<uint8_t>(std::min(1.0f, std::max(0.0f, value)) * 255.0f + 0.5f);
+    }
+};
 
-    uint8_t* getRowPointer(uint32_t y);
+// 16-bit channels are stored in native byte order
+template<>
+struct ChannelTraits<uint16_t>
+{
+    static float toFloat(uint16_t value)
+    {
+        return static_cast<float>(value) / 65535.0f;
+    }
 
-    void flipVertically();
+    static uint16_t fromFloat(float value)
+    {
+        return static_cast<uint16_t>(std::min(1.0f, std::max(0.0f, value)) * 65535.0f + 0.5f);
+    }
+};
 
-private:
-    size_t m_rowAlignment = 0;
-    std::unique_ptr<uint8_t[]> m_data;
+template<>
+struct ChannelTraits<float>
+{
+    static float toFloat(float value) { return value; }
+    static float fromFloat(float value) { return value; }
 };
 
+inline RGBA premultiply(const RGBA& p)
+{
+    return RGBA(p.r * p.a, p.g * p.a, p.b * p.a, p.a);
 }
 
-// include/ImageApprovals/ImageComparator.hpp
-
-#include <ApprovalTests.hpp>
+// Colors of fully transparent pixels are undefined and decode as black
+inline RGBA unpremultiply(const RGBA& p)
+{
+    if (p.a <= 0.0f)
+    {
+        return RGBA(0.0f, 0.0f, 0.0f, p.a);
+    }
 
-namespace ImageApprovals {
+    return RGBA(p.r / p.a, p.g / p.a, p.b / p.a, p.a);
+}
 
-class ImageComparator : public ApprovalTests::ApprovalComparator
+// Compile-time description of a pixel layout. Channel indices give the position
+// of each component within a pixel; gray formats use the same index for red, green
+// and blue, and formats without alpha use -1 as alphaIndex. Premultiplied formats
+// store colors already multiplied by alpha.
+template<typename ChannelT, size_t NumChannels, int RedIndex, int GreenIndex, int BlueIndex, int AlphaIndex,
+         bool Premultiplied = false>
+struct PixelFormatTraits
 {
-public:
-    class Disposer
-    {
-    public:
-        explicit Disposer(std::vector<ApprovalTests::ComparatorDisposer> disposers);
-        Disposer(const Disposer&) = delete;
-        Disposer(Disposer&&) = default;
+    using ChannelType = ChannelT;
+    using Channels = std::array<ChannelT, NumChannels>;
 
-        Disposer& operator =(const Disposer&) = delete;
-        Disposer& operator =(Disposer&&) = delete;
+    static constexpr size_t numChannels = NumChannels;
+    static constexpr size_t pixelStride = NumChannels * sizeof(ChannelT);
 
-    private:
-        std::vector<ApprovalTests::ComparatorDisposer> m_disposers;
-    };
+    static constexpr int redIndex = RedIndex;
+    static constexpr int greenIndex = GreenIndex;
+    static constexpr int blueIndex = BlueIndex;
+    static constexpr int alphaIndex = AlphaIndex;
 
-    ImageComparator();
-    explicit ImageComparator(std::shared_ptr<CompareStrategy> comparator);
+    static constexpr bool hasAlpha = (AlphaIndex >= 0);
+    static constexpr bool isGray = (RedIndex == GreenIndex) && (GreenIndex == BlueIndex);
+    static constexpr bool isPremultiplied = Premultiplied;
 
-    bool contentsAreEquivalent(std::string receivedPath, std::string approvedPath) const override;
+    static Channels load(const uint8_t* src)
+    {
+        Channels channels;
+        std::memcpy(channels.data(), src, pixelStride);
+        return channels;
+    }
 
-    template<typename ConcreteImageComparator, typename... Arguments>
-    static std::shared_ptr<ImageComparator> make(Arguments&&... args)
+    static void store(const Channels& channels, uint8_t* dst)
     {
-        std::shared_ptr<CompareStrategy> imgComparator(
-            new ConcreteImageComparator(std::forward<Arguments>(args)...));
+        std::memcpy(dst, channels.data(), pixelStride);
+    }
 
-        return std::make_shared<ImageComparator>(std::move(imgComparator));
+    // Returns the channels as stored, without unpremultiplying them
+    static RGBA decodeStored(const uint8_t* src)
+    {
+        using CT = ChannelTraits<ChannelT>;
+
+        const Channels c = load(src);
+
+        return RGBA(
+            CT::toFloat(c[RedIndex]),
+            CT::toFloat(c[GreenIndex]),
+            CT::toFloat(c[BlueIndex]),
+            hasAlpha ? CT::toFloat(c[hasAlpha ? AlphaIndex : 0]) : 1.0f);
     }
 
-    template<typename Strategy, typename... Arguments>
-    static Disposer registerForAllExtensions(Arguments&&... args)
+    static RGBA decode(const uint8_t* src)
     {
-        auto strategy = std::make_shared<Strategy>(std::forward<Arguments>(args)...);
-        return registerForAllExtensions(strategy);
+        return Premultiplied ? unpremultiply(decodeStored(src)) : decodeStored(src);
     }
+};
 
-    static Disposer registerForAllExtensions(std::shared_ptr<CompareStrategy> strategy);
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr size_t PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::numChannels;
 
-private:
-    std::shared_ptr<CompareStrategy> m_compareStrategy;
-};
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr size_t PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::pixelStride;
 
-}
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr int PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::redIndex;
 
-// include/ImageApprovals/Qt5Integration.hpp
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr int PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::greenIndex;
 
-#ifdef ImageApprovals_CONFIG_WITH_QT5
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr int PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::blueIndex;
 
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr int PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::alphaIndex;
 
-class QImage;
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr bool PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::hasAlpha;
 
-namespace ImageApprovals {
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr bool PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::isGray;
 
-ImageView makeView(const QImage& image);
+template<typename ChannelT, size_t NumChannels, int R, int G, int B, int A, bool P>
+constexpr bool PixelFormatTraits<ChannelT, NumChannels, R, G, B, A, P>::isPremultiplied;
 
-}
+struct GrayU8Traits : PixelFormatTraits<uint8_t, 1, 0, 0, 0, -1>
+{
+    static const char* getName() { return "GrayU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayU8(); }
+};
 
-#endif // ImageApprovals_CONFIG_WITH_QT5
+struct GrayAlphaU8Traits : PixelFormatTraits<uint8_t, 2, 0, 0, 0, 1>
+{
+    static const char* getName() { return "GrayAlphaU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayAlphaU8(); }
+};
 
-// include/ImageApprovals/ImageCodec.hpp
+struct RgbU8Traits : PixelFormatTraits<uint8_t, 3, 0, 1, 2, -1>
+{
+    static const char* getName() { return "RgbU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbU8(); }
+};
 
-#include <string>
-#include <memory>
-#include <vector>
+struct RgbAlphaU8Traits : PixelFormatTraits<uint8_t, 4, 0, 1, 2, 3>
+{
+    static const char* getName() { return "RgbAlphaU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaU8(); }
+};
 
-namespace ImageApprovals {
+struct BgrU8Traits : PixelFormatTraits<uint8_t, 3, 2, 1, 0, -1>
+{
+    static const char* getName() { return "BgrU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getBgrU8(); }
+};
 
-class ImageCodec
+struct BgrAlphaU8Traits : PixelFormatTraits<uint8_t, 4, 2, 1, 0, 3>
 {
-public:
-    class Disposer;
+    static const char* getName() { return "BgrAlphaU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getBgrAlphaU8(); }
+};
 
-    virtual ~ImageCodec() = default;
+struct AlphaRgbU8Traits : PixelFormatTraits<uint8_t, 4, 1, 2, 3, 0>
+{
+    static const char* getName() { return "AlphaRgbU8"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getAlphaRgbU8(); }
+};
 
-    virtual std::string getFileExtensionWithDot() const = 0;
+struct GrayAlphaU8PremultipliedTraits : PixelFormatTraits<uint8_t, 2, 0, 0, 0, 1, true>
+{
+    static const char* getName() { return "GrayAlphaU8Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayAlphaU8Premultiplied(); }
+};
 
-    virtual int getScore(const std::string& extensionWithDot) const = 0;
-    virtual int getScore(const PixelFormat& pf, const ColorSpace& cs) const = 0;
+struct RgbAlphaU8PremultipliedTraits : PixelFormatTraits<uint8_t, 4, 0, 1, 2, 3, true>
+{
+    static const char* getName() { return "RgbAlphaU8Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaU8Premultiplied(); }
+};
 
-    Image read(const std::string& fileName) const;
-    void write(const std::string& fileName, const ImageView& image) const;
+struct BgrAlphaU8PremultipliedTraits : PixelFormatTraits<uint8_t, 4, 2, 1, 0, 3, true>
+{
+    static const char* getName() { return "BgrAlphaU8Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getBgrAlphaU8Premultiplied(); }
+};
 
-    static Disposer registerCodec(const std::shared_ptr<ImageCodec>& codec);
-    static void unregisterCodec(const std::shared_ptr<ImageCodec>& codec);
+struct AlphaRgbU8PremultipliedTraits : PixelFormatTraits<uint8_t, 4, 1, 2, 3, 0, true>
+{
+    static const char* getName() { return "AlphaRgbU8Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getAlphaRgbU8Premultiplied(); }
+};
 
-    static std::vector<std::string> getRegisteredExtensions();
+struct GrayU16Traits : PixelFormatTraits<uint16_t, 1, 0, 0, 0, -1>
+{
+    static const char* getName() { return "GrayU16"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayU16(); }
+};
 
-    static const ImageCodec& getBestCodec(const ImageView& image);
-    static const ImageCodec& getBestCodec(const std::string& filePath);
+struct GrayAlphaU16Traits : PixelFormatTraits<uint16_t, 2, 0, 0, 0, 1>
+{
+    static const char* getName() { return "GrayAlphaU16"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayAlphaU16(); }
+};
 
-protected:
-    virtual Image readFromStream(std::istream& stream, const std::string& fileName) const = 0;
-    virtual void writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const = 0;
+struct RgbU16Traits : PixelFormatTraits<uint16_t, 3, 0, 1, 2, -1>
+{
+    static const char* getName() { return "RgbU16"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbU16(); }
+};
 
-private:
-    static std::vector<std::shared_ptr<ImageCodec>>& getImageCodecs();
+struct RgbAlphaU16Traits : PixelFormatTraits<uint16_t, 4, 0, 1, 2, 3>
+{
+    static const char* getName() { return "RgbAlphaU16"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaU16(); }
 };
 
-class ImageCodec::Disposer
+struct RgbAlphaU16PremultipliedTraits : PixelFormatTraits<uint16_t, 4, 0, 1, 2, 3, true>
 {
-public:
-    explicit Disposer(std::shared_ptr<ImageCodec> codec);
-    Disposer(const Disposer&) = delete;
-    Disposer(Disposer&&) noexcept;
-    ~Disposer();
+    static const char* getName() { return "RgbAlphaU16Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaU16Premultiplied(); }
+};
 
-    Disposer& operator =(const Disposer&) = delete;
-    Disposer& operator =(Disposer&&) noexcept;
+struct GrayF32Traits : PixelFormatTraits<float, 1, 0, 0, 0, -1>
+{
+    static const char* getName() { return "GrayF32"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayF32(); }
+};
 
-private:
-    std::shared_ptr<ImageCodec> m_codec;
+struct GrayAlphaF32Traits : PixelFormatTraits<float, 2, 0, 0, 0, 1>
+{
+    static const char* getName() { return "GrayAlphaF32"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getGrayAlphaF32(); }
 };
 
-}
+struct RgbF32Traits : PixelFormatTraits<float, 3, 0, 1, 2, -1>
+{
+    static const char* getName() { return "RgbF32"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbF32(); }
+};
 
-// include/ImageApprovals/ImageWriter.hpp
+struct RgbAlphaF32Traits : PixelFormatTraits<float, 4, 0, 1, 2, 3>
+{
+    static const char* getName() { return "RgbAlphaF32"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaF32(); }
+};
 
-#include <ApprovalTests.hpp>
-#include <stdexcept>
-#include <type_traits>
+struct RgbAlphaF32PremultipliedTraits : PixelFormatTraits<float, 4, 0, 1, 2, 3, true>
+{
+    static const char* getName() { return "RgbAlphaF32Premultiplied"; }
+    static const PixelFormat& getPixelFormat() { return PixelFormat::getRgbAlphaF32Premultiplied(); }
+};
 
-namespace ImageApprovals {
+// Calls fn with a default-constructed traits object matching the given format,
+// so that a kernel templated on the traits type is selected once per image.
+template<typename Fn>
+auto dispatchPixelFormat(const PixelFormat& format, Fn&& fn) -> decltype(fn(GrayU8Traits()))
+{
+    if (format == PixelFormat::getGrayU8()) { return fn(GrayU8Traits()); }
+    if (format == PixelFormat::getGrayAlphaU8()) { return fn(GrayAlphaU8Traits()); }
+    if (format == PixelFormat::getRgbU8()) { return fn(RgbU8Traits()); }
+    if (format == PixelFormat::getRgbAlphaU8()) { return fn(RgbAlphaU8Traits()); }
+    if (format == PixelFormat::getBgrU8()) { return fn(BgrU8Traits()); }
+    if (format == PixelFormat::getBgrAlphaU8()) { return fn(BgrAlphaU8Traits()); }
+    if (format == PixelFormat::getAlphaRgbU8()) { return fn(AlphaRgbU8Traits()); }
+    if (format == PixelFormat::getGrayAlphaU8Premultiplied()) { return fn(GrayAlphaU8PremultipliedTraits()); }
+    if (format == PixelFormat::getRgbAlphaU8Premultiplied()) { return fn(RgbAlphaU8PremultipliedTraits()); }
+    if (format == PixelFormat::getBgrAlphaU8Premultiplied()) { return fn(BgrAlphaU8PremultipliedTraits()); }
+    if (format == PixelFormat::getAlphaRgbU8Premultiplied()) { return fn(AlphaRgbU8PremultipliedTraits()); }
+    if (format == PixelFormat::getGrayU16()) { return fn(GrayU16Traits()); }
+    if (format == PixelFormat::getGrayAlphaU16()) { return fn(GrayAlphaU16Traits()); }
+    if (format == PixelFormat::getRgbU16()) { return fn(RgbU16Traits()); }
+    if (format == PixelFormat::getRgbAlphaU16()) { return fn(RgbAlphaU16Traits()); }
+    if (format == PixelFormat::getRgbAlphaU16Premultiplied()) { return fn(RgbAlphaU16PremultipliedTraits()); }
+    if (format == PixelFormat::getGrayF32()) { return fn(GrayF32Traits()); }
+    if (format == PixelFormat::getGrayAlphaF32()) { return fn(GrayAlphaF32Traits()); }
+    if (format == PixelFormat::getRgbF32()) { return fn(RgbF32Traits()); }
+    if (format == PixelFormat::getRgbAlphaF32()) { return fn(RgbAlphaF32Traits()); }
+    if (format == PixelFormat::getRgbAlphaF32Premultiplied()) { return fn(RgbAlphaF32PremultipliedTraits()); }
+
+    throw ImageApprovalsError(std::string("Unsupported pixel format ") + format.getName());
+}
 
-class ImageWriter : public ApprovalTests::ApprovalWriter
+// Runtime counterpart of PixelFormatTraits, used to relate two formats
+// whose channels are the same but stored in a different order or with
+// different alpha premultiplication.
+struct PixelLayout
 {
-public:
-    explicit ImageWriter(const ImageView& image)
-        : m_image(image), m_codec(ImageCodec::getBestCodec(image))
-    {}
+    const std::type_info* channelType = nullptr;
+    size_t numChannels = 0;
 
-    ImageWriter(const ImageWriter&) = delete;
+    int redIndex = -1;
+    int greenIndex = -1;
+    int blueIndex = -1;
+    int alphaIndex = -1;
 
-    std::string getFileExtensionWithDot() const override
+    bool premultiplied = false;
+
+    bool hasAlpha() const { return alphaIndex >= 0; }
+    bool isGray() const { return (redIndex == greenIndex) && (greenIndex == blueIndex); }
+
+    bool hasSameChannels(const PixelLayout& other) const
     {
-        return m_codec.getFileExtensionWithDot();
+        return (*channelType == *other.channelType)
+            && (numChannels == other.numChannels)
+            && (hasAlpha() == other.hasAlpha())
+            && (isGray() == other.isGray());
     }
 
-    void write(std::string path) const override
+    template<typename Traits>
+    static PixelLayout fromTraits()
     {
-        m_codec.write(path, m_image);
+        PixelLayout layout;
+        layout.channelType = &typeid(typename Traits::ChannelType);
+        layout.numChannels = Traits::numChannels;
+        layout.redIndex = Traits::redIndex;
+        layout.greenIndex = Traits::greenIndex;
+        layout.blueIndex = Traits::blueIndex;
+        layout.alphaIndex = Traits::alphaIndex;
+        layout.premultiplied = Traits::isPremultiplied;
+        return layout;
     }
+};
 
-    void cleanUpReceived(std::string receivedPath) const override
+namespace detail {
+
+struct GetPixelLayout
+{
+    template<typename Traits>
+    PixelLayout operator()(Traits) const
     {
-        remove(receivedPath.c_str());
+        return PixelLayout::fromTraits<Traits>();
     }
-
-private:
-    const ImageView m_image;
-    const ImageCodec& m_codec;
 };
 
 }
 
-// include/ImageApprovals.hpp
+inline PixelLayout getPixelLayout(const PixelFormat& format)
+{
+    return dispatchPixelFormat(format, detail::GetPixelLayout());
+}
 
-#ifdef ImageApprovals_CONFIG_IMPLEMENT
+}
 
-// src/ColorSpace.cpp
+// include/ImageApprovals/FailureMask.hpp
 
-#include <ostream>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
 
 namespace ImageApprovals {
 
-namespace detail {
-
-struct LinearColorSpace : ColorSpace
+// The failed pixels of a comparison as horizontal runs in row-major order, with their
+// bounding box and the number of failed pixels in each square tile of the image
+class FailureMask
 {
-    const char* getName() const override
-    { return "Linear sRGB"; }
-};
+public:
+    struct Run
+    {
+        uint32_t y;
+        uint32_t x;
+        uint32_t length;
+    };
 
-struct SRGBColorSpace : ColorSpace
-{
-    const char* getName() const override
-    { return "sRGB"; }
-};
+    struct Rect
+    {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
 
-}
+    struct Tile
+    {
+        // In tiles, not pixels
+        uint32_t column;
+        uint32_t row;
+        uint64_t numFailedPixels;
+    };
 
-const ColorSpace& ColorSpace::getLinearSRgb()
-{
-    static const detail::LinearColorSpace instance;
-    return instance;
-}
+    static const uint32_t defaultTileSize = 64;
+    static const size_t defaultMaxRuns = 1 << 20;
 
-const ColorSpace& ColorSpace::getSRgb()
-{
-    static const detail::SRGBColorSpace instance;
-    return instance;
-}
+    FailureMask() = default;
 
-std::ostream& operator <<(std::ostream& stream, const ColorSpace& colorSpace)
-{
-    return stream << colorSpace.getName();
-}
+    // Runs over maxRuns are dropped (see isComplete); counts, tiles and the bounding box stay exact
+    explicit FailureMask(const Size& imageSize, uint32_t tileSize = defaultTileSize, size_t maxRuns = defaultMaxRuns);
 
-}
+    // Runs are added in row-major order; a run that continues the previous one is merged into it
+    void addRun(uint32_t y, uint32_t x, uint32_t length);
 
-// src/ColorSpaceUtils.hpp
+    bool isEmpty() const { return m_numFailedPixels == 0; }
+    bool isComplete() const { return m_complete; }
 
-#include <cstdint>
-#include <cmath>
+    Size getImageSize() const { return m_imageSize; }
+    uint32_t getTileSize() const { return m_tileSize; }
+    uint64_t getNumFailedPixels() const { return m_numFailedPixels; }
 
-namespace ImageApprovals { namespace detail {
+    const std::vector<Run>& getRuns() const { return m_runs; }
 
-struct RgbPrimaries
-{
-    struct Primary
-    {
-        double x = 0.0, y = 0.0;
+    // All zero when the mask is empty
+    Rect getBoundingBox() const;
 
-        Primary() = default;
-        Primary(const Primary&) = default;
+    // Tiles with failed pixels, in row-major order
+    std::vector<Tile> getTiles() const;
 
-        Primary(double x, double y)
-            : x(x), y(y)
-        {}
+    // False for pixels of dropped runs
+    bool contains(uint32_t x, uint32_t y) const;
 
-        Primary& operator =(const Primary&) = default;
+    // A compact text form, one run or tile per line
+    std::string serialize() const;
+    static FailureMask deserialize(const std::string& text);
 
-        bool approxEqual(const Primary& other) const;
-    };
+private:
+    // Tiles are indexed by row * columns + column
+    uint64_t getNumTileColumns() const;
+
+    Size m_imageSize;
+    uint32_t m_tileSize = defaultTileSize;
+    size_t m_maxRuns = defaultMaxRuns;
+    bool m_complete = true;
+
+    uint64_t m_numFailedPixels = 0;
+    std::vector<Run> m_runs;
+    std::map<uint64_t, uint64_t> m_tileCounts;
+
+    uint32_t m_minX = UINT32_MAX;
+    uint32_t m_maxX = 0;
+    uint32_t m_minY = UINT32_MAX;
+    uint32_t m_maxY = 0;
+};
 
-    Primary r, g, b;
+}
 
-    bool approxEqual(const RgbPrimaries& other) const;
+// include/ImageApprovals/Image.hpp
 
-    static RgbPrimaries getSRgbPrimaries();
-};
+#include <memory>
 
-bool isSRgbIccProfile(uint32_t profLen, const uint8_t* profData);
+namespace ImageApprovals {
 
-const ColorSpace* detectColorSpace(const RgbPrimaries& primaries, double gamma);
+class Image : public ImageView
+{
+public:
+    Image() = default;
+    Image(const Image&) = delete;
+    Image(Image&& other) noexcept;
+    Image(const PixelFormat& format, const ColorSpace& colorSpace, const Size& size, size_t rowAlignment = 4);
+    ~Image() noexcept;
 
-} }
+    Image& operator =(const Image&) = delete;
+    Image& operator =(Image&& rhs) noexcept;
 
-// src/CompareStrategy.cpp
+    size_t getRowAlignment() const { return m_rowAlignment; }
 
-#include <cstring>
-#define NOMINMAX
-#include <ApprovalTests.hpp>
-#include <algorithm>
+    uint8_t* getPixelData() { return m_data.get(); }
+    const uint8_t* getPixelData() const { return m_data.get(); }
 
-namespace ImageApprovals {
+    using ImageView::getRowPointer;
+    uint8_t* getRowPointer(uint32_t y);
 
-using ApprovalTests::StringUtils;
+    void flipVertically();
 
-CompareStrategy::Result CompareStrategy::Result::makePassed()
-{
-    Result res;
-    res.passed = true;
-    return res;
-}
+private:
+    size_t m_rowAlignment = 0;
+    std::unique_ptr<uint8_t[]> m_data;
+};
 
-CompareStrategy::Result CompareStrategy::Result::makeFailed(std::string leftInfo, std::string rightInfo)
-{
-    Result res;
-    res.passed = false;
-    res.leftImageInfo = std::move(leftInfo);
-    res.rightImageInfo = std::move(rightInfo);
-    return res;
 }
 
-CompareStrategy::Result CompareStrategy::compare(const ImageView& left, const ImageView& right) const
+// include/ImageApprovals/ImageRowWriter.hpp
+
+namespace ImageApprovals {
+
+// Writes an image file in batches of rows, from top to bottom, so that the
+// whole image never has to be in memory.
+class ImageRowWriter
 {
-    Result result;
+public:
+    ImageRowWriter(const PixelFormat& format, const ColorSpace& colorSpace, const Size& size);
+    ImageRowWriter(const ImageRowWriter&) = delete;
+    virtual ~ImageRowWriter() = default;
 
-    if (!(result = compareInfos(left, right)).passed)
-    {
-        return result;
-    }
+    ImageRowWriter& operator =(const ImageRowWriter&) = delete;
 
-    if (!(result = compareContents(left, right)).passed)
-    {
-        return result;
-    }
+    const PixelFormat& getPixelFormat() const { return *m_format; }
+    const ColorSpace& getColorSpace() const { return *m_colorSpace; }
+    Size getSize() const { return m_size; }
 
-    return Result::makePassed();
-}
+    uint32_t getNumberOfWrittenRows() const { return m_numWrittenRows; }
 
-CompareStrategy::Result CompareStrategy::compareInfos(const ImageView& left, const ImageView& right) const
-{
-    Result result;
-    result.passed = false;
+    // Appends rows below the ones written so far; they must have the pixel format,
+    // color space and width the writer was opened with
+    void writeRows(const ImageView& rows);
 
-    if (left.getPixelFormat() != right.getPixelFormat())
-    {
-        return Result::makeFailed(
-            "pixel format = " + StringUtils::toString(left.getPixelFormat()),
-            "pixel format = " + StringUtils::toString(right.getPixelFormat()));
-    }
+    // Completes the file; all rows must have been written
+    void finish();
 
-    if (left.getColorSpace() != right.getColorSpace())
-    {
-        return Result::makeFailed(
-            "color space = " + StringUtils::toString(left.getColorSpace()),
-            "color space = " + StringUtils::toString(right.getColorSpace()));
-    }
+protected:
+    virtual void appendRows(uint32_t firstRow, const ImageView& rows) = 0;
+    virtual void finishFile() = 0;
 
-    if (left.getSize() != right.getSize())
-    {
-        return Result::makeFailed(
-            "size = " + StringUtils::toString(left.getSize()),
-            "size = " + StringUtils::toString(right.getSize()));
-    }
+private:
+    const PixelFormat* m_format;
+    const ColorSpace* m_colorSpace;
+    Size m_size;
+    uint32_t m_numWrittenRows = 0;
+    bool m_finished = false;
+};
 
-    return Result::makePassed();
 }
 
-ThresholdCompareStrategy::ThresholdCompareStrategy(AbsThreshold pixelFailThreshold, Percent maxFailedPixelsPercentage)
-    : m_pixelFailThreshold(pixelFailThreshold), m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
-{}
-
-namespace detail {
+// include/ImageApprovals/Qt5Integration.hpp
 
-float maxAbsDiff(const RGBA& left, const RGBA& right)
-{
-    float result = std::abs(left.r - right.r);
-    result = std::max(result, std::abs(left.g - right.g));
-    result = std::max(result, std::abs(left.b - right.b));
-    result = std::max(result, std::abs(left.a - right.a));
-    return result;
-}
+#ifdef ImageApprovals_CONFIG_WITH_QT5
 
-}
 
-CompareStrategy::Result ThresholdCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
-{
-    const auto sz = left.getSize();
+class QImage;
 
-    uint32_t numAboveThreshold = 0;
+namespace ImageApprovals {
 
-    for (uint32_t y = 0; y < sz.height; ++y)
-    {
-        for (uint32_t x = 0; x < sz.width; ++x)
-        {
-            const auto leftPixel = left.getPixel(x, y);
-            const auto rightPixel = right.getPixel(x, y);
+ImageView makeView(const QImage& image);
 
-            const float diff = detail::maxAbsDiff(leftPixel, rightPixel);
-            if (diff > m_pixelFailThreshold.value)
-            {
-                ++numAboveThreshold;
-            }
-        }
-    }
+}
 
-    const double numPixels = static_cast<double>(sz.width)* static_cast<double>(sz.height);
-    const auto percentAboveThreshold = Percent((numAboveThreshold / numPixels) * 100.0);
+#endif // ImageApprovals_CONFIG_WITH_QT5
 
-    if (percentAboveThreshold > m_maxFailedPixelsPercentage)
-    {
-        std::string rightInfo
-            = StringUtils::toString(numAboveThreshold) + " pixels (" + StringUtils::toString(percentAboveThreshold)
-            + ") are above threshold = " + StringUtils::toString(m_pixelFailThreshold);
+// include/ImageApprovals/ToleranceMask.hpp
 
-        return Result::makeFailed("reference image", rightInfo);
-    }
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
 
-    return Result::makePassed();
-}
+namespace ImageApprovals {
 
-CompareStrategy::Result BitwiseCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+// Per-pixel overrides of the pixel fail threshold of a strategy, as run-length encoded spans
+// of each row; pixels outside of all spans use the threshold of the strategy
+class ToleranceMask
 {
-    const auto sz = left.getSize();
-    const auto rowLen = left.getPixelFormat().getPixelStride() * sz.width;
-
-    for(uint32_t y = 0; y < sz.height; ++y)
+public:
+    struct Span
     {
-        const auto leftRow = left.getRowPointer(y);
-        const auto rightRow = right.getRowPointer(y);
+        uint32_t x;
+        uint32_t length;
 
-        if(0 != std::memcmp(leftRow, rightRow, rowLen))
-        {
-            return Result::makeFailed("reference image", "different pixels in row " + std::to_string(y));
-        }
-    }
+        // Infinite for pixels that are not compared at all
+        float threshold;
 
-    return Result::makePassed();
-}
+        bool isIgnored() const { return threshold == std::numeric_limits<float>::infinity(); }
+    };
 
-}
+    ToleranceMask() = default;
+    explicit ToleranceMask(const Size& size);
 
-// src/ExrImageCodec.hpp
+    // Regions are clipped to the image; where they overlap, the region set last applies
+    ToleranceMask& ignoreRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    ToleranceMask& setRegionThreshold(uint32_t x, uint32_t y, uint32_t width, uint32_t height, AbsThreshold threshold);
 
-#ifdef ImageApprovals_CONFIG_WITH_OPENEXR
+    Size getSize() const { return m_size; }
 
+    // Sorted and not overlapping
+    const std::vector<Span>& getRowSpans(uint32_t y) const { return m_rows[y]; }
 
-namespace ImageApprovals { namespace detail {
+    uint64_t getNumIgnoredPixels() const;
 
-class ExrImageCodec : public ImageCodec
-{
-public:
-    std::string getFileExtensionWithDot() const override;
+    // One region per line, "ignore x y width height" or "threshold x y width height value",
+    // applied in order after a "tolerance-mask width height" header; equal rows are merged.
+    // Reading rejects, naming the line, malformed lines, sizes over 2^18 and regions outside of the mask
+    std::string serialize() const;
+    static ToleranceMask deserialize(const std::string& text);
 
-    int getScore(const std::string& extensionWithDot) const override;
-    int getScore(const PixelFormat& pf, const ColorSpace& cs) const override;
+private:
+    void setRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height, float threshold);
 
-protected:
-    Image readFromStream(std::istream& stream, const std::string& fileName) const override;
-    void writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const override;
+    Size m_size;
+    std::vector<std::vector<Span>> m_rows;
 };
 
-} }
-
-#endif // ImageApprovals_CONFIG_WITH_OPENEXR
+}
 
-// src/Image.cpp
+// include/ImageApprovals/CompareStrategy.hpp
 
-#include <cstring>
-#include <fstream>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
 
 namespace ImageApprovals {
 
+class ImageView;
+class ImageReader;
+struct Size;
+
 namespace detail {
 
-size_t alignedSize(size_t baseSize, size_t alignment)
-{
-    return ((baseSize + alignment - 1) / alignment) * alignment;
+struct ErrorSums;
+
 }
 
-size_t rowStride(const PixelFormat& fmt, const Size& sz, size_t rowAlignment)
+// Pixel errors measured by a comparison, as absolute differences of channel values
+// normalized to [0, 1], after the alpha handling of the strategy. Strategies with a single
+// error per pixel, such as DepthCompareStrategy, leave channelMaxErrors at 0.
+struct CompareStatistics
 {
-    if (rowAlignment == 0)
-    {
-        return 0;
-    }
+    uint64_t numComparedPixels = 0;
+    uint64_t numFailedPixels = 0;
 
-    const auto rowSize = fmt.getPixelStride() * sz.width;
-    return alignedSize(rowSize, rowAlignment);
-}
+    // The largest difference in any channel, and the first pixel (in row-major order) where it occurs
+    float maxError = 0.0f;
+    uint32_t worstPixelX = 0;
+    uint32_t worstPixelY = 0;
 
-}
+    // The largest differences per channel; alpha is 0 for images without alpha
+    RGBA channelMaxErrors;
 
-Image::Image(Image&& other) noexcept
-{
-    *this = std::move(other);
-}
+    // Over the color channels, and alpha if the images have it
+    double meanError = 0.0;
+    double rmsError = 0.0;
 
-Image::Image(const PixelFormat& format, const ColorSpace& colorSpace, const Size& size, size_t rowAlignment)
-    : ImageView(format, colorSpace, size, detail::rowStride(format, size, rowAlignment), nullptr), m_rowAlignment(rowAlignment)
+    // Peak signal-to-noise ratio in dB for a peak value of 1; infinite when the images are equal
+    double psnr = std::numeric_limits<double>::infinity();
+};
+
+// Collects an RGB image of the absolute channel differences found by a comparison, multiplied
+// by amplification, for strategies that render diff images (see CompareStrategy::rendersDiffImages).
+// The image is allocated at the first difference, so equal images cost nothing; it always has the
+// full size, also for banded comparisons, whose memory limit does not cover it.
+class DiffImageRenderer
 {
-    if (m_size.isZero())
+public:
+    DiffImageRenderer(const Size& size, float amplification);
+
+    // Called by strategies for the rows in which they find differences; pixels that are not set stay black
+    uint8_t* getRowPointer(uint32_t y)
     {
-        throw ImageApprovalsError("Image size cannot be zero");
+        if (!m_rendered)
+        {
+            allocate();
+        }
+
+        return m_image.getRowPointer(y);
     }
 
-    if (m_rowAlignment == 0)
+    void setPixel(uint8_t* row, uint32_t x, float redDiff, float greenDiff, float blueDiff) const
     {
-        throw ImageApprovalsError("Image row alignment must be greater than 0");
+        row[3 * x + 0] = toByte(redDiff);
+        row[3 * x + 1] = toByte(greenDiff);
+        row[3 * x + 2] = toByte(blueDiff);
     }
 
-    const size_t rowStride = getRowStride();
+    // False if the strategy found no differences, or did not get to compare any pixels
+    bool isRendered() const { return m_rendered; }
 
-    m_data.reset(new uint8_t[rowStride * m_size.height]);
-    m_dataPtr = m_data.get();
+    Size getSize() const { return m_size; }
 
-    for (uint32_t y = 0; y < m_size.height; ++y)
+    // Empty if nothing was rendered
+    const Image& getImage() const { return m_image; }
+
+private:
+    void allocate();
+
+    // NaN differences are shown at full intensity
+    uint8_t toByte(float diff) const
     {
-        std::memset(getRowPointer(y), 0, rowStride);
+        const float value = diff * m_scale;
+        return !(value < 255.0f) ? 255 : ((value > 0.0f) ? static_cast<uint8_t>(value + 0.5f) : 0);
     }
-}
 
-Image::~Image() noexcept = default;
+    Size m_size;
+    Image m_image;
+    float m_scale;
+    bool m_rendered = false;
+};
 
-Image& Image::operator =(Image&& rhs) noexcept
+// Optional inputs and outputs of a single comparison
+struct CompareOptions
 {
-    if (this != &rhs)
-    {
-        m_format = rhs.m_format;
-        rhs.m_format = nullptr;
+    // Rendered while the images are compared, if the strategy renders diff images
+    DiffImageRenderer* diff = nullptr;
 
-        m_colorSpace = rhs.m_colorSpace;
-        rhs.m_colorSpace = nullptr;
+    // Overrides the pixel fail threshold per pixel; must have the size of the images,
+    // and strategies that do not support tolerance masks throw if one is given
+    const ToleranceMask* toleranceMask = nullptr;
+};
 
-        m_size = rhs.m_size;
-        rhs.m_size = {};
+enum class AlphaComparison
+{
+    // Color and alpha channels are compared independently; two premultiplied images are compared as stored
+    Straight,
+    // Colors are multiplied by alpha before comparing, so color differences
+    // in fully transparent pixels are ignored
+    Premultiplied
+};
 
-        m_rowStride = rhs.m_rowStride;
-        rhs.m_rowStride = 0;
+class CompareStrategy
+{
+public:
+    struct Result
+    {
+        bool passed = false;
 
-        m_rowAlignment = rhs.m_rowAlignment;
-        rhs.m_rowAlignment = 0;
+        // Set by strategies that measure pixel errors, whether the comparison passed or not;
+        // comparisons that stop early, like banded ones, have statistics of the pixels compared so far
+        bool hasStatistics = false;
+        CompareStatistics statistics;
 
-        m_data = std::move(rhs.m_data);
+        // Set by strategies that locate failed pixels, like the statistics; null otherwise
+        std::shared_ptr<const FailureMask> failureMask;
 
-        m_dataPtr = m_data.get();
-        rhs.m_dataPtr = nullptr;
-    }
+        // True when the statistics and the failure mask cover only a sample of the rows,
+        // as for failures found by a quick reject (see ThresholdCompareStrategy::setQuickRejectRowStep)
+        bool sampled = false;
 
-    return *this;
-}
+        // Descriptions of both images for failure messages, formatted when requested
+        std::string getLeftImageInfo() const;
+        std::string getRightImageInfo() const;
 
-uint8_t* Image::getRowPointer(uint32_t y)
-{
-    if (y >= m_size.height)
-    {
-        throw ImageApprovalsError("Row index out of range");
-    }
+        static Result makePassed();
+        static Result makeFailed(std::string leftInfo, std::string rightInfo);
+        static Result makeFailedLazy(std::function<std::string()> formatLeftInfo, std::function<std::string()> formatRightInfo);
 
-    const auto rowStride = getRowStride();
-    return &m_data[rowStride * y];
-}
+    private:
+        std::string m_leftInfo;
+        std::string m_rightInfo;
+        std::function<std::string()> m_formatLeftInfo;
+        std::function<std::string()> m_formatRightInfo;
+    };
 
-void Image::flipVertically()
-{
-    const auto rowStride = getRowStride();
+    // Collects the comparison of two images passed as consecutive bands of rows
+    class BandAccumulator
+    {
+    public:
+        virtual ~BandAccumulator() = default;
 
-    std::unique_ptr<uint8_t[]> rowBuffer;
-    rowBuffer.reset(new uint8_t[rowStride]);
+        virtual void addBand(uint32_t firstRow, const ImageView& left, const ImageView& right) = 0;
 
-    for (uint32_t y = 0; y < m_size.height / 2; ++y)
-    {
-        auto upperRow = getRowPointer(y);
-        auto lowerRow = getRowPointer(m_size.height - y - 1);
+        // Returns true when the remaining bands cannot change the result, so they need not be read
+        virtual bool isDecided() const { return false; }
 
-        std::memcpy(rowBuffer.get(), upperRow, rowStride);
-        std::memcpy(upperRow, lowerRow, rowStride);
-        std::memcpy(lowerRow, rowBuffer.get(), rowStride);
-    }
-}
+        virtual Result getResult() const = 0;
+    };
 
-}
+    virtual ~CompareStrategy() = default;
 
-// src/ImageComparator.cpp
+    // If diff is not null and the strategy renders diff images, the differences are
+    // rendered into it while the images are compared
+    Result compare(const ImageView& left, const ImageView& right, DiffImageRenderer* diff = nullptr) const;
+    Result compare(const ImageView& left, const ImageView& right, const CompareOptions& options) const;
 
-#include <sstream>
-#include <iterator>
-#include <stdexcept>
+    // Compares images read in full-width bands, with at most about maxBandBytes of pixels
+    // of both images in memory at a time, and stops reading once the result is known
+    // (rows after that are left black in diff); strategies without band support read whole images
+    Result compare(ImageReader& left, ImageReader& right, size_t maxBandBytes, DiffImageRenderer* diff = nullptr) const;
+    Result compare(ImageReader& left, ImageReader& right, size_t maxBandBytes, const CompareOptions& options) const;
 
-namespace ImageApprovals {
+    virtual bool rendersDiffImages() const { return false; }
+    virtual bool supportsToleranceMasks() const { return false; }
 
-ImageComparator::Disposer::Disposer(std::vector<ApprovalTests::ComparatorDisposer> disposers)
-    : m_disposers(std::move(disposers))
-{}
+protected:
+    virtual Result compareInfos(const ImageView& left, const ImageView& right) const;
+    virtual Result compareContents(const ImageView& left, const ImageView& right) const = 0;
 
-ImageComparator::ImageComparator()
-    : m_compareStrategy(std::make_shared<ThresholdCompareStrategy>())
-{}
+    // Returns nullptr if the strategy needs whole images
+    virtual std::unique_ptr<BandAccumulator> makeBandAccumulator(const Size& size) const;
 
-ImageComparator::ImageComparator(std::shared_ptr<CompareStrategy> comparator)
-    : m_compareStrategy(std::move(comparator))
-{}
+    // Used instead of the above when a diff image or tolerance mask the strategy supports is given;
+    // the defaults ignore the options
+    virtual Result compareContentsWithOptions(const ImageView& left, const ImageView& right, const CompareOptions& options) const;
+    virtual std::unique_ptr<BandAccumulator> makeBandAccumulatorWithOptions(const Size& size, const CompareOptions& options) const;
 
-namespace detail {
+private:
+    // Drops the options the strategy does not use, and checks the others
+    CompareOptions getUsedOptions(const CompareOptions& options, const Size& size) const;
+};
 
-Image readImage(const std::string& which, const std::string& path)
+class ThresholdCompareStrategy : public CompareStrategy
 {
-    try
-    {
-        const auto& codec = ImageCodec::getBestCodec(path);
-        return codec.read(path);
-    }
-    catch (const std::exception & exc)
-    {
-        const auto msg =
-            "Failed to read " + which + " image from \""
-            + path + "\": " + exc.what();
+public:
+    explicit ThresholdCompareStrategy(
+        AbsThreshold pixelFailThreshold = AbsThreshold(0.004),
+        Percent maxFailedPixelsPercentage = Percent(0.1),
+        AlphaComparison alphaComparison = AlphaComparison::Straight);
 
-        throw ApprovalTests::ApprovalException(msg);
-    }
-}
+    // Before comparing images of at least minPixels pixels, compares only every rowStep-th row, and
+    // fails right away if those rows alone have more failed pixels than allowed, as with most gross differences.
+    // Otherwise all rows are compared as usual, so the verdict is never affected. Rejected results are marked
+    // as sampled, with statistics and failure masks of the sampled rows. Banded comparisons sample the rows
+    // of their first band. Not used when a diff image is rendered; 0, the default, disables the pre-check.
+    ThresholdCompareStrategy& setQuickRejectRowStep(uint32_t rowStep, uint64_t minPixels = uint64_t(1) << 20);
 
-}
+    bool rendersDiffImages() const override { return true; }
 
-bool ImageComparator::contentsAreEquivalent(std::string receivedPath, std::string approvedPath) const
-{
-    const Image receivedImg = detail::readImage("received", receivedPath);
-    const Image approvedImg = detail::readImage("approved", approvedPath);
+    // Ignored pixels are not compared, and do not count towards the failed pixels percentage
+    bool supportsToleranceMasks() const override { return true; }
 
-    const auto result = m_compareStrategy->compare(approvedImg, receivedImg);
-    if (!result.passed)
-    {
-        throw ApprovalTests::ApprovalMismatchException(result.rightImageInfo, result.leftImageInfo);
-    }
+protected:
+    Result compareContents(const ImageView& left, const ImageView& right) const override;
+    std::unique_ptr<BandAccumulator> makeBandAccumulator(const Size& size) const override;
 
-    return true;
-}
+    Result compareContentsWithOptions(const ImageView& left, const ImageView& right, const CompareOptions& options) const override;
+    std::unique_ptr<BandAccumulator> makeBandAccumulatorWithOptions(const Size& size, const CompareOptions& options) const override;
 
-ImageComparator::Disposer ImageComparator::registerForAllExtensions(std::shared_ptr<CompareStrategy> strategy)
-{
-    using namespace ApprovalTests;
+private:
+    // Counts failed pixels, measures the statistics, adds the failed pixels to mask and renders the rows
+    // into the diff of options in a single pass; row y of the views is row firstRow + y * rowStep of the image
+    detail::ErrorSums measureErrors(
+        const ImageView& left, const ImageView& right, FailureMask* mask, const CompareOptions& options,
+        uint32_t firstRow, uint32_t rowStep = 1) const;
+    Result makeResult(
+        const detail::ErrorSums& sums, uint64_t numComparablePixels, std::shared_ptr<const FailureMask> mask,
+        bool sampled = false) const;
+
+    // Measures the sampled rows of the first rows of images of the given size, if the pre-check
+    // applies, and returns true with the result in rejected if they already fail
+    bool quickReject(const ImageView& left, const ImageView& right, const Size& size, const CompareOptions& options,
+                     Result& rejected) const;
 
-    auto comparator = std::make_shared<ImageComparator>(std::move(strategy));
+    AbsThreshold m_pixelFailThreshold;
+    Percent m_maxFailedPixelsPercentage;
+    AlphaComparison m_alphaComparison;
+    uint32_t m_quickRejectRowStep = 0;
+    uint64_t m_quickRejectMinPixels = 0;
+};
 
-    const auto allExtensions = ImageCodec::getRegisteredExtensions();
-    
-    std::vector<ApprovalTests::ComparatorDisposer> disposers;
-    disposers.reserve(allExtensions.size());
+struct DepthRange
+{
+    float nearPlane;
+    float farPlane;
 
-    transform(allExtensions.begin(), allExtensions.end(), std::back_inserter(disposers),
-        [&](const std::string& ext) { return FileApprover::registerComparatorForExtension(ext, comparator); });
+    DepthRange(float nearPlane, float farPlane)
+        : nearPlane(nearPlane), farPlane(farPlane)
+    {}
+};
 
-    return Disposer(std::move(disposers));
-}
+// Compares single-channel float images, such as depth buffers, height maps or distance fields.
+// Pixels where both values are at or beyond the far plane are background and are skipped.
+class DepthCompareStrategy : public CompareStrategy
+{
+public:
+    // Values a and b match when |a - b| <= relativeTolerance * max(|a|, |b|);
+    // the far plane is at infinity
+    explicit DepthCompareStrategy(
+        RelThreshold relativeTolerance = RelThreshold(1e-4),
+        Percent maxFailedPixelsPercentage = Percent(0.0));
 
-}
+    // Values a and b match when |a - b| <= rangeTolerance * (range.farPlane - range.nearPlane)
+    DepthCompareStrategy(
+        RelThreshold rangeTolerance, DepthRange range,
+        Percent maxFailedPixelsPercentage = Percent(0.0));
 
-// src/ImageView.cpp
+protected:
+    Result compareInfos(const ImageView& left, const ImageView& right) const override;
+    Result compareContents(const ImageView& left, const ImageView& right) const override;
+    std::unique_ptr<BandAccumulator> makeBandAccumulator(const Size& size) const override;
 
-#include <stdexcept>
-#include <cstring>
-#include <ostream>
+private:
+    detail::ErrorSums measureErrors(const ImageView& left, const ImageView& right) const;
+    Result makeResult(const detail::ErrorSums& sums, const Size& size) const;
 
-namespace ImageApprovals {
+    RelThreshold m_tolerance;
+    float m_absTolerance = 0.0f;
+    float m_relTolerance = 0.0f;
+    float m_farPlane;
+    Percent m_maxFailedPixelsPercentage;
+};
 
-std::ostream& operator <<(std::ostream& stream, const Size& size)
+class BitwiseCompareStrategy : public CompareStrategy
 {
-    stream << "[" << size.width << ", " << size.height << "]";
-    return stream;
-}
+public:
+    BitwiseCompareStrategy() = default;
 
-ImageView::ImageView(const PixelFormat& format, const ColorSpace& colorSpace,
-                     const Size& size, size_t rowStride, const uint8_t* data)
-    : m_format(&format), m_colorSpace(&colorSpace), m_size(size),
-      m_rowStride(rowStride), m_dataPtr(data)
-{}
+protected:
+    Result compareInfos(const ImageView& left, const ImageView& right) const override;
+    Result compareContents(const ImageView& left, const ImageView& right) const override;
+    std::unique_ptr<BandAccumulator> makeBandAccumulator(const Size& size) const override;
+};
 
-Image ImageView::copy() const
+// Compares the structural similarity (SSIM) of the luma of both images in square windows at every
+// pixel position, with colors premultiplied by alpha. Unlike per-pixel thresholds, SSIM tolerates
+// slight blur and noise, but not changes of local structure. Images fail when the mean SSIM of all
+// windows is below minMeanSsim, or when the SSIM of any window is below minWindowSsim.
+class SsimCompareStrategy : public CompareStrategy
 {
-    if(isEmpty())
-    {
-        return {};
-    }
-
-    const auto sz = getSize();
-    const auto& pf = getPixelFormat();
-
-    Image imgCopy(pf, getColorSpace(), sz);
-
-    const size_t pixelStride = pf.getPixelStride();
-    for(uint32_t y = 0; y < sz.height; ++y)
-    {
-        const auto srcRow = getRowPointer(y);
-        auto dstRow = imgCopy.getRowPointer(y);
+public:
+    // Windows are clipped to the size of smaller images; the default minWindowSsim checks no windows
+    explicit SsimCompareStrategy(double minMeanSsim = 0.99, double minWindowSsim = -1.0, uint32_t windowSize = 8);
 
-        std::memcpy(dstRow, srcRow, pixelStride * sz.width);
-    }
+protected:
+    Result compareContents(const ImageView& left, const ImageView& right) const override;
 
-    return imgCopy;
-}
+private:
+    double m_minMeanSsim;
+    double m_minWindowSsim;
+    uint32_t m_windowSize;
+};
 
-bool ImageView::isEmpty() const
+enum class DeltaEFormula
 {
-    return m_format == nullptr;
-}
+    CIE76,
+    // More uniform perceptually, but several times as expensive; only pixels whose CIE76
+    // difference does not already prove that they pass are measured with it, the others
+    // count with that bound in the statistics
+    CIEDE2000
+};
 
-const PixelFormat& ImageView::getPixelFormat() const
+// Compares the perceptual color difference (Delta E) of pixels in CIE L*a*b* with the D65 white point,
+// after compositing them over black. Pixels fail when their Delta E is above maxDeltaE; about 1 for
+// CIEDE2000 and 2.3 for CIE76 is a just noticeable difference.
+class DeltaECompareStrategy : public CompareStrategy
 {
-    if (!m_format)
-    {
-        throw ImageApprovalsError("Calling getPixelFormat on an empty ImageView");
-    }
+public:
+    explicit DeltaECompareStrategy(
+        double maxDeltaE = 1.0,
+        Percent maxFailedPixelsPercentage = Percent(0.1),
+        DeltaEFormula formula = DeltaEFormula::CIEDE2000);
 
-    return *m_format;
-}
+protected:
+    Result compareContents(const ImageView& left, const ImageView& right) const override;
+    std::unique_ptr<BandAccumulator> makeBandAccumulator(const Size& size) const override;
 
-const ColorSpace& ImageView::getColorSpace() const
-{
-    if (!m_colorSpace)
-    {
-        throw ImageApprovalsError("Calling getColorSpace on an empty ImageView");
-    }
+private:
+    detail::ErrorSums measureErrors(const ImageView& left, const ImageView& right) const;
+    Result makeResult(const detail::ErrorSums& sums, const Size& size) const;
 
-    return *m_colorSpace;
-}
+    double m_maxDeltaE;
+    Percent m_maxFailedPixelsPercentage;
+    DeltaEFormula m_formula;
+};
 
-const uint8_t* ImageView::getRowPointer(uint32_t index) const
+// Compares the perceptual distance of colors in YIQ, after blending them over white, like pixelmatch.
+// Pixels fail when the distance is above maxColorDelta, where 1 is the largest possible distance,
+// unless they are anti-aliasing: a pixel between a darker and a brighter neighbour in either image,
+// where the darker or the brighter neighbour lies in a flat area in both images. Anti-aliased pixels
+// are ignored and counted separately.
+class YiqCompareStrategy : public CompareStrategy
 {
-    if (index >= m_size.height)
-    {
-        throw ImageApprovalsError("Row index out of range");
-    }
+public:
+    explicit YiqCompareStrategy(double maxColorDelta = 0.1, Percent maxFailedPixelsPercentage = Percent(0.1));
+
+protected:
+    Result compareContents(const ImageView& left, const ImageView& right) const override;
+
+private:
+    double m_maxColorDelta;
+    Percent m_maxFailedPixelsPercentage;
+};
 
-    return m_dataPtr + m_rowStride * index;
 }
 
-RGBA ImageView::getPixel(uint32_t x, uint32_t y) const
-{
-    if (x >= m_size.width)
-    {
-        throw ImageApprovalsError("X out of range");
-    }
+// include/ImageApprovals/Conversion.hpp
 
-    const auto rowPtr = getRowPointer(y);
+namespace ImageApprovals {
 
-    const auto& fmt = getPixelFormat();
-    const auto pixelStride = fmt.getPixelStride();
+// Converts the image to the given pixel format and color space.
+Image convert(const ImageView& src, const PixelFormat& format, const ColorSpace& colorSpace);
 
-    RGBA value;
-    fmt.decode(rowPtr + pixelStride * x, rowPtr + m_rowStride, value);
-    return value;
-}
+// Converts the image to the pixel format and color space of dst;
+// both images must have the same size.
+void convert(const ImageView& src, Image& dst);
 
 }
 
-// src/PixelFormat.cpp
-
-#include <algorithm>
-#include <stdexcept>
-#include <cstring>
-#include <ostream>
-#include <array>
+// include/ImageApprovals/ImageReader.hpp
 
 namespace ImageApprovals {
 
-namespace detail {
-
-float clamp(float x, float minX, float maxX)
+// An opened image file whose pixels are read region by region, so that
+// images larger than the available memory can still be processed.
+class ImageReader
 {
-    return std::min(maxX, std::max(minX, x));
-}
+public:
+    virtual ~ImageReader() = default;
 
-template<typename T, size_t N>
-std::array<float, N> normalize(const std::array<T, N>& src, float maxValue)
-{
-    std::array<float, N> dst;
+    virtual const PixelFormat& getPixelFormat() const = 0;
+    virtual const ColorSpace& getColorSpace() const = 0;
+    virtual Size getSize() const = 0;
 
-    for (size_t i = 0; i < N; ++i)
-    {
-        dst[i] = clamp(src[i] / maxValue, 0.0f, 1.0f);
-    }
+    // Reading whole blocks of this many rows is the most efficient, e.g. the tile height of tiled files
+    virtual uint32_t getRowsPerBlock() const { return 1; }
+
+    // Reads the given rectangle; the coordinates are relative to the top-left corner of the image
+    virtual Image readRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) = 0;
+};
 
-    return dst;
 }
 
-template<size_t NumChannels, typename ChannelType>
-struct GenericPixelFormat : PixelFormat
-{
-    size_t getNumberOfChannels() const override { return NumChannels; }
-    size_t getPixelStride() const override { return NumChannels * sizeof(ChannelType); }
+// include/ImageApprovals/LayeredImage.hpp
 
-    bool isU8() const override { return std::is_same<ChannelType, uint8_t>::value; }
-    bool isF32() const override { return std::is_same<ChannelType, float>::value; }
+#include <memory>
+#include <string>
+#include <vector>
 
-    std::array<ChannelType, NumChannels> decodeBytes(const uint8_t* src) const
-    {
-        std::array<ChannelType, NumChannels> dst;
-        std::memcpy(dst.data(), src, NumChannels * sizeof(ChannelType));
-        return dst;
+namespace ImageApprovals {
+
+// A set of named images stored in one file, e.g. the AOVs of a render.
+class LayeredImage
+{
+public:
+    struct Layer
+    {
+        std::string name;
+
+        // Names of the stored channels, in the order of the pixel format channels;
+        // empty if the codec should choose them
+        std::vector<std::string> channelNames;
+
+        ImageView image;
+    };
+
+    LayeredImage() = default;
+    LayeredImage(const LayeredImage&) = delete;
+    LayeredImage(LayeredImage&&) = default;
+
+    LayeredImage& operator =(const LayeredImage&) = delete;
+    LayeredImage& operator =(LayeredImage&&) = default;
+
+    // Adds a layer referring to pixels owned by the caller, which must outlive this object
+    void addLayer(std::string name, const ImageView& image, std::vector<std::string> channelNames = {});
+
+    // Adds a layer that owns its pixels
+    void addLayer(std::string name, Image&& image, std::vector<std::string> channelNames = {});
+
+    size_t getNumberOfLayers() const { return m_layers.size(); }
+    const Layer& getLayer(size_t index) const;
+
+    // Returns nullptr if there is no layer with the given name
+    const Layer* findLayer(const std::string& name) const;
+
+private:
+    std::vector<Layer> m_layers;
+    std::vector<std::unique_ptr<Image>> m_ownedImages;
+};
+
+}
+
+// include/ImageApprovals/ImageCodec.hpp
+
+#include <string>
+#include <memory>
+#include <vector>
+
+namespace ImageApprovals {
+
+class ImageCodec
+{
+public:
+    class Disposer;
+
+    virtual ~ImageCodec() = default;
+
+    virtual std::string getFileExtensionWithDot() const = 0;
+
+    virtual int getScore(const std::string& extensionWithDot) const = 0;
+    virtual int getScore(const PixelFormat& pf, const ColorSpace& cs) const = 0;
+
+    Image read(const std::string& fileName) const;
+    void write(const std::string& fileName, const ImageView& image) const;
+
+    // Opens a file for reading in regions; see ImageReader
+    std::unique_ptr<ImageReader> openReader(const std::string& fileName) const;
+
+    // Opens a file for writing in batches of rows; see ImageRowWriter
+    std::unique_ptr<ImageRowWriter> openRowWriter(
+        const std::string& fileName, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const;
+
+    LayeredImage readLayers(const std::string& fileName) const;
+    void writeLayers(const std::string& fileName, const LayeredImage& image) const;
+
+    // Encode to and decode from memory without touching the file system;
+    // the second overload replaces the contents of data, reusing its capacity
+    std::vector<uint8_t> encode(const ImageView& image) const;
+    void encode(const ImageView& image, std::vector<uint8_t>& data) const;
+    Image decode(const uint8_t* data, size_t size) const;
+
+    // Registration is thread-safe; codec scores must not change once a codec is registered
+    static Disposer registerCodec(const std::shared_ptr<ImageCodec>& codec);
+    static void unregisterCodec(const std::shared_ptr<ImageCodec>& codec);
+
+    static std::vector<std::string> getRegisteredExtensions();
+
+    static const ImageCodec& getBestCodec(const ImageView& image);
+    static const ImageCodec& getBestCodec(const std::string& filePath);
+
+protected:
+    virtual Image readFromStream(std::istream& stream, const std::string& fileName) const = 0;
+    virtual void writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const = 0;
+
+    // Codecs without layer support read a single unnamed layer and write only single-layer images
+    virtual LayeredImage readLayersFromStream(std::istream& stream, const std::string& fileName) const;
+    virtual void writeLayersToStream(const LayeredImage& image, std::ostream& stream, const std::string& fileName) const;
+
+    // The defaults wrap the memory in a string stream; codecs should override them with direct memory sources and sinks
+    virtual Image decodeFromMemory(const uint8_t* data, size_t size) const;
+    virtual void encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const;
+
+    // The default reader decodes the whole image with readFromStream when opened
+    virtual std::unique_ptr<ImageReader> openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const;
+
+    // The default writer collects all rows and writes them with writeToStream when finished
+    virtual std::unique_ptr<ImageRowWriter> openRowWriterForStream(
+        std::unique_ptr<std::ostream> stream, const std::string& fileName,
+        const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const;
+};
+
+class ImageCodec::Disposer
+{
+public:
+    explicit Disposer(std::shared_ptr<ImageCodec> codec);
+    Disposer(const Disposer&) = delete;
+    Disposer(Disposer&&) noexcept;
+    ~Disposer();
+
+    Disposer& operator =(const Disposer&) = delete;
+    Disposer& operator =(Disposer&&) noexcept;
+
+private:
+    std::shared_ptr<ImageCodec> m_codec;
+};
+
+}
+
+// include/ImageApprovals/ImageComparator.hpp
+
+#include <ApprovalTests.hpp>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace ImageApprovals {
+
+class ImageComparator : public ApprovalTests::ApprovalComparator
+{
+public:
+    class Disposer
+    {
+    public:
+        explicit Disposer(std::vector<ApprovalTests::ComparatorDisposer> disposers);
+        Disposer(const Disposer&) = delete;
+        Disposer(Disposer&&) = default;
+
+        Disposer& operator =(const Disposer&) = delete;
+        Disposer& operator =(Disposer&&) = delete;
+
+    private:
+        std::vector<ApprovalTests::ComparatorDisposer> m_disposers;
+    };
+
+    ImageComparator();
+    explicit ImageComparator(std::shared_ptr<CompareStrategy> comparator);
+
+    // Reads and compares the images in bands of at most about maxBytes of pixels, and stops
+    // reading at the first band that decides a failure; 0, the default, compares whole images
+    ImageComparator& setBandMemoryLimit(size_t maxBytes);
+
+    // When a comparison fails, writes <name>.diff.png next to <name>.received.<ext>, with the absolute
+    // channel differences multiplied by amplification; 0, the default, disables diff images.
+    // The diff is rendered in the comparison pass, by strategies that support it, and only allocated
+    // once a difference is found; it is not covered by the band memory limit (see DiffImageRenderer).
+    ImageComparator& setDiffImageAmplification(float amplification);
+
+    // Per-pixel thresholds and ignored regions for all compared images; when not set, they are read
+    // from <name>.mask.txt next to <name>.approved.<ext>, if it exists (see ToleranceMask::serialize)
+    ImageComparator& setToleranceMask(std::shared_ptr<const ToleranceMask> mask);
+
+    bool contentsAreEquivalent(std::string receivedPath, std::string approvedPath) const override;
+
+    template<typename ConcreteImageComparator, typename... Arguments>
+    static std::shared_ptr<ImageComparator> make(Arguments&&... args)
+    {
+        std::shared_ptr<CompareStrategy> imgComparator(
+            new ConcreteImageComparator(std::forward<Arguments>(args)...));
+
+        return std::make_shared<ImageComparator>(std::move(imgComparator));
+    }
+
+    template<typename Strategy, typename... Arguments>
+    static Disposer registerForAllExtensions(Arguments&&... args)
+    {
+        auto strategy = std::make_shared<Strategy>(std::forward<Arguments>(args)...);
+        return registerForAllExtensions(strategy);
+    }
+
+    static Disposer registerForAllExtensions(std::shared_ptr<CompareStrategy> strategy);
+
+private:
+    std::shared_ptr<CompareStrategy> m_compareStrategy;
+    size_t m_bandMemoryLimit = 0;
+    float m_diffAmplification = 0.0f;
+    std::shared_ptr<const ToleranceMask> m_toleranceMask;
+};
+
+// Compares every layer of multi-layer files (see LayeredImage) and reports all failing layers at once.
+class LayeredImageComparator : public ApprovalTests::ApprovalComparator
+{
+public:
+    LayeredImageComparator();
+    explicit LayeredImageComparator(std::shared_ptr<CompareStrategy> defaultStrategy);
+
+    // Overrides the strategy for a single layer, e.g. a looser tolerance for a noisy AOV
+    LayeredImageComparator& setLayerStrategy(std::string layerName, std::shared_ptr<CompareStrategy> strategy);
+
+    bool contentsAreEquivalent(std::string receivedPath, std::string approvedPath) const override;
+
+private:
+    const CompareStrategy& getStrategy(const std::string& layerName) const;
+
+    std::shared_ptr<CompareStrategy> m_defaultStrategy;
+    std::map<std::string, std::shared_ptr<CompareStrategy>> m_layerStrategies;
+};
+
+}
+
+// include/ImageApprovals/AsyncVerifier.hpp
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ImageApprovals {
+
+// Verifies images on background threads, so that the caller can carry on, e.g. render the next frame.
+// Each verification writes <pathWithoutExtension>.received<ext>, compares it with
+// <pathWithoutExtension>.approved<ext> and removes the received file if they match.
+class AsyncVerifier
+{
+public:
+    // At most maxQueuedImages images wait for a thread at a time; verify blocks while the queue is full.
+    // A single thread is usually enough, as comparisons are already parallel.
+    explicit AsyncVerifier(
+        std::shared_ptr<CompareStrategy> strategy = std::make_shared<ThresholdCompareStrategy>(),
+        size_t numThreads = 1, size_t maxQueuedImages = 4);
+
+    AsyncVerifier(const AsyncVerifier&) = delete;
+    AsyncVerifier& operator =(const AsyncVerifier&) = delete;
+
+    // Waits for all queued verifications
+    ~AsyncVerifier();
+
+    // The future throws ApprovalTests::ApprovalException (or the codec's error) if the verification fails.
+    // The first overload copies the pixels; the second shares ownership of the image.
+    std::future<void> verify(const ImageView& image, std::string pathWithoutExtension);
+    std::future<void> verify(std::shared_ptr<const Image> image, std::string pathWithoutExtension);
+
+    // Waits until every verification queued so far has finished
+    void join();
+
+private:
+    void runWorker();
+    void stopWorkers();
+
+    ImageComparator m_comparator;
+    size_t m_maxQueuedImages;
+
+    std::mutex m_mutex;
+    std::condition_variable m_stateChanged;
+    std::deque<std::packaged_task<void()>> m_queue;
+    size_t m_numRunning = 0;
+    bool m_stopping = false;
+
+    std::vector<std::thread> m_threads;
+};
+
+}
+
+// include/ImageApprovals/BatchVerifier.hpp
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ImageApprovals {
+
+// Verifies many images against their approved files on a pool of threads.
+// Each entry is written (for images), read, and compared independently; at most
+// getMaxImagesInFlight() entries are processed, and held in memory, at a time.
+class BatchVerifier
+{
+public:
+    struct Failure
+    {
+        std::string receivedPath;
+        std::string approvedPath;
+        std::string message;
+    };
+
+    explicit BatchVerifier(std::shared_ptr<CompareStrategy> strategy = std::make_shared<ThresholdCompareStrategy>());
+
+    // Defaults to the number of hardware threads
+    BatchVerifier& setMaxImagesInFlight(size_t maxImages);
+    size_t getMaxImagesInFlight() const { return m_maxImagesInFlight; }
+
+    // See ImageComparator::setBandMemoryLimit
+    BatchVerifier& setBandMemoryLimit(size_t maxBytes);
+
+    // Writes the image to <pathWithoutExtension>.received<ext>, with the extension of the
+    // best codec for the image, and compares it with <pathWithoutExtension>.approved<ext>.
+    // The pixels are not copied, so the image must stay valid until run() returns.
+    BatchVerifier& add(const ImageView& image, std::string pathWithoutExtension);
+
+    // Compares a received file that already exists with its approved file
+    BatchVerifier& addFiles(std::string receivedPath, std::string approvedPath);
+
+    size_t getNumberOfEntries() const { return m_entries.size(); }
+
+    // Returns the failures in the order in which the entries were added. As with
+    // single approvals, received files written from images are removed when they match.
+    std::vector<Failure> run() const;
+
+    // Runs all entries and throws ApprovalTests::ApprovalException describing every failure
+    void verify() const;
+
+private:
+    struct Entry
+    {
+        // Null for entries added with addFiles
+        const ImageCodec* codec;
+        ImageView image;
+        std::string receivedPath;
+        std::string approvedPath;
+    };
+
+    // Returns false and fills in failure if the entry does not match
+    bool runEntry(const Entry& entry, Failure& failure) const;
+
+    std::shared_ptr<CompareStrategy> m_strategy;
+    size_t m_maxImagesInFlight;
+    size_t m_bandMemoryLimit = 0;
+    std::vector<Entry> m_entries;
+};
+
+}
+
+// include/ImageApprovals/ImageWriter.hpp
+
+#include <ApprovalTests.hpp>
+#include <stdexcept>
+#include <type_traits>
+
+namespace ImageApprovals {
+
+class ImageWriter : public ApprovalTests::ApprovalWriter
+{
+public:
+    explicit ImageWriter(const ImageView& image)
+        : m_image(image), m_codec(ImageCodec::getBestCodec(image))
+    {}
+
+    ImageWriter(const ImageWriter&) = delete;
+
+    std::string getFileExtensionWithDot() const override
+    {
+        return m_codec.getFileExtensionWithDot();
+    }
+
+    void write(std::string path) const override
+    {
+        m_codec.write(path, m_image);
+    }
+
+    void cleanUpReceived(std::string receivedPath) const override
+    {
+        remove(receivedPath.c_str());
+    }
+
+private:
+    const ImageView m_image;
+    const ImageCodec& m_codec;
+};
+
+// Writes all layers to one file; the layers must outlive the writer
+class LayeredImageWriter : public ApprovalTests::ApprovalWriter
+{
+public:
+    explicit LayeredImageWriter(const LayeredImage& image, const std::string& extensionWithDot = ".exr")
+        : m_image(image), m_codec(ImageCodec::getBestCodec(extensionWithDot))
+    {}
+
+    LayeredImageWriter(const LayeredImageWriter&) = delete;
+
+    std::string getFileExtensionWithDot() const override
+    {
+        return m_codec.getFileExtensionWithDot();
+    }
+
+    void write(std::string path) const override
+    {
+        m_codec.writeLayers(path, m_image);
+    }
+
+    void cleanUpReceived(std::string receivedPath) const override
+    {
+        remove(receivedPath.c_str());
+    }
+
+private:
+    const LayeredImage& m_image;
+    const ImageCodec& m_codec;
+};
+
+}
+
+// include/ImageApprovals.hpp
+
+#ifdef ImageApprovals_CONFIG_IMPLEMENT
+
+// src/ColorDifference.hpp
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace ImageApprovals { namespace detail {
+
+// CIE L*a*b* with the D65 white point
+struct Lab
+{
+    float l = 0.0f;
+    float a = 0.0f;
+    float b = 0.0f;
+
+    Lab() = default;
+
+    Lab(float l, float a, float b)
+        : l(l), a(a), b(b)
+    {}
+};
+
+// Cube root of positive values: a first guess from the float bits, refined by Newton steps
+// to about float precision; branch-free, so that loops over it can be vectorized
+inline float fastCbrt(float x)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    bits = bits / 3 + 709921077u;
+
+    float y;
+    std::memcpy(&y, &bits, sizeof(y));
+
+    y = (2.0f * y + x / (y * y)) * (1.0f / 3.0f);
+    y = (2.0f * y + x / (y * y)) * (1.0f / 3.0f);
+    y = (2.0f * y + x / (y * y)) * (1.0f / 3.0f);
+
+    return y;
+}
+
+inline float labCompand(float t)
+{
+    const float epsilon = 216.0f / 24389.0f;
+    const float kappa = 24389.0f / 27.0f;
+
+    return (t > epsilon) ? fastCbrt(t) : (kappa * t + 16.0f) / 116.0f;
+}
+
+// From linear sRGB; alpha is ignored
+inline Lab linearSRgbToLab(const RGBA& p)
+{
+    const float x = (0.4124564f * p.r + 0.3575761f * p.g + 0.1804375f * p.b) * (1.0f / 0.95047f);
+    const float y = 0.2126729f * p.r + 0.7151522f * p.g + 0.0721750f * p.b;
+    const float z = (0.0193339f * p.r + 0.1191920f * p.g + 0.9503041f * p.b) * (1.0f / 1.08883f);
+
+    const float fx = labCompand(x);
+    const float fy = labCompand(y);
+    const float fz = labCompand(z);
+
+    return Lab(116.0f * fy - 16.0f, 500.0f * (fx - fy), 200.0f * (fy - fz));
+}
+
+inline float deltaE76(const Lab& left, const Lab& right)
+{
+    const float dl = left.l - right.l;
+    const float da = left.a - right.a;
+    const float db = left.b - right.b;
+
+    return std::sqrt(dl * dl + da * da + db * db);
+}
+
+double deltaE2000(const Lab& left, const Lab& right);
+
+// deltaE2000 <= deltaE2000Bound * deltaE76 for any pair of colors: the weights S_L, S_C and S_H
+// are at least 1, the rotation term adds at most the chroma and hue terms once more, and a' is at
+// most 1.5 a, so deltaE2000^2 <= dL^2 + 2 * 1.5^2 * (da^2 + db^2); rounded up for float errors
+const float deltaE2000Bound = 2.125f;
+
+} }
+
+// src/ColorSpace.cpp
+
+#include <ostream>
+
+namespace ImageApprovals {
+
+namespace detail {
+
+struct LinearColorSpace : ColorSpace
+{
+    const char* getName() const override
+    { return "Linear sRGB"; }
+};
+
+struct SRGBColorSpace : ColorSpace
+{
+    const char* getName() const override
+    { return "sRGB"; }
+};
+
+}
+
+const ColorSpace& ColorSpace::getLinearSRgb()
+{
+    static const detail::LinearColorSpace instance;
+    return instance;
+}
+
+const ColorSpace& ColorSpace::getSRgb()
+{
+    static const detail::SRGBColorSpace instance;
+    return instance;
+}
+
+std::ostream& operator <<(std::ostream& stream, const ColorSpace& colorSpace)
+{
+    return stream << colorSpace.getName();
+}
+
+}
+
+// src/ColorSpaceUtils.hpp
+
+#include <cstdint>
+#include <cmath>
+
+namespace ImageApprovals { namespace detail {
+
+struct RgbPrimaries
+{
+    struct Primary
+    {
+        double x = 0.0, y = 0.0;
+
+        Primary() = default;
+        Primary(const Primary&) = default;
+
+        Primary(double x, double y)
+            : x(x), y(y)
+        {}
+
+        Primary& operator =(const Primary&) = default;
+
+        bool approxEqual(const Primary& other) const;
+    };
+
+    Primary r, g, b;
+
+    bool approxEqual(const RgbPrimaries& other) const;
+
+    static RgbPrimaries getSRgbPrimaries();
+};
+
+bool isSRgbIccProfile(uint32_t profLen, const uint8_t* profData);
+
+const ColorSpace* detectColorSpace(const RgbPrimaries& primaries, double gamma);
+
+float sRgbToLinear(float value);
+
+float linearToSRgb(float value);
+
+} }
+
+// src/ConversionUtils.hpp
+
+#include <cstdint>
+
+namespace ImageApprovals { namespace detail {
+
+enum class Transfer
+{
+    None,
+    SRgbToLinear,
+    LinearToSRgb
+};
+
+using DecodeRowFn = void (*)(const uint8_t* src, uint32_t width, RGBA* dst, Transfer transfer);
+using EncodeRowFn = void (*)(const RGBA* src, uint32_t width, uint8_t* dst, Transfer transfer);
+
+DecodeRowFn getDecodeRowFn(const PixelFormat& format);
+EncodeRowFn getEncodeRowFn(const PixelFormat& format);
+
+// Decodes width pixels into normalized RGBA values, without changing the color space
+void decodeRow(const PixelFormat& format, const uint8_t* src, uint32_t width, RGBA* dst);
+
+class PixelConverter
+{
+public:
+    PixelConverter(const PixelFormat& srcFormat, const ColorSpace& srcColorSpace,
+                   const PixelFormat& dstFormat, const ColorSpace& dstColorSpace);
+
+    // buffer must have room for at least width elements
+    void convertRow(const uint8_t* src, uint32_t width, RGBA* buffer, uint8_t* dst) const;
+
+private:
+    DecodeRowFn m_decode = nullptr;
+    EncodeRowFn m_encode = nullptr;
+    Transfer m_decodeTransfer = Transfer::None;
+    Transfer m_encodeTransfer = Transfer::None;
+};
+
+} }
+
+// src/ExrImageCodec.hpp
+
+#ifdef ImageApprovals_CONFIG_WITH_OPENEXR
+
+
+namespace ImageApprovals { namespace detail {
+
+// How the colors of RGBA images are stored in EXR files
+enum class ExrAlphaStorage
+{
+    // Colors are written and read back as RgbAlphaF32, unchanged
+    Straight,
+    // Colors are premultiplied, as most EXR tools expect, and read back as RgbAlphaF32Premultiplied.
+    // Approved files written with straight alpha then fail where alpha is not 1; to migrate them,
+    // read them with a Straight codec and write them again with a Premultiplied one.
+    Premultiplied
+};
+
+class ExrImageCodec : public ImageCodec
+{
+public:
+    // Single-channel images are written to the channel with the given name,
+    // e.g. "Y" for luminance or "Z" for depth
+    explicit ExrImageCodec(std::string grayChannelName = "Y", ExrAlphaStorage alphaStorage = ExrAlphaStorage::Straight);
+
+    std::string getFileExtensionWithDot() const override;
+
+    int getScore(const std::string& extensionWithDot) const override;
+    int getScore(const PixelFormat& pf, const ColorSpace& cs) const override;
+
+protected:
+    Image readFromStream(std::istream& stream, const std::string& fileName) const override;
+    void writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const override;
+
+    Image decodeFromMemory(const uint8_t* data, size_t size) const override;
+    void encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const override;
+
+    // Reads every channel of every part; see getExrLayers for how channels are grouped
+    LayeredImage readLayersFromStream(std::istream& stream, const std::string& fileName) const override;
+    void writeLayersToStream(const LayeredImage& image, std::ostream& stream, const std::string& fileName) const override;
+
+    std::unique_ptr<ImageReader> openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const override;
+    std::unique_ptr<ImageRowWriter> openRowWriterForStream(
+        std::unique_ptr<std::ostream> stream, const std::string& fileName,
+        const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const override;
+
+private:
+    std::string m_grayChannelName;
+    ExrAlphaStorage m_alphaStorage;
+};
+
+} }
+
+#endif // ImageApprovals_CONFIG_WITH_OPENEXR
+
+// src/FailureMask.cpp
+
+#include <algorithm>
+#include <sstream>
+
+namespace ImageApprovals {
+
+const uint32_t FailureMask::defaultTileSize;
+const size_t FailureMask::defaultMaxRuns;
+
+FailureMask::FailureMask(const Size& imageSize, uint32_t tileSize, size_t maxRuns)
+    : m_imageSize(imageSize)
+    , m_tileSize(tileSize)
+    , m_maxRuns(maxRuns)
+{
+    if (tileSize == 0)
+    {
+        throw ImageApprovalsError("Tile size of a failure mask must not be zero");
+    }
+}
+
+void FailureMask::addRun(uint32_t y, uint32_t x, uint32_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    const uint32_t end = x + length;
+
+    m_numFailedPixels += length;
+
+    m_minX = std::min(m_minX, x);
+    m_maxX = std::max(m_maxX, end - 1);
+    m_minY = std::min(m_minY, y);
+    m_maxY = std::max(m_maxY, y);
+
+    const uint32_t tileRow = y / m_tileSize;
+    for (uint32_t column = x / m_tileSize; column <= (end - 1) / m_tileSize; ++column)
+    {
+        const uint32_t tileBegin = std::max(x, column * m_tileSize);
+        const uint32_t tileEnd = std::min(end, (column + 1) * m_tileSize);
+
+        m_tileCounts[uint64_t(tileRow) * getNumTileColumns() + column] += tileEnd - tileBegin;
+    }
+
+    if (!m_runs.empty() && m_runs.back().y == y && m_runs.back().x + m_runs.back().length == x)
+    {
+        m_runs.back().length += length;
+    }
+    else if (m_runs.size() < m_maxRuns)
+    {
+        m_runs.push_back(Run{ y, x, length });
+    }
+    else
+    {
+        m_complete = false;
+    }
+}
+
+FailureMask::Rect FailureMask::getBoundingBox() const
+{
+    Rect rect;
+
+    if (!isEmpty())
+    {
+        rect.x = m_minX;
+        rect.y = m_minY;
+        rect.width = m_maxX - m_minX + 1;
+        rect.height = m_maxY - m_minY + 1;
+    }
+
+    return rect;
+}
+
+std::vector<FailureMask::Tile> FailureMask::getTiles() const
+{
+    const uint64_t numColumns = getNumTileColumns();
+
+    std::vector<Tile> tiles;
+    tiles.reserve(m_tileCounts.size());
+
+    for (const auto& entry : m_tileCounts)
+    {
+        tiles.push_back(Tile{
+            static_cast<uint32_t>(entry.first % numColumns),
+            static_cast<uint32_t>(entry.first / numColumns),
+            entry.second });
+    }
+
+    return tiles;
+}
+
+bool FailureMask::contains(uint32_t x, uint32_t y) const
+{
+    // The last run starting at or before (x, y)
+    const auto it = std::upper_bound(m_runs.begin(), m_runs.end(), Run{ y, x, 0 }, [](const Run& lhs, const Run& rhs) {
+        return (lhs.y < rhs.y) || ((lhs.y == rhs.y) && (lhs.x < rhs.x));
+    });
+
+    if (it == m_runs.begin())
+    {
+        return false;
+    }
+
+    const Run& run = *(it - 1);
+    return (run.y == y) && (x - run.x < run.length);
+}
+
+std::string FailureMask::serialize() const
+{
+    std::ostringstream stream;
+
+    const Rect box = getBoundingBox();
+
+    stream << "failure-mask " << m_imageSize.width << " " << m_imageSize.height << " " << m_tileSize
+           << " " << m_numFailedPixels << " " << (m_complete ? 1 : 0) << "\n";
+    stream << "bounds " << box.x << " " << box.y << " " << box.width << " " << box.height << "\n";
+
+    const auto tiles = getTiles();
+    stream << "tiles " << tiles.size() << "\n";
+    for (const auto& tile : tiles)
+    {
+        stream << tile.column << " " << tile.row << " " << tile.numFailedPixels << "\n";
+    }
+
+    stream << "runs " << m_runs.size() << "\n";
+    for (const auto& run : m_runs)
+    {
+        stream << run.y << " " << run.x << " " << run.length << "\n";
+    }
+
+    return stream.str();
+}
+
+FailureMask FailureMask::deserialize(const std::string& text)
+{
+    std::istringstream stream(text);
+
+    auto expect = [&](const char* keyword) {
+        std::string word;
+        if (!(stream >> word) || word != keyword)
+        {
+            throw ImageApprovalsError(std::string("Invalid failure mask: expected \"") + keyword + "\"");
+        }
+    };
+
+    auto check = [&]() {
+        if (!stream)
+        {
+            throw ImageApprovalsError("Invalid failure mask: truncated or malformed numbers");
+        }
+    };
+
+    FailureMask mask;
+    Rect box;
+    int complete = 1;
+    size_t numTiles = 0, numRuns = 0;
+
+    expect("failure-mask");
+    stream >> mask.m_imageSize.width >> mask.m_imageSize.height >> mask.m_tileSize >> mask.m_numFailedPixels >> complete;
+    expect("bounds");
+    stream >> box.x >> box.y >> box.width >> box.height;
+    expect("tiles");
+    stream >> numTiles;
+    check();
+
+    if (mask.m_tileSize == 0)
+    {
+        throw ImageApprovalsError("Invalid failure mask: tile size is zero");
+    }
+
+    const uint64_t numColumns = mask.getNumTileColumns();
+
+    for (size_t i = 0; i < numTiles; ++i)
+    {
+        Tile tile;
+        stream >> tile.column >> tile.row >> tile.numFailedPixels;
+        check();
+
+        mask.m_tileCounts[uint64_t(tile.row) * numColumns + tile.column] = tile.numFailedPixels;
+    }
+
+    expect("runs");
+    stream >> numRuns;
+    check();
+
+    for (size_t i = 0; i < numRuns; ++i)
+    {
+        Run run;
+        stream >> run.y >> run.x >> run.length;
+        check();
+
+        if (run.length == 0 || run.y >= mask.m_imageSize.height || run.x > mask.m_imageSize.width
+            || run.length > mask.m_imageSize.width - run.x)
+        {
+            throw ImageApprovalsError("Invalid failure mask: run " + std::to_string(i) + " is empty or outside of the image");
+        }
+
+        // contains() relies on runs in row-major order that do not overlap
+        if (!mask.m_runs.empty())
+        {
+            const Run& previous = mask.m_runs.back();
+
+            if (run.y < previous.y || (run.y == previous.y && run.x < previous.x + previous.length))
+            {
+                throw ImageApprovalsError("Invalid failure mask: run " + std::to_string(i) + " overlaps or precedes the previous run");
+            }
+        }
+
+        mask.m_runs.push_back(run);
+    }
+
+    mask.m_complete = (complete != 0);
+    mask.m_maxRuns = std::max(defaultMaxRuns, mask.m_runs.size());
+
+    if (box.width != 0 && box.height != 0)
+    {
+        mask.m_minX = box.x;
+        mask.m_minY = box.y;
+        mask.m_maxX = box.x + box.width - 1;
+        mask.m_maxY = box.y + box.height - 1;
+    }
+
+    return mask;
+}
+
+uint64_t FailureMask::getNumTileColumns() const
+{
+    return std::max<uint64_t>((uint64_t(m_imageSize.width) + m_tileSize - 1) / m_tileSize, 1);
+}
+
+}
+
+// src/Image.cpp
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace ImageApprovals {
+
+namespace detail {
+
+uint64_t alignedSize(uint64_t baseSize, uint64_t alignment)
+{
+    return ((baseSize + alignment - 1) / alignment) * alignment;
+}
+
+std::ptrdiff_t rowStride(const PixelFormat& fmt, const Size& sz, size_t rowAlignment)
+{
+    if (rowAlignment == 0)
+    {
+        return 0;
+    }
+
+    // Sizes are computed in 64 bits, so that only images that cannot be addressed are rejected
+    const uint64_t rowSize = alignedSize(uint64_t(fmt.getPixelStride()) * sz.width, rowAlignment);
+    const uint64_t imageSize = rowSize * sz.height;
+
+    if (rowSize > uint64_t(std::numeric_limits<std::ptrdiff_t>::max())
+        || imageSize / std::max<uint64_t>(rowSize, 1) != sz.height
+        || imageSize > uint64_t(std::numeric_limits<std::ptrdiff_t>::max()))
+    {
+        throw ImageApprovalsError("Image is too large to be addressed");
+    }
+
+    return static_cast<std::ptrdiff_t>(rowSize);
+}
+
+}
+
+Image::Image(Image&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+Image::Image(const PixelFormat& format, const ColorSpace& colorSpace, const Size& size, size_t rowAlignment)
+    : ImageView(format, colorSpace, size, detail::rowStride(format, size, rowAlignment), nullptr), m_rowAlignment(rowAlignment)
+{
+    if (m_size.isZero())
+    {
+        throw ImageApprovalsError("Image size cannot be zero");
+    }
+
+    if (m_rowAlignment == 0)
+    {
+        throw ImageApprovalsError("Image row alignment must be greater than 0");
+    }
+
+    const auto rowStride = static_cast<size_t>(getRowStride());
+
+    m_data.reset(new uint8_t[rowStride * m_size.height]);
+    m_dataPtr = m_data.get();
+
+    for (uint32_t y = 0; y < m_size.height; ++y)
+    {
+        std::memset(getRowPointer(y), 0, rowStride);
+    }
+}
+
+Image::~Image() noexcept = default;
+
+Image& Image::operator =(Image&& rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        m_format = rhs.m_format;
+        rhs.m_format = nullptr;
+
+        m_colorSpace = rhs.m_colorSpace;
+        rhs.m_colorSpace = nullptr;
+
+        m_size = rhs.m_size;
+        rhs.m_size = {};
+
+        m_rowStride = rhs.m_rowStride;
+        rhs.m_rowStride = 0;
+
+        m_rowAlignment = rhs.m_rowAlignment;
+        rhs.m_rowAlignment = 0;
+
+        m_data = std::move(rhs.m_data);
+
+        m_dataPtr = m_data.get();
+        rhs.m_dataPtr = nullptr;
+    }
+
+    return *this;
+}
+
+uint8_t* Image::getRowPointer(uint32_t y)
+{
+    if (y >= m_size.height)
+    {
+        throw ImageApprovalsError("Row index out of range");
+    }
+
+    const auto rowStride = static_cast<size_t>(getRowStride());
+    return &m_data[rowStride * y];
+}
+
+void Image::flipVertically()
+{
+    const auto rowSize = getPixelFormat().getPixelStride() * m_size.width;
+
+    for (uint32_t y = 0; y < m_size.height / 2; ++y)
+    {
+        auto upperRow = getRowPointer(y);
+        auto lowerRow = getRowPointer(m_size.height - y - 1);
+
+        std::swap_ranges(upperRow, upperRow + rowSize, lowerRow);
+    }
+}
+
+}
+
+// src/ImageRowWriter.cpp
+
+namespace ImageApprovals {
+
+ImageRowWriter::ImageRowWriter(const PixelFormat& format, const ColorSpace& colorSpace, const Size& size)
+    : m_format(&format), m_colorSpace(&colorSpace), m_size(size)
+{
+    if (m_size.isZero())
+    {
+        throw ImageApprovalsError("Image size cannot be zero");
+    }
+}
+
+void ImageRowWriter::writeRows(const ImageView& rows)
+{
+    if (m_finished)
+    {
+        throw ImageApprovalsError("Cannot write rows after the image is finished");
+    }
+
+    if (rows.getPixelFormat() != *m_format || rows.getColorSpace() != *m_colorSpace)
+    {
+        throw ImageApprovalsError("Rows must have the pixel format and color space of the image");
+    }
+
+    const auto rowsSize = rows.getSize();
+
+    if (rowsSize.width != m_size.width)
+    {
+        throw ImageApprovalsError("Rows must have the width of the image");
+    }
+
+    if (rowsSize.height > m_size.height - m_numWrittenRows)
+    {
+        throw ImageApprovalsError("Too many rows written to the image");
+    }
+
+    if (rowsSize.height == 0)
+    {
+        return;
+    }
+
+    appendRows(m_numWrittenRows, rows);
+    m_numWrittenRows += rowsSize.height;
+}
+
+void ImageRowWriter::finish()
+{
+    if (m_finished)
+    {
+        return;
+    }
+
+    if (m_numWrittenRows != m_size.height)
+    {
+        throw ImageApprovalsError("Cannot finish an image before all rows are written");
+    }
+
+    finishFile();
+    m_finished = true;
+}
+
+}
+
+// src/ImageView.cpp
+
+#include <stdexcept>
+#include <cstring>
+#include <ostream>
+
+namespace ImageApprovals {
+
+std::ostream& operator <<(std::ostream& stream, const Size& size)
+{
+    stream << "[" << size.width << ", " << size.height << "]";
+    return stream;
+}
+
+ImageView::ImageView(const PixelFormat& format, const ColorSpace& colorSpace,
+                     const Size& size, std::ptrdiff_t rowStride, const uint8_t* data)
+    : m_format(&format), m_colorSpace(&colorSpace), m_size(size),
+      m_rowStride(rowStride), m_dataPtr(data)
+{}
+
+Image ImageView::copy() const
+{
+    if(isEmpty())
+    {
+        return {};
+    }
+
+    const auto sz = getSize();
+    const auto& pf = getPixelFormat();
+
+    Image imgCopy(pf, getColorSpace(), sz);
+
+    const size_t pixelStride = pf.getPixelStride();
+    for(uint32_t y = 0; y < sz.height; ++y)
+    {
+        const auto srcRow = getRowPointer(y);
+        auto dstRow = imgCopy.getRowPointer(y);
+
+        std::memcpy(dstRow, srcRow, pixelStride * sz.width);
+    }
+
+    return imgCopy;
+}
+
+bool ImageView::isEmpty() const
+{
+    return m_format == nullptr;
+}
+
+const PixelFormat& ImageView::getPixelFormat() const
+{
+    if (!m_format)
+    {
+        throw ImageApprovalsError("Calling getPixelFormat on an empty ImageView");
+    }
+
+    return *m_format;
+}
+
+const ColorSpace& ImageView::getColorSpace() const
+{
+    if (!m_colorSpace)
+    {
+        throw ImageApprovalsError("Calling getColorSpace on an empty ImageView");
+    }
+
+    return *m_colorSpace;
+}
+
+const uint8_t* ImageView::getRowPointer(uint32_t index) const
+{
+    if (index >= m_size.height)
+    {
+        throw ImageApprovalsError("Row index out of range");
+    }
+
+    return m_dataPtr + m_rowStride * static_cast<std::ptrdiff_t>(index);
+}
+
+ImageView ImageView::flippedVertically() const
+{
+    if (isEmpty() || m_size.isZero())
+    {
+        return *this;
+    }
+
+    const auto lastRow = getRowPointer(m_size.height - 1);
+    return ImageView(*m_format, *m_colorSpace, m_size, -m_rowStride, lastRow);
+}
+
+ImageView ImageView::subView(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const
+{
+    if (x > m_size.width || width > m_size.width - x)
+    {
+        throw ImageApprovalsError("Sub-view exceeds the width of the view");
+    }
+
+    if (y > m_size.height || height > m_size.height - y)
+    {
+        throw ImageApprovalsError("Sub-view exceeds the height of the view");
+    }
+
+    const auto& fmt = getPixelFormat();
+
+    const uint8_t* dataPtr = m_dataPtr
+        + m_rowStride * static_cast<std::ptrdiff_t>(y)
+        + fmt.getPixelStride() * x;
+
+    return ImageView(fmt, getColorSpace(), Size(width, height), m_rowStride, dataPtr);
+}
+
+RGBA ImageView::getPixel(uint32_t x, uint32_t y) const
+{
+    if (x >= m_size.width)
+    {
+        throw ImageApprovalsError("X out of range");
+    }
+
+    const auto rowPtr = getRowPointer(y);
+
+    const auto& fmt = getPixelFormat();
+    const auto pixelStride = fmt.getPixelStride();
+
+    RGBA value;
+    fmt.decode(rowPtr + pixelStride * x, rowPtr + pixelStride * m_size.width, value);
+    return value;
+}
+
+}
+
+// src/LayeredImage.cpp
+
+namespace ImageApprovals {
+
+void LayeredImage::addLayer(std::string name, const ImageView& image, std::vector<std::string> channelNames)
+{
+    if (image.isEmpty())
+    {
+        throw ImageApprovalsError("Layer \"" + name + "\" is empty");
+    }
+
+    if (findLayer(name))
+    {
+        throw ImageApprovalsError("Duplicate layer \"" + name + "\"");
+    }
+
+    if (!channelNames.empty() && channelNames.size() != image.getPixelFormat().getNumberOfChannels())
+    {
+        throw ImageApprovalsError("Number of channel names does not match the pixel format of layer \"" + name + "\"");
+    }
+
+    Layer layer;
+    layer.name = std::move(name);
+    layer.channelNames = std::move(channelNames);
+    layer.image = image;
+
+    m_layers.push_back(std::move(layer));
+}
+
+void LayeredImage::addLayer(std::string name, Image&& image, std::vector<std::string> channelNames)
+{
+    m_ownedImages.emplace_back(new Image(std::move(image)));
+
+    try
+    {
+        addLayer(std::move(name), static_cast<const ImageView&>(*m_ownedImages.back()), std::move(channelNames));
+    }
+    catch (...)
+    {
+        m_ownedImages.pop_back();
+        throw;
+    }
+}
+
+const LayeredImage::Layer& LayeredImage::getLayer(size_t index) const
+{
+    if (index >= m_layers.size())
+    {
+        throw ImageApprovalsError("Layer index out of range");
+    }
+
+    return m_layers[index];
+}
+
+const LayeredImage::Layer* LayeredImage::findLayer(const std::string& name) const
+{
+    for (const auto& layer : m_layers)
+    {
+        if (layer.name == name)
+        {
+            return &layer;
+        }
+    }
+
+    return nullptr;
+}
+
+}
+
+// src/Parallel.hpp
+
+#include <cstddef>
+#include <functional>
+
+namespace ImageApprovals { namespace detail {
+
+// All functions below run their work on the calling thread alone when called from work they
+// are already running in parallel, e.g. a compare inside a batch of verifications, so that
+// nested calls do not multiply the number of threads.
+
+// Splits [0, count) into contiguous ranges of at least minRangeSize items
+// and calls fn(begin, end) for each of them, on multiple threads if there
+// is enough work. The first exception thrown by fn is rethrown.
+void parallelFor(size_t count, size_t minRangeSize, const std::function<void(size_t, size_t)>& fn);
+
+// Calls fn(index) for every index in [0, count) on at most maxThreads threads,
+// each of which takes the next index as soon as it is done with the previous
+// one. The first exception thrown by fn is rethrown.
+void parallelForEach(size_t count, size_t maxThreads, const std::function<void(size_t)>& fn);
+
+// Calls first on the calling thread while second runs on another one, and
+// waits for both. An exception thrown by first takes precedence over one
+// thrown by second.
+void parallelInvoke(const std::function<void()>& first, const std::function<void()>& second);
+
+} }
+
+// src/PixelFormat.cpp
+
+#include <stdexcept>
+#include <ostream>
+#include <type_traits>
+
+namespace ImageApprovals {
+
+namespace detail {
+
+template<typename Traits>
+struct TraitsPixelFormat : PixelFormat
+{
+    const char* getName() const override { return Traits::getName(); }
+
+    size_t getNumberOfChannels() const override { return Traits::numChannels; }
+    size_t getPixelStride() const override { return Traits::pixelStride; }
+
+    bool isU8() const override { return std::is_same<typename Traits::ChannelType, uint8_t>::value; }
+    bool isU16() const override { return std::is_same<typename Traits::ChannelType, uint16_t>::value; }
+    bool isF32() const override { return std::is_same<typename Traits::ChannelType, float>::value; }
+
+    void decode(const uint8_t* begin, RGBA& outRgba) const override
+    {
+        outRgba = Traits::decode(begin);
+    }
+};
+
+}
+
+const uint8_t* PixelFormat::decode(const uint8_t* begin, const uint8_t* end, RGBA& outRgba) const
+{
+    const auto stride = getPixelStride();
+    if (begin + stride > end)
+    {
+        throw ImageApprovalsError("begin + stride > end");
+    }
+
+    decode(begin, outRgba);
+    return begin + stride;
+}
+
+const PixelFormat& PixelFormat::getGrayU8()
+{
+    static const detail::TraitsPixelFormat<GrayU8Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getGrayAlphaU8()
+{
+    static const detail::TraitsPixelFormat<GrayAlphaU8Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getRgbU8()
+{
+    static const detail::TraitsPixelFormat<RgbU8Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getRgbAlphaU8()
+{
+    static const detail::TraitsPixelFormat<RgbAlphaU8Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getBgrU8()
+{
+    static const detail::TraitsPixelFormat<BgrU8Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getBgrAlphaU8()
+{
+    static const detail::TraitsPixelFormat<BgrAlphaU8Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getAlphaRgbU8()
+{
+    static const detail::TraitsPixelFormat<AlphaRgbU8Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getGrayAlphaU8Premultiplied()
+{
+    static const detail::TraitsPixelFormat<GrayAlphaU8PremultipliedTraits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getRgbAlphaU8Premultiplied()
+{
+    static const detail::TraitsPixelFormat<RgbAlphaU8PremultipliedTraits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getBgrAlphaU8Premultiplied()
+{
+    static const detail::TraitsPixelFormat<BgrAlphaU8PremultipliedTraits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getAlphaRgbU8Premultiplied()
+{
+    static const detail::TraitsPixelFormat<AlphaRgbU8PremultipliedTraits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getGrayU16()
+{
+    static const detail::TraitsPixelFormat<GrayU16Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getGrayAlphaU16()
+{
+    static const detail::TraitsPixelFormat<GrayAlphaU16Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getRgbU16()
+{
+    static const detail::TraitsPixelFormat<RgbU16Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getRgbAlphaU16()
+{
+    static const detail::TraitsPixelFormat<RgbAlphaU16Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getRgbAlphaU16Premultiplied()
+{
+    static const detail::TraitsPixelFormat<RgbAlphaU16PremultipliedTraits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getGrayF32()
+{
+    static const detail::TraitsPixelFormat<GrayF32Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getGrayAlphaF32()
+{
+    static const detail::TraitsPixelFormat<GrayAlphaF32Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getRgbF32()
+{
+    static const detail::TraitsPixelFormat<RgbF32Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getRgbAlphaF32()
+{
+    static const detail::TraitsPixelFormat<RgbAlphaF32Traits> instance;
+    return instance;
+}
+
+const PixelFormat& PixelFormat::getRgbAlphaF32Premultiplied()
+{
+    static const detail::TraitsPixelFormat<RgbAlphaF32PremultipliedTraits> instance;
+    return instance;
+}
+
+std::ostream& operator <<(std::ostream& stream, const PixelFormat& format)
+{
+    stream << format.getName();
+    return stream;
+}
+
+std::ostream& operator <<(std::ostream& stream, const RGBA& rgba)
+{
+    stream << "(" << rgba.r << ", " << rgba.g << ", " << rgba.b << ", " << rgba.a << ")";
+    return stream;
+}
+
+}
+
+// src/PngImageCodec.hpp
+
+#ifdef ImageApprovals_CONFIG_WITH_LIBPNG
+
+
+namespace ImageApprovals { namespace detail {
+
+enum class PngCompression
+{
+    Default,
+    // For files written on every failure, such as diff images
+    Fastest
+};
+
+class PngImageCodec : public ImageCodec
+{
+public:
+    explicit PngImageCodec(PngCompression compression = PngCompression::Default);
+
+    std::string getFileExtensionWithDot() const override;
+
+    int getScore(const std::string& extensionWithDot) const override;
+    int getScore(const PixelFormat& pf, const ColorSpace& cs) const override;
+
+protected:
+    Image readFromStream(std::istream& stream, const std::string& fileName) const override;
+    void writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const override;
+
+    Image decodeFromMemory(const uint8_t* data, size_t size) const override;
+    void encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const override;
+
+    // Reads and writes row by row with png_read_row and png_write_row
+    std::unique_ptr<ImageReader> openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const override;
+    std::unique_ptr<ImageRowWriter> openRowWriterForStream(
+        std::unique_ptr<std::ostream> stream, const std::string& fileName,
+        const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const override;
+
+private:
+    PngCompression m_compression;
+};
+
+} }
+
+#endif // ImageApprovals_CONFIG_WITH_LIBPNG
+
+// src/Qt5Integration.cpp
+
+#ifdef ImageApprovals_CONFIG_WITH_QT5
+
+#include <QImage>
+
+namespace ImageApprovals {
+
+namespace detail {
+
+const PixelFormat* fromQt5PixelFormat(const QImage& image)
+{
+    // 32-bit formats store 0xAARRGGBB words, so their byte order depends on the host
+    const bool littleEndian = (Q_BYTE_ORDER == Q_LITTLE_ENDIAN);
+
+    switch (image.format())
+    {
+        case QImage::Format_Grayscale8:
+        case QImage::Format_Alpha8:
+            return &PixelFormat::getGrayU8();
+        case QImage::Format_RGB888:
+            return &PixelFormat::getRgbU8();
+        case QImage::Format_RGBA8888:
+        case QImage::Format_RGBX8888:
+            return &PixelFormat::getRgbAlphaU8();
+        case QImage::Format_RGBA8888_Premultiplied:
+            return &PixelFormat::getRgbAlphaU8Premultiplied();
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+            return littleEndian ? &PixelFormat::getBgrAlphaU8() : &PixelFormat::getAlphaRgbU8();
+        case QImage::Format_ARGB32_Premultiplied:
+            return littleEndian ? &PixelFormat::getBgrAlphaU8Premultiplied() : &PixelFormat::getAlphaRgbU8Premultiplied();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+        case QImage::Format_RGBX64:
+        case QImage::Format_RGBA64:
+            return &PixelFormat::getRgbAlphaU16();
+        case QImage::Format_RGBA64_Premultiplied:
+            return &PixelFormat::getRgbAlphaU16Premultiplied();
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+        case QImage::Format_Grayscale16:
+            return &PixelFormat::getGrayU16();
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        case QImage::Format_BGR888:
+            return &PixelFormat::getBgrU8();
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+        // Half-float formats have no matching PixelFormat and still need convertToFormat
+        case QImage::Format_RGBX32FPx4:
+        case QImage::Format_RGBA32FPx4:
+            return &PixelFormat::getRgbAlphaF32();
+        case QImage::Format_RGBA32FPx4_Premultiplied:
+            return &PixelFormat::getRgbAlphaF32Premultiplied();
+#endif
+        default:
+            break;
+    }
+
+    return nullptr;
+}
+
+const ColorSpace* fromQt5ColorSpace(const QImage &image)
+{
+    // TODO QColorSpace was added in Qt 5.14
+    ((void) image);
+    return &ColorSpace::getSRgb();
+}
+
+}
+
+ImageView makeView(const QImage& image)
+{
+    auto format = detail::fromQt5PixelFormat(image);
+    auto colorSpace = detail::fromQt5ColorSpace(image);
+
+    if(!format)
+    {
+        throw ImageApprovalsError("Unsupported QImage::Format value");
+    }
+
+    if(!colorSpace)
+    {
+        throw ImageApprovalsError("Unsupported QColorSpace");
+    }
+
+    const auto w = static_cast<uint32_t>(image.width());
+    const auto h = static_cast<uint32_t>(image.height());
+    const auto stride = static_cast<size_t>(image.bytesPerLine());
+
+    return ImageView(*format, *colorSpace, Size(w, h), stride, image.constBits());
+}
+
+}
+
+#endif // ImageApprovals_CONFIG_WITH_QT5
+
+// src/ToleranceMask.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace ImageApprovals {
+
+namespace detail {
+
+// Masks are read from hand-edited files, so their size is limited before anything is allocated
+const uint32_t maxMaskDimension = 1u << 18;
+
+ImageApprovalsError makeMaskLineError(size_t lineNumber, const std::string& message)
+{
+    return ImageApprovalsError("Invalid tolerance mask, line " + std::to_string(lineNumber) + ": " + message);
+}
+
+// Digits only, so that signs and trailing characters are not silently accepted
+uint32_t parseMaskNumber(const std::string& token, size_t lineNumber)
+{
+    uint64_t value = 0;
+
+    for (const char c : token)
+    {
+        if (c < '0' || c > '9')
+        {
+            throw makeMaskLineError(lineNumber, "\"" + token + "\" is not a non-negative integer");
+        }
+
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+
+        if (value > UINT32_MAX)
+        {
+            throw makeMaskLineError(lineNumber, "\"" + token + "\" is too large");
+        }
+    }
+
+    return static_cast<uint32_t>(value);
+}
+
+float parseMaskThreshold(const std::string& token, size_t lineNumber)
+{
+    std::istringstream stream(token);
+    double value = 0.0;
+    char rest = 0;
+
+    if (!(stream >> value) || (stream >> rest) || !(value >= 0.0) || !std::isfinite(static_cast<float>(value)))
+    {
+        throw makeMaskLineError(lineNumber, "\"" + token + "\" is not a non-negative threshold");
+    }
+
+    return static_cast<float>(value);
+}
+
+bool sameSpans(const std::vector<ToleranceMask::Span>& lhs, const std::vector<ToleranceMask::Span>& rhs)
+{
+    return (lhs.size() == rhs.size())
+        && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](const ToleranceMask::Span& l, const ToleranceMask::Span& r) {
+               return (l.x == r.x) && (l.length == r.length) && (l.threshold == r.threshold);
+           });
+}
+
+}
+
+ToleranceMask::ToleranceMask(const Size& size)
+    : m_size(size)
+    , m_rows(size.height)
+{}
+
+ToleranceMask& ToleranceMask::ignoreRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    setRegion(x, y, width, height, std::numeric_limits<float>::infinity());
+    return *this;
+}
+
+ToleranceMask& ToleranceMask::setRegionThreshold(uint32_t x, uint32_t y, uint32_t width, uint32_t height, AbsThreshold threshold)
+{
+    if (!(threshold.value >= 0.0))
+    {
+        throw ImageApprovalsError("Region threshold must not be negative");
+    }
+
+    setRegion(x, y, width, height, static_cast<float>(threshold.value));
+    return *this;
+}
+
+void ToleranceMask::setRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height, float threshold)
+{
+    const uint32_t begin = std::min(x, m_size.width);
+    const uint32_t end = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(x) + width, m_size.width));
+    const uint32_t endRow = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(y) + height, m_size.height));
+
+    if (begin >= end)
+    {
+        return;
+    }
+
+    for (uint32_t row = y; row < endRow; ++row)
+    {
+        std::vector<Span> spans;
+        spans.reserve(m_rows[row].size() + 2);
+
+        bool inserted = false;
+
+        // Keeps the parts of the existing spans outside of [begin, end)
+        for (const Span& span : m_rows[row])
+        {
+            const uint32_t spanEnd = span.x + span.length;
+
+            if (span.x < begin)
+            {
+                spans.push_back(Span{ span.x, std::min(spanEnd, begin) - span.x, span.threshold });
+            }
+
+            if (spanEnd > end)
+            {
+                if (!inserted)
+                {
+                    spans.push_back(Span{ begin, end - begin, threshold });
+                    inserted = true;
+                }
+
+                const uint32_t rest = std::max(span.x, end);
+                spans.push_back(Span{ rest, spanEnd - rest, span.threshold });
+            }
+        }
+
+        if (!inserted)
+        {
+            spans.push_back(Span{ begin, end - begin, threshold });
+        }
+
+        m_rows[row] = std::move(spans);
+    }
+}
+
+uint64_t ToleranceMask::getNumIgnoredPixels() const
+{
+    uint64_t numIgnored = 0;
+
+    for (const auto& row : m_rows)
+    {
+        for (const Span& span : row)
+        {
+            numIgnored += span.isIgnored() ? span.length : 0;
+        }
+    }
+
+    return numIgnored;
+}
+
+std::string ToleranceMask::serialize() const
+{
+    std::ostringstream stream;
+    stream << std::setprecision(9);
+
+    stream << "tolerance-mask " << m_size.width << " " << m_size.height << "\n";
+
+    for (uint32_t y = 0; y < m_size.height;)
+    {
+        uint32_t height = 1;
+        while ((y + height < m_size.height) && detail::sameSpans(m_rows[y], m_rows[y + height]))
+        {
+            ++height;
+        }
+
+        for (const Span& span : m_rows[y])
+        {
+            if (span.isIgnored())
+            {
+                stream << "ignore " << span.x << " " << y << " " << span.length << " " << height << "\n";
+            }
+            else
+            {
+                stream << "threshold " << span.x << " " << y << " " << span.length << " " << height << " " << span.threshold << "\n";
+            }
+        }
+
+        y += height;
+    }
+
+    return stream.str();
+}
+
+ToleranceMask ToleranceMask::deserialize(const std::string& text)
+{
+    std::istringstream stream(text);
+
+    ToleranceMask mask;
+    bool hasHeader = false;
+
+    std::string line;
+    size_t lineNumber = 0;
+
+    while (std::getline(stream, line))
+    {
+        ++lineNumber;
+
+        std::istringstream lineStream(line);
+        std::vector<std::string> tokens;
+
+        for (std::string token; lineStream >> token;)
+        {
+            tokens.push_back(token);
+        }
+
+        if (tokens.empty())
+        {
+            continue;
+        }
+
+        if (!hasHeader)
+        {
+            if (tokens.size() != 3 || tokens[0] != "tolerance-mask")
+            {
+                throw detail::makeMaskLineError(lineNumber, "expected \"tolerance-mask width height\"");
+            }
+
+            const Size size(detail::parseMaskNumber(tokens[1], lineNumber), detail::parseMaskNumber(tokens[2], lineNumber));
+
+            if (size.width == 0 || size.height == 0 || size.width > detail::maxMaskDimension || size.height > detail::maxMaskDimension)
+            {
+                throw detail::makeMaskLineError(lineNumber, "size must be between 1 and " + std::to_string(detail::maxMaskDimension));
+            }
+
+            mask = ToleranceMask(size);
+            hasHeader = true;
+            continue;
+        }
+
+        const bool ignore = (tokens[0] == "ignore");
+
+        if (!(ignore && tokens.size() == 5) && !(tokens[0] == "threshold" && tokens.size() == 6))
+        {
+            throw detail::makeMaskLineError(lineNumber, "expected \"ignore x y width height\" or \"threshold x y width height value\"");
+        }
+
+        const uint32_t x = detail::parseMaskNumber(tokens[1], lineNumber);
+        const uint32_t y = detail::parseMaskNumber(tokens[2], lineNumber);
+        const uint32_t width = detail::parseMaskNumber(tokens[3], lineNumber);
+        const uint32_t height = detail::parseMaskNumber(tokens[4], lineNumber);
+
+        if (width == 0 || height == 0 || x > mask.m_size.width || width > mask.m_size.width - x
+            || y > mask.m_size.height || height > mask.m_size.height - y)
+        {
+            throw detail::makeMaskLineError(lineNumber, "region is empty or outside of the mask");
+        }
+
+        mask.setRegion(x, y, width, height,
+            ignore ? std::numeric_limits<float>::infinity() : detail::parseMaskThreshold(tokens[5], lineNumber));
+    }
+
+    if (!hasHeader)
+    {
+        throw ImageApprovalsError("Invalid tolerance mask: expected \"tolerance-mask width height\"");
+    }
+
+    return mask;
+}
+
+}
+
+// src/Units.cpp
+
+#include <ostream>
+
+namespace ImageApprovals {
+
+std::ostream& operator <<(std::ostream& stream, const AbsThreshold& threshold)
+{
+    stream << threshold.value;
+    return stream;
+}
+
+std::ostream& operator <<(std::ostream& stream, const RelThreshold& threshold)
+{
+    stream << threshold.value;
+    return stream;
+}
+
+std::ostream& operator <<(std::ostream& stream, const Percent& percent)
+{
+    stream << percent.value << "%";
+    return stream;
+}
+
+}
+
+// src/VerifyUtils.hpp
+
+#include <string>
+
+namespace ImageApprovals { namespace detail {
+
+struct ApprovalPaths
+{
+    std::string receivedPath;
+    std::string approvedPath;
+};
+
+// <pathWithoutExtension>.received<ext> and <pathWithoutExtension>.approved<ext>
+ApprovalPaths getApprovalPaths(const ImageCodec& codec, const std::string& pathWithoutExtension);
+
+// Writes image to receivedPath if codec is not null, compares the received and approved files
+// and removes the written file if they match; throws an exception describing any failure
+void verifyFiles(const ImageCodec* codec, const ImageView& image,
+                 const std::string& receivedPath, const std::string& approvedPath, const ImageComparator& comparator);
+
+} }
+
+// src/AsyncVerifier.cpp
+
+namespace ImageApprovals {
+
+AsyncVerifier::AsyncVerifier(std::shared_ptr<CompareStrategy> strategy, size_t numThreads, size_t maxQueuedImages)
+    : m_comparator(std::move(strategy)), m_maxQueuedImages(maxQueuedImages)
+{
+    if (numThreads == 0 || maxQueuedImages == 0)
+    {
+        throw ImageApprovalsError("AsyncVerifier needs at least one thread and one queued image");
+    }
+
+    m_threads.reserve(numThreads);
+
+    try
+    {
+        for (size_t i = 0; i < numThreads; ++i)
+        {
+            m_threads.emplace_back([this]() { runWorker(); });
+        }
+    }
+    catch (...)
+    {
+        stopWorkers();
+        throw;
+    }
+}
+
+AsyncVerifier::~AsyncVerifier()
+{
+    stopWorkers();
+}
+
+void AsyncVerifier::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_stateChanged.notify_all();
+
+    // Workers drain the queue before they exit
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+std::future<void> AsyncVerifier::verify(const ImageView& image, std::string pathWithoutExtension)
+{
+    return verify(std::make_shared<const Image>(image.copy()), std::move(pathWithoutExtension));
+}
+
+std::future<void> AsyncVerifier::verify(std::shared_ptr<const Image> image, std::string pathWithoutExtension)
+{
+    if (!image || image->isEmpty())
+    {
+        throw ImageApprovalsError("Cannot verify an empty image");
+    }
+
+    const ImageCodec& codec = ImageCodec::getBestCodec(*image);
+    const auto paths = detail::getApprovalPaths(codec, pathWithoutExtension);
+
+    const ImageComparator& comparator = m_comparator;
+
+    std::packaged_task<void()> task([&codec, &comparator, image, paths]() {
+        detail::verifyFiles(&codec, *image, paths.receivedPath, paths.approvedPath, comparator);
+    });
+
+    std::future<void> result = task.get_future();
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stateChanged.wait(lock, [this]() { return m_queue.size() < m_maxQueuedImages; });
+
+        m_queue.push_back(std::move(task));
+    }
+
+    m_stateChanged.notify_all();
+
+    return result;
+}
+
+void AsyncVerifier::join()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stateChanged.wait(lock, [this]() { return m_queue.empty() && (m_numRunning == 0); });
+}
+
+void AsyncVerifier::runWorker()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        m_stateChanged.wait(lock, [this]() { return !m_queue.empty() || m_stopping; });
+
+        if (m_queue.empty())
+        {
+            return;
+        }
+
+        std::packaged_task<void()> task = std::move(m_queue.front());
+        m_queue.pop_front();
+        ++m_numRunning;
+
+        lock.unlock();
+        m_stateChanged.notify_all();
+
+        // Failures are stored in the task's future
+        task();
+
+        lock.lock();
+        --m_numRunning;
+        m_stateChanged.notify_all();
+    }
+}
+
+}
+
+// src/BatchVerifier.cpp
+
+#include <ApprovalTests.hpp>
+#include <algorithm>
+#include <thread>
+
+namespace ImageApprovals {
+
+BatchVerifier::BatchVerifier(std::shared_ptr<CompareStrategy> strategy)
+    : m_strategy(std::move(strategy))
+    , m_maxImagesInFlight(std::max<size_t>(std::thread::hardware_concurrency(), 1))
+{
+    if (!m_strategy)
+    {
+        throw ImageApprovalsError("Compare strategy must not be null");
+    }
+}
+
+BatchVerifier& BatchVerifier::setMaxImagesInFlight(size_t maxImages)
+{
+    if (maxImages == 0)
+    {
+        throw ImageApprovalsError("At least one image must be allowed in flight");
+    }
+
+    m_maxImagesInFlight = maxImages;
+    return *this;
+}
+
+BatchVerifier& BatchVerifier::setBandMemoryLimit(size_t maxBytes)
+{
+    m_bandMemoryLimit = maxBytes;
+    return *this;
+}
+
+BatchVerifier& BatchVerifier::add(const ImageView& image, std::string pathWithoutExtension)
+{
+    if (image.isEmpty())
+    {
+        throw ImageApprovalsError("Cannot verify an empty image");
+    }
+
+    const ImageCodec& codec = ImageCodec::getBestCodec(image);
+
+    auto paths = detail::getApprovalPaths(codec, pathWithoutExtension);
+
+    m_entries.push_back(Entry{ &codec, image, std::move(paths.receivedPath), std::move(paths.approvedPath) });
+    return *this;
+}
+
+BatchVerifier& BatchVerifier::addFiles(std::string receivedPath, std::string approvedPath)
+{
+    m_entries.push_back(Entry{ nullptr, ImageView(), std::move(receivedPath), std::move(approvedPath) });
+    return *this;
+}
+
+std::vector<BatchVerifier::Failure> BatchVerifier::run() const
+{
+    std::vector<Failure> results(m_entries.size());
+    std::vector<char> failed(m_entries.size(), 0);
+
+    // Each worker holds at most one entry in memory, and failures keep their slots
+    detail::parallelForEach(m_entries.size(), m_maxImagesInFlight,
+        [&](size_t index) { failed[index] = !runEntry(m_entries[index], results[index]); });
+
+    std::vector<Failure> failures;
+
+    for (size_t index = 0; index < results.size(); ++index)
+    {
+        if (failed[index])
+        {
+            failures.push_back(std::move(results[index]));
+        }
+    }
+
+    return failures;
+}
+
+void BatchVerifier::verify() const
+{
+    const auto failures = run();
+    if (failures.empty())
+    {
+        return;
+    }
+
+    std::string msg = std::to_string(failures.size()) + " of " + std::to_string(m_entries.size()) + " images failed verification";
+
+    for (const auto& failure : failures)
+    {
+        msg += "\n\"" + failure.receivedPath + "\": " + failure.message;
+    }
+
+    throw ApprovalTests::ApprovalException(msg);
+}
+
+bool BatchVerifier::runEntry(const Entry& entry, Failure& failure) const
+{
+    failure.receivedPath = entry.receivedPath;
+    failure.approvedPath = entry.approvedPath;
+
+    try
+    {
+        ImageComparator comparator(m_strategy);
+        comparator.setBandMemoryLimit(m_bandMemoryLimit);
+
+        detail::verifyFiles(entry.codec, entry.image, entry.receivedPath, entry.approvedPath, comparator);
+    }
+    catch (const std::exception& exc)
+    {
+        failure.message = exc.what();
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+// src/ColorDifference.cpp
+
+#include <cmath>
+
+namespace ImageApprovals { namespace detail {
+
+namespace {
+
+const double pi = 3.14159265358979323846;
+
+double toRadians(double degrees)
+{
+    return degrees * (pi / 180.0);
+}
+
+// Hue angle in degrees, in [0, 360)
+double hueAngle(double b, double a)
+{
+    if (a == 0.0 && b == 0.0)
+    {
+        return 0.0;
+    }
+
+    const double h = std::atan2(b, a) * (180.0 / pi);
+    return (h < 0.0) ? h + 360.0 : h;
+}
+
+}
+
+// Following G. Sharma, W. Wu and E. N. Dalal, "The CIEDE2000 color-difference formula:
+// implementation notes, supplementary test data, and mathematical observations", 2005
+double deltaE2000(const Lab& left, const Lab& right)
+{
+    const double l1 = left.l, a1 = left.a, b1 = left.b;
+    const double l2 = right.l, a2 = right.a, b2 = right.b;
+
+    const double meanC = (std::sqrt(a1 * a1 + b1 * b1) + std::sqrt(a2 * a2 + b2 * b2)) / 2.0;
+    const double meanC7 = std::pow(meanC, 7.0);
+    const double g = 0.5 * (1.0 - std::sqrt(meanC7 / (meanC7 + std::pow(25.0, 7.0))));
+
+    const double a1p = (1.0 + g) * a1;
+    const double a2p = (1.0 + g) * a2;
+
+    const double c1p = std::sqrt(a1p * a1p + b1 * b1);
+    const double c2p = std::sqrt(a2p * a2p + b2 * b2);
+
+    const double h1p = hueAngle(b1, a1p);
+    const double h2p = hueAngle(b2, a2p);
+
+    const double dLp = l2 - l1;
+    const double dCp = c2p - c1p;
+
+    double dhp = 0.0;
+    if (c1p * c2p != 0.0)
+    {
+        dhp = h2p - h1p;
+        if (dhp > 180.0)
+        {
+            dhp -= 360.0;
+        }
+        else if (dhp < -180.0)
+        {
+            dhp += 360.0;
+        }
+    }
+
+    const double dHp = 2.0 * std::sqrt(c1p * c2p) * std::sin(toRadians(dhp / 2.0));
+
+    const double meanLp = (l1 + l2) / 2.0;
+    const double meanCp = (c1p + c2p) / 2.0;
+
+    double meanHp = h1p + h2p;
+    if (c1p * c2p != 0.0)
+    {
+        if (std::abs(h1p - h2p) <= 180.0)
+        {
+            meanHp /= 2.0;
+        }
+        else
+        {
+            meanHp = (meanHp < 360.0) ? (meanHp + 360.0) / 2.0 : (meanHp - 360.0) / 2.0;
+        }
+    }
+
+    const double t = 1.0
+        - 0.17 * std::cos(toRadians(meanHp - 30.0))
+        + 0.24 * std::cos(toRadians(2.0 * meanHp))
+        + 0.32 * std::cos(toRadians(3.0 * meanHp + 6.0))
+        - 0.20 * std::cos(toRadians(4.0 * meanHp - 63.0));
+
+    const double dTheta = 30.0 * std::exp(-std::pow((meanHp - 275.0) / 25.0, 2.0));
+    const double meanCp7 = std::pow(meanCp, 7.0);
+    const double rc = 2.0 * std::sqrt(meanCp7 / (meanCp7 + std::pow(25.0, 7.0)));
+
+    const double meanLp50 = (meanLp - 50.0) * (meanLp - 50.0);
+    const double sl = 1.0 + 0.015 * meanLp50 / std::sqrt(20.0 + meanLp50);
+    const double sc = 1.0 + 0.045 * meanCp;
+    const double sh = 1.0 + 0.015 * meanCp * t;
+    const double rt = -std::sin(toRadians(2.0 * dTheta)) * rc;
+
+    const double lTerm = dLp / sl;
+    const double cTerm = dCp / sc;
+    const double hTerm = dHp / sh;
+
+    return std::sqrt(lTerm * lTerm + cTerm * cTerm + hTerm * hTerm + rt * cTerm * hTerm);
+}
+
+} }
+
+// src/ColorSpaceUtils.cpp
+
+#include <stdexcept>
+#include <cstring>
+#include <memory>
+#include <array>
+
+namespace ImageApprovals { namespace detail {
+
+bool approxEqual(double a, double b)
+{
+    return std::abs(a - b) <= 1e-5;
+}
+
+bool RgbPrimaries::Primary::approxEqual(const Primary& other) const
+{
+    return detail::approxEqual(x, other.x)
+        && detail::approxEqual(y, other.y);
+}
+
+bool RgbPrimaries::approxEqual(const RgbPrimaries& other) const
+{
+    return r.approxEqual(other.r)
+        && g.approxEqual(other.g)
+        && b.approxEqual(other.b);
+}
+
+RgbPrimaries RgbPrimaries::getSRgbPrimaries()
+{
+    RgbPrimaries p;
+    p.r = Primary(0.64, 0.33);
+    p.g = Primary(0.30, 0.60);
+    p.b = Primary(0.15, 0.06);
+    return p;
+}
+
+namespace {
+
+uint32_t fromBigEndian(uint32_t value)
+{
+    uint32_t result = 0;
+
+    uint8_t beBytes[4];
+    std::memcpy(beBytes, &value, 4);
+    
+    const uint8_t leBytes[4]{ beBytes[3], beBytes[2], beBytes[1], beBytes[0] };
+    std::memcpy(&result, leBytes, 4);
+
+    return result;
+}
+
+}
+
+bool isSRgbIccProfile(uint32_t profLen, const uint8_t* profData)
+{
+    if (profLen < 132)
+    {
+        throw ImageApprovalsError("Incomplete ICC profile data");
+    }
+
+    const std::array<char, 4> rgbColorSpace{ 'R', 'G', 'B', ' ' };
+    std::array<char, 4> colorSpace;
+    std::memcpy(colorSpace.data(), profData + 16, 4);
+    if (colorSpace != rgbColorSpace)
+    {
+        throw ImageApprovalsError("Color space in the ICC profile is not RGB");
+    }
+
+    uint32_t numTags = 0;
+    std::memcpy(&numTags, profData + 128, 4);
+    numTags = fromBigEndian(numTags);
+    if ((128 + numTags * 12) > profLen)
+    {
+        throw ImageApprovalsError("Incomplete ICC profile data");
+    }
+
+    struct TagInfo
+    {
+        std::array<char, 4> signature;
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    for (uint32_t tagIndex = 0; tagIndex < numTags; ++tagIndex)
+    {
+        TagInfo info{};
+        std::memcpy(&info, profData + 132 + tagIndex * sizeof(TagInfo), sizeof(TagInfo));
+        info.offset = fromBigEndian(info.offset);
+        info.size = fromBigEndian(info.size);
+
+        if ((info.offset + info.size) > profLen)
+        {
+            throw ImageApprovalsError("Incomplete ICC profile data");
+        }
+
+        // profileDescriptionTag 
+        const std::array<char, 4> descSig{ 'd', 'e', 's', 'c' };
+        if (info.signature == descSig)
+        {
+            const uint8_t* descPtr = profData + info.offset;
+
+            uint32_t strLen = 0, strOffset = 0;
+
+            std::memcpy(&strLen, descPtr + 20, 4);
+            strLen = fromBigEndian(strLen);
+
+            std::memcpy(&strOffset, descPtr + 24, 4);
+            strOffset = fromBigEndian(strOffset);
+
+            std::unique_ptr<char[]> str(new char[(strLen / 2) + 1]);
+            str[strLen / 2] = '\0';
+
+            for (uint32_t i = 0; i < strLen / 2; ++i)
+            {
+                str[i] = static_cast<char>((descPtr + strOffset)[1 + i * 2]);
+            }
+
+            if (std::strstr(str.get(), "sRGB") != nullptr)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+const ColorSpace* detectColorSpace(const RgbPrimaries& primaries, double gamma)
+{
+    const auto sRgbPrimaries = RgbPrimaries::getSRgbPrimaries();
+
+    if (!primaries.approxEqual(sRgbPrimaries))
+    {
+        return nullptr;
+    }
+
+    if (approxEqual(gamma, 1.0))
+    {
+        return &ColorSpace::getLinearSRgb();
+    }
+    else if (approxEqual(gamma, 1.0 / 2.2))
+    {
+        return &ColorSpace::getSRgb();
+    }
+
+    return nullptr;
+}
+
+float sRgbToLinear(float value)
+{
+    if (value <= 0.04045f)
+    {
+        return value / 12.92f;
+    }
+
+    return std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSRgb(float value)
+{
+    if (value <= 0.0031308f)
+    {
+        return value * 12.92f;
+    }
+
+    return 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+} }
+
+// src/CompareStrategy.cpp
+
+#include <cstring>
+#define NOMINMAX
+#include <ApprovalTests.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace ImageApprovals {
+
+using ApprovalTests::StringUtils;
+
+CompareStrategy::Result CompareStrategy::Result::makePassed()
+{
+    Result res;
+    res.passed = true;
+    return res;
+}
+
+CompareStrategy::Result CompareStrategy::Result::makeFailed(std::string leftInfo, std::string rightInfo)
+{
+    Result res;
+    res.passed = false;
+    res.m_leftInfo = std::move(leftInfo);
+    res.m_rightInfo = std::move(rightInfo);
+    return res;
+}
+
+CompareStrategy::Result CompareStrategy::Result::makeFailedLazy(
+    std::function<std::string()> formatLeftInfo, std::function<std::string()> formatRightInfo)
+{
+    Result res;
+    res.passed = false;
+    res.m_formatLeftInfo = std::move(formatLeftInfo);
+    res.m_formatRightInfo = std::move(formatRightInfo);
+    return res;
+}
+
+std::string CompareStrategy::Result::getLeftImageInfo() const
+{
+    return m_formatLeftInfo ? m_formatLeftInfo() : m_leftInfo;
+}
+
+std::string CompareStrategy::Result::getRightImageInfo() const
+{
+    return m_formatRightInfo ? m_formatRightInfo() : m_rightInfo;
+}
+
+DiffImageRenderer::DiffImageRenderer(const Size& size, float amplification)
+    : m_size(size)
+    , m_scale(amplification * 255.0f)
+{}
+
+void DiffImageRenderer::allocate()
+{
+    m_image = Image(PixelFormat::getRgbU8(), ColorSpace::getSRgb(), m_size, 1);
+    m_rendered = true;
+}
+
+CompareStrategy::Result CompareStrategy::compare(const ImageView& left, const ImageView& right, DiffImageRenderer* diff) const
+{
+    CompareOptions options;
+    options.diff = diff;
+
+    return compare(left, right, options);
+}
+
+CompareStrategy::Result CompareStrategy::compare(const ImageView& left, const ImageView& right, const CompareOptions& options) const
+{
+    Result result;
+
+    if (!(result = compareInfos(left, right)).passed)
+    {
+        return result;
+    }
+
+    const CompareOptions used = getUsedOptions(options, left.getSize());
+    if (used.diff || used.toleranceMask)
+    {
+        return compareContentsWithOptions(left, right, used);
+    }
+
+    return compareContents(left, right);
+}
+
+CompareOptions CompareStrategy::getUsedOptions(const CompareOptions& options, const Size& size) const
+{
+    CompareOptions used;
+
+    if (options.diff && rendersDiffImages())
+    {
+        if (options.diff->getSize() != size)
+        {
+            throw ImageApprovalsError("Size of the diff image does not match the size of the compared images");
+        }
+
+        used.diff = options.diff;
+    }
+
+    if (options.toleranceMask)
+    {
+        if (!supportsToleranceMasks())
+        {
+            throw ImageApprovalsError("The compare strategy does not support tolerance masks");
+        }
+
+        if (options.toleranceMask->getSize() != size)
+        {
+            throw ImageApprovalsError("Size of the tolerance mask does not match the size of the compared images");
+        }
+
+        used.toleranceMask = options.toleranceMask;
+    }
+
+    return used;
+}
+
+namespace detail {
+
+// Full-width bands of both images fit in maxBandBytes, and are aligned to the blocks of the files if possible
+uint32_t getBandHeight(const ImageReader& left, const ImageReader& right, size_t maxBandBytes)
+{
+    const auto sz = left.getSize();
+
+    const uint64_t rowBytes
+        = uint64_t(left.getPixelFormat().getPixelStride() + right.getPixelFormat().getPixelStride()) * sz.width;
+
+    uint64_t numRows = std::max<uint64_t>(maxBandBytes / std::max<uint64_t>(rowBytes, 1), 1);
+
+    const uint64_t rowsPerBlock = std::max(left.getRowsPerBlock(), right.getRowsPerBlock());
+    if (numRows >= rowsPerBlock)
+    {
+        numRows -= numRows % rowsPerBlock;
+    }
+
+    return static_cast<uint32_t>(std::min<uint64_t>(numRows, sz.height));
+}
+
+// Sums of the pixel errors of the rows measured so far
+struct ErrorSums
+{
+    uint64_t numPixels = 0;
+    uint64_t numFailed = 0;
+    size_t numChannels = 3;
+    double sumErrors = 0.0;
+    double sumSquaredErrors = 0.0;
+    float maxError = 0.0f;
+    uint32_t worstX = 0;
+    uint32_t worstY = 0;
+    RGBA channelMaxErrors;
+
+    // Adds the sums of a band of rows starting at firstRow; bands measured in parallel may be added in any order
+    void addBand(const ErrorSums& band, uint32_t firstRow)
+    {
+        numPixels += band.numPixels;
+        numFailed += band.numFailed;
+        numChannels = band.numChannels;
+        sumErrors += band.sumErrors;
+        sumSquaredErrors += band.sumSquaredErrors;
+
+        const uint32_t bandWorstY = firstRow + band.worstY;
+
+        if (band.maxError > maxError
+            || (band.maxError == maxError && (bandWorstY < worstY || (bandWorstY == worstY && band.worstX < worstX))))
+        {
+            maxError = band.maxError;
+            worstX = band.worstX;
+            worstY = bandWorstY;
+        }
+
+        channelMaxErrors.r = std::max(channelMaxErrors.r, band.channelMaxErrors.r);
+        channelMaxErrors.g = std::max(channelMaxErrors.g, band.channelMaxErrors.g);
+        channelMaxErrors.b = std::max(channelMaxErrors.b, band.channelMaxErrors.b);
+        channelMaxErrors.a = std::max(channelMaxErrors.a, band.channelMaxErrors.a);
+    }
+
+    CompareStatistics getStatistics() const
+    {
+        CompareStatistics stats;
+        stats.numComparedPixels = numPixels;
+        stats.numFailedPixels = numFailed;
+        stats.maxError = maxError;
+        stats.worstPixelX = worstX;
+        stats.worstPixelY = worstY;
+        stats.channelMaxErrors = channelMaxErrors;
+
+        const double numValues = static_cast<double>(numPixels) * static_cast<double>(numChannels);
+        if (numValues > 0.0)
+        {
+            stats.meanError = sumErrors / numValues;
+            stats.rmsError = std::sqrt(sumSquaredErrors / numValues);
+        }
+
+        if (stats.rmsError > 0.0)
+        {
+            stats.psnr = -20.0 * std::log10(stats.rmsError);
+        }
+
+        return stats;
+    }
+
+    // Adds row y of single-channel errors, such as depth differences; the row maximum is searched for only when it is a new maximum
+    void addRow(const float* errors, uint32_t width, uint32_t y)
+    {
+        float rowMax = 0.0f;
+        double rowErrors = 0.0;
+        double rowSquaredErrors = 0.0;
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            rowMax = std::max(rowMax, errors[x]);
+            rowErrors += errors[x];
+            rowSquaredErrors += double(errors[x]) * errors[x];
+        }
+
+        numPixels += width;
+        sumErrors += rowErrors;
+        sumSquaredErrors += rowSquaredErrors;
+
+        if (rowMax > maxError)
+        {
+            maxError = rowMax;
+            worstX = static_cast<uint32_t>(std::find(errors, errors + width, rowMax) - errors);
+            worstY = y;
+        }
+    }
+};
+
+// Sums errors over bands; quickReject, if set, may decide a failure from the first band alone before it is measured
+class ErrorSumsAccumulator : public CompareStrategy::BandAccumulator
+{
+public:
+    ErrorSumsAccumulator(
+        std::function<ErrorSums(uint32_t, const ImageView&, const ImageView&)> measure,
+        std::function<CompareStrategy::Result(const ErrorSums&)> makeResult,
+        std::function<bool(const ImageView&, const ImageView&, CompareStrategy::Result&)> quickReject = nullptr)
+        : m_measure(std::move(measure)), m_makeResult(std::move(makeResult)), m_quickReject(std::move(quickReject))
+    {}
+
+    void addBand(uint32_t firstRow, const ImageView& left, const ImageView& right) override
+    {
+        if (m_failed)
+        {
+            return;
+        }
+
+        if (firstRow == 0 && m_quickReject && m_quickReject(left, right, m_rejected))
+        {
+            m_failed = true;
+            m_quickRejected = true;
+            return;
+        }
+
+        const ErrorSums band = m_measure(firstRow, left, right);
+        m_sums.addBand(band, firstRow);
+
+        // Results are formatted lazily, so checking the verdict is cheap
+        if (band.numFailed != 0)
+        {
+            m_failed = !m_makeResult(m_sums).passed;
+        }
+    }
+
+    bool isDecided() const override
+    {
+        return m_failed;
+    }
+
+    CompareStrategy::Result getResult() const override
+    {
+        return m_quickRejected ? m_rejected : m_makeResult(m_sums);
+    }
+
+private:
+    std::function<ErrorSums(uint32_t, const ImageView&, const ImageView&)> m_measure;
+    std::function<CompareStrategy::Result(const ErrorSums&)> m_makeResult;
+    std::function<bool(const ImageView&, const ImageView&, CompareStrategy::Result&)> m_quickReject;
+    ErrorSums m_sums;
+    CompareStrategy::Result m_rejected;
+    bool m_failed = false;
+    bool m_quickRejected = false;
+};
+
+}
+
+CompareStrategy::Result CompareStrategy::compare(ImageReader& left, ImageReader& right, size_t maxBandBytes, DiffImageRenderer* diff) const
+{
+    CompareOptions options;
+    options.diff = diff;
+
+    return compare(left, right, maxBandBytes, options);
+}
+
+CompareStrategy::Result CompareStrategy::compare(ImageReader& left, ImageReader& right, size_t maxBandBytes, const CompareOptions& options) const
+{
+    const auto sz = left.getSize();
+
+    // Views without pixels, so that image properties are checked before anything is read
+    const ImageView leftInfo(left.getPixelFormat(), left.getColorSpace(), sz, 0, nullptr);
+    const ImageView rightInfo(right.getPixelFormat(), right.getColorSpace(), right.getSize(), 0, nullptr);
+
+    Result result;
+
+    if (!(result = compareInfos(leftInfo, rightInfo)).passed)
+    {
+        return result;
+    }
+
+    // The two images are decoded concurrently
+    Image leftBand, rightBand;
+
+    auto readBands = [&](uint32_t y, uint32_t height) {
+        detail::parallelInvoke(
+            [&]() { leftBand = left.readRegion(0, y, sz.width, height); },
+            [&]() { rightBand = right.readRegion(0, y, sz.width, height); });
+    };
+
+    const CompareOptions used = getUsedOptions(options, sz);
+
+    const auto accumulator = (used.diff || used.toleranceMask) ? makeBandAccumulatorWithOptions(sz, used) : makeBandAccumulator(sz);
+    if (!accumulator)
+    {
+        readBands(0, sz.height);
+        return compare(leftBand, rightBand, used);
+    }
+
+    const uint32_t bandHeight = detail::getBandHeight(left, right, maxBandBytes);
+
+    // Both images are decoded in lockstep, and no further than needed for the verdict
+    for (uint32_t y = 0; (y < sz.height) && !accumulator->isDecided(); y += std::min(bandHeight, sz.height - y))
+    {
+        const uint32_t height = std::min(bandHeight, sz.height - y);
+
+        readBands(y, height);
+        accumulator->addBand(y, leftBand, rightBand);
+    }
+
+    return accumulator->getResult();
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> CompareStrategy::makeBandAccumulator(const Size&) const
+{
+    return nullptr;
+}
+
+CompareStrategy::Result CompareStrategy::compareContentsWithOptions(const ImageView& left, const ImageView& right, const CompareOptions&) const
+{
+    return compareContents(left, right);
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> CompareStrategy::makeBandAccumulatorWithOptions(const Size& size, const CompareOptions&) const
+{
+    return makeBandAccumulator(size);
+}
+
+CompareStrategy::Result CompareStrategy::compareInfos(const ImageView& left, const ImageView& right) const
+{
+    Result result;
+    result.passed = false;
+
+    if (left.getPixelFormat() != right.getPixelFormat()
+        && !getPixelLayout(left.getPixelFormat()).hasSameChannels(getPixelLayout(right.getPixelFormat())))
+    {
+        return Result::makeFailed(
+            "pixel format = " + StringUtils::toString(left.getPixelFormat()),
+            "pixel format = " + StringUtils::toString(right.getPixelFormat()));
+    }
+
+    if (left.getColorSpace() != right.getColorSpace())
+    {
+        return Result::makeFailed(
+            "color space = " + StringUtils::toString(left.getColorSpace()),
+            "color space = " + StringUtils::toString(right.getColorSpace()));
+    }
+
+    if (left.getSize() != right.getSize())
+    {
+        return Result::makeFailed(
+            "size = " + StringUtils::toString(left.getSize()),
+            "size = " + StringUtils::toString(right.getSize()));
+    }
+
+    return Result::makePassed();
+}
+
+ThresholdCompareStrategy::ThresholdCompareStrategy(
+    AbsThreshold pixelFailThreshold, Percent maxFailedPixelsPercentage, AlphaComparison alphaComparison)
+    : m_pixelFailThreshold(pixelFailThreshold)
+    , m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+    , m_alphaComparison(alphaComparison)
+{}
+
+namespace detail {
+
+float maxAbsDiff(const RGBA& left, const RGBA& right)
+{
+    float result = std::abs(left.r - right.r);
+    result = std::max(result, std::abs(left.g - right.g));
+    result = std::max(result, std::abs(left.b - right.b));
+    result = std::max(result, std::abs(left.a - right.a));
+    return result;
+}
+
+// Decodes pixels stored in the channel order of Traits
+template<typename Traits>
+struct NativeOrder
+{
+    bool isPremultiplied() const { return Traits::isPremultiplied; }
+
+    RGBA decodeStored(const uint8_t* src) const
+    {
+        return Traits::decodeStored(src);
+    }
+};
+
+// Decodes pixels with the same channels as Traits, stored in the order given by layout
+template<typename Traits>
+struct SwizzledOrder
+{
+    PixelLayout layout;
+
+    bool isPremultiplied() const { return layout.premultiplied; }
+
+    RGBA decodeStored(const uint8_t* src) const
+    {
+        using CT = ChannelTraits<typename Traits::ChannelType>;
+
+        const auto c = Traits::load(src);
+
+        return RGBA(
+            CT::toFloat(c[layout.redIndex]),
+            CT::toFloat(c[layout.greenIndex]),
+            CT::toFloat(c[layout.blueIndex]),
+            layout.hasAlpha() ? CT::toFloat(c[layout.alphaIndex]) : 1.0f);
+    }
+};
+
+struct MeasureErrors
+{
+    const ImageView& left;
+    const ImageView& right;
+    double threshold;
+    bool comparePremultiplied;
+    FailureMask* mask;
+    DiffImageRenderer* diff;
+    const ToleranceMask* tolerances;
+    uint32_t firstRow;
+    uint32_t rowStep;
+
+    // Sums of a single row, and the run of failed pixels that ends at the last measured pixel
+    struct RowState
+    {
+        const uint8_t* leftRow;
+        const uint8_t* rightRow;
+        // Null until the first difference in the row
+        uint8_t* diffRow;
+        // Relative to firstRow
+        uint32_t y;
+        uint32_t runLength;
+        double errors;
+        double squaredErrors;
+    };
+
+    // Premultiplication is applied or undone per pixel, only when the stored form differs from
+    // the one used for comparison. Two premultiplied images are compared as stored, since
+    // unpremultiplying both would hide their color differences under zero alpha.
+    RGBA toCompared(const RGBA& stored, bool storedPremultiplied, bool otherPremultiplied) const
+    {
+        if (storedPremultiplied == comparePremultiplied || (storedPremultiplied && otherPremultiplied))
+        {
+            return stored;
+        }
+
+        return comparePremultiplied ? premultiply(stored) : unpremultiply(stored);
+    }
+
+    void endRun(RowState& row, uint32_t end) const
+    {
+        if (mask && row.runLength != 0)
+        {
+            mask->addRun(firstRow + row.y, end - row.runLength, row.runLength);
+        }
+
+        row.runLength = 0;
+    }
+
+    template<typename Traits>
+    ErrorSums operator()(Traits) const
+    {
+        if (left.getPixelFormat() == right.getPixelFormat())
+        {
+            return measure<Traits>(NativeOrder<Traits>());
+        }
+
+        return measure<Traits>(SwizzledOrder<Traits>{ getPixelLayout(right.getPixelFormat()) });
+    }
+
+    // Measures pixels [begin, end) of a row against spanThreshold
+    template<typename Traits, typename RightOrder>
+    void measureSpan(RightOrder rightOrder, ErrorSums& sums, RowState& row, uint32_t begin, uint32_t end, double spanThreshold) const
+    {
+        const uint8_t* leftPtr = row.leftRow + size_t(begin) * Traits::pixelStride;
+        const uint8_t* rightPtr = row.rightRow + size_t(begin) * Traits::pixelStride;
+
+        RGBA& channelMax = sums.channelMaxErrors;
+
+        sums.numPixels += end - begin;
+
+        for (uint32_t x = begin; x < end; ++x)
+        {
+            const RGBA l = toCompared(Traits::decodeStored(leftPtr), Traits::isPremultiplied, rightOrder.isPremultiplied());
+            const RGBA r = toCompared(rightOrder.decodeStored(rightPtr), rightOrder.isPremultiplied(), Traits::isPremultiplied);
+
+            const float dr = std::abs(l.r - r.r);
+            const float dg = std::abs(l.g - r.g);
+            const float db = std::abs(l.b - r.b);
+            const float da = std::abs(l.a - r.a);
+
+            const float error = maxAbsDiff(l, r);
+            if (error > spanThreshold)
+            {
+                ++sums.numFailed;
+                ++row.runLength;
+            }
+            else if (row.runLength != 0)
+            {
+                endRun(row, x);
+            }
+
+            if (error > sums.maxError)
+            {
+                sums.maxError = error;
+                sums.worstX = x;
+                sums.worstY = row.y;
+            }
+
+            channelMax.r = std::max(channelMax.r, dr);
+            channelMax.g = std::max(channelMax.g, dg);
+            channelMax.b = std::max(channelMax.b, db);
+            channelMax.a = std::max(channelMax.a, da);
+
+            // Only differing pixels are written, the others stay black; NaN differences count as differences
+            if (diff && !(dr == 0.0f && dg == 0.0f && db == 0.0f))
+            {
+                if (!row.diffRow)
+                {
+                    row.diffRow = diff->getRowPointer(firstRow + row.y);
+                }
+
+                diff->setPixel(row.diffRow, x, dr, dg, db);
+            }
+
+            row.errors += double(dr) + dg + db + da;
+            row.squaredErrors += double(dr) * dr + double(dg) * dg + double(db) * db + double(da) * da;
+
+            leftPtr += Traits::pixelStride;
+            rightPtr += Traits::pixelStride;
+        }
+
+        endRun(row, end);
+    }
+
+    template<typename Traits, typename RightOrder>
+    ErrorSums measure(RightOrder rightOrder) const
+    {
+        const auto sz = left.getSize();
+
+        ErrorSums sums;
+        sums.numChannels = Traits::hasAlpha ? 4 : 3;
+
+        for (uint32_t y = 0; y < sz.height; ++y)
+        {
+            const uint32_t rowY = y * rowStep;
+
+            RowState row{ left.getRowPointer(y), right.getRowPointer(y), nullptr, rowY, 0, 0.0, 0.0 };
+
+            if (!tolerances)
+            {
+                measureSpan<Traits>(rightOrder, sums, row, 0, sz.width, threshold);
+            }
+            else
+            {
+                // Ignored spans are skipped as a whole, the others are measured against their own threshold
+                uint32_t x = 0;
+
+                for (const auto& span : tolerances->getRowSpans(firstRow + rowY))
+                {
+                    measureSpan<Traits>(rightOrder, sums, row, x, span.x, threshold);
+
+                    if (!span.isIgnored())
+                    {
+                        measureSpan<Traits>(rightOrder, sums, row, span.x, span.x + span.length, span.threshold);
+                    }
+
+                    x = span.x + span.length;
+                }
+
+                measureSpan<Traits>(rightOrder, sums, row, x, sz.width, threshold);
+            }
+
+            sums.sumErrors += row.errors;
+            sums.sumSquaredErrors += row.squaredErrors;
+        }
+
+        return sums;
+    }
+};
+
+template<typename ChannelType>
+bool sameChannelBits(const ChannelType& left, const ChannelType& right)
+{
+    return std::memcmp(&left, &right, sizeof(ChannelType)) == 0;
+}
+
+// Finds the first row in which pixels differ, for images with the same channels
+// stored in different order; returns height if all rows are equal
+struct FindFirstSwizzledDifference
+{
+    const ImageView& left;
+    const ImageView& right;
+
+    template<typename Traits>
+    uint32_t operator()(Traits) const
+    {
+        const auto sz = left.getSize();
+        const auto layout = getPixelLayout(right.getPixelFormat());
+
+        for (uint32_t y = 0; y < sz.height; ++y)
+        {
+            const uint8_t* leftPtr = left.getRowPointer(y);
+            const uint8_t* rightPtr = right.getRowPointer(y);
+
+            for (uint32_t x = 0; x < sz.width; ++x)
+            {
+                const auto l = Traits::load(leftPtr);
+                const auto r = Traits::load(rightPtr);
+
+                const bool equal
+                    = sameChannelBits(l[Traits::redIndex], r[layout.redIndex])
+                    && sameChannelBits(l[Traits::greenIndex], r[layout.greenIndex])
+                    && sameChannelBits(l[Traits::blueIndex], r[layout.blueIndex])
+                    && (!Traits::hasAlpha || sameChannelBits(l[Traits::hasAlpha ? Traits::alphaIndex : 0], r[layout.alphaIndex]));
+
+                if (!equal)
+                {
+                    return y;
+                }
+
+                leftPtr += Traits::pixelStride;
+                rightPtr += Traits::pixelStride;
+            }
+        }
+
+        return sz.height;
+    }
+};
+
+}
+
+ThresholdCompareStrategy& ThresholdCompareStrategy::setQuickRejectRowStep(uint32_t rowStep, uint64_t minPixels)
+{
+    m_quickRejectRowStep = rowStep;
+    m_quickRejectMinPixels = minPixels;
+    return *this;
+}
+
+namespace detail {
+
+// Every step-th row of a view, from the middle of the first step rows on
+ImageView sampleRows(const ImageView& view, uint32_t step)
+{
+    const auto sz = view.getSize();
+    const uint32_t first = std::min(step / 2, sz.height - 1);
+
+    return ImageView(
+        view.getPixelFormat(), view.getColorSpace(), Size(sz.width, (sz.height - first + step - 1) / step),
+        view.getRowStride() * static_cast<std::ptrdiff_t>(step), view.getRowPointer(first));
+}
+
+// Ignored pixels do not count towards the failed pixels percentage
+uint64_t getNumComparablePixels(const Size& size, const ToleranceMask* tolerances)
+{
+    const uint64_t numPixels = uint64_t(size.width) * size.height;
+    return tolerances ? (numPixels - tolerances->getNumIgnoredPixels()) : numPixels;
+}
+
+}
+
+CompareStrategy::Result ThresholdCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    return compareContentsWithOptions(left, right, CompareOptions());
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> ThresholdCompareStrategy::makeBandAccumulator(const Size& size) const
+{
+    return makeBandAccumulatorWithOptions(size, CompareOptions());
+}
+
+CompareStrategy::Result ThresholdCompareStrategy::compareContentsWithOptions(
+    const ImageView& left, const ImageView& right, const CompareOptions& options) const
+{
+    const auto sz = left.getSize();
+    const uint64_t numComparable = detail::getNumComparablePixels(sz, options.toleranceMask);
+
+    Result rejected;
+    if (quickReject(left, right, sz, options, rejected))
+    {
+        return rejected;
+    }
+
+    auto mask = std::make_shared<FailureMask>(sz);
+    const auto sums = measureErrors(left, right, mask.get(), options, 0);
+
+    return makeResult(sums, numComparable, mask);
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> ThresholdCompareStrategy::makeBandAccumulatorWithOptions(
+    const Size& size, const CompareOptions& options) const
+{
+    auto mask = std::make_shared<FailureMask>(size);
+    const uint64_t numComparable = detail::getNumComparablePixels(size, options.toleranceMask);
+
+    return std::unique_ptr<BandAccumulator>(new detail::ErrorSumsAccumulator(
+        [this, mask, options](uint32_t firstRow, const ImageView& left, const ImageView& right) {
+            return measureErrors(left, right, mask.get(), options, firstRow);
+        },
+        [this, numComparable, mask](const detail::ErrorSums& sums) { return makeResult(sums, numComparable, mask); },
+        [this, size, options](const ImageView& left, const ImageView& right, Result& rejected) {
+            return quickReject(left, right, size, options, rejected);
+        }));
+}
+
+bool ThresholdCompareStrategy::quickReject(
+    const ImageView& left, const ImageView& right, const Size& size, const CompareOptions& options, Result& rejected) const
+{
+    const auto sz = left.getSize();
+
+    if (m_quickRejectRowStep <= 1 || options.diff || uint64_t(size.width) * size.height < m_quickRejectMinPixels
+        || sz.isZero())
+    {
+        return false;
+    }
+
+    // Failed pixels in a subset of the rows are a lower bound for all failed pixels,
+    // so if the subset already fails, so do the whole images
+    const uint32_t step = m_quickRejectRowStep;
+    const uint32_t first = std::min(step / 2, sz.height - 1);
+
+    auto sampledMask = std::make_shared<FailureMask>(size);
+    auto sampled = measureErrors(
+        detail::sampleRows(left, step), detail::sampleRows(right, step), sampledMask.get(), options, first, step);
+    sampled.worstY += first;
+
+    rejected = makeResult(sampled, detail::getNumComparablePixels(size, options.toleranceMask), sampledMask, true);
+    return !rejected.passed;
+}
+
+detail::ErrorSums ThresholdCompareStrategy::measureErrors(
+    const ImageView& left, const ImageView& right, FailureMask* mask, const CompareOptions& options,
+    uint32_t firstRow, uint32_t rowStep) const
+{
+    return dispatchPixelFormat(
+        left.getPixelFormat(),
+        detail::MeasureErrors{
+            left, right, m_pixelFailThreshold.value, m_alphaComparison == AlphaComparison::Premultiplied,
+            mask, options.diff, options.toleranceMask, firstRow, rowStep });
+}
+
+CompareStrategy::Result ThresholdCompareStrategy::makeResult(
+    const detail::ErrorSums& sums, uint64_t numComparablePixels, std::shared_ptr<const FailureMask> mask, bool sampled) const
+{
+    // All pixels may be ignored, and then none fail
+    const double numPixels = static_cast<double>(std::max<uint64_t>(numComparablePixels, 1));
+    const auto percentAboveThreshold = Percent((sums.numFailed / numPixels) * 100.0);
+
+    const auto stats = sums.getStatistics();
+
+    Result result = Result::makePassed();
+
+    if (percentAboveThreshold > m_maxFailedPixelsPercentage)
+    {
+        const auto threshold = m_pixelFailThreshold;
+
+        result = Result::makeFailedLazy(
+            []() { return std::string("reference image"); },
+            [threshold, percentAboveThreshold, stats, sampled]() {
+                return (sampled ? "at least " : "")
+                    + StringUtils::toString(stats.numFailedPixels) + " pixels (" + StringUtils::toString(percentAboveThreshold)
+                    + ") are above threshold = " + StringUtils::toString(threshold)
+                    + ", max difference = " + StringUtils::toString(stats.maxError)
+                    + " at (" + std::to_string(stats.worstPixelX) + ", " + std::to_string(stats.worstPixelY) + ")";
+            });
+    }
+
+    result.hasStatistics = true;
+    result.statistics = stats;
+    result.failureMask = std::move(mask);
+    result.sampled = sampled;
+
+    return result;
+}
+
+DepthCompareStrategy::DepthCompareStrategy(RelThreshold relativeTolerance, Percent maxFailedPixelsPercentage)
+    : m_tolerance(relativeTolerance)
+    , m_relTolerance(static_cast<float>(relativeTolerance.value))
+    , m_farPlane(std::numeric_limits<float>::infinity())
+    , m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+{}
+
+DepthCompareStrategy::DepthCompareStrategy(RelThreshold rangeTolerance, DepthRange range, Percent maxFailedPixelsPercentage)
+    : m_tolerance(rangeTolerance)
+    , m_absTolerance(static_cast<float>(rangeTolerance.value * (range.farPlane - range.nearPlane)))
+    , m_farPlane(range.farPlane)
+    , m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+{}
+
+namespace detail {
+
+struct MeasureDepthDifferences
+{
+    float absTolerance;
+    float relTolerance;
+    float farPlane;
+
+    // Branch-free, so that the compiler can vectorize the loop; returns the number of failed pixels
+    template<size_t NumChannels>
+    uint64_t measureRow(const uint8_t* leftRow, const uint8_t* rightRow, uint32_t width, float* errors) const
+    {
+        const size_t pixelStride = NumChannels * sizeof(float);
+
+        uint64_t numFailed = 0;
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            float l, r;
+            std::memcpy(&l, leftRow + x * pixelStride, sizeof(float));
+            std::memcpy(&r, rightRow + x * pixelStride, sizeof(float));
+
+            const float diff = std::abs(l - r);
+            const float limit = absTolerance + relTolerance * std::max(std::abs(l), std::abs(r));
+            const bool background = (l >= farPlane) & (r >= farPlane);
+
+            // A finite value never matches an infinite one, even though the relative limit is then infinite
+            const bool match = (diff <= limit) & (diff <= std::numeric_limits<float>::max());
+
+            numFailed += static_cast<uint64_t>(!match & !background);
+
+            // Background has no error, and NaN differences count as infinite ones
+            errors[x] = background ? 0.0f : ((diff <= std::numeric_limits<float>::max()) ? diff : std::numeric_limits<float>::infinity());
+        }
+
+        return numFailed;
+    }
+
+    ErrorSums operator()(const ImageView& left, const ImageView& right) const
+    {
+        const auto sz = left.getSize();
+        const bool hasAlpha = getPixelLayout(left.getPixelFormat()).hasAlpha();
+
+        ErrorSums sums;
+        sums.numChannels = 1;
+        std::mutex mutex;
+
+        parallelFor(sz.height, std::max<size_t>(1, 65536 / std::max<uint32_t>(1, sz.width)), [&](size_t begin, size_t end) {
+            std::vector<float> errors(sz.width);
+
+            ErrorSums rangeSums;
+            rangeSums.numChannels = 1;
+
+            for (size_t y = begin; y < end; ++y)
+            {
+                const auto row = static_cast<uint32_t>(y);
+                rangeSums.numFailed += hasAlpha
+                    ? measureRow<2>(left.getRowPointer(row), right.getRowPointer(row), sz.width, errors.data())
+                    : measureRow<1>(left.getRowPointer(row), right.getRowPointer(row), sz.width, errors.data());
+
+                rangeSums.addRow(errors.data(), sz.width, row);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            sums.addBand(rangeSums, 0);
+        });
+
+        return sums;
+    }
+};
+
+}
+
+CompareStrategy::Result DepthCompareStrategy::compareInfos(const ImageView& left, const ImageView& right) const
+{
+    Result result = CompareStrategy::compareInfos(left, right);
+
+    if (result.passed && left.getPixelFormat() != PixelFormat::getGrayF32() && left.getPixelFormat() != PixelFormat::getGrayAlphaF32())
+    {
+        return Result::makeFailed(
+            "pixel format = " + StringUtils::toString(left.getPixelFormat()),
+            "depth comparison needs GrayF32 or GrayAlphaF32 pixels");
+    }
+
+    return result;
+}
+
+CompareStrategy::Result DepthCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    return makeResult(measureErrors(left, right), left.getSize());
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> DepthCompareStrategy::makeBandAccumulator(const Size& size) const
+{
+    return std::unique_ptr<BandAccumulator>(new detail::ErrorSumsAccumulator(
+        [this](uint32_t, const ImageView& left, const ImageView& right) { return measureErrors(left, right); },
+        [this, size](const detail::ErrorSums& sums) { return makeResult(sums, size); }));
+}
+
+detail::ErrorSums DepthCompareStrategy::measureErrors(const ImageView& left, const ImageView& right) const
+{
+    return detail::MeasureDepthDifferences{ m_absTolerance, m_relTolerance, m_farPlane }(left, right);
+}
+
+CompareStrategy::Result DepthCompareStrategy::makeResult(const detail::ErrorSums& sums, const Size& sz) const
+{
+    const double numPixels = static_cast<double>(sz.width) * static_cast<double>(sz.height);
+    const auto percentFailed = Percent((sums.numFailed / numPixels) * 100.0);
+
+    Result result = Result::makePassed();
+
+    if (percentFailed > m_maxFailedPixelsPercentage)
+    {
+        const auto numFailed = sums.numFailed;
+        const auto tolerance = m_tolerance;
+
+        result = Result::makeFailedLazy(
+            []() { return std::string("reference image"); },
+            [numFailed, percentFailed, tolerance]() {
+                return StringUtils::toString(numFailed) + " pixels (" + StringUtils::toString(percentFailed)
+                    + ") differ by more than tolerance = " + StringUtils::toString(tolerance);
+            });
+    }
+
+    result.hasStatistics = true;
+    result.statistics = sums.getStatistics();
+
+    return result;
+}
+
+CompareStrategy::Result BitwiseCompareStrategy::compareInfos(const ImageView& left, const ImageView& right) const
+{
+    Result result = CompareStrategy::compareInfos(left, right);
+
+    if (result.passed
+        && getPixelLayout(left.getPixelFormat()).premultiplied != getPixelLayout(right.getPixelFormat()).premultiplied)
+    {
+        return Result::makeFailed(
+            "pixel format = " + StringUtils::toString(left.getPixelFormat()),
+            "pixel format = " + StringUtils::toString(right.getPixelFormat()));
+    }
+
+    return result;
+}
+
+namespace detail {
+
+// Returns height if all rows are equal
+uint32_t findFirstDifferentRow(const ImageView& left, const ImageView& right)
+{
+    const auto sz = left.getSize();
+
+    if (left.getPixelFormat() != right.getPixelFormat())
+    {
+        return dispatchPixelFormat(left.getPixelFormat(), FindFirstSwizzledDifference{ left, right });
+    }
+
+    const auto rowLen = left.getPixelFormat().getPixelStride() * sz.width;
+
+    for(uint32_t y = 0; y < sz.height; ++y)
+    {
+        const auto leftRow = left.getRowPointer(y);
+        const auto rightRow = right.getRowPointer(y);
+
+        if(0 != std::memcmp(leftRow, rightRow, rowLen))
+        {
+            return y;
+        }
+    }
+
+    return sz.height;
+}
+
+CompareStrategy::Result makeBitwiseResult(uint32_t firstDifferentRow, uint32_t height)
+{
+    if (firstDifferentRow != height)
+    {
+        return CompareStrategy::Result::makeFailed(
+            "reference image", "different pixels in row " + std::to_string(firstDifferentRow));
+    }
+
+    return CompareStrategy::Result::makePassed();
+}
+
+class BitwiseBandAccumulator : public CompareStrategy::BandAccumulator
+{
+public:
+    explicit BitwiseBandAccumulator(uint32_t height)
+        : m_height(height), m_firstDifferentRow(height)
+    {}
+
+    void addBand(uint32_t firstRow, const ImageView& left, const ImageView& right) override
+    {
+        if (isDecided())
+        {
+            return;
+        }
+
+        const uint32_t y = findFirstDifferentRow(left, right);
+        if (y != left.getSize().height)
+        {
+            m_firstDifferentRow = firstRow + y;
+        }
+    }
+
+    bool isDecided() const override
+    {
+        return m_firstDifferentRow != m_height;
+    }
+
+    CompareStrategy::Result getResult() const override
+    {
+        return makeBitwiseResult(m_firstDifferentRow, m_height);
+    }
+
+private:
+    uint32_t m_height;
+    uint32_t m_firstDifferentRow;
+};
+
+}
+
+CompareStrategy::Result BitwiseCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    return detail::makeBitwiseResult(detail::findFirstDifferentRow(left, right), left.getSize().height);
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> BitwiseCompareStrategy::makeBandAccumulator(const Size& size) const
+{
+    return std::unique_ptr<BandAccumulator>(new detail::BitwiseBandAccumulator(size.height));
+}
+
+SsimCompareStrategy::SsimCompareStrategy(double minMeanSsim, double minWindowSsim, uint32_t windowSize)
+    : m_minMeanSsim(minMeanSsim)
+    , m_minWindowSsim(minWindowSsim)
+    , m_windowSize(windowSize)
+{
+    if (windowSize == 0)
+    {
+        throw ImageApprovalsError("SSIM window size must not be zero");
+    }
+}
+
+namespace detail {
+
+// Rec. 709 luma of colors premultiplied by alpha, so that transparent regions compare as black
+struct ComputeLuma
+{
+    const ImageView& image;
+    float* luma;
+
+    template<typename Traits>
+    void operator()(Traits) const
+    {
+        const auto sz = image.getSize();
+
+        parallelFor(sz.height, std::max<size_t>(1, 65536 / std::max<uint32_t>(1, sz.width)), [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y)
+            {
+                const uint8_t* src = image.getRowPointer(static_cast<uint32_t>(y));
+                float* dst = luma + y * sz.width;
+
+                for (uint32_t x = 0; x < sz.width; ++x)
+                {
+                    RGBA p = Traits::decodeStored(src);
+                    if (Traits::hasAlpha && !Traits::isPremultiplied)
+                    {
+                        p = premultiply(p);
+                    }
+
+                    dst[x] = 0.2126f * p.r + 0.7152f * p.g + 0.0722f * p.b;
+                    src += Traits::pixelStride;
+                }
+            }
+        });
+    }
+};
+
+struct SsimSums
+{
+    double sum = 0.0;
+    uint64_t numWindows = 0;
+
+    // Of the first window in row-major order with the lowest SSIM; NaN wins over everything
+    double min = std::numeric_limits<double>::infinity();
+    uint32_t minX = 0;
+    uint32_t minY = 0;
+
+    void addWindow(double ssim, uint32_t x, uint32_t y)
+    {
+        sum += ssim;
+        ++numWindows;
+
+        if ((ssim < min) || (std::isnan(ssim) && !std::isnan(min)))
+        {
+            min = ssim;
+            minX = x;
+            minY = y;
+        }
+    }
+
+    void add(const SsimSums& other)
+    {
+        sum += other.sum;
+        numWindows += other.numWindows;
+
+        const bool lower = (other.min < min) || (std::isnan(other.min) && !std::isnan(min));
+        const bool tieFirst = (other.min == min) && ((other.minY < minY) || ((other.minY == minY) && (other.minX < minX)));
+
+        if (lower || tieFirst)
+        {
+            min = other.min;
+            minX = other.minX;
+            minY = other.minY;
+        }
+    }
+};
+
+// Slides a window over both luma planes with running sums: the sums of each column over the window rows
+// are updated by one row in and one row out, and the window sums by one column in and one column out.
+// Bands of window rows are measured on separate threads.
+SsimSums measureSsim(const float* left, const float* right, uint32_t width, uint32_t height, uint32_t windowSize)
+{
+    const uint32_t win = std::min(windowSize, std::min(width, height));
+    const uint32_t numX = width - win + 1;
+    const uint32_t numY = height - win + 1;
+
+    const double n = static_cast<double>(win) * win;
+    const double c1 = 0.01 * 0.01;
+    const double c2 = 0.03 * 0.03;
+
+    std::mutex mutex;
+    SsimSums total;
+
+    parallelFor(numY, std::max<size_t>(1, 65536 / width), [&](size_t begin, size_t end) {
+        std::vector<double> sx(width), sy(width), sxx(width), syy(width), sxy(width);
+
+        auto addRow = [&](size_t row, double sign) {
+            const float* l = left + row * width;
+            const float* r = right + row * width;
+
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const double a = l[x];
+                const double b = r[x];
+
+                sx[x] += sign * a;
+                sy[x] += sign * b;
+                sxx[x] += sign * a * a;
+                syy[x] += sign * b * b;
+                sxy[x] += sign * a * b;
+            }
+        };
+
+        for (size_t row = begin; row < begin + win; ++row)
+        {
+            addRow(row, 1.0);
+        }
+
+        SsimSums sums;
+
+        for (size_t y = begin; y < end; ++y)
+        {
+            if (y != begin)
+            {
+                addRow(y + win - 1, 1.0);
+                addRow(y - 1, -1.0);
+            }
+
+            double wx = 0.0, wy = 0.0, wxx = 0.0, wyy = 0.0, wxy = 0.0;
+
+            for (uint32_t x = 0; x < win; ++x)
+            {
+                wx += sx[x];
+                wy += sy[x];
+                wxx += sxx[x];
+                wyy += syy[x];
+                wxy += sxy[x];
+            }
+
+            for (uint32_t x = 0; x < numX; ++x)
+            {
+                if (x != 0)
+                {
+                    const uint32_t in = x + win - 1;
+                    const uint32_t out = x - 1;
+
+                    wx += sx[in] - sx[out];
+                    wy += sy[in] - sy[out];
+                    wxx += sxx[in] - sxx[out];
+                    wyy += syy[in] - syy[out];
+                    wxy += sxy[in] - sxy[out];
+                }
+
+                const double mx = wx / n;
+                const double my = wy / n;
+                const double vx = std::max(wxx / n - mx * mx, 0.0);
+                const double vy = std::max(wyy / n - my * my, 0.0);
+                const double cov = wxy / n - mx * my;
+
+                const double ssim
+                    = ((2.0 * mx * my + c1) * (2.0 * cov + c2))
+                    / ((mx * mx + my * my + c1) * (vx + vy + c2));
+
+                sums.addWindow(ssim, x, static_cast<uint32_t>(y));
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        total.add(sums);
+    });
+
+    return total;
+}
+
+}
+
+CompareStrategy::Result SsimCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    const auto sz = left.getSize();
+    if (sz.isZero())
+    {
+        return Result::makePassed();
+    }
+
+    std::vector<float> leftLuma(size_t(sz.width) * sz.height);
+    std::vector<float> rightLuma(leftLuma.size());
+
+    dispatchPixelFormat(left.getPixelFormat(), detail::ComputeLuma{ left, leftLuma.data() });
+    dispatchPixelFormat(right.getPixelFormat(), detail::ComputeLuma{ right, rightLuma.data() });
+
+    const auto sums = detail::measureSsim(leftLuma.data(), rightLuma.data(), sz.width, sz.height, m_windowSize);
+    const double mean = sums.sum / static_cast<double>(sums.numWindows);
+
+    if ((mean >= m_minMeanSsim) && (sums.min >= m_minWindowSsim))
+    {
+        return Result::makePassed();
+    }
+
+    const double minMean = m_minMeanSsim;
+    const double minWindow = m_minWindowSsim;
+
+    return Result::makeFailedLazy(
+        []() { return std::string("reference image"); },
+        [sums, mean, minMean, minWindow]() {
+            return "mean SSIM = " + StringUtils::toString(mean) + " (minimum " + StringUtils::toString(minMean)
+                + "), lowest window SSIM = " + StringUtils::toString(sums.min) + " (minimum " + StringUtils::toString(minWindow)
+                + ") at (" + std::to_string(sums.minX) + ", " + std::to_string(sums.minY) + ")";
+        });
+}
+
+DeltaECompareStrategy::DeltaECompareStrategy(double maxDeltaE, Percent maxFailedPixelsPercentage, DeltaEFormula formula)
+    : m_maxDeltaE(maxDeltaE)
+    , m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+    , m_formula(formula)
+{}
+
+namespace detail {
+
+struct MeasureDeltaEDifferences
+{
+    float maxDeltaE;
+    DeltaEFormula formula;
+
+    // Decodes a row to linear sRGB (U8 rows through a lookup table) composited over black
+    static void decodeComposited(const ImageView& image, uint32_t y, RGBA* dst)
+    {
+        const auto width = image.getSize().width;
+        const auto transfer = (image.getColorSpace() == ColorSpace::getSRgb()) ? Transfer::SRgbToLinear : Transfer::None;
+
+        getDecodeRowFn(image.getPixelFormat())(image.getRowPointer(y), width, dst, transfer);
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            dst[x] = premultiply(dst[x]);
+        }
+    }
+
+    ErrorSums operator()(const ImageView& left, const ImageView& right) const
+    {
+        const auto sz = left.getSize();
+
+        ErrorSums sums;
+        sums.numChannels = 1;
+        std::mutex mutex;
+
+        parallelFor(sz.height, std::max<size_t>(1, 16384 / std::max<uint32_t>(1, sz.width)), [&](size_t begin, size_t end) {
+            std::vector<RGBA> leftRow(sz.width), rightRow(sz.width);
+            std::vector<float> errors(sz.width);
+            std::vector<uint32_t> candidates;
+            candidates.reserve(sz.width);
+
+            ErrorSums rangeSums;
+            rangeSums.numChannels = 1;
+
+            for (size_t y = begin; y < end; ++y)
+            {
+                decodeComposited(left, static_cast<uint32_t>(y), leftRow.data());
+                decodeComposited(right, static_cast<uint32_t>(y), rightRow.data());
+                std::fill(errors.begin(), errors.end(), 0.0f);
+
+                // Equal colors, the vast majority in approval tests, are never converted to Lab
+                candidates.clear();
+                for (uint32_t x = 0; x < sz.width; ++x)
+                {
+                    const RGBA& l = leftRow[x];
+                    const RGBA& r = rightRow[x];
+
+                    if (!((l.r == r.r) && (l.g == r.g) && (l.b == r.b)))
+                    {
+                        candidates.push_back(x);
+                    }
+                }
+
+                for (const uint32_t x : candidates)
+                {
+                    const Lab l = linearSRgbToLab(leftRow[x]);
+                    const Lab r = linearSRgbToLab(rightRow[x]);
+                    const float distance = deltaE76(l, r);
+
+                    float& error = errors[x];
+
+                    if (formula == DeltaEFormula::CIE76)
+                    {
+                        error = distance;
+                    }
+                    else
+                    {
+                        // Far enough below the threshold in CIE76 to pass in CIEDE2000 as well;
+                        // the bound then stands in for the CIEDE2000 difference
+                        error = distance * deltaE2000Bound;
+                        error = (error <= maxDeltaE) ? error : deltaE2000(l, r);
+                    }
+
+                    rangeSums.numFailed += (error <= maxDeltaE) ? 0 : 1;
+                }
+
+                rangeSums.addRow(errors.data(), sz.width, static_cast<uint32_t>(y));
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            sums.addBand(rangeSums, 0);
+        });
+
+        return sums;
+    }
+};
+
+}
+
+CompareStrategy::Result DeltaECompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    return makeResult(measureErrors(left, right), left.getSize());
+}
+
+std::unique_ptr<CompareStrategy::BandAccumulator> DeltaECompareStrategy::makeBandAccumulator(const Size& size) const
+{
+    return std::unique_ptr<BandAccumulator>(new detail::ErrorSumsAccumulator(
+        [this](uint32_t, const ImageView& left, const ImageView& right) { return measureErrors(left, right); },
+        [this, size](const detail::ErrorSums& sums) { return makeResult(sums, size); }));
+}
+
+detail::ErrorSums DeltaECompareStrategy::measureErrors(const ImageView& left, const ImageView& right) const
+{
+    return detail::MeasureDeltaEDifferences{ static_cast<float>(m_maxDeltaE), m_formula }(left, right);
+}
+
+CompareStrategy::Result DeltaECompareStrategy::makeResult(const detail::ErrorSums& sums, const Size& sz) const
+{
+    const double numPixels = static_cast<double>(sz.width) * static_cast<double>(sz.height);
+    const auto percentFailed = Percent((sums.numFailed / numPixels) * 100.0);
+
+    Result result = Result::makePassed();
+
+    if (percentFailed > m_maxFailedPixelsPercentage)
+    {
+        const auto numFailed = sums.numFailed;
+        const auto maxDeltaE = m_maxDeltaE;
+        const auto formula = m_formula;
+
+        result = Result::makeFailedLazy(
+            []() { return std::string("reference image"); },
+            [numFailed, percentFailed, maxDeltaE, formula]() {
+                return StringUtils::toString(numFailed) + " pixels (" + StringUtils::toString(percentFailed)
+                    + ") differ by more than "
+                    + ((formula == DeltaEFormula::CIE76) ? "CIE76" : "CIEDE2000")
+                    + " Delta E = " + StringUtils::toString(maxDeltaE);
+            });
+    }
+
+    result.hasStatistics = true;
+    result.statistics = sums.getStatistics();
+
+    return result;
+}
+
+YiqCompareStrategy::YiqCompareStrategy(double maxColorDelta, Percent maxFailedPixelsPercentage)
+    : m_maxColorDelta(maxColorDelta)
+    , m_maxFailedPixelsPercentage(maxFailedPixelsPercentage)
+{}
+
+namespace detail {
+
+// The largest squared YIQ distance of two colors with the weights below
+const float maxYiqDelta = 35215.0f / (255.0f * 255.0f);
+
+struct YiqCounts
+{
+    // Errors are the distances of all pixels, anti-aliased ones included, relative to the largest possible distance
+    ErrorSums sums;
+    uint64_t numAntiAliased = 0;
+};
+
+// True when at least three of the neighbours of the pixel (with pixels outside of the image
+// counting as one) have exactly the same value as the pixel itself
+bool hasManySiblings(const ImageView& image, uint32_t x, uint32_t y)
+{
+    const auto sz = image.getSize();
+    const size_t stride = image.getPixelFormat().getPixelStride();
+
+    const uint32_t x0 = (x > 0) ? x - 1 : 0;
+    const uint32_t y0 = (y > 0) ? y - 1 : 0;
+    const uint32_t x1 = std::min(x + 1, sz.width - 1);
+    const uint32_t y1 = std::min(y + 1, sz.height - 1);
+
+    const uint8_t* pixel = image.getRowPointer(y) + x * stride;
+    int numEqual = (x == x0 || x == x1 || y == y0 || y == y1) ? 1 : 0;
+
+    for (uint32_t ny = y0; ny <= y1; ++ny)
+    {
+        for (uint32_t nx = x0; nx <= x1; ++nx)
+        {
+            if ((nx != x || ny != y) && std::memcmp(pixel, image.getRowPointer(ny) + nx * stride, stride) == 0
+                && ++numEqual > 2)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// The test of pixelmatch: the pixel must have both a darker and a brighter neighbour in image, few
+// neighbours of equal brightness, and either the darkest or the brightest neighbour must have
+// many siblings in both images, that is, be part of a flat area on one side of an edge
+bool isAntiAliased(const ImageView& image, const float* luma, const ImageView& other, uint32_t x, uint32_t y)
+{
+    const auto sz = image.getSize();
+
+    const uint32_t x0 = (x > 0) ? x - 1 : 0;
+    const uint32_t y0 = (y > 0) ? y - 1 : 0;
+    const uint32_t x1 = std::min(x + 1, sz.width - 1);
+    const uint32_t y1 = std::min(y + 1, sz.height - 1);
+
+    const float center = luma[size_t(y) * sz.width + x];
+    int numEqual = (x == x0 || x == x1 || y == y0 || y == y1) ? 1 : 0;
+
+    float minDelta = 0.0f, maxDelta = 0.0f;
+    uint32_t minX = 0, minY = 0, maxX = 0, maxY = 0;
+
+    for (uint32_t ny = y0; ny <= y1; ++ny)
+    {
+        for (uint32_t nx = x0; nx <= x1; ++nx)
+        {
+            if (nx == x && ny == y)
+            {
+                continue;
+            }
+
+            const float delta = center - luma[size_t(ny) * sz.width + nx];
+
+            if (delta == 0.0f)
+            {
+                if (++numEqual > 2)
+                {
+                    return false;
+                }
+            }
+            else if (delta < minDelta)
+            {
+                minDelta = delta;
+                minX = nx;
+                minY = ny;
+            }
+            else if (delta > maxDelta)
+            {
+                maxDelta = delta;
+                maxX = nx;
+                maxY = ny;
+            }
+        }
+    }
+
+    if (minDelta == 0.0f || maxDelta == 0.0f)
+    {
+        return false;
+    }
+
+    return (hasManySiblings(image, minX, minY) && hasManySiblings(other, minX, minY))
+        || (hasManySiblings(image, maxX, maxY) && hasManySiblings(other, maxX, maxY));
+}
+
+struct MeasureYiqDifferences
+{
+    float maxDelta;
+
+    // Decodes a row to gamma-encoded colors blended over white
+    static void decodeBlended(const ImageView& image, uint32_t y, RGBA* dst)
+    {
+        const auto width = image.getSize().width;
+        const bool linear = (image.getColorSpace() == ColorSpace::getLinearSRgb());
+
+        getDecodeRowFn(image.getPixelFormat())(image.getRowPointer(y), width, dst, Transfer::None);
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            RGBA& p = dst[x];
+
+            if (linear)
+            {
+                p.r = linearToSRgb(p.r);
+                p.g = linearToSRgb(p.g);
+                p.b = linearToSRgb(p.b);
+            }
+
+            p.r = 1.0f + (p.r - 1.0f) * p.a;
+            p.g = 1.0f + (p.g - 1.0f) * p.a;
+            p.b = 1.0f + (p.b - 1.0f) * p.a;
+        }
+    }
+
+    YiqCounts operator()(const ImageView& left, const ImageView& right) const
+    {
+        const auto sz = left.getSize();
+
+        // Brightness of both images, for the neighbourhoods of the anti-aliasing test
+        std::vector<float> leftLuma(size_t(sz.width) * sz.height), rightLuma(leftLuma.size());
+
+        YiqCounts counts;
+        counts.sums.numChannels = 1;
+
+        std::mutex mutex;
+        std::vector<std::pair<uint32_t, uint32_t>> candidates;
+
+        parallelFor(sz.height, std::max<size_t>(1, 65536 / std::max<uint32_t>(1, sz.width)), [&](size_t begin, size_t end) {
+            std::vector<RGBA> leftRow(sz.width), rightRow(sz.width);
+            std::vector<float> deltas(sz.width), errors(sz.width);
+            std::vector<std::pair<uint32_t, uint32_t>> rangeCandidates;
+
+            ErrorSums rangeSums;
+            rangeSums.numChannels = 1;
+
+            for (size_t y = begin; y < end; ++y)
+            {
+                decodeBlended(left, static_cast<uint32_t>(y), leftRow.data());
+                decodeBlended(right, static_cast<uint32_t>(y), rightRow.data());
+
+                float* leftY = leftLuma.data() + y * sz.width;
+                float* rightY = rightLuma.data() + y * sz.width;
+
+                // Branch-free, so that the compiler can vectorize it
+                for (uint32_t x = 0; x < sz.width; ++x)
+                {
+                    const RGBA& l = leftRow[x];
+                    const RGBA& r = rightRow[x];
+
+                    leftY[x] = 0.29889531f * l.r + 0.58662247f * l.g + 0.11448223f * l.b;
+                    rightY[x] = 0.29889531f * r.r + 0.58662247f * r.g + 0.11448223f * r.b;
+
+                    const float dr = l.r - r.r;
+                    const float dg = l.g - r.g;
+                    const float db = l.b - r.b;
+
+                    const float dy = leftY[x] - rightY[x];
+                    const float di = 0.59597799f * dr - 0.27417610f * dg - 0.32180189f * db;
+                    const float dq = 0.21147017f * dr - 0.52261711f * dg + 0.31114694f * db;
+
+                    deltas[x] = 0.5053f * dy * dy + 0.299f * di * di + 0.1957f * dq * dq;
+                    errors[x] = std::sqrt(deltas[x] / maxYiqDelta);
+                }
+
+                rangeSums.addRow(errors.data(), sz.width, static_cast<uint32_t>(y));
+
+                for (uint32_t x = 0; x < sz.width; ++x)
+                {
+                    if (!(deltas[x] <= maxDelta))
+                    {
+                        rangeCandidates.emplace_back(x, static_cast<uint32_t>(y));
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            candidates.insert(candidates.end(), rangeCandidates.begin(), rangeCandidates.end());
+            counts.sums.addBand(rangeSums, 0);
+        });
+
+        // Only the pixels failing the color test have their neighbourhoods analyzed
+        std::atomic<uint64_t> numAntiAliased(0);
+
+        parallelFor(candidates.size(), 4096, [&](size_t begin, size_t end) {
+            uint64_t rangeAntiAliased = 0;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                const uint32_t x = candidates[i].first;
+                const uint32_t y = candidates[i].second;
+
+                const bool antiAliased
+                    = isAntiAliased(left, leftLuma.data(), right, x, y)
+                    || isAntiAliased(right, rightLuma.data(), left, x, y);
+
+                rangeAntiAliased += antiAliased ? 1 : 0;
+            }
+
+            numAntiAliased += rangeAntiAliased;
+        });
+
+        counts.numAntiAliased = numAntiAliased;
+        counts.sums.numFailed = candidates.size() - counts.numAntiAliased;
+        return counts;
+    }
+};
+
+}
+
+CompareStrategy::Result YiqCompareStrategy::compareContents(const ImageView& left, const ImageView& right) const
+{
+    const auto sz = left.getSize();
+
+    const float maxDelta = detail::maxYiqDelta * static_cast<float>(m_maxColorDelta * m_maxColorDelta);
+    const detail::YiqCounts counts = detail::MeasureYiqDifferences{ maxDelta }(left, right);
+
+    const double numPixels = static_cast<double>(sz.width) * static_cast<double>(sz.height);
+    const auto percentFailed = Percent((counts.sums.numFailed / numPixels) * 100.0);
+
+    Result result = Result::makePassed();
+
+    if (percentFailed > m_maxFailedPixelsPercentage)
+    {
+        const auto numFailed = counts.sums.numFailed;
+        const auto numAntiAliased = counts.numAntiAliased;
+        const auto maxColorDelta = m_maxColorDelta;
+
+        result = Result::makeFailedLazy(
+            []() { return std::string("reference image"); },
+            [numFailed, numAntiAliased, percentFailed, maxColorDelta]() {
+                return StringUtils::toString(numFailed) + " pixels (" + StringUtils::toString(percentFailed)
+                    + ") differ by more than YIQ delta " + StringUtils::toString(maxColorDelta)
+                    + ", " + StringUtils::toString(numAntiAliased) + " anti-aliased pixels ignored";
+            });
+    }
+
+    result.hasStatistics = true;
+    result.statistics = counts.sums.getStatistics();
+
+    return result;
+}
+
+}
+
+// src/Conversion.cpp
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace ImageApprovals {
+
+Image convert(const ImageView& src, const PixelFormat& format, const ColorSpace& colorSpace)
+{
+    if (src.isEmpty())
+    {
+        throw ImageApprovalsError("Cannot convert an empty image");
+    }
+
+    Image dst(format, colorSpace, src.getSize());
+    convert(src, dst);
+    return dst;
+}
+
+void convert(const ImageView& src, Image& dst)
+{
+    if (src.isEmpty() || dst.isEmpty())
+    {
+        throw ImageApprovalsError("Cannot convert an empty image");
+    }
+
+    const auto sz = src.getSize();
+    if (sz != dst.getSize())
+    {
+        throw ImageApprovalsError("Source and destination images have different sizes");
+    }
+
+    const auto& srcFormat = src.getPixelFormat();
+    const auto& dstFormat = dst.getPixelFormat();
+
+    if (srcFormat == dstFormat && src.getColorSpace() == dst.getColorSpace())
+    {
+        const size_t rowSize = srcFormat.getPixelStride() * sz.width;
+
+        for (uint32_t y = 0; y < sz.height; ++y)
+        {
+            std::memcpy(dst.getRowPointer(y), src.getRowPointer(y), rowSize);
+        }
+
+        return;
+    }
+
+    const detail::PixelConverter converter(
+        srcFormat, src.getColorSpace(),
+        dstFormat, dst.getColorSpace());
+
+    const size_t minRowsPerThread = std::max<size_t>(1, (64 * 1024) / sz.width);
+
+    detail::parallelFor(sz.height, minRowsPerThread, [&](size_t begin, size_t end) {
+        std::vector<RGBA> buffer(sz.width);
+
+        for (size_t y = begin; y < end; ++y)
+        {
+            const auto row = static_cast<uint32_t>(y);
+            converter.convertRow(src.getRowPointer(row), sz.width, buffer.data(), dst.getRowPointer(row));
+        }
+    });
+}
+
+}
+
+// src/ConversionUtils.cpp
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace ImageApprovals { namespace detail {
+
+namespace {
+
+struct U8Tables
+{
+    std::array<float, 256> normalized;
+    std::array<float, 256> sRgbToLinear;
+
+    // sRgbThresholds[i] is the smallest linear value encoded as sRGB code i + 1
+    std::array<float, 255> sRgbThresholds;
+
+    // sRgbCodes[i] is the sRGB code of linear value i / (sRgbCodes.size() - 1)
+    std::array<uint8_t, 4097> sRgbCodes;
+
+    U8Tables()
+    {
+        for (size_t i = 0; i < 256; ++i)
+        {
+            normalized[i] = static_cast<float>(i) / 255.0f;
+            sRgbToLinear[i] = detail::sRgbToLinear(normalized[i]);
+        }
+
+        for (size_t i = 0; i < 255; ++i)
+        {
+            sRgbThresholds[i] = detail::sRgbToLinear((static_cast<float>(i) + 0.5f) / 255.0f);
+        }
+
+        const float maxIndex = static_cast<float>(sRgbCodes.size() - 1);
+        for (size_t i = 0; i < sRgbCodes.size(); ++i)
+        {
+            const float value = static_cast<float>(i) / maxIndex;
+            const auto pos = std::upper_bound(sRgbThresholds.begin(), sRgbThresholds.end(), value);
+            sRgbCodes[i] = static_cast<uint8_t>(pos - sRgbThresholds.begin());
+        }
+    }
+};
+
+const U8Tables& getU8Tables()
+{
+    static const U8Tables tables;
+    return tables;
+}
+
+float clampUnit(float value)
+{
+    return std::min(1.0f, std::max(0.0f, value));
+}
+
+uint8_t quantizeSRgbU8(float linearValue, const U8Tables& tables)
+{
+    const float value = clampUnit(linearValue);
+
+    // Start from the code at the beginning of the table cell containing the value,
+    // then step over the (at most few) thresholds inside that cell
+    const float maxIndex = static_cast<float>(tables.sRgbCodes.size() - 1);
+    size_t code = tables.sRgbCodes[static_cast<size_t>(value * maxIndex)];
+
+    while (code < tables.sRgbThresholds.size() && tables.sRgbThresholds[code] <= value)
+    {
+        ++code;
+    }
+
+    return static_cast<uint8_t>(code);
+}
+
+float toGray(const RGBA& p)
+{
+    if (p.r == p.g && p.g == p.b)
+    {
+        return p.r;
+    }
+
+    return 0.2126f * p.r + 0.7152f * p.g + 0.0722f * p.b;
+}
+
+void applyTransfer(RGBA* pixels, uint32_t width, Transfer transfer)
+{
+    if (transfer == Transfer::None)
+    {
+        return;
+    }
+
+    float (*fn)(float) = (transfer == Transfer::SRgbToLinear) ? &detail::sRgbToLinear : &detail::linearToSRgb;
+
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        pixels[x].r = fn(pixels[x].r);
+        pixels[x].g = fn(pixels[x].g);
+        pixels[x].b = fn(pixels[x].b);
+    }
+}
+
+template<typename Traits>
+constexpr size_t alphaIndexOf()
+{
+    return Traits::hasAlpha ? static_cast<size_t>(Traits::alphaIndex) : 0;
+}
+
+template<typename Traits>
+void decodeRowU8(const uint8_t* src, uint32_t width, RGBA* dst, Transfer transfer)
+{
+    const auto& tables = getU8Tables();
+
+    const float* alphaLut = tables.normalized.data();
+    const float* colorLut = (transfer == Transfer::SRgbToLinear) ? tables.sRgbToLinear.data() : alphaLut;
+
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        dst[x] = RGBA(
+            colorLut[src[Traits::redIndex]],
+            colorLut[src[Traits::greenIndex]],
+            colorLut[src[Traits::blueIndex]],
+            Traits::hasAlpha ? alphaLut[src[alphaIndexOf<Traits>()]] : 1.0f);
+
+        src += Traits::pixelStride;
+    }
+}
+
+template<typename Traits>
+void decodeRowGeneric(const uint8_t* src, uint32_t width, RGBA* dst, Transfer transfer)
+{
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        dst[x] = Traits::decode(src);
+        src += Traits::pixelStride;
+    }
+
+    applyTransfer(dst, width, transfer);
+}
+
+template<typename Traits, typename EncodeColor, typename EncodeAlpha>
+void storeChannels(const RGBA& p, typename Traits::Channels& c,
+                   EncodeColor encodeColor, EncodeAlpha encodeAlpha)
+{
+    if (Traits::isGray)
+    {
+        c[Traits::redIndex] = encodeColor(toGray(p));
+    }
+    else
+    {
+        c[Traits::redIndex] = encodeColor(p.r);
+        c[Traits::greenIndex] = encodeColor(p.g);
+        c[Traits::blueIndex] = encodeColor(p.b);
+    }
+
+    if (Traits::hasAlpha)
+    {
+        c[alphaIndexOf<Traits>()] = encodeAlpha(p.a);
+    }
+}
+
+struct EncodeU8
+{
+    uint8_t operator()(float value) const
+    {
+        return ChannelTraits<uint8_t>::fromFloat(value);
+    }
+};
+
+struct EncodeSRgbU8
+{
+    const U8Tables& tables;
+
+    uint8_t operator()(float value) const
+    {
+        return quantizeSRgbU8(value, tables);
+    }
+};
+
+template<typename Traits, typename EncodeColor>
+void encodeRowU8Impl(const RGBA* src, uint32_t width, uint8_t* dst, EncodeColor encodeColor)
+{
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        typename Traits::Channels c;
+        storeChannels<Traits>(src[x], c, encodeColor, EncodeU8());
+        Traits::store(c, dst);
+
+        dst += Traits::pixelStride;
+    }
+}
+
+template<typename Traits>
+void encodeRowU8(const RGBA* src, uint32_t width, uint8_t* dst, Transfer transfer)
+{
+    if (transfer == Transfer::LinearToSRgb)
+    {
+        encodeRowU8Impl<Traits>(src, width, dst, EncodeSRgbU8{ getU8Tables() });
+    }
+    else
+    {
+        encodeRowU8Impl<Traits>(src, width, dst, EncodeU8());
+    }
+}
+
+template<typename Traits>
+void encodeRowGeneric(const RGBA* src, uint32_t width, uint8_t* dst, Transfer transfer)
+{
+    using CT = ChannelTraits<typename Traits::ChannelType>;
+
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        RGBA pixel = src[x];
+        applyTransfer(&pixel, 1, transfer);
+
+        if (Traits::isPremultiplied)
+        {
+            pixel = premultiply(pixel);
+        }
+
+        typename Traits::Channels c;
+        storeChannels<Traits>(pixel, c, &CT::fromFloat, &CT::fromFloat);
+        Traits::store(c, dst);
+
+        dst += Traits::pixelStride;
+    }
+}
+
+template<typename ChannelType>
+struct RowKernels
+{
+    template<typename Traits>
+    static DecodeRowFn getDecode() { return &decodeRowGeneric<Traits>; }
+
+    template<typename Traits>
+    static EncodeRowFn getEncode() { return &encodeRowGeneric<Traits>; }
+};
+
+// The lookup-table kernels work on stored values; premultiplied formats need the
+// transfer function applied to unpremultiplied colors, so they use the generic ones
+template<>
+struct RowKernels<uint8_t>
+{
+    template<typename Traits>
+    static DecodeRowFn getDecode()
+    {
+        return Traits::isPremultiplied ? &decodeRowGeneric<Traits> : &decodeRowU8<Traits>;
+    }
+
+    template<typename Traits>
+    static EncodeRowFn getEncode()
+    {
+        return Traits::isPremultiplied ? &encodeRowGeneric<Traits> : &encodeRowU8<Traits>;
+    }
+};
+
+struct SelectDecodeRowFn
+{
+    template<typename Traits>
+    DecodeRowFn operator()(Traits) const
+    {
+        return RowKernels<typename Traits::ChannelType>::template getDecode<Traits>();
+    }
+};
+
+struct SelectEncodeRowFn
+{
+    template<typename Traits>
+    EncodeRowFn operator()(Traits) const
+    {
+        return RowKernels<typename Traits::ChannelType>::template getEncode<Traits>();
+    }
+};
+
+Transfer getTransfer(const ColorSpace& from, const ColorSpace& to)
+{
+    if (from == to)
+    {
+        return Transfer::None;
+    }
+
+    if (from == ColorSpace::getSRgb() && to == ColorSpace::getLinearSRgb())
+    {
+        return Transfer::SRgbToLinear;
+    }
+
+    if (from == ColorSpace::getLinearSRgb() && to == ColorSpace::getSRgb())
+    {
+        return Transfer::LinearToSRgb;
+    }
+
+    throw ImageApprovalsError("Unsupported color space conversion");
+}
+
+}
+
+DecodeRowFn getDecodeRowFn(const PixelFormat& format)
+{
+    return dispatchPixelFormat(format, SelectDecodeRowFn());
+}
+
+EncodeRowFn getEncodeRowFn(const PixelFormat& format)
+{
+    return dispatchPixelFormat(format, SelectEncodeRowFn());
+}
+
+void decodeRow(const PixelFormat& format, const uint8_t* src, uint32_t width, RGBA* dst)
+{
+    getDecodeRowFn(format)(src, width, dst, Transfer::None);
+}
+
+PixelConverter::PixelConverter(const PixelFormat& srcFormat, const ColorSpace& srcColorSpace,
+                               const PixelFormat& dstFormat, const ColorSpace& dstColorSpace)
+    : m_decode(getDecodeRowFn(srcFormat)), m_encode(getEncodeRowFn(dstFormat))
+{
+    const Transfer transfer = getTransfer(srcColorSpace, dstColorSpace);
+
+    if (transfer == Transfer::SRgbToLinear)
+    {
+        m_decodeTransfer = transfer;
+    }
+    else
+    {
+        m_encodeTransfer = transfer;
+    }
+}
+
+void PixelConverter::convertRow(const uint8_t* src, uint32_t width, RGBA* buffer, uint8_t* dst) const
+{
+    m_decode(src, width, buffer, m_decodeTransfer);
+    m_encode(buffer, width, dst, m_encodeTransfer);
+}
+
+} }
+
+// src/ExrImageCodec.cpp
+
+#ifdef ImageApprovals_CONFIG_WITH_OPENEXR
+
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+# pragma warning(push)
+# pragma warning(disable: 4996)
+#endif
+
+#include <OpenEXR/ImfRgbaFile.h>
+#include <OpenEXR/ImfInputFile.h>
+#include <OpenEXR/ImfTiledInputFile.h>
+#include <OpenEXR/ImfOutputFile.h>
+#include <OpenEXR/ImfChannelList.h>
+#include <OpenEXR/ImfFrameBuffer.h>
+#include <OpenEXR/ImfHeader.h>
+#include <OpenEXR/ImfMultiPartInputFile.h>
+#include <OpenEXR/ImfMultiPartOutputFile.h>
+#include <OpenEXR/ImfInputPart.h>
+#include <OpenEXR/ImfOutputPart.h>
+#include <OpenEXR/ImfPartType.h>
+#include <OpenEXR/ImfIO.h>
+#include <OpenEXR/ImfArray.h>
+#include <OpenEXR/half.h>
+
+#ifdef _MSC_VER
+# pragma warning(pop)
+#endif
+
+namespace ImageApprovals { namespace detail {
+
+namespace {
+
+class InputStramAdapter : public Imf::IStream
+{
+public:
+    InputStramAdapter(const std::string& fileName, std::istream& stream)
+        : Imf::IStream(fileName.c_str()), m_stream(stream)
+    {}
+
+    bool isMemoryMapped() const override { return false; }
+
+    bool read(char* c, int n) override
+    {
+        m_stream.read(c, n);
+
+        const auto read_bytes = m_stream.gcount();
+        if (read_bytes < n)
+        {
+            throw ImageApprovalsError("Not enough data");
+        }
+
+        return !m_stream.eof();
+    }
+
+    char* readMemoryMapped(int) override { throw ImageApprovalsError("Not memory mapped"); }
+
+    Imf::Int64 tellg() override { return m_stream.tellg(); }
+
+    void seekg(Imf::Int64 pos) override { m_stream.seekg(pos); }
+
+    void clear() override { m_stream.clear(); }
+
+private:
+    std::istream& m_stream;
+};
+
+class OutputStreamAdapter : public Imf::OStream
+{
+public:
+    OutputStreamAdapter(const std::string& fileName, std::ostream& stream)
+        : Imf::OStream(fileName.c_str()), m_stream(stream)
+    {}
+
+    void write(const char* c, int n) override
+    {
+        m_stream.write(c, n);
+    }
+
+    Imf::Int64 tellp() override { return m_stream.tellp(); }
+
+    void seekp(Imf::Int64 p) override { m_stream.seekp(p); }
+
+private:
+    std::ostream& m_stream;
+};
+
+// Lets several threads read the same file contents through separate EXR file objects
+class MemoryInputStream : public Imf::IStream
+{
+public:
+    MemoryInputStream(const std::string& fileName, const char* data, size_t size)
+        : Imf::IStream(fileName.c_str()), m_data(data), m_size(size)
+    {}
+
+    bool isMemoryMapped() const override { return true; }
+
+    bool read(char* c, int n) override
+    {
+        std::memcpy(c, readMemoryMapped(n), static_cast<size_t>(n));
+        return m_pos < m_size;
+    }
+
+    char* readMemoryMapped(int n) override
+    {
+        if (n < 0 || m_pos > m_size || static_cast<size_t>(n) > m_size - m_pos)
+        {
+            throw ImageApprovalsError("Not enough data");
+        }
+
+        char* ptr = const_cast<char*>(m_data) + m_pos;
+        m_pos += static_cast<size_t>(n);
+        return ptr;
+    }
+
+    Imf::Int64 tellg() override { return m_pos; }
+
+    // Positions come from offsets in the file, so they are checked like reads
+    void seekg(Imf::Int64 pos) override
+    {
+        if (pos > m_size)
+        {
+            throw ImageApprovalsError("Not enough data");
+        }
+
+        m_pos = static_cast<size_t>(pos);
+    }
+
+private:
+    const char* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+};
+
+// Appends the written file to a byte vector; seeking back overwrites what was appended
+class MemoryOutputStream : public Imf::OStream
+{
+public:
+    MemoryOutputStream(const std::string& fileName, std::vector<uint8_t>& data)
+        : Imf::OStream(fileName.c_str()), m_data(data), m_start(data.size()), m_pos(data.size())
+    {}
+
+    void write(const char* c, int n) override
+    {
+        const auto count = static_cast<size_t>(n);
+
+        if (m_pos + count > m_data.size())
+        {
+            m_data.resize(m_pos + count);
+        }
+
+        std::memcpy(m_data.data() + m_pos, c, count);
+        m_pos += count;
+    }
+
+    Imf::Int64 tellp() override { return m_pos - m_start; }
+
+    void seekp(Imf::Int64 p) override { m_pos = m_start + static_cast<size_t>(p); }
+
+private:
+    std::vector<uint8_t>& m_data;
+    size_t m_start;
+    size_t m_pos;
+};
+
+}
+
+namespace {
+
+void copyPixels(size_t numChannels, const Size& sz, const Imf::Array2D<Imf::Rgba>& src, uint8_t* dst)
+{
+    for (uint32_t y = 0; y < sz.height; ++y)
+    {
+        for (uint32_t x = 0; x < sz.width; ++x)
+        {
+            const auto srcPixel = src[y][x];
+
+            const float value[]{
+                static_cast<float>(srcPixel.r),
+                static_cast<float>(srcPixel.g),
+                static_cast<float>(srcPixel.b),
+                static_cast<float>(srcPixel.a)
+            };
+
+            std::memcpy(dst, value, numChannels * 4);
+            dst += numChannels * 4;
+        }
+    }
+}
+
+// Returns the channel holding the data of a single-channel file,
+// or nullptr if the file stores colors
+const char* findGrayChannel(const Imf::ChannelList& channels)
+{
+    for (const char* colorChannel : { "R", "G", "B", "RY", "BY" })
+    {
+        if (channels.findChannel(colorChannel))
+        {
+            return nullptr;
+        }
+    }
+
+    for (const char* grayChannel : { "Y", "Z" })
+    {
+        if (channels.findChannel(grayChannel))
+        {
+            return grayChannel;
+        }
+    }
+
+    return nullptr;
+}
+
+// Single-channel data is read and written as 32-bit floats, so that depth values keep their precision
+Image readGrayPixels(Imf::InputFile& file, const char* grayChannel)
+{
+    const Imath::Box2i dw = file.header().dataWindow();
+    const bool hasAlpha = (file.header().channels().findChannel("A") != nullptr);
+
+    const PixelFormat& fmt = hasAlpha ? PixelFormat::getGrayAlphaF32() : PixelFormat::getGrayF32();
+    const Size imgSize(static_cast<uint32_t>(dw.max.x - dw.min.x + 1), static_cast<uint32_t>(dw.max.y - dw.min.y + 1));
+
+    Image image(fmt, ColorSpace::getLinearSRgb(), imgSize, 4);
+
+    const auto xStride = static_cast<std::ptrdiff_t>(fmt.getPixelStride());
+    const auto yStride = image.getRowStride();
+
+    char* origin
+        = reinterpret_cast<char*>(image.getPixelData())
+        - static_cast<std::ptrdiff_t>(dw.min.x) * xStride
+        - static_cast<std::ptrdiff_t>(dw.min.y) * yStride;
+
+    Imf::FrameBuffer frameBuffer;
+    frameBuffer.insert(grayChannel, Imf::Slice(Imf::FLOAT, origin, xStride, yStride));
+
+    if (hasAlpha)
+    {
+        frameBuffer.insert("A", Imf::Slice(Imf::FLOAT, origin + sizeof(float), xStride, yStride));
+    }
+
+    file.setFrameBuffer(frameBuffer);
+    file.readPixels(dw.min.y, dw.max.y);
+
+    return image;
+}
+
+struct ExrLayer
+{
+    std::string name;
+
+    // Channel names within the layer, in pixel format order
+    std::vector<std::string> channelNames;
+
+    // Full names of the same channels in the file
+    std::vector<std::string> fileChannels;
+};
+
+std::string joinExrName(const std::string& parent, const std::string& child)
+{
+    if (parent.empty())
+    {
+        return child;
+    }
+
+    if (child.empty())
+    {
+        return parent;
+    }
+
+    return parent + "." + child;
+}
+
+// Orders channels as the pixel formats store them: colors or vector components first, alpha last
+void sortExrChannels(std::vector<std::string>& names)
+{
+    const auto rank = [](const std::string& name) {
+        static const std::array<const char*, 9> order{ { "R", "G", "B", "X", "Y", "Z", "U", "V", "W" } };
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            if (name == order[i])
+            {
+                return static_cast<int>(i);
+            }
+        }
+
+        return (name == "A") ? 100 : 50;
+    };
+
+    std::stable_sort(names.begin(), names.end(), [&](const std::string& a, const std::string& b) {
+        const int rankA = rank(a);
+        const int rankB = rank(b);
+        return (rankA != rankB) ? (rankA < rankB) : (a < b);
+    });
+}
+
+ExrLayer makeExrLayer(const std::string& name, const std::string& prefix, std::vector<std::string> channelNames)
+{
+    ExrLayer layer;
+    layer.name = name;
+
+    for (const auto& channel : channelNames)
+    {
+        layer.fileChannels.push_back(joinExrName(prefix, channel));
+    }
+
+    layer.channelNames = std::move(channelNames);
+    return layer;
+}
+
+// Layers have alpha only when their last channel, in the order of sortExrChannels, is A. Returns nullptr
+// for channels that match no pixel format, such as the vector components U and V, or X, Y, Z and W.
+const PixelFormat* findExrLayerFormat(const std::vector<std::string>& channelNames)
+{
+    const bool hasAlpha = !channelNames.empty() && channelNames.back() == "A";
+
+    switch (channelNames.size())
+    {
+    case 1:
+        return &PixelFormat::getGrayF32();
+    case 2:
+        return hasAlpha ? &PixelFormat::getGrayAlphaF32() : nullptr;
+    case 3:
+        return hasAlpha ? nullptr : &PixelFormat::getRgbF32();
+    case 4:
+        return hasAlpha ? &PixelFormat::getRgbAlphaF32() : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+// The format in which pixels of the given format are stored in files and read back
+const PixelFormat& getStoredExrFormat(const PixelFormat& format, ExrAlphaStorage alphaStorage)
+{
+    if (format.getNumberOfChannels() == 4)
+    {
+        return (alphaStorage == ExrAlphaStorage::Premultiplied)
+            ? PixelFormat::getRgbAlphaF32Premultiplied()
+            : PixelFormat::getRgbAlphaF32();
+    }
+
+    return format;
+}
+
+// Channels sharing a prefix form one layer, named after the part and the prefix, if a pixel format
+// matches them; otherwise each channel becomes a layer of its own. Groups of more than four channels
+// keep R, G, B and A together and split off the other channels.
+std::vector<ExrLayer> getExrLayers(const Imf::Header& header)
+{
+    const std::string partName = header.hasName() ? header.name() : std::string();
+
+    std::vector<std::pair<std::string, std::vector<std::string>>> groups;
+
+    for (auto it = header.channels().begin(); it != header.channels().end(); ++it)
+    {
+        if (it.channel().xSampling != 1 || it.channel().ySampling != 1)
+        {
+            throw ImageApprovalsError(std::string("Subsampled EXR channel ") + it.name() + " is not supported");
+        }
+
+        const std::string fullName = it.name();
+        const auto dot = fullName.rfind('.');
+        const std::string prefix = (dot == std::string::npos) ? std::string() : fullName.substr(0, dot);
+        const std::string channel = (dot == std::string::npos) ? fullName : fullName.substr(dot + 1);
+
+        auto group = std::find_if(groups.begin(), groups.end(),
+            [&](const std::pair<std::string, std::vector<std::string>>& g) { return g.first == prefix; });
+
+        if (group == groups.end())
+        {
+            groups.emplace_back(prefix, std::vector<std::string>());
+            group = std::prev(groups.end());
+        }
+
+        group->second.push_back(channel);
+    }
+
+    std::vector<ExrLayer> layers;
+
+    const auto addLayers = [&layers](const std::string& layerName, const std::string& prefix, const std::vector<std::string>& channels) {
+        if (findExrLayerFormat(channels))
+        {
+            layers.push_back(makeExrLayer(layerName, prefix, channels));
+            return;
+        }
+
+        for (const auto& channel : channels)
+        {
+            layers.push_back(makeExrLayer(joinExrName(layerName, channel), prefix, { channel }));
+        }
+    };
+
+    for (auto& group : groups)
+    {
+        const std::string layerName = joinExrName(partName, group.first);
+        auto& channels = group.second;
+
+        sortExrChannels(channels);
+
+        if (channels.size() <= 4)
+        {
+            addLayers(layerName, group.first, channels);
+            continue;
+        }
+
+        std::vector<std::string> rgba;
+
+        for (const auto& channel : channels)
+        {
+            if (channel == "R" || channel == "G" || channel == "B" || channel == "A")
+            {
+                rgba.push_back(channel);
+            }
+            else
+            {
+                layers.push_back(makeExrLayer(joinExrName(layerName, channel), group.first, { channel }));
+            }
+        }
+
+        if (!rgba.empty())
+        {
+            addLayers(layerName, group.first, rgba);
+        }
+    }
+
+    return layers;
+}
+
+std::vector<std::string> getDefaultExrChannelNames(const PixelFormat& format)
+{
+    const auto layout = getPixelLayout(format);
+
+    if (layout.isGray())
+    {
+        return layout.hasAlpha() ? std::vector<std::string>{ "Y", "A" } : std::vector<std::string>{ "Y" };
+    }
+
+    return layout.hasAlpha() ? std::vector<std::string>{ "R", "G", "B", "A" } : std::vector<std::string>{ "R", "G", "B" };
+}
+
+// Channel c of the slices is the c-th float of each pixel; origin is the address of pixel (0, 0)
+void insertExrSlices(Imf::FrameBuffer& frameBuffer, const std::vector<std::string>& fileChannels,
+                     char* origin, size_t xStride, size_t yStride)
+{
+    for (size_t c = 0; c < fileChannels.size(); ++c)
+    {
+        frameBuffer.insert(fileChannels[c], Imf::Slice(Imf::FLOAT, origin + c * sizeof(float), xStride, yStride));
+    }
+}
+
+// Returns the channels of a single image in pixel format order, or an empty list
+// for files that only RgbaInputFile can read, such as luminance-chroma images
+std::vector<std::string> getRegionReaderChannels(const Imf::ChannelList& channels)
+{
+    std::vector<std::string> names;
+
+    if (const char* grayChannel = findGrayChannel(channels))
+    {
+        names.push_back(grayChannel);
+    }
+    else if (channels.findChannel("R") && channels.findChannel("G") && channels.findChannel("B"))
+    {
+        names = { "R", "G", "B" };
+    }
+    else
+    {
+        return names;
+    }
+
+    if (channels.findChannel("A"))
+    {
+        names.push_back("A");
+    }
+
+    return names;
+}
+
+// Reads tiled files tile by tile, so that a region only decodes the tiles overlapping it,
+// and scanline files block by block
+class ExrImageReader : public ImageReader
+{
+public:
+    ExrImageReader(std::unique_ptr<std::istream> stream, const std::string& fileName,
+                   std::vector<std::string> channels, bool tiled, ExrAlphaStorage alphaStorage)
+        : m_stream(std::move(stream))
+        , m_streamAdapter(fileName, *m_stream)
+        , m_channels(std::move(channels))
+        , m_format(&getStoredExrFormat(*findExrLayerFormat(m_channels), alphaStorage))
+    {
+        if (tiled)
+        {
+            m_tiledFile.reset(new Imf::TiledInputFile(m_streamAdapter));
+            m_dataWindow = m_tiledFile->header().dataWindow();
+        }
+        else
+        {
+            m_file.reset(new Imf::InputFile(m_streamAdapter));
+            m_dataWindow = m_file->header().dataWindow();
+        }
+
+        m_size = Size(
+            static_cast<uint32_t>(m_dataWindow.max.x - m_dataWindow.min.x + 1),
+            static_cast<uint32_t>(m_dataWindow.max.y - m_dataWindow.min.y + 1));
+    }
+
+    const PixelFormat& getPixelFormat() const override { return *m_format; }
+    const ColorSpace& getColorSpace() const override { return ColorSpace::getLinearSRgb(); }
+    Size getSize() const override { return m_size; }
+
+    uint32_t getRowsPerBlock() const override
+    {
+        return m_tiledFile ? static_cast<uint32_t>(m_tiledFile->tileYSize()) : 1;
+    }
+
+    Image readRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) override
+    {
+        if (x > m_size.width || width > m_size.width - x || y > m_size.height || height > m_size.height - y)
+        {
+            throw ImageApprovalsError("Region exceeds the image");
+        }
+
+        if (!m_tiledFile)
+        {
+            // Scanline files always decode whole rows
+            Image rows(*m_format, ColorSpace::getLinearSRgb(), Size(m_size.width, height), 4);
+
+            m_file->setFrameBuffer(makeFrameBuffer(rows, 0, y));
+            m_file->readPixels(m_dataWindow.min.y + static_cast<int>(y), m_dataWindow.min.y + static_cast<int>(y + height) - 1);
+
+            return crop(std::move(rows), x, 0, width, height);
+        }
+
+        const auto tileWidth = static_cast<uint32_t>(m_tiledFile->tileXSize());
+        const auto tileHeight = static_cast<uint32_t>(m_tiledFile->tileYSize());
+
+        const uint32_t firstTileX = x / tileWidth;
+        const uint32_t lastTileX = (x + width - 1) / tileWidth;
+        const uint32_t firstTileY = y / tileHeight;
+        const uint32_t lastTileY = (y + height - 1) / tileHeight;
+
+        const uint32_t tilesX = firstTileX * tileWidth;
+        const uint32_t tilesY = firstTileY * tileHeight;
+        const uint32_t tilesWidth = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(lastTileX + 1) * tileWidth, m_size.width) - tilesX);
+        const uint32_t tilesHeight = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(lastTileY + 1) * tileHeight, m_size.height) - tilesY);
+
+        Image tiles(*m_format, ColorSpace::getLinearSRgb(), Size(tilesWidth, tilesHeight), 4);
+
+        m_tiledFile->setFrameBuffer(makeFrameBuffer(tiles, tilesX, tilesY));
+        m_tiledFile->readTiles(
+            static_cast<int>(firstTileX), static_cast<int>(lastTileX),
+            static_cast<int>(firstTileY), static_cast<int>(lastTileY), 0, 0);
+
+        return crop(std::move(tiles), x - tilesX, y - tilesY, width, height);
+    }
+
+private:
+    // Slices for pixels starting at (x, y) of the image stored in the given buffer
+    Imf::FrameBuffer makeFrameBuffer(Image& buffer, uint32_t x, uint32_t y) const
+    {
+        const auto xStride = static_cast<std::ptrdiff_t>(m_format->getPixelStride());
+        const auto yStride = buffer.getRowStride();
+
+        char* origin
+            = reinterpret_cast<char*>(buffer.getPixelData())
+            - (static_cast<std::ptrdiff_t>(m_dataWindow.min.x) + static_cast<std::ptrdiff_t>(x)) * xStride
+            - (static_cast<std::ptrdiff_t>(m_dataWindow.min.y) + static_cast<std::ptrdiff_t>(y)) * yStride;
+
+        Imf::FrameBuffer frameBuffer;
+        insertExrSlices(frameBuffer, m_channels, origin, static_cast<size_t>(xStride), static_cast<size_t>(yStride));
+        return frameBuffer;
+    }
+
+    static Image crop(Image buffer, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+    {
+        if (x == 0 && y == 0 && buffer.getSize() == Size(width, height))
+        {
+            return buffer;
+        }
+
+        return buffer.subView(x, y, width, height).copy();
+    }
+
+    std::unique_ptr<std::istream> m_stream;
+    InputStramAdapter m_streamAdapter;
+    std::vector<std::string> m_channels;
+    const PixelFormat* m_format;
+    std::unique_ptr<Imf::InputFile> m_file;
+    std::unique_ptr<Imf::TiledInputFile> m_tiledFile;
+    Imath::Box2i m_dataWindow;
+    Size m_size;
+};
+
+// Writes scanlines as they come; colors are stored as half floats, single channels as 32-bit floats
+class ExrRowWriter : public ImageRowWriter
+{
+public:
+    // ownedStream, if any, is the stream the adapter writes to
+    ExrRowWriter(std::unique_ptr<Imf::OStream> stream, std::unique_ptr<std::ostream> ownedStream,
+                 const PixelFormat& format, const ColorSpace& colorSpace, const Size& size, const std::string& grayChannelName,
+                 ExrAlphaStorage alphaStorage)
+        : ImageRowWriter(format, colorSpace, size)
+        , m_ownedStream(std::move(ownedStream))
+        , m_stream(std::move(stream))
+        , m_storedFormat(&getStoredExrFormat(format, alphaStorage))
+    {
+        if (!format.isF32())
+        {
+            throw ImageApprovalsError("EXR codec cannot write non-float pixels");
+        }
+
+        if (colorSpace != ColorSpace::getLinearSRgb())
+        {
+            throw ImageApprovalsError("EXR codec can write only images with linear color space");
+        }
+
+        Imf::PixelType pixelType = Imf::HALF;
+
+        if (format == PixelFormat::getGrayF32() || format == PixelFormat::getGrayAlphaF32())
+        {
+            m_channels.push_back(grayChannelName);
+            pixelType = Imf::FLOAT;
+        }
+        else if (format == PixelFormat::getRgbF32()
+                 || format == PixelFormat::getRgbAlphaF32()
+                 || format == PixelFormat::getRgbAlphaF32Premultiplied())
+        {
+            m_channels = { "R", "G", "B" };
+        }
+        else
+        {
+            throw ImageApprovalsError("Unexpected pixel format");
+        }
+
+        if (getPixelLayout(format).hasAlpha())
+        {
+            m_channels.push_back("A");
+        }
+
+        const int width = static_cast<int>(size.width);
+        const int height = static_cast<int>(size.height);
+
+        Imf::Header header(width, height, static_cast<float>(width) / height);
+
+        for (const auto& channel : m_channels)
+        {
+            header.channels().insert(channel, Imf::Channel(pixelType));
+        }
+
+        m_file.reset(new Imf::OutputFile(*m_stream, header));
+    }
+
+protected:
+    void appendRows(uint32_t firstRow, const ImageView& rows) override
+    {
+        // Colors with alpha are stored as the codec reads them back
+        if (rows.getPixelFormat() != *m_storedFormat)
+        {
+            appendRows(firstRow, convert(rows, *m_storedFormat, rows.getColorSpace()));
+            return;
+        }
+
+        if (rows.isBottomUp())
+        {
+            appendRows(firstRow, convert(rows, rows.getPixelFormat(), rows.getColorSpace()));
+            return;
+        }
+
+        // Slices address the whole image, of which only the rows of this batch are read
+        char* origin
+            = const_cast<char*>(reinterpret_cast<const char*>(rows.getRowPointer(0)))
+            - static_cast<std::ptrdiff_t>(firstRow) * rows.getRowStride();
+
+        Imf::FrameBuffer frameBuffer;
+        insertExrSlices(frameBuffer, m_channels, origin,
+                        rows.getPixelFormat().getPixelStride(), static_cast<size_t>(rows.getRowStride()));
+
+        m_file->setFrameBuffer(frameBuffer);
+        m_file->writePixels(static_cast<int>(rows.getSize().height));
+    }
+
+    void finishFile() override
+    {
+        // The offsets of the scanlines are written when the file is closed
+        m_file.reset();
+    }
+
+private:
+    std::unique_ptr<std::ostream> m_ownedStream;
+    std::unique_ptr<Imf::OStream> m_stream;
+    const PixelFormat* m_storedFormat;
+    std::vector<std::string> m_channels;
+    std::unique_ptr<Imf::OutputFile> m_file;
+};
+
+// Reads the gray channel if there is one, otherwise RGB(A) through the RGBA interface
+Image readExrImage(Imf::IStream& stream, ExrAlphaStorage alphaStorage)
+{
+    const auto start = stream.tellg();
+
+    {
+        Imf::InputFile grayFile(stream);
+
+        if (const char* grayChannel = findGrayChannel(grayFile.header().channels()))
+        {
+            return readGrayPixels(grayFile, grayChannel);
+        }
+    }
+
+    stream.clear();
+    stream.seekg(start);
+
+    Imf::RgbaInputFile file(stream);
+    Imath::Box2i dw = file.dataWindow();
+
+    const auto width = dw.max.x - dw.min.x + 1;
+    const auto height = dw.max.y - dw.min.y + 1;
+
+    Imf::Array2D<Imf::Rgba> pixels;
+    pixels.resizeErase(height, width);
+
+    file.setFrameBuffer(pixels[0] - dw.min.x - dw.min.y * width, 1, width);
+    file.readPixels(dw.min.y, dw.max.y);
+
+    const PixelFormat* fmt = nullptr;
+
+    switch (file.channels())
+    {
+    case Imf::WRITE_RGB:
+        fmt = &PixelFormat::getRgbF32();
+        break;
+    case Imf::WRITE_RGBA:
+        fmt = &getStoredExrFormat(PixelFormat::getRgbAlphaF32(), alphaStorage);
+        break;
+    default:
+        throw ImageApprovalsError("Unsupported pixel format");
+    }
+
+    const Size imgSize(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+
+    Image image(*fmt, ColorSpace::getLinearSRgb(), imgSize, 4);
+    copyPixels(fmt->getNumberOfChannels(), imgSize, pixels, image.getPixelData());
+
+    return image;
+}
+
+struct ExrOutputLayer
+{
+    const LayeredImage::Layer* layer;
+    ImageView pixels;
+    std::vector<std::string> channelNames;
+};
+
+}
+
+ExrImageCodec::ExrImageCodec(std::string grayChannelName, ExrAlphaStorage alphaStorage)
+    : m_grayChannelName(std::move(grayChannelName))
+    , m_alphaStorage(alphaStorage)
+{}
+
+std::string ExrImageCodec::getFileExtensionWithDot() const
+{
+    return ".exr";
+}
+
+int ExrImageCodec::getScore(const std::string& extensionWithDot) const
+{
+    if(extensionWithDot == ".exr")
+    {
+        return 100;
+    }
+    
+    return -1;
+}
+
+int ExrImageCodec::getScore(const PixelFormat& pf, const ColorSpace& cs) const
+{
+    if(!pf.isF32() || cs != ColorSpace::getLinearSRgb())
+    {
+        return -1;
+    }
+
+    return 100;
+}
+
+Image ExrImageCodec::readFromStream(std::istream& stream, const std::string& fileName) const
+{
+    InputStramAdapter streamAdapter(fileName, stream);
+    return readExrImage(streamAdapter, m_alphaStorage);
+}
+
+Image ExrImageCodec::decodeFromMemory(const uint8_t* data, size_t size) const
+{
+    MemoryInputStream stream("<memory>", reinterpret_cast<const char*>(data), size);
+    return readExrImage(stream, m_alphaStorage);
+}
+
+void ExrImageCodec::encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const
+{
+    ExrRowWriter writer(
+        std::unique_ptr<Imf::OStream>(new MemoryOutputStream("<memory>", data)), nullptr,
+        image.getPixelFormat(), image.getColorSpace(), image.getSize(), m_grayChannelName, m_alphaStorage);
+
+    writer.writeRows(image);
+    writer.finish();
+}
+
+void ExrImageCodec::writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const
+{
+    ExrRowWriter writer(
+        std::unique_ptr<Imf::OStream>(new OutputStreamAdapter(fileName, stream)), nullptr,
+        image.getPixelFormat(), image.getColorSpace(), image.getSize(), m_grayChannelName, m_alphaStorage);
+
+    writer.writeRows(image);
+    writer.finish();
+}
+
+std::unique_ptr<ImageRowWriter> ExrImageCodec::openRowWriterForStream(
+    std::unique_ptr<std::ostream> stream, const std::string& fileName,
+    const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const
+{
+    std::unique_ptr<Imf::OStream> streamAdapter(new OutputStreamAdapter(fileName, *stream));
+
+    return std::unique_ptr<ImageRowWriter>(new ExrRowWriter(
+        std::move(streamAdapter), std::move(stream), format, colorSpace, size, m_grayChannelName, m_alphaStorage));
+}
+
+std::unique_ptr<ImageReader> ExrImageCodec::openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const
+{
+    const auto start = stream->tellg();
+
+    std::vector<std::string> channels;
+    bool tiled = false;
+
+    {
+        InputStramAdapter headerAdapter(fileName, *stream);
+        Imf::InputFile headerFile(headerAdapter);
+
+        channels = getRegionReaderChannels(headerFile.header().channels());
+        tiled = headerFile.header().hasTileDescription();
+    }
+
+    stream->clear();
+    stream->seekg(start);
+
+    if (channels.empty())
+    {
+        return ImageCodec::openReaderForStream(std::move(stream), fileName);
+    }
+
+    return std::unique_ptr<ImageReader>(new ExrImageReader(std::move(stream), fileName, std::move(channels), tiled, m_alphaStorage));
+}
+
+LayeredImage ExrImageCodec::readLayersFromStream(std::istream& stream, const std::string& fileName) const
+{
+    const std::vector<char> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    MemoryInputStream headerStream(fileName, data.data(), data.size());
+    Imf::MultiPartInputFile file(headerStream, 0);
+
+    LayeredImage result;
+
+    for (int part = 0; part < file.parts(); ++part)
+    {
+        const Imf::Header& header = file.header(part);
+
+        if (header.hasType() && Imf::isDeepData(header.type()))
+        {
+            throw ImageApprovalsError("Deep EXR images are not supported");
+        }
+
+        const Imath::Box2i dw = header.dataWindow();
+        const Size size(static_cast<uint32_t>(dw.max.x - dw.min.x + 1), static_cast<uint32_t>(dw.max.y - dw.min.y + 1));
+
+        const std::vector<ExrLayer> layers = getExrLayers(header);
+
+        std::vector<Image> images;
+        images.reserve(layers.size());
+
+        for (const auto& layer : layers)
+        {
+            images.emplace_back(
+                getStoredExrFormat(*findExrLayerFormat(layer.channelNames), m_alphaStorage), ColorSpace::getLinearSRgb(), size, 4);
+        }
+
+        // Each thread decodes a range of rows through its own file object
+        parallelFor(size.height, 64, [&](size_t begin, size_t end) {
+            MemoryInputStream partStream(fileName, data.data(), data.size());
+            Imf::MultiPartInputFile partFile(partStream, 0);
+            Imf::InputPart input(partFile, part);
+
+            Imf::FrameBuffer frameBuffer;
+
+            for (size_t i = 0; i < layers.size(); ++i)
+            {
+                const auto xStride = static_cast<std::ptrdiff_t>(images[i].getPixelFormat().getPixelStride());
+                const auto yStride = images[i].getRowStride();
+
+                char* origin
+                    = reinterpret_cast<char*>(images[i].getPixelData())
+                    - static_cast<std::ptrdiff_t>(dw.min.x) * xStride
+                    - static_cast<std::ptrdiff_t>(dw.min.y) * yStride;
+
+                insertExrSlices(frameBuffer, layers[i].fileChannels, origin,
+                                static_cast<size_t>(xStride), static_cast<size_t>(yStride));
+            }
+
+            input.setFrameBuffer(frameBuffer);
+            input.readPixels(dw.min.y + static_cast<int>(begin), dw.min.y + static_cast<int>(end) - 1);
+        });
+
+        for (size_t i = 0; i < layers.size(); ++i)
+        {
+            result.addLayer(layers[i].name, std::move(images[i]), layers[i].channelNames);
+        }
+    }
+
+    return result;
+}
+
+void ExrImageCodec::writeLayersToStream(const LayeredImage& image, std::ostream& stream, const std::string& fileName) const
+{
+    if (image.getNumberOfLayers() == 0)
+    {
+        throw ImageApprovalsError("Cannot write an image without layers");
+    }
+
+    // Layers are stored as top-down 32-bit float pixels, converted if needed
+    std::vector<Image> converted;
+    std::vector<ExrOutputLayer> layers;
+
+    converted.reserve(image.getNumberOfLayers());
+
+    bool sameSizes = true;
+
+    for (size_t i = 0; i < image.getNumberOfLayers(); ++i)
+    {
+        const auto& layer = image.getLayer(i);
+        const auto& view = layer.image;
+
+        if (view.getColorSpace() != ColorSpace::getLinearSRgb())
+        {
+            throw ImageApprovalsError("EXR codec can write only images with linear color space");
+        }
+
+        ExrOutputLayer output{ &layer, view, layer.channelNames };
+
+        if (output.channelNames.empty())
+        {
+            output.channelNames = getDefaultExrChannelNames(view.getPixelFormat());
+        }
+
+        const PixelFormat* format = findExrLayerFormat(output.channelNames);
+
+        // Without an A channel no channel is alpha, so the values are written as they are stored
+        if (format)
+        {
+            format = &getStoredExrFormat(*format, m_alphaStorage);
+        }
+        else
+        {
+            const auto layout = getPixelLayout(view.getPixelFormat());
+
+            if (layout.numChannels == 4)
+            {
+                format = layout.premultiplied ? &PixelFormat::getRgbAlphaF32Premultiplied() : &PixelFormat::getRgbAlphaF32();
+            }
+            else if (layout.premultiplied)
+            {
+                throw ImageApprovalsError("Premultiplied layer \"" + layer.name + "\" needs an A channel");
+            }
+            else
+            {
+                format = (layout.numChannels == 2) ? &PixelFormat::getGrayAlphaF32() : &PixelFormat::getRgbF32();
+            }
+        }
+
+        if (view.getPixelFormat() != *format || view.isBottomUp())
+        {
+            converted.push_back(convert(view, *format, view.getColorSpace()));
+            output.pixels = converted.back();
+        }
+
+        sameSizes = sameSizes && (view.getSize() == image.getLayer(0).image.getSize());
+        layers.push_back(std::move(output));
+    }
+
+    OutputStreamAdapter streamAdapter(fileName, stream);
+
+    const auto makeHeader = [](const Size& size) {
+        return Imf::Header(static_cast<int>(size.width), static_cast<int>(size.height));
+    };
+
+    const auto makeFrameBuffer = [](const ExrOutputLayer& layer, const std::string& prefix, Imf::FrameBuffer& frameBuffer) {
+        std::vector<std::string> fileChannels;
+
+        for (const auto& channel : layer.channelNames)
+        {
+            fileChannels.push_back(joinExrName(prefix, channel));
+        }
+
+        insertExrSlices(
+            frameBuffer, fileChannels,
+            const_cast<char*>(reinterpret_cast<const char*>(layer.pixels.getRowPointer(0))),
+            layer.pixels.getPixelFormat().getPixelStride(),
+            static_cast<size_t>(layer.pixels.getRowStride()));
+    };
+
+    // Layers of the same size become channel groups of a single part, others get a part each
+    if (sameSizes)
+    {
+        Imf::Header header = makeHeader(layers.front().pixels.getSize());
+        Imf::FrameBuffer frameBuffer;
+
+        for (const auto& layer : layers)
+        {
+            for (const auto& channel : layer.channelNames)
+            {
+                header.channels().insert(joinExrName(layer.layer->name, channel), Imf::Channel(Imf::FLOAT));
+            }
+
+            makeFrameBuffer(layer, layer.layer->name, frameBuffer);
+        }
+
+        Imf::OutputFile file(streamAdapter, header);
+        file.setFrameBuffer(frameBuffer);
+        file.writePixels(static_cast<int>(layers.front().pixels.getSize().height));
+        return;
+    }
+
+    std::vector<Imf::Header> headers;
+
+    for (const auto& layer : layers)
+    {
+        if (layer.layer->name.empty())
+        {
+            throw ImageApprovalsError("Layers of different sizes must have names");
+        }
+
+        Imf::Header header = makeHeader(layer.pixels.getSize());
+        header.setName(layer.layer->name);
+        header.setType(Imf::SCANLINEIMAGE);
+
+        for (const auto& channel : layer.channelNames)
+        {
+            header.channels().insert(channel, Imf::Channel(Imf::FLOAT));
+        }
+
+        headers.push_back(header);
+    }
+
+    Imf::MultiPartOutputFile file(streamAdapter, headers.data(), static_cast<int>(headers.size()));
+
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        Imf::FrameBuffer frameBuffer;
+        makeFrameBuffer(layers[i], std::string(), frameBuffer);
+
+        Imf::OutputPart part(file, static_cast<int>(i));
+        part.setFrameBuffer(frameBuffer);
+        part.writePixels(static_cast<int>(layers[i].pixels.getSize().height));
+    }
+}
+
+} }
+
+#endif // ImageApprovals_CONFIG_WITH_OPENEXR
+
+// src/ImageCodec.cpp
+
+#include <ApprovalTests.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace ImageApprovals {
+
+namespace detail {
+
+std::vector<std::shared_ptr<ImageCodec>> initCodecs()
+{
+    std::vector<std::shared_ptr<ImageCodec>> codecs;
+
+#ifdef ImageApprovals_CONFIG_WITH_LIBPNG
+    codecs.push_back(std::make_shared<PngImageCodec>());
+#endif // ImageApprovals_CONFIG_WITH_LIBPNG
+
+#ifdef ImageApprovals_CONFIG_WITH_OPENEXR
+    codecs.push_back(std::make_shared<ExrImageCodec>());
+#endif // ImageApprovals_CONFIG_WITH_OPENEXR
+
+    return codecs;
+}
+
+template<typename... ArgTypes>
+const ImageCodec* findBestMatch(const std::vector<std::shared_ptr<ImageCodec>>& codecs, const ArgTypes&... args)
+{
+    const ImageCodec* bestCodec = nullptr;
+    int bestScore = -1;
+
+    for(auto iter = codecs.rbegin(); iter != codecs.rend(); ++iter)
+    {
+        const ImageCodec* codec = iter->get();
+        const int score = codec->getScore(args...);
+
+        if((score >= 0) && (score > bestScore))
+        {
+            bestCodec = codec;
+            bestScore = score;
+        }
+    }
+
+    return bestCodec;
+}
+
+using CodecList = std::vector<std::shared_ptr<ImageCodec>>;
+
+// Immutable state of the registry; lookups of the extensions of registered codecs
+// and of the built-in pixel formats are answered from the precomputed maps
+struct CodecSnapshot
+{
+    CodecList codecs;
+    std::unordered_map<std::string, const ImageCodec*> byExtension;
+    std::map<std::pair<const PixelFormat*, const ColorSpace*>, const ImageCodec*> byFormat;
+};
+
+std::shared_ptr<const CodecSnapshot> makeCodecSnapshot(CodecList codecs)
+{
+    static const PixelFormat* const builtInFormats[] = {
+        &PixelFormat::getGrayU8(), &PixelFormat::getGrayAlphaU8(),
+        &PixelFormat::getRgbU8(), &PixelFormat::getRgbAlphaU8(),
+        &PixelFormat::getBgrU8(), &PixelFormat::getBgrAlphaU8(), &PixelFormat::getAlphaRgbU8(),
+        &PixelFormat::getGrayAlphaU8Premultiplied(), &PixelFormat::getRgbAlphaU8Premultiplied(),
+        &PixelFormat::getBgrAlphaU8Premultiplied(), &PixelFormat::getAlphaRgbU8Premultiplied(),
+        &PixelFormat::getGrayU16(), &PixelFormat::getGrayAlphaU16(),
+        &PixelFormat::getRgbU16(), &PixelFormat::getRgbAlphaU16(), &PixelFormat::getRgbAlphaU16Premultiplied(),
+        &PixelFormat::getGrayF32(), &PixelFormat::getGrayAlphaF32(),
+        &PixelFormat::getRgbF32(), &PixelFormat::getRgbAlphaF32(), &PixelFormat::getRgbAlphaF32Premultiplied()
+    };
+
+    static const ColorSpace* const builtInColorSpaces[] = {
+        &ColorSpace::getLinearSRgb(), &ColorSpace::getSRgb()
+    };
+
+    std::shared_ptr<CodecSnapshot> snapshot = std::make_shared<CodecSnapshot>();
+    snapshot->codecs = std::move(codecs);
+
+    for (const auto& codec : snapshot->codecs)
+    {
+        const std::string extension = codec->getFileExtensionWithDot();
+        snapshot->byExtension[extension] = findBestMatch(snapshot->codecs, extension);
+    }
+
+    for (const PixelFormat* pf : builtInFormats)
+    {
+        for (const ColorSpace* cs : builtInColorSpaces)
+        {
+            snapshot->byFormat[std::make_pair(pf, cs)] = findBestMatch(snapshot->codecs, *pf, *cs);
+        }
+    }
+
+    return snapshot;
+}
+
+// Lookups load the current snapshot without locking; changes are serialized
+// and publish a modified copy
+class CodecRegistry
+{
+public:
+    CodecRegistry()
+        : m_snapshot(makeCodecSnapshot(initCodecs()))
+    {}
+
+    std::shared_ptr<const CodecSnapshot> getSnapshot() const
+    {
+        return std::atomic_load(&m_snapshot);
+    }
+
+    void modify(const std::function<void(CodecList&)>& change)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        CodecList codecs = getSnapshot()->codecs;
+        change(codecs);
+
+        std::atomic_store(&m_snapshot, makeCodecSnapshot(std::move(codecs)));
+    }
+
+private:
+    std::mutex m_mutex;
+    std::shared_ptr<const CodecSnapshot> m_snapshot;
+};
+
+CodecRegistry& getCodecRegistry()
+{
+    static CodecRegistry registry;
+    return registry;
+}
+
+class WholeImageReader : public ImageReader
+{
+public:
+    explicit WholeImageReader(Image image)
+        : m_format(&image.getPixelFormat())
+        , m_colorSpace(&image.getColorSpace())
+        , m_size(image.getSize())
+        , m_image(std::move(image))
+    {}
+
+    const PixelFormat& getPixelFormat() const override { return *m_format; }
+    const ColorSpace& getColorSpace() const override { return *m_colorSpace; }
+    Size getSize() const override { return m_size; }
+
+    // Reading the whole image hands over the decoded image instead of copying it,
+    // after which the reader is exhausted
+    Image readRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) override
+    {
+        if (m_image.isEmpty())
+        {
+            throw ImageApprovalsError("The whole image was already read from this reader");
+        }
+
+        if (x == 0 && y == 0 && width == m_size.width && height == m_size.height)
+        {
+            return std::move(m_image);
+        }
+
+        return m_image.subView(x, y, width, height).copy();
+    }
+
+private:
+    const PixelFormat* m_format;
+    const ColorSpace* m_colorSpace;
+    Size m_size;
+    Image m_image;
+};
+
+class BufferedRowWriter : public ImageRowWriter
+{
+public:
+    BufferedRowWriter(
+        std::unique_ptr<std::ostream> stream, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size,
+        std::function<void(const ImageView&, std::ostream&)> write)
+        : ImageRowWriter(format, colorSpace, size)
+        , m_stream(std::move(stream))
+        , m_image(format, colorSpace, size)
+        , m_write(std::move(write))
+    {}
+
+protected:
+    void appendRows(uint32_t firstRow, const ImageView& rows) override
+    {
+        const auto rowSize = getPixelFormat().getPixelStride() * getSize().width;
+
+        for (uint32_t y = 0; y < rows.getSize().height; ++y)
+        {
+            std::memcpy(m_image.getRowPointer(firstRow + y), rows.getRowPointer(y), rowSize);
+        }
+    }
+
+    void finishFile() override
+    {
+        m_write(m_image, *m_stream);
     }
+
+private:
+    std::unique_ptr<std::ostream> m_stream;
+    Image m_image;
+    std::function<void(const ImageView&, std::ostream&)> m_write;
 };
 
-struct GrayU8PixelFormat : GenericPixelFormat<1, uint8_t>
+}
+
+Image ImageCodec::read(const std::string& fileName) const
 {
-    const char* getName() const override { return "GrayU8"; }
+    std::ifstream fileStream(fileName.c_str(), std::ios::binary);
+    if (!fileStream)
+    {
+        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for reading");
+    }
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
+    fileStream.exceptions(std::ios::failbit | std::ios::badbit);
+
+    return readFromStream(fileStream, fileName);
+}
+
+void ImageCodec::write(const std::string& fileName, const ImageView& image) const
+{
+    std::ofstream fileStream(fileName.c_str(), std::ios::binary);
+    if (!fileStream)
+    {
+        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for writing");
+    }
+
+    fileStream.exceptions(std::ios::badbit | std::ios::failbit);
+
+    writeToStream(image, fileStream, fileName);
+}
+
+LayeredImage ImageCodec::readLayers(const std::string& fileName) const
+{
+    std::ifstream fileStream(fileName.c_str(), std::ios::binary);
+    if (!fileStream)
+    {
+        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for reading");
+    }
+
+    fileStream.exceptions(std::ios::failbit | std::ios::badbit);
+
+    return readLayersFromStream(fileStream, fileName);
+}
+
+void ImageCodec::writeLayers(const std::string& fileName, const LayeredImage& image) const
+{
+    std::ofstream fileStream(fileName.c_str(), std::ios::binary);
+    if (!fileStream)
+    {
+        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for writing");
+    }
+
+    fileStream.exceptions(std::ios::badbit | std::ios::failbit);
+
+    writeLayersToStream(image, fileStream, fileName);
+}
+
+std::vector<uint8_t> ImageCodec::encode(const ImageView& image) const
+{
+    std::vector<uint8_t> data;
+    encodeToMemory(image, data);
+    return data;
+}
+
+void ImageCodec::encode(const ImageView& image, std::vector<uint8_t>& data) const
+{
+    data.clear();
+    encodeToMemory(image, data);
+}
+
+Image ImageCodec::decode(const uint8_t* data, size_t size) const
+{
+    if (!data && (size != 0))
+    {
+        throw ImageApprovalsError("Cannot decode image from null data");
+    }
+
+    return decodeFromMemory(data, size);
+}
+
+std::unique_ptr<ImageReader> ImageCodec::openReader(const std::string& fileName) const
+{
+    std::unique_ptr<std::ifstream> fileStream(new std::ifstream(fileName.c_str(), std::ios::binary));
+    if (!*fileStream)
+    {
+        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for reading");
+    }
+
+    fileStream->exceptions(std::ios::failbit | std::ios::badbit);
+
+    return openReaderForStream(std::move(fileStream), fileName);
+}
+
+std::unique_ptr<ImageRowWriter> ImageCodec::openRowWriter(
+    const std::string& fileName, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const
+{
+    std::unique_ptr<std::ofstream> fileStream(new std::ofstream(fileName.c_str(), std::ios::binary));
+    if (!*fileStream)
+    {
+        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for writing");
+    }
+
+    fileStream->exceptions(std::ios::badbit | std::ios::failbit);
+
+    return openRowWriterForStream(std::move(fileStream), fileName, format, colorSpace, size);
+}
+
+LayeredImage ImageCodec::readLayersFromStream(std::istream& stream, const std::string& fileName) const
+{
+    LayeredImage image;
+    image.addLayer("", readFromStream(stream, fileName));
+    return image;
+}
+
+void ImageCodec::writeLayersToStream(const LayeredImage& image, std::ostream& stream, const std::string& fileName) const
+{
+    if (image.getNumberOfLayers() != 1)
+    {
+        throw ImageApprovalsError("Codec for " + getFileExtensionWithDot() + " files can only write a single layer");
+    }
+
+    writeToStream(image.getLayer(0).image, stream, fileName);
+}
+
+Image ImageCodec::decodeFromMemory(const uint8_t* data, size_t size) const
+{
+    std::istringstream stream(std::string(reinterpret_cast<const char*>(data), size), std::ios::binary);
+    stream.exceptions(std::ios::failbit | std::ios::badbit);
+
+    return readFromStream(stream, "<memory>");
+}
+
+void ImageCodec::encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const
+{
+    std::ostringstream stream(std::ios::binary);
+    stream.exceptions(std::ios::badbit | std::ios::failbit);
+
+    writeToStream(image, stream, "<memory>");
+
+    const std::string bytes = stream.str();
+    data.insert(data.end(), bytes.begin(), bytes.end());
+}
+
+std::unique_ptr<ImageReader> ImageCodec::openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const
+{
+    return std::unique_ptr<ImageReader>(new detail::WholeImageReader(readFromStream(*stream, fileName)));
+}
+
+std::unique_ptr<ImageRowWriter> ImageCodec::openRowWriterForStream(
+    std::unique_ptr<std::ostream> stream, const std::string& fileName,
+    const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const
+{
+    return std::unique_ptr<ImageRowWriter>(new detail::BufferedRowWriter(
+        std::move(stream), format, colorSpace, size,
+        [this, fileName](const ImageView& image, std::ostream& stream) { writeToStream(image, stream, fileName); }));
+}
+
+ImageCodec::Disposer ImageCodec::registerCodec(const std::shared_ptr<ImageCodec>& codec)
+{
+    if (codec)
+    {
+        detail::getCodecRegistry().modify(
+            [&codec](detail::CodecList& codecs) { codecs.insert(codecs.begin(), codec); });
+    }
+
+    return Disposer(codec);
+}
+
+void ImageCodec::unregisterCodec(const std::shared_ptr<ImageCodec>& codec)
+{
+    if (!codec)
+    {
+        return;
+    }
+
+    detail::getCodecRegistry().modify([&codec](detail::CodecList& codecs)
+    {
+        auto pos = std::find(codecs.begin(), codecs.end(), codec);
+        if (pos != codecs.end())
+        {
+            codecs.erase(pos);
+        }
+    });
+}
+
+std::vector<std::string> ImageCodec::getRegisteredExtensions()
+{
+    const auto snapshot = detail::getCodecRegistry().getSnapshot();
+    const auto& codecs = snapshot->codecs;
+
+    std::vector<std::string> extensions;
+    extensions.resize(codecs.size());
+
+    transform(codecs.begin(), codecs.end(), extensions.begin(),
+        [](const std::shared_ptr<ImageCodec>& codec) { return codec->getFileExtensionWithDot(); });
+
+    return extensions;
+}
+
+const ImageCodec& ImageCodec::getBestCodec(const ImageView& image)
+{
+    const auto& pf = image.getPixelFormat();
+    const auto& cs = image.getColorSpace();
+
+    const auto snapshot = detail::getCodecRegistry().getSnapshot();
+
+    const ImageCodec* codec = nullptr;
+
+    auto pos = snapshot->byFormat.find(std::make_pair(&pf, &cs));
+    if (pos != snapshot->byFormat.end())
+    {
+        codec = pos->second;
+    }
+    else
+    {
+        codec = detail::findBestMatch(snapshot->codecs, pf, cs);
+    }
+
+    if(!codec)
+    {
+        std::ostringstream msg;
+        msg << "Could find a codec for pixel format " << pf << " and color space " << cs;
+        throw ImageApprovalsError(msg.str());
+    }
+
+    return *codec;
+}
+
+const ImageCodec& ImageCodec::getBestCodec(const std::string& filePath)
+{
+    using namespace ApprovalTests;
+    const std::string extWithDot = FileUtils::getExtensionWithDot(filePath);
+
+    const auto snapshot = detail::getCodecRegistry().getSnapshot();
+
+    const ImageCodec* codec = nullptr;
+
+    auto pos = snapshot->byExtension.find(extWithDot);
+    if (pos != snapshot->byExtension.end())
+    {
+        codec = pos->second;
+    }
+    else
+    {
+        codec = detail::findBestMatch(snapshot->codecs, extWithDot);
+    }
+
+    if(!codec)
+    {
+        std::ostringstream msg;
+        msg << "Could not find a codec for file extension \"" << extWithDot << "\"";
+        throw ImageApprovalsError(msg.str());
+    }
+
+    return *codec;
+}
+
+ImageCodec::Disposer::Disposer(std::shared_ptr<ImageCodec> codec)
+    : m_codec(std::move(codec))
+{}
+
+ImageCodec::Disposer::Disposer(Disposer&& other) noexcept
+    : m_codec(std::move(other.m_codec))
+{}
+
+ImageCodec::Disposer::~Disposer()
+{
+    if (m_codec)
+    {
+        ImageCodec::unregisterCodec(m_codec);
+    }
+}
+
+ImageCodec::Disposer& ImageCodec::Disposer::operator =(Disposer&& rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        m_codec = std::move(rhs.m_codec);
+    }
+
+    return *this;
+}
+
+}
+
+// src/ImageComparator.cpp
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace ImageApprovals {
+
+ImageComparator::Disposer::Disposer(std::vector<ApprovalTests::ComparatorDisposer> disposers)
+    : m_disposers(std::move(disposers))
+{}
+
+ImageComparator::ImageComparator()
+    : m_compareStrategy(std::make_shared<ThresholdCompareStrategy>())
+{}
+
+ImageComparator::ImageComparator(std::shared_ptr<CompareStrategy> comparator)
+    : m_compareStrategy(std::move(comparator))
+{}
+
+namespace detail {
+
+std::unique_ptr<ImageReader> openImageReader(const std::string& which, const std::string& path)
+{
+    try
+    {
+        const auto& codec = ImageCodec::getBestCodec(path);
+        return codec.openReader(path);
+    }
+    catch (const std::exception & exc)
+    {
+        const auto msg =
+            "Failed to read " + which + " image from \""
+            + path + "\": " + exc.what();
+
+        throw ApprovalTests::ApprovalException(msg);
+    }
+}
+
+LayeredImage readLayeredImage(const std::string& which, const std::string& path)
+{
+    try
+    {
+        const auto& codec = ImageCodec::getBestCodec(path);
+        return codec.readLayers(path);
+    }
+    catch (const std::exception & exc)
     {
-        const auto v = normalize(decodeBytes(begin), 255.0f)[0];
-        outRgba = RGBA(v, v, v, 1);
+        const auto msg =
+            "Failed to read " + which + " image from \""
+            + path + "\": " + exc.what();
+
+        throw ApprovalTests::ApprovalException(msg);
     }
-};
+}
 
-struct GrayAlphaU8PixelFormat : GenericPixelFormat<2, uint8_t>
+// name.<tag>.ext -> name<suffix>, e.g. name.received.png -> name.diff.png
+std::string getSiblingPath(const std::string& path, const std::string& tag, const std::string& suffix)
 {
-    const char* getName() const override { return "GrayAlphaU8"; }
+    const std::string extension = ApprovalTests::FileUtils::getExtensionWithDot(path);
+    std::string base = path.substr(0, path.size() - extension.size());
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
+    if (base.size() >= tag.size() && base.compare(base.size() - tag.size(), tag.size(), tag) == 0)
     {
-        const auto v = normalize(decodeBytes(begin), 255.0f);
-        outRgba = RGBA(v[0], v[0], v[0], v[1]);
+        base.erase(base.size() - tag.size());
     }
-};
 
-struct RgbU8PixelFormat : GenericPixelFormat<3, uint8_t>
+    return base + suffix;
+}
+
+// Returns a note for the failure message
+std::string writeDiffImage(const std::string& receivedPath, const ImageView& diff)
 {
-    const char* getName() const override { return "RgbU8"; }
+    const std::string path = getSiblingPath(receivedPath, ".received", ".diff.png");
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
+    try
     {
-        const auto v = normalize(decodeBytes(begin), 255.0f);
-        outRgba = RGBA(v[0], v[1], v[2], 1);
+#ifdef ImageApprovals_CONFIG_WITH_LIBPNG
+        PngImageCodec(PngCompression::Fastest).write(path, diff);
+#else
+        ImageCodec::getBestCodec(path).write(path, diff);
+#endif
     }
-};
-
-struct RgbAlphaU8PixelFormat : GenericPixelFormat<4, uint8_t>
-{
-    const char* getName() const override { return "RgbAlphaU8"; }
-
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
+    catch (const std::exception& exc)
     {
-        const auto v = normalize(decodeBytes(begin), 255.0f);
-        outRgba = RGBA(v[0], v[1], v[2], v[3]);
+        return " (could not write diff image: " + std::string(exc.what()) + ")";
     }
-};
 
-struct RgbF32PixelFormat : GenericPixelFormat<3, float>
+    return " (diff image: \"" + path + "\")";
+}
+
+// Reads name.mask.txt next to name.approved.ext; returns nullptr if there is no such file
+std::shared_ptr<const ToleranceMask> readToleranceMask(const std::string& approvedPath)
 {
-    const char* getName() const override { return "RgbF32"; }
+    const std::string path = getSiblingPath(approvedPath, ".approved", ".mask.txt");
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
     {
-        const auto v = decodeBytes(begin);
-        outRgba = RGBA(v[0], v[1], v[2], 1);
+        return nullptr;
     }
-};
 
-struct RgbAlphaF32PixelFormat : GenericPixelFormat<4, float>
-{
-    const char* getName() const override { return "RgbAlphaF32"; }
+    try
+    {
+        std::ostringstream text;
+        text << file.rdbuf();
 
-    void decode(const uint8_t* begin, RGBA& outRgba) const override
+        return std::make_shared<ToleranceMask>(ToleranceMask::deserialize(text.str()));
+    }
+    catch (const std::exception& exc)
     {
-        const auto v = decodeBytes(begin);
-        outRgba = RGBA(v[0], v[1], v[2], v[3]);
+        throw ApprovalTests::ApprovalException("Failed to read tolerance mask from \"" + path + "\": " + exc.what());
     }
-};
-
 }
 
-const uint8_t* PixelFormat::decode(const uint8_t* begin, const uint8_t* end, RGBA& outRgba) const
+std::string getLayerNames(const LayeredImage& image)
 {
-    const auto stride = getPixelStride();
-    if (begin + stride > end)
+    std::string names;
+
+    for (size_t i = 0; i < image.getNumberOfLayers(); ++i)
     {
-        throw ImageApprovalsError("begin + stride > end");
+        names += (i == 0) ? "" : ", ";
+        names += "\"" + image.getLayer(i).name + "\"";
     }
 
-    decode(begin, outRgba);
-    return begin + stride;
-}
-
-const PixelFormat& PixelFormat::getGrayU8()
-{
-    static const detail::GrayU8PixelFormat instance;
-    return instance;
-}
-
-const PixelFormat& PixelFormat::getGrayAlphaU8()
-{
-    static const detail::GrayAlphaU8PixelFormat instance;
-    return instance;
+    return "layers: " + names;
 }
 
-const PixelFormat& PixelFormat::getRgbU8()
-{
-    static const detail::RgbU8PixelFormat instance;
-    return instance;
 }
 
-const PixelFormat& PixelFormat::getRgbAlphaU8()
+ImageComparator& ImageComparator::setBandMemoryLimit(size_t maxBytes)
 {
-    static const detail::RgbAlphaU8PixelFormat instance;
-    return instance;
+    m_bandMemoryLimit = maxBytes;
+    return *this;
 }
 
-const PixelFormat& PixelFormat::getRgbF32()
+ImageComparator& ImageComparator::setDiffImageAmplification(float amplification)
 {
-    static const detail::RgbF32PixelFormat instance;
-    return instance;
-}
+    if (!(amplification >= 0.0f))
+    {
+        throw ImageApprovalsError("Diff image amplification must not be negative");
+    }
 
-const PixelFormat& PixelFormat::getRgbAlphaF32()
-{
-    static const detail::RgbAlphaF32PixelFormat instance;
-    return instance;
+    m_diffAmplification = amplification;
+    return *this;
 }
 
-std::ostream& operator <<(std::ostream& stream, const PixelFormat& format)
+ImageComparator& ImageComparator::setToleranceMask(std::shared_ptr<const ToleranceMask> mask)
 {
-    stream << format.getName();
-    return stream;
+    m_toleranceMask = std::move(mask);
+    return *this;
 }
 
-std::ostream& operator <<(std::ostream& stream, const RGBA& rgba)
+bool ImageComparator::contentsAreEquivalent(std::string receivedPath, std::string approvedPath) const
 {
-    stream << "(" << rgba.r << ", " << rgba.g << ", " << rgba.b << ", " << rgba.a << ")";
-    return stream;
-}
-
-}
-
-// src/PngImageCodec.hpp
-
-#ifdef ImageApprovals_CONFIG_WITH_LIBPNG
+    // Both files are opened concurrently; the headers are compared before any pixels are read,
+    // and the pixels of both images are then decoded concurrently as well
+    std::unique_ptr<ImageReader> receivedReader, approvedReader;
 
+    detail::parallelInvoke(
+        [&]() { receivedReader = detail::openImageReader("received", receivedPath); },
+        [&]() { approvedReader = detail::openImageReader("approved", approvedPath); });
 
-namespace ImageApprovals { namespace detail {
-
-class PngImageCodec : public ImageCodec
-{
-public:
-    std::string getFileExtensionWithDot() const override;
+    const size_t bandBytes
+        = (m_bandMemoryLimit != 0) ? m_bandMemoryLimit : std::numeric_limits<size_t>::max();
 
-    int getScore(const std::string& extensionWithDot) const override;
-    int getScore(const PixelFormat& pf, const ColorSpace& cs) const override;
+    std::unique_ptr<DiffImageRenderer> diff;
+    if (m_diffAmplification > 0.0f && m_compareStrategy->rendersDiffImages()
+        && approvedReader->getSize() == receivedReader->getSize())
+    {
+        diff.reset(new DiffImageRenderer(approvedReader->getSize(), m_diffAmplification));
+    }
 
-protected:
-    Image readFromStream(std::istream& stream, const std::string& fileName) const override;
-    void writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const override;
-};
+    const auto toleranceMask = m_toleranceMask ? m_toleranceMask : detail::readToleranceMask(approvedPath);
 
-} }
+    CompareOptions options;
+    options.diff = diff.get();
+    options.toleranceMask = toleranceMask.get();
 
-#endif // ImageApprovals_CONFIG_WITH_LIBPNG
+    const auto result = m_compareStrategy->compare(*approvedReader, *receivedReader, bandBytes, options);
+    if (!result.passed)
+    {
+        std::string receivedInfo = result.getRightImageInfo();
 
-// src/Qt5Integration.cpp
+        if (diff && diff->isRendered())
+        {
+            receivedInfo += detail::writeDiffImage(receivedPath, diff->getImage());
+        }
 
-#ifdef ImageApprovals_CONFIG_WITH_QT5
+        throw ApprovalTests::ApprovalMismatchException(receivedInfo, result.getLeftImageInfo());
+    }
 
-#include <QImage>
+    return true;
+}
 
-namespace ImageApprovals {
+LayeredImageComparator::LayeredImageComparator()
+    : m_defaultStrategy(std::make_shared<ThresholdCompareStrategy>())
+{}
 
-namespace detail {
+LayeredImageComparator::LayeredImageComparator(std::shared_ptr<CompareStrategy> defaultStrategy)
+    : m_defaultStrategy(std::move(defaultStrategy))
+{}
 
-const PixelFormat* fromQt5PixelFormat(const QImage& image)
+LayeredImageComparator& LayeredImageComparator::setLayerStrategy(
+    std::string layerName, std::shared_ptr<CompareStrategy> strategy)
 {
-    switch (image.format())
+    if (!strategy)
     {
-        case QImage::Format_Grayscale8:
-        case QImage::Format_Alpha8:
-            return &PixelFormat::getGrayU8();
-        case QImage::Format_RGB888:
-            return &PixelFormat::getRgbU8();
-        case QImage::Format_RGBA8888:
-        case QImage::Format_RGBX8888:
-            return &PixelFormat::getRgbAlphaU8();
-        default:
-            break;
+        throw ImageApprovalsError("Layer compare strategy must not be null");
     }
 
-    return nullptr;
+    m_layerStrategies[std::move(layerName)] = std::move(strategy);
+    return *this;
 }
 
-const ColorSpace* fromQt5ColorSpace(const QImage &image)
+const CompareStrategy& LayeredImageComparator::getStrategy(const std::string& layerName) const
 {
-    // TODO QColorSpace was added in Qt 5.14
-    ((void) image);
-    return &ColorSpace::getSRgb();
+    const auto it = m_layerStrategies.find(layerName);
+    return (it != m_layerStrategies.end()) ? *it->second : *m_defaultStrategy;
 }
 
-}
-
-ImageView makeView(const QImage& image)
+bool LayeredImageComparator::contentsAreEquivalent(std::string receivedPath, std::string approvedPath) const
 {
-    auto format = detail::fromQt5PixelFormat(image);
-    auto colorSpace = detail::fromQt5ColorSpace(image);
+    LayeredImage received, approved;
 
-    if(!format)
+    detail::parallelInvoke(
+        [&]() { received = detail::readLayeredImage("received", receivedPath); },
+        [&]() { approved = detail::readLayeredImage("approved", approvedPath); });
+
+    bool sameLayers = (received.getNumberOfLayers() == approved.getNumberOfLayers());
+
+    for (size_t i = 0; sameLayers && (i < approved.getNumberOfLayers()); ++i)
     {
-        throw ImageApprovalsError("Unsupported QImage::Format value");
+        sameLayers = (received.findLayer(approved.getLayer(i).name) != nullptr);
     }
 
-    if(!colorSpace)
+    if (!sameLayers)
     {
-        throw ImageApprovalsError("Unsupported QColorSpace");
+        throw ApprovalTests::ApprovalMismatchException(detail::getLayerNames(received), detail::getLayerNames(approved));
     }
 
-    const auto w = static_cast<uint32_t>(image.width());
-    const auto h = static_cast<uint32_t>(image.height());
-    const auto stride = static_cast<size_t>(image.bytesPerLine());
+    // Strategies split each image across threads, so layers are compared one after another
+    std::string receivedInfo;
+    std::string approvedInfo;
 
-    return ImageView(*format, *colorSpace, Size(w, h), stride, image.constBits());
-}
+    for (size_t i = 0; i < approved.getNumberOfLayers(); ++i)
+    {
+        const auto& approvedLayer = approved.getLayer(i);
+        const auto& receivedLayer = *received.findLayer(approvedLayer.name);
 
-}
+        const auto result = getStrategy(approvedLayer.name).compare(approvedLayer.image, receivedLayer.image);
+        if (!result.passed)
+        {
+            const std::string separator = receivedInfo.empty() ? "" : "; ";
+            receivedInfo += separator + "layer \"" + approvedLayer.name + "\": " + result.getRightImageInfo();
+            approvedInfo += separator + "layer \"" + approvedLayer.name + "\": " + result.getLeftImageInfo();
+        }
+    }
 
-#endif // ImageApprovals_CONFIG_WITH_QT5
+    if (!receivedInfo.empty())
+    {
+        throw ApprovalTests::ApprovalMismatchException(receivedInfo, approvedInfo);
+    }
 
-// src/Units.cpp
+    return true;
+}
 
-#include <ostream>
+ImageComparator::Disposer ImageComparator::registerForAllExtensions(std::shared_ptr<CompareStrategy> strategy)
+{
+    using namespace ApprovalTests;
 
-namespace ImageApprovals {
+    auto comparator = std::make_shared<ImageComparator>(std::move(strategy));
 
-std::ostream& operator <<(std::ostream& stream, const AbsThreshold& threshold)
-{
-    stream << threshold.value;
-    return stream;
-}
+    const auto allExtensions = ImageCodec::getRegisteredExtensions();
+    
+    std::vector<ApprovalTests::ComparatorDisposer> disposers;
+    disposers.reserve(allExtensions.size());
 
-std::ostream& operator <<(std::ostream& stream, const Percent& percent)
-{
-    stream << percent.value << "%";
-    return stream;
+    transform(allExtensions.begin(), allExtensions.end(), std::back_inserter(disposers),
+        [&](const std::string& ext) { return FileApprover::registerComparatorForExtension(ext, comparator); });
+
+    return Disposer(std::move(disposers));
 }
 
 }
 
-// src/ColorSpaceUtils.cpp
+// src/Parallel.cpp
 
-#include <stdexcept>
-#include <cstring>
-#include <memory>
-#include <array>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 namespace ImageApprovals { namespace detail {
 
-bool approxEqual(double a, double b)
-{
-    return std::abs(a - b) <= 1e-5;
-}
+namespace {
 
-bool RgbPrimaries::Primary::approxEqual(const Primary& other) const
+size_t getMaxNumThreads()
 {
-    return detail::approxEqual(x, other.x)
-        && detail::approxEqual(y, other.y);
+    const size_t numThreads = std::thread::hardware_concurrency();
+    return std::max<size_t>(numThreads, 1);
 }
 
-bool RgbPrimaries::approxEqual(const RgbPrimaries& other) const
-{
-    return r.approxEqual(other.r)
-        && g.approxEqual(other.g)
-        && b.approxEqual(other.b);
-}
+thread_local bool inParallelRegion = false;
 
-RgbPrimaries RgbPrimaries::getSRgbPrimaries()
+// Marks the current thread as running parallel work while the object lives
+class ParallelRegion
 {
-    RgbPrimaries p;
-    p.r = Primary(0.64, 0.33);
-    p.g = Primary(0.30, 0.60);
-    p.b = Primary(0.15, 0.06);
-    return p;
-}
-
-namespace {
+public:
+    ParallelRegion()
+        : m_outer(inParallelRegion)
+    {
+        inParallelRegion = true;
+    }
 
-uint32_t fromBigEndian(uint32_t value)
-{
-    uint32_t result = 0;
+    ~ParallelRegion() { inParallelRegion = m_outer; }
 
-    uint8_t beBytes[4];
-    std::memcpy(beBytes, &value, 4);
-    
-    const uint8_t leBytes[4]{ beBytes[3], beBytes[2], beBytes[1], beBytes[0] };
-    std::memcpy(&result, leBytes, 4);
+    ParallelRegion(const ParallelRegion&) = delete;
+    ParallelRegion& operator =(const ParallelRegion&) = delete;
 
-    return result;
-}
+private:
+    bool m_outer;
+};
 
 }
 
-bool isSRgbIccProfile(uint32_t profLen, const uint8_t* profData)
+void parallelFor(size_t count, size_t minRangeSize, const std::function<void(size_t, size_t)>& fn)
 {
-    if (profLen < 132)
+    if (count == 0)
     {
-        throw ImageApprovalsError("Incomplete ICC profile data");
+        return;
     }
 
-    const std::array<char, 4> rgbColorSpace{ 'R', 'G', 'B', ' ' };
-    std::array<char, 4> colorSpace;
-    std::memcpy(colorSpace.data(), profData + 16, 4);
-    if (colorSpace != rgbColorSpace)
+    minRangeSize = std::max<size_t>(minRangeSize, 1);
+
+    const size_t numRanges = std::min(getMaxNumThreads(), (count + minRangeSize - 1) / minRangeSize);
+    if (numRanges <= 1 || inParallelRegion)
     {
-        throw ImageApprovalsError("Color space in the ICC profile is not RGB");
+        fn(0, count);
+        return;
     }
 
-    uint32_t numTags = 0;
-    std::memcpy(&numTags, profData + 128, 4);
-    numTags = fromBigEndian(numTags);
-    if ((128 + numTags * 12) > profLen)
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+
+    auto runRange = [&](size_t rangeIndex) {
+        ParallelRegion region;
+
+        const size_t begin = (count * rangeIndex) / numRanges;
+        const size_t end = (count * (rangeIndex + 1)) / numRanges;
+
+        try
+        {
+            fn(begin, end);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!firstError)
+            {
+                firstError = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numRanges - 1);
+
+    for (size_t rangeIndex = 1; rangeIndex < numRanges; ++rangeIndex)
     {
-        throw ImageApprovalsError("Incomplete ICC profile data");
+        try
+        {
+            threads.emplace_back(runRange, rangeIndex);
+        }
+        catch (const std::system_error&)
+        {
+            runRange(rangeIndex);
+        }
     }
 
-    struct TagInfo
+    runRange(0);
+
+    for (auto& thread : threads)
     {
-        std::array<char, 4> signature;
-        uint32_t offset;
-        uint32_t size;
-    };
+        thread.join();
+    }
 
-    for (uint32_t tagIndex = 0; tagIndex < numTags; ++tagIndex)
+    if (firstError)
     {
-        TagInfo info{};
-        std::memcpy(&info, profData + 132 + tagIndex * sizeof(TagInfo), sizeof(TagInfo));
-        info.offset = fromBigEndian(info.offset);
-        info.size = fromBigEndian(info.size);
+        std::rethrow_exception(firstError);
+    }
+}
 
-        if ((info.offset + info.size) > profLen)
+void parallelForEach(size_t count, size_t maxThreads, const std::function<void(size_t)>& fn)
+{
+    const size_t numThreads = std::min(std::max<size_t>(maxThreads, 1), count);
+    if (numThreads <= 1 || inParallelRegion)
+    {
+        for (size_t index = 0; index < count; ++index)
         {
-            throw ImageApprovalsError("Incomplete ICC profile data");
+            fn(index);
         }
 
-        // profileDescriptionTag 
-        const std::array<char, 4> descSig{ 'd', 'e', 's', 'c' };
-        if (info.signature == descSig)
-        {
-            const uint8_t* descPtr = profData + info.offset;
-
-            uint32_t strLen = 0, strOffset = 0;
-
-            std::memcpy(&strLen, descPtr + 20, 4);
-            strLen = fromBigEndian(strLen);
+        return;
+    }
 
-            std::memcpy(&strOffset, descPtr + 24, 4);
-            strOffset = fromBigEndian(strOffset);
+    std::atomic<size_t> nextIndex(0);
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
 
-            std::unique_ptr<char[]> str(new char[(strLen / 2) + 1]);
-            str[strLen / 2] = '\0';
+    auto runWorker = [&]() {
+        ParallelRegion region;
 
-            for (uint32_t i = 0; i < strLen / 2; ++i)
+        for (size_t index = nextIndex++; index < count; index = nextIndex++)
+        {
+            try
             {
-                str[i] = static_cast<char>((descPtr + strOffset)[1 + i * 2]);
+                fn(index);
             }
-
-            if (std::strstr(str.get(), "sRGB") != nullptr)
+            catch (...)
             {
-                return true;
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!firstError)
+                {
+                    firstError = std::current_exception();
+                }
             }
         }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+
+    for (size_t threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+    {
+        try
+        {
+            threads.emplace_back(runWorker);
+        }
+        catch (const std::system_error&)
+        {
+            break;
+        }
     }
 
-    return false;
+    runWorker();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    if (firstError)
+    {
+        std::rethrow_exception(firstError);
+    }
 }
 
-const ColorSpace* detectColorSpace(const RgbPrimaries& primaries, double gamma)
+void parallelInvoke(const std::function<void()>& first, const std::function<void()>& second)
 {
-    const auto sRgbPrimaries = RgbPrimaries::getSRgbPrimaries();
+    if (getMaxNumThreads() <= 1 || inParallelRegion)
+    {
+        first();
+        second();
+        return;
+    }
 
-    if (!primaries.approxEqual(sRgbPrimaries))
+    std::exception_ptr firstError;
+    std::exception_ptr secondError;
+
+    auto runSecond = [&]() {
+        ParallelRegion region;
+
+        try
+        {
+            second();
+        }
+        catch (...)
+        {
+            secondError = std::current_exception();
+        }
+    };
+
+    std::thread thread;
+
+    try
     {
-        return nullptr;
+        thread = std::thread(runSecond);
+    }
+    catch (const std::system_error&)
+    {
+        runSecond();
     }
 
-    if (approxEqual(gamma, 1.0))
+    try
     {
-        return &ColorSpace::getLinearSRgb();
+        ParallelRegion region;
+        first();
     }
-    else if (approxEqual(gamma, 1.0 / 2.2))
+    catch (...)
     {
-        return &ColorSpace::getSRgb();
+        firstError = std::current_exception();
     }
 
-    return nullptr;
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+
+    if (firstError)
+    {
+        std::rethrow_exception(firstError);
+    }
+
+    if (secondError)
+    {
+        std::rethrow_exception(secondError);
+    }
 }
 
 } }
 
-// src/ExrImageCodec.cpp
+// src/PngImageCodec.cpp
 
-#ifdef ImageApprovals_CONFIG_WITH_OPENEXR
+#ifdef ImageApprovals_CONFIG_WITH_LIBPNG
 
+#include <png.h>
+#include <zlib.h>
+#include <functional>
 #include <cstring>
-#include <array>
-
-#ifdef _MSC_VER
-# pragma warning(push)
-# pragma warning(disable: 4996)
-#endif
-
-#include <OpenEXR/ImfRgbaFile.h>
-#include <OpenEXR/ImfIO.h>
-#include <OpenEXR/ImfArray.h>
-#include <OpenEXR/half.h>
-
-#ifdef _MSC_VER
-# pragma warning(pop)
-#endif
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <vector>
 
 namespace ImageApprovals { namespace detail {
 
 namespace {
 
-class InputStramAdapter : public Imf::IStream
+class OnExit
 {
 public:
-    InputStramAdapter(const std::string& fileName, std::istream& stream)
-        : Imf::IStream(fileName.c_str()), m_stream(stream)
+    OnExit(std::function<void()> fn)
+        : m_fn(std::move(fn))
     {}
 
-    bool isMemoryMapped() const override { return false; }
+    OnExit(const OnExit&) = delete;
+    OnExit(OnExit&&) = delete;
 
-    bool read(char* c, int n) override
+    ~OnExit() noexcept
     {
-        m_stream.read(c, n);
-
-        const auto read_bytes = m_stream.gcount();
-        if (read_bytes < n)
-        {
-            throw ImageApprovalsError("Not enough data");
-        }
-
-        return !m_stream.eof();
+        m_fn();
     }
 
-    char* readMemoryMapped(int) override { throw ImageApprovalsError("Not memory mapped"); }
+private:
+    std::function<void()> m_fn;
+};
 
-    Imf::Int64 tellg() override { return m_stream.tellg(); }
+void PNGCBAPI readBytes(png_struct* png, png_byte* data, size_t len)
+{
+    auto& stream = *reinterpret_cast<std::istream*>(png_get_io_ptr(png));
+    stream.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(len));
+}
 
-    void seekg(Imf::Int64 pos) override { m_stream.seekg(pos); }
+void PNGCBAPI writeBytes(png_struct* png, png_byte* data, size_t len)
+{
+    auto& stream = *reinterpret_cast<std::ostream*>(png_get_io_ptr(png));
+    stream.write(reinterpret_cast<const char*>(data), static_cast<std::streampos>(len));
+}
 
-    void clear() override { m_stream.clear(); }
+void PNGCBAPI flush(png_struct* png)
+{
+    auto& stream = *reinterpret_cast<std::ostream*>(png_get_io_ptr(png));
+    stream.flush();
+}
 
-private:
-    std::istream& m_stream;
+struct MemorySource
+{
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
 };
 
-class OutputStreamAdapter : public Imf::OStream
+void PNGCBAPI readMemoryBytes(png_struct* png, png_byte* data, size_t len)
 {
-public:
-    OutputStreamAdapter(const std::string& fileName, std::ostream& stream)
-        : Imf::OStream(fileName.c_str()), m_stream(stream)
-    {}
+    auto& source = *reinterpret_cast<MemorySource*>(png_get_io_ptr(png));
 
-    void write(const char* c, int n) override
+    if (len > source.size - source.pos)
     {
-        m_stream.write(c, n);
+        png_error(png, "Not enough data");
     }
 
-    Imf::Int64 tellp() override { return m_stream.tellp(); }
-
-    void seekp(Imf::Int64 p) override { m_stream.seekp(p); }
-
-private:
-    std::ostream& m_stream;
-};
-
+    std::memcpy(data, source.data + source.pos, len);
+    source.pos += len;
 }
 
-namespace {
+void PNGCBAPI appendBytes(png_struct* png, png_byte* data, size_t len)
+{
+    auto& sink = *reinterpret_cast<std::vector<uint8_t>*>(png_get_io_ptr(png));
+    sink.insert(sink.end(), data, data + len);
+}
 
-void copyPixels(size_t numChannels, const Size& sz, const Imf::Array2D<Imf::Rgba>& src, uint8_t* dst)
+const ColorSpace* detectColorSpace(png_struct* png, png_info* info)
 {
-    for (uint32_t y = 0; y < sz.height; ++y)
+    int intent = -1;
+    if (png_get_sRGB(png, info, &intent) == PNG_INFO_sRGB)
     {
-        for (uint32_t x = 0; x < sz.width; ++x)
-        {
-            const auto srcPixel = src[x][y];
+        return &ColorSpace::getSRgb();
+    }
 
-            const float value[]{
-                static_cast<float>(srcPixel.r),
-                static_cast<float>(srcPixel.g),
-                static_cast<float>(srcPixel.b),
-                static_cast<float>(srcPixel.a)
-            };
+    char* iccpName = nullptr;
+    int iccpCompressionType = PNG_COMPRESSION_TYPE_BASE;
+    png_byte* iccpData = nullptr;
+    uint32_t iccpDataLen = 0;
+    const auto iCCP
+        = png_get_iCCP(
+            png, info,
+            &iccpName,
+            &iccpCompressionType,
+            &iccpData, &iccpDataLen);
 
-            std::memcpy(dst, value, numChannels * 4);
-            dst += numChannels * 4;
-        }
+    if (iCCP == PNG_INFO_iCCP && isSRgbIccProfile(iccpDataLen, iccpData))
+    {
+        return &ColorSpace::getSRgb();
     }
-}
 
-}
+    double white_x = 0.0, white_y = 0.0;
+    RgbPrimaries prims;
 
-std::string ExrImageCodec::getFileExtensionWithDot() const
-{
-    return ".exr";
-}
+    const auto cHRM
+        = png_get_cHRM(
+            png, info,
+            &white_x, &white_y,
+            &prims.r.x, &prims.r.y,
+            &prims.g.x, &prims.g.y,
+            &prims.b.x, &prims.b.y);
 
-int ExrImageCodec::getScore(const std::string& extensionWithDot) const
-{
-    if(extensionWithDot == ".exr")
+    double gamma = 0.0f;
+    const auto gAMA = png_get_gAMA(png, info, &gamma);
+
+    if (cHRM == PNG_INFO_cHRM && gAMA == PNG_INFO_gAMA)
     {
-        return 100;
+        return detectColorSpace(prims, gamma);
     }
-    
-    return -1;
+
+    return &ColorSpace::getLinearSRgb();
 }
 
-int ExrImageCodec::getScore(const PixelFormat& pf, const ColorSpace& cs) const
+void writePngComment(png_struct* png, png_info* info)
 {
-    if(!pf.isF32() || cs != ColorSpace::getLinearSRgb())
-    {
-        return -1;
-    }
+    std::string textKey = "Software";
+    std::string textStr = "ImageApprovals";
 
-    return 100;
+    png_text text;
+    text.compression = PNG_TEXT_COMPRESSION_NONE;
+    text.key = &textKey[0];
+    text.text = &textStr[0];
+    text.text_length = textStr.size();
+    text.itxt_length = 0;
+    text.lang = nullptr;
+    text.lang_key = nullptr;
+
+    png_set_text(png, info, &text, 1);
 }
 
-Image ExrImageCodec::readFromStream(std::istream& stream, const std::string& fileName) const
+// PNG stores 16-bit samples in big-endian order, 16-bit pixel formats use native order
+bool isHostLittleEndian()
 {
-    InputStramAdapter streamAdapter(fileName, stream);
-
-    Imf::RgbaInputFile file(streamAdapter);
-    Imath::Box2i dw = file.dataWindow();
-
-    const auto width = dw.max.x - dw.min.x + 1;
-    const auto height = dw.max.y - dw.min.y + 1;
-
-    Imf::Array2D<Imf::Rgba> pixels;
-    pixels.resizeErase(width, height);
+    const uint16_t probe = 1;
+    uint8_t firstByte = 0;
+    std::memcpy(&firstByte, &probe, 1);
+    return firstByte == 1;
+}
 
-    file.setFrameBuffer(pixels[0] - dw.min.x - dw.min.y * width, 1, width);
-    file.readPixels(dw.min.y, dw.max.y);
+// PNG stores straight alpha, so premultiplied images are written through their straight counterpart
+const PixelFormat* getPngStraightAlphaFormat(const PixelFormat& fmt)
+{
+    if (fmt == PixelFormat::getGrayAlphaU8Premultiplied())
+    {
+        return &PixelFormat::getGrayAlphaU8();
+    }
 
-    const PixelFormat* fmt = nullptr;
+    if (fmt == PixelFormat::getRgbAlphaU8Premultiplied())
+    {
+        return &PixelFormat::getRgbAlphaU8();
+    }
 
-    switch (file.channels())
+    if (fmt == PixelFormat::getBgrAlphaU8Premultiplied())
     {
-    case Imf::WRITE_RGB:
-        fmt = &PixelFormat::getRgbF32();
-        break;
-    case Imf::WRITE_RGBA:
-        fmt = &PixelFormat::getRgbAlphaF32();
-        break;
-    default:
-        throw ImageApprovalsError("Unsupported pixel format");
+        return &PixelFormat::getBgrAlphaU8();
     }
 
-    const Size imgSize(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+    if (fmt == PixelFormat::getAlphaRgbU8Premultiplied())
+    {
+        return &PixelFormat::getAlphaRgbU8();
+    }
 
-    Image image(*fmt, ColorSpace::getLinearSRgb(), imgSize, 4);
-    copyPixels(fmt->getNumberOfChannels(), imgSize, pixels, image.getPixelData());
+    if (fmt == PixelFormat::getRgbAlphaU16Premultiplied())
+    {
+        return &PixelFormat::getRgbAlphaU16();
+    }
 
-    return image;
+    return nullptr;
 }
 
-void ExrImageCodec::writeToStream(const ImageView& image, std::ostream& stream, const std::string& fileName) const
+// Returns the color type of PNG files storing the format, and the transforms mapping its channel order
+void getPngColorType(const PixelFormat& fmt, int& pngColorType, int& pngTransforms)
 {
-    const auto& fmt = image.getPixelFormat();
+    pngTransforms = PNG_TRANSFORM_IDENTITY;
 
-    if (!fmt.isF32())
+    if (fmt == PixelFormat::getGrayU8() || fmt == PixelFormat::getGrayU16())
     {
-        throw ImageApprovalsError("EXR codec cannot write non-float pixels");
+        pngColorType = PNG_COLOR_TYPE_GRAY;
     }
-
-    if (image.getColorSpace() != ColorSpace::getLinearSRgb())
+    else if (fmt == PixelFormat::getGrayAlphaU8() || fmt == PixelFormat::getGrayAlphaU16())
     {
-        throw ImageApprovalsError("EXR codec can write only images with linear color space");
+        pngColorType = PNG_COLOR_TYPE_GRAY_ALPHA;
     }
-
-    Imf::RgbaChannels channels{};
-
-    if (fmt == PixelFormat::getRgbF32())
+    else if (fmt == PixelFormat::getRgbU8() || fmt == PixelFormat::getRgbU16())
+    {
+        pngColorType = PNG_COLOR_TYPE_RGB;
+    }
+    else if (fmt == PixelFormat::getRgbAlphaU8() || fmt == PixelFormat::getRgbAlphaU16())
+    {
+        pngColorType = PNG_COLOR_TYPE_RGB_ALPHA;
+    }
+    else if (fmt == PixelFormat::getBgrU8())
+    {
+        pngColorType = PNG_COLOR_TYPE_RGB;
+        pngTransforms = PNG_TRANSFORM_BGR;
+    }
+    else if (fmt == PixelFormat::getBgrAlphaU8())
     {
-        channels = Imf::WRITE_RGB;
+        pngColorType = PNG_COLOR_TYPE_RGB_ALPHA;
+        pngTransforms = PNG_TRANSFORM_BGR;
     }
-    else if (fmt == PixelFormat::getRgbAlphaF32())
+    else if (fmt == PixelFormat::getAlphaRgbU8())
     {
-        channels = Imf::WRITE_RGBA;
+        pngColorType = PNG_COLOR_TYPE_RGB_ALPHA;
+        pngTransforms = PNG_TRANSFORM_SWAP_ALPHA;
     }
     else
     {
         throw ImageApprovalsError("Unexpected pixel format");
     }
 
-    OutputStreamAdapter streamAdapter(fileName, stream);
-
-    const auto sz = image.getSize();
-    int width = static_cast<int>(sz.width);
-    int height = static_cast<int>(sz.height);
-
-    const Imf::Header hdr(
-        width, height,
-        static_cast<float>(width) / height);
-
-    Imf::RgbaOutputFile file(streamAdapter, hdr, channels);
-
-    Imf::Array2D<Imf::Rgba> pixels;
-    pixels.resizeErase(width, height);
-
-    for (uint32_t y = 0; y < sz.height; ++y)
+    if (fmt.isU16() && isHostLittleEndian())
     {
-        for (uint32_t x = 0; x < sz.width; ++x)
-        {
-            const auto srcPixel = image.getPixel(x, y);
-
-            Imf::Rgba dstPixel;
-            dstPixel.r = half(srcPixel.r);
-            dstPixel.g = half(srcPixel.g);
-            dstPixel.b = half(srcPixel.b);
-            dstPixel.a = half(srcPixel.a);
-
-            pixels[x][y] = dstPixel;
-        }
+        pngTransforms |= PNG_TRANSFORM_SWAP_ENDIAN;
     }
-
-    file.setFrameBuffer(pixels[0], 1, width);
-    file.writePixels(height);
 }
 
-} }
-
-#endif // ImageApprovals_CONFIG_WITH_OPENEXR
-
-// src/ImageCodec.cpp
-
-#include <ApprovalTests.hpp>
-#include <algorithm>
-#include <fstream>
-#include <sstream>
-#include <vector>
-
-
-namespace ImageApprovals {
-
-namespace detail {
-
-std::vector<std::shared_ptr<ImageCodec>> initCodecs()
+const PixelFormat& getPngPixelFormat(int pngBitDepth, int pngColorType)
 {
-    std::vector<std::shared_ptr<ImageCodec>> codecs;
-
-#ifdef ImageApprovals_CONFIG_WITH_LIBPNG
-    codecs.push_back(std::make_shared<PngImageCodec>());
-#endif // ImageApprovals_CONFIG_WITH_LIBPNG
+    if (pngBitDepth != 8 && pngBitDepth != 16)
+    {
+        throw ImageApprovalsError("Unsupported PNG bit depth");
+    }
 
-#ifdef ImageApprovals_CONFIG_WITH_OPENEXR
-    codecs.push_back(std::make_shared<ExrImageCodec>());
-#endif // ImageApprovals_CONFIG_WITH_OPENEXR
+    const bool is16Bit = (pngBitDepth == 16);
 
-    return codecs;
+    switch (pngColorType)
+    {
+    case PNG_COLOR_TYPE_GRAY:
+        return is16Bit ? PixelFormat::getGrayU16() : PixelFormat::getGrayU8();
+    case PNG_COLOR_TYPE_GRAY_ALPHA:
+        return is16Bit ? PixelFormat::getGrayAlphaU16() : PixelFormat::getGrayAlphaU8();
+    case PNG_COLOR_TYPE_RGB:
+        return is16Bit ? PixelFormat::getRgbU16() : PixelFormat::getRgbU8();
+    case PNG_COLOR_TYPE_RGB_ALPHA:
+        return is16Bit ? PixelFormat::getRgbAlphaU16() : PixelFormat::getRgbAlphaU8();
+    default:
+        throw ImageApprovalsError("Unsupported PNG color type");
+    }
 }
 
-template<typename... ArgTypes>
-const ImageCodec* findBestMatch(const std::vector<std::shared_ptr<ImageCodec>>& codecs, const ArgTypes&... args)
+struct PngReadStructs
 {
-    const ImageCodec* bestCodec = nullptr;
-    int bestScore = -1;
+    png_struct* png = nullptr;
+    png_info* info = nullptr;
 
-    for(auto iter = codecs.rbegin(); iter != codecs.rend(); ++iter)
+    PngReadStructs()
     {
-        const ImageCodec* codec = iter->get();
-        const int score = codec->getScore(args...);
+        if (!(png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr)))
+        {
+            throw ImageApprovalsError("Failed to allocate PNG read struct");
+        }
 
-        if((score >= 0) && (score > bestScore))
+        if (!(info = png_create_info_struct(png)))
         {
-            bestCodec = codec;
-            bestScore = score;
+            png_destroy_read_struct(&png, nullptr, nullptr);
+            throw ImageApprovalsError("Failed to allocate PNG info struct");
         }
     }
 
-    return bestCodec;
-}
-
-}
+    PngReadStructs(const PngReadStructs&) = delete;
 
-Image ImageCodec::read(const std::string& fileName) const
-{
-    std::ifstream fileStream(fileName.c_str(), std::ios::binary);
-    if (!fileStream)
+    ~PngReadStructs() noexcept
     {
-        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for reading");
+        png_destroy_read_struct(&png, &info, nullptr);
     }
+};
 
-    fileStream.exceptions(std::ios::failbit | std::ios::badbit);
-
-    return readFromStream(fileStream, fileName);
-}
-
-void ImageCodec::write(const std::string& fileName, const ImageView& image) const
+struct PngWriteStructs
 {
-    std::ofstream fileStream(fileName.c_str(), std::ios::binary);
-    if (!fileStream)
+    png_struct* png = nullptr;
+    png_info* info = nullptr;
+
+    PngWriteStructs()
     {
-        throw ImageApprovalsError("Could not open file \"" + fileName + "\" for writing");
-    }
+        if (!(png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr)))
+        {
+            throw ImageApprovalsError("Failed to allocate PNG write struct");
+        }
 
-    fileStream.exceptions(std::ios::badbit | std::ios::failbit);
+        if (!(info = png_create_info_struct(png)))
+        {
+            png_destroy_write_struct(&png, nullptr);
+            throw ImageApprovalsError("Failed to allocate PNG info struct");
+        }
+    }
 
-    writeToStream(image, fileStream, fileName);
-}
+    PngWriteStructs(const PngWriteStructs&) = delete;
 
-ImageCodec::Disposer ImageCodec::registerCodec(const std::shared_ptr<ImageCodec>& codec)
-{
-    if (codec)
+    ~PngWriteStructs() noexcept
     {
-        getImageCodecs().insert(getImageCodecs().begin(), codec);
+        png_destroy_write_struct(&png, &info);
     }
+};
 
-    return Disposer(codec);
-}
-
-void ImageCodec::unregisterCodec(const std::shared_ptr<ImageCodec>& codec)
+// Decodes rows with png_read_row; reading rows above the last one read starts over from the beginning of the file
+class PngRowReader : public ImageReader
 {
-    if (!codec)
+public:
+    explicit PngRowReader(std::unique_ptr<std::istream> stream)
+        : m_stream(std::move(stream)), m_start(m_stream->tellg())
     {
-        return;
+        start();
     }
 
-    auto& codecs = getImageCodecs();
+    bool isInterlaced() const { return m_interlaced; }
 
-    auto pos = std::find(codecs.begin(), codecs.end(), codec);
-    if (pos != codecs.end())
+    // Returns the stream positioned at the start of the file
+    std::unique_ptr<std::istream> releaseStream()
     {
-        codecs.erase(pos);
+        m_structs.reset();
+        m_stream->clear();
+        m_stream->seekg(m_start);
+        return std::move(m_stream);
     }
-}
-
-std::vector<std::string> ImageCodec::getRegisteredExtensions()
-{
-    auto& codecs = getImageCodecs();
-
-    std::vector<std::string> extensions;
-    extensions.resize(codecs.size());
-
-    transform(codecs.begin(), codecs.end(), extensions.begin(),
-        [](const std::shared_ptr<ImageCodec>& codec) { return codec->getFileExtensionWithDot(); });
-
-    return extensions;
-}
-
-const ImageCodec& ImageCodec::getBestCodec(const ImageView& image)
-{
-    const auto& pf = image.getPixelFormat();
-    const auto& cs = image.getColorSpace();
 
-    const ImageCodec* codec = detail::findBestMatch(getImageCodecs(), pf, cs);
+    const PixelFormat& getPixelFormat() const override { return *m_format; }
+    const ColorSpace& getColorSpace() const override { return *m_colorSpace; }
+    Size getSize() const override { return m_size; }
 
-    if(!codec)
+    Image readRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) override
     {
-        std::ostringstream msg;
-        msg << "Could find a codec for pixel format " << pf << " and color space " << cs;
-        throw ImageApprovalsError(msg.str());
-    }
-
-    return *codec;
-}
-
-const ImageCodec& ImageCodec::getBestCodec(const std::string& filePath)
-{
-    using namespace ApprovalTests;
-    const std::string extWithDot = FileUtils::getExtensionWithDot(filePath);
+        if (x > m_size.width || width > m_size.width - x || y > m_size.height || height > m_size.height - y)
+        {
+            throw ImageApprovalsError("Region exceeds the image");
+        }
 
-    const ImageCodec* codec = detail::findBestMatch(getImageCodecs(), extWithDot);
+        if (y < m_nextRow)
+        {
+            start();
+        }
 
-    if(!codec)
-    {
-        std::ostringstream msg;
-        msg << "Could not find a codec for file extension \"" << extWithDot << "\"";
-        throw ImageApprovalsError(msg.str());
-    }
+        Image rows(*m_format, *m_colorSpace, Size(m_size.width, height));
+        png_struct* png = m_structs->png;
 
-    return *codec;
-}
+        if (setjmp(png_jmpbuf(png)))
+        {
+            throw ImageApprovalsError("Failed to read PNG image");
+        }
 
-std::vector<std::shared_ptr<ImageCodec>>& ImageCodec::getImageCodecs()
-{
-    static std::vector<std::shared_ptr<ImageCodec>> imageCodecs = detail::initCodecs();
-    return imageCodecs;
-}
+        for (; m_nextRow < y; ++m_nextRow)
+        {
+            png_read_row(png, m_skippedRow.data(), nullptr);
+        }
 
-ImageCodec::Disposer::Disposer(std::shared_ptr<ImageCodec> codec)
-    : m_codec(std::move(codec))
-{}
+        for (uint32_t row = 0; row < height; ++row, ++m_nextRow)
+        {
+            png_read_row(png, rows.getRowPointer(row), nullptr);
+        }
 
-ImageCodec::Disposer::Disposer(Disposer&& other) noexcept
-    : m_codec(std::move(other.m_codec))
-{}
+        if (x == 0 && width == m_size.width)
+        {
+            return rows;
+        }
 
-ImageCodec::Disposer::~Disposer()
-{
-    if (m_codec)
-    {
-        ImageCodec::unregisterCodec(m_codec);
+        return rows.subView(x, 0, width, height).copy();
     }
-}
 
-ImageCodec::Disposer& ImageCodec::Disposer::operator =(Disposer&& rhs) noexcept
-{
-    if (this != &rhs)
+private:
+    void start()
     {
-        m_codec = std::move(rhs.m_codec);
-    }
-
-    return *this;
-}
+        m_structs.reset();
+        m_stream->clear();
+        m_stream->seekg(m_start);
 
-}
+        m_structs.reset(new PngReadStructs());
+        m_nextRow = 0;
 
-// src/PngImageCodec.cpp
+        png_struct* png = m_structs->png;
+        png_info* info = m_structs->info;
 
-#ifdef ImageApprovals_CONFIG_WITH_LIBPNG
+        if (setjmp(png_jmpbuf(png)))
+        {
+            throw ImageApprovalsError("Failed to read PNG image");
+        }
 
-#include <png.h>
-#include <functional>
-#include <cstring>
-#include <istream>
-#include <ostream>
+        png_set_read_fn(png, m_stream.get(), &readBytes);
+        png_read_info(png, info);
 
-namespace ImageApprovals { namespace detail {
+        m_format = &getPngPixelFormat(png_get_bit_depth(png, info), png_get_color_type(png, info));
+        m_size = Size(png_get_image_width(png, info), png_get_image_height(png, info));
+        m_interlaced = (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE);
 
-namespace {
+        if (!(m_colorSpace = detectColorSpace(png, info)))
+        {
+            throw ImageApprovalsError("Unknown color space");
+        }
 
-class OnExit
-{
-public:
-    OnExit(std::function<void()> fn)
-        : m_fn(std::move(fn))
-    {}
+        if (m_format->isU16() && isHostLittleEndian())
+        {
+            png_set_swap(png);
+        }
 
-    OnExit(const OnExit&) = delete;
-    OnExit(OnExit&&) = delete;
+        png_read_update_info(png, info);
 
-    ~OnExit() noexcept
-    {
-        m_fn();
+        m_skippedRow.resize(m_format->getPixelStride() * m_size.width);
     }
 
-private:
-    std::function<void()> m_fn;
+    std::unique_ptr<std::istream> m_stream;
+    std::streampos m_start;
+    std::unique_ptr<PngReadStructs> m_structs;
+    const PixelFormat* m_format = nullptr;
+    const ColorSpace* m_colorSpace = nullptr;
+    Size m_size;
+    bool m_interlaced = false;
+    uint32_t m_nextRow = 0;
+    std::vector<png_byte> m_skippedRow;
 };
 
-void PNGCBAPI readBytes(png_struct* png, png_byte* data, size_t len)
-{
-    auto& stream = *reinterpret_cast<std::istream*>(png_get_io_ptr(png));
-    stream.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(len));
-}
-
-void PNGCBAPI writeBytes(png_struct* png, png_byte* data, size_t len)
-{
-    auto& stream = *reinterpret_cast<std::ostream*>(png_get_io_ptr(png));
-    stream.write(reinterpret_cast<const char*>(data), static_cast<std::streampos>(len));
-}
-
-void PNGCBAPI flush(png_struct* png)
+class PngRowWriter : public ImageRowWriter
 {
-    auto& stream = *reinterpret_cast<std::ostream*>(png_get_io_ptr(png));
-    stream.flush();
-}
+public:
+    PngRowWriter(std::ostream& stream, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size,
+                 PngCompression compression)
+        : ImageRowWriter(format, colorSpace, size), m_ioPtr(&stream), m_writeFn(&writeBytes), m_flushFn(&flush)
+    {
+        start(compression);
+    }
 
-const ColorSpace* detectColorSpace(png_struct* png, png_info* info)
-{
-    int intent = -1;
-    if (png_get_sRGB(png, info, &intent) == PNG_INFO_sRGB)
+    PngRowWriter(std::unique_ptr<std::ostream> stream, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size,
+                 PngCompression compression)
+        : ImageRowWriter(format, colorSpace, size), m_ownedStream(std::move(stream))
+        , m_ioPtr(m_ownedStream.get()), m_writeFn(&writeBytes), m_flushFn(&flush)
     {
-        return &ColorSpace::getSRgb();
+        start(compression);
     }
 
-    char* iccpName = nullptr;
-    int iccpCompressionType = PNG_COMPRESSION_TYPE_BASE;
-    png_byte* iccpData = nullptr;
-    uint32_t iccpDataLen = 0;
-    const auto iCCP
-        = png_get_iCCP(
-            png, info,
-            &iccpName,
-            &iccpCompressionType,
-            &iccpData, &iccpDataLen);
+    // Appends the encoded file to data
+    PngRowWriter(std::vector<uint8_t>& data, const PixelFormat& format, const ColorSpace& colorSpace, const Size& size,
+                 PngCompression compression)
+        : ImageRowWriter(format, colorSpace, size), m_ioPtr(&data), m_writeFn(&appendBytes), m_flushFn(nullptr)
+    {
+        start(compression);
+    }
 
-    if (iCCP == PNG_INFO_iCCP && isSRgbIccProfile(iccpDataLen, iccpData))
+protected:
+    void appendRows(uint32_t, const ImageView& rows) override
     {
-        return &ColorSpace::getSRgb();
+        // PNG stores straight alpha, so premultiplied rows are written through their straight counterpart
+        if (m_straightFormat)
+        {
+            writePngRows(convert(rows, *m_straightFormat, rows.getColorSpace()));
+            return;
+        }
+
+        writePngRows(rows);
     }
 
-    double white_x = 0.0, white_y = 0.0;
-    RgbPrimaries prims;
+    void finishFile() override
+    {
+        png_struct* png = m_structs.png;
 
-    const auto cHRM
-        = png_get_cHRM(
-            png, info,
-            &white_x, &white_y,
-            &prims.r.x, &prims.r.y,
-            &prims.g.x, &prims.g.y,
-            &prims.b.x, &prims.b.y);
+        if (setjmp(png_jmpbuf(png)))
+        {
+            throw ImageApprovalsError("Failed to write PNG image");
+        }
 
-    double gamma = 0.0f;
-    const auto gAMA = png_get_gAMA(png, info, &gamma);
+        png_write_end(png, nullptr);
 
-    if (cHRM == PNG_INFO_cHRM && gAMA == PNG_INFO_gAMA)
-    {
-        return detectColorSpace(prims, gamma);
+        if (m_flushFn)
+        {
+            m_flushFn(png);
+        }
     }
 
-    return &ColorSpace::getLinearSRgb();
-}
+private:
+    void start(PngCompression compression)
+    {
+        const auto& fmt = getPixelFormat();
 
-void writePngComment(png_struct* png, png_info* info)
-{
-    std::string textKey = "Software";
-    std::string textStr = "ImageApprovals";
+        if (!fmt.isU8() && !fmt.isU16())
+        {
+            throw ImageApprovalsError("Unable to write the image to PNG file");
+        }
 
-    png_text text;
-    text.compression = PNG_TEXT_COMPRESSION_NONE;
-    text.key = &textKey[0];
-    text.text = &textStr[0];
-    text.text_length = textStr.size();
-    text.itxt_length = 0;
-    text.lang = nullptr;
-    text.lang_key = nullptr;
+        m_straightFormat = getPngStraightAlphaFormat(fmt);
 
-    png_set_text(png, info, &text, 1);
-}
+        int pngColorType = 0;
+        int pngTransforms = PNG_TRANSFORM_IDENTITY;
+        getPngColorType(m_straightFormat ? *m_straightFormat : fmt, pngColorType, pngTransforms);
 
-}
+        png_struct* png = m_structs.png;
+        png_info* info = m_structs.info;
 
-std::string PngImageCodec::getFileExtensionWithDot() const
-{
-    return ".png";
-}
+        if (setjmp(png_jmpbuf(png)))
+        {
+            throw ImageApprovalsError("Failed to write PNG image");
+        }
 
-int PngImageCodec::getScore(const std::string& extensionWithDot) const
-{
-    if(extensionWithDot == ".png")
-    {
-        return 100;
-    }
+        png_set_write_fn(png, m_ioPtr, m_writeFn, m_flushFn);
 
-    return -1;
-}
+        if (compression == PngCompression::Fastest)
+        {
+            // Without filtering, run-length encoding is enough for mostly uniform images, such as diff images
+            png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+            png_set_compression_level(png, Z_BEST_SPEED);
+            png_set_compression_strategy(png, Z_RLE);
+        }
 
-int PngImageCodec::getScore(const PixelFormat& pf, const ColorSpace& cs) const
-{
-    if(!pf.isU8())
-    {
-        return -1;
+        const auto sz = getSize();
+        png_set_IHDR(
+            png, info, sz.width, sz.height,
+            fmt.isU16() ? 16 : 8, pngColorType,
+            PNG_INTERLACE_NONE,
+            PNG_COMPRESSION_TYPE_DEFAULT,
+            PNG_FILTER_TYPE_DEFAULT);
+
+        if (getColorSpace() == ColorSpace::getSRgb())
+        {
+            png_set_sRGB_gAMA_and_cHRM(png, info, PNG_sRGB_INTENT_RELATIVE);
+        }
+        else if (getColorSpace() == ColorSpace::getLinearSRgb())
+        {
+            png_set_gAMA(png, info, 1.0);
+
+            const auto p = RgbPrimaries::getSRgbPrimaries();
+            png_set_cHRM(
+                png, info,
+                0.3127, 0.3291,
+                p.r.x, p.r.y,
+                p.g.x, p.g.y,
+                p.b.x, p.b.y);
+        }
+        else
+        {
+            throw ImageApprovalsError("Unsupported ColorSpace");
+        }
+
+        writePngComment(png, info);
+
+        png_write_info(png, info);
+
+        if (pngTransforms & PNG_TRANSFORM_BGR)
+        {
+            png_set_bgr(png);
+        }
+
+        if (pngTransforms & PNG_TRANSFORM_SWAP_ALPHA)
+        {
+            png_set_swap_alpha(png);
+        }
+
+        if (pngTransforms & PNG_TRANSFORM_SWAP_ENDIAN)
+        {
+            png_set_swap(png);
+        }
     }
 
-    if(cs != ColorSpace::getSRgb() && cs != ColorSpace::getLinearSRgb())
+    void writePngRows(const ImageView& rows)
     {
-        return -1;
+        png_struct* png = m_structs.png;
+
+        if (setjmp(png_jmpbuf(png)))
+        {
+            throw ImageApprovalsError("Failed to write PNG image");
+        }
+
+        for (uint32_t y = 0; y < rows.getSize().height; ++y)
+        {
+            png_write_row(png, rows.getRowPointer(y));
+        }
     }
 
-    return 100;
-}
+    std::unique_ptr<std::ostream> m_ownedStream;
+    void* m_ioPtr;
+    png_rw_ptr m_writeFn;
+    png_flush_ptr m_flushFn;
+    PngWriteStructs m_structs;
+    const PixelFormat* m_straightFormat = nullptr;
+};
 
-Image PngImageCodec::readFromStream(std::istream& stream, const std::string&) const
+Image readPng(void* ioPtr, png_rw_ptr readFn)
 {
     Image image;
     png_struct* png = nullptr;
@@ -2115,38 +8610,12 @@ Image PngImageCodec::readFromStream(std::istream& stream, const std::string&) co
         throw ImageApprovalsError("Failed to read PNG image");
     }
 
-    png_set_read_fn(png, &stream, &readBytes);
+    png_set_read_fn(png, ioPtr, readFn);
 
-    png_read_png(png, info, 0, nullptr);
+    png_read_png(png, info, isHostLittleEndian() ? PNG_TRANSFORM_SWAP_ENDIAN : PNG_TRANSFORM_IDENTITY, nullptr);
 
-    const PixelFormat* format = nullptr;
     const Size imgSize{ png_get_image_width(png, info), png_get_image_height(png, info) };
-
-    const int pngBitDepth = png_get_bit_depth(png, info);
-    const int pngColorType = png_get_color_type(png, info);
-
-    if (pngBitDepth != 8)
-    {
-        throw ImageApprovalsError("Unsupported PNG bit depth");
-    }
-
-    switch (pngColorType)
-    {
-    case PNG_COLOR_TYPE_GRAY:
-        format = &PixelFormat::getGrayU8();
-        break;
-    case PNG_COLOR_TYPE_GRAY_ALPHA:
-        format = &PixelFormat::getGrayAlphaU8();
-        break;
-    case PNG_COLOR_TYPE_RGB:
-        format = &PixelFormat::getRgbU8();
-        break;
-    case PNG_COLOR_TYPE_RGB_ALPHA:
-        format = &PixelFormat::getRgbAlphaU8();
-        break;
-    default:
-        throw ImageApprovalsError("Unsupported PNG color type");
-    }
+    const PixelFormat* format = &getPngPixelFormat(png_get_bit_depth(png, info), png_get_color_type(png, info));
 
     const ColorSpace* colorSpace = detectColorSpace(png, info);
     if (!colorSpace)
@@ -2167,113 +8636,128 @@ Image PngImageCodec::readFromStream(std::istream& stream, const std::string&) co
 
     return image;
 }
+}
 
-void PngImageCodec::writeToStream(const ImageView& image, std::ostream& stream, const std::string&) const
+PngImageCodec::PngImageCodec(PngCompression compression)
+    : m_compression(compression)
+{}
+
+std::string PngImageCodec::getFileExtensionWithDot() const
 {
-    const auto& fmt = image.getPixelFormat();
+    return ".png";
+}
 
-    if (!fmt.isU8())
+int PngImageCodec::getScore(const std::string& extensionWithDot) const
+{
+    if(extensionWithDot == ".png")
     {
-        throw ImageApprovalsError("Unable to write the image to PNG file");
+        return 100;
     }
 
-    png_struct* png = nullptr;
-    png_info* info = nullptr;
-        
-    std::unique_ptr<png_const_bytep[]> rowPointers;
-
-    OnExit onExit([&]() {
-        if (png)
-        {
-            png_destroy_write_struct(&png, info ? &info : nullptr);
-        }
-    });
+    return -1;
+}
 
-    if (!(png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr)))
+int PngImageCodec::getScore(const PixelFormat& pf, const ColorSpace& cs) const
+{
+    if(!pf.isU8() && !pf.isU16())
     {
-        throw ImageApprovalsError("Failed to allocate PNG write struct");
+        return -1;
     }
 
-    if (!(info = png_create_info_struct(png)))
+    if(cs != ColorSpace::getSRgb() && cs != ColorSpace::getLinearSRgb())
     {
-        throw ImageApprovalsError("Failed to allocate PNG info struct");
+        return -1;
     }
 
-    if (setjmp(png_jmpbuf(png)))
-    {
-        throw ImageApprovalsError("Failed to write PNG image");
-    }
+    return 100;
+}
 
-    png_set_write_fn(png, &stream, &writeBytes, &flush);
+Image PngImageCodec::readFromStream(std::istream& stream, const std::string&) const
+{
+    return readPng(&stream, &readBytes);
+}
 
-    int pngColorType = 0;
-    if (fmt == PixelFormat::getGrayU8())
-    {
-        pngColorType = PNG_COLOR_TYPE_GRAY;
-    }
-    else if (fmt == PixelFormat::getGrayAlphaU8())
-    {
-        pngColorType = PNG_COLOR_TYPE_GRAY_ALPHA;
-    }
-    else if (fmt == PixelFormat::getRgbU8())
-    {
-        pngColorType = PNG_COLOR_TYPE_RGB;
-    }
-    else if (fmt == PixelFormat::getRgbAlphaU8())
-    {
-        pngColorType = PNG_COLOR_TYPE_RGB_ALPHA;
-    }
-    else
+Image PngImageCodec::decodeFromMemory(const uint8_t* data, size_t size) const
+{
+    MemorySource source{ data, size, 0 };
+    return readPng(&source, &readMemoryBytes);
+}
+
+void PngImageCodec::encodeToMemory(const ImageView& image, std::vector<uint8_t>& data) const
+{
+    PngRowWriter writer(data, image.getPixelFormat(), image.getColorSpace(), image.getSize(), m_compression);
+    writer.writeRows(image);
+    writer.finish();
+}
+
+void PngImageCodec::writeToStream(const ImageView& image, std::ostream& stream, const std::string&) const
+{
+    PngRowWriter writer(stream, image.getPixelFormat(), image.getColorSpace(), image.getSize(), m_compression);
+    writer.writeRows(image);
+    writer.finish();
+}
+
+std::unique_ptr<ImageReader> PngImageCodec::openReaderForStream(std::unique_ptr<std::istream> stream, const std::string& fileName) const
+{
+    std::unique_ptr<PngRowReader> reader(new PngRowReader(std::move(stream)));
+
+    // Rows of interlaced images are complete only after the last pass
+    if (reader->isInterlaced())
     {
-        throw ImageApprovalsError("Unexpected pixel format");
+        return ImageCodec::openReaderForStream(reader->releaseStream(), fileName);
     }
 
-    const auto sz = image.getSize();
-    png_set_IHDR(
-        png, info, sz.width, sz.height,
-        8, pngColorType,
-        PNG_INTERLACE_NONE,
-        PNG_COMPRESSION_TYPE_DEFAULT,
-        PNG_FILTER_TYPE_DEFAULT);
+    return std::unique_ptr<ImageReader>(reader.release());
+}
+
+std::unique_ptr<ImageRowWriter> PngImageCodec::openRowWriterForStream(
+    std::unique_ptr<std::ostream> stream, const std::string&,
+    const PixelFormat& format, const ColorSpace& colorSpace, const Size& size) const
+{
+    return std::unique_ptr<ImageRowWriter>(new PngRowWriter(std::move(stream), format, colorSpace, size, m_compression));
+}
+
+} }
+
+#endif // ImageApprovals_CONFIG_WITH_LIBPNG
+
+// src/VerifyUtils.cpp
+
+#include <ApprovalTests.hpp>
+#include <cstdio>
+#include <fstream>
+
+namespace ImageApprovals { namespace detail {
+
+ApprovalPaths getApprovalPaths(const ImageCodec& codec, const std::string& pathWithoutExtension)
+{
+    const std::string extensionWithDot = codec.getFileExtensionWithDot();
+    return ApprovalPaths{ pathWithoutExtension + ".received" + extensionWithDot, pathWithoutExtension + ".approved" + extensionWithDot };
+}
 
-    if (image.getColorSpace() == ColorSpace::getSRgb())
+void verifyFiles(const ImageCodec* codec, const ImageView& image,
+                 const std::string& receivedPath, const std::string& approvedPath, const ImageComparator& comparator)
+{
+    if (codec)
     {
-        png_set_sRGB_gAMA_and_cHRM(png, info, PNG_sRGB_INTENT_RELATIVE);
+        codec->write(receivedPath, image);
     }
-    else if (image.getColorSpace() == ColorSpace::getLinearSRgb())
-    {
-        png_set_gAMA(png, info, 1.0);
 
-        const auto p = RgbPrimaries::getSRgbPrimaries();
-        png_set_cHRM(
-            png, info,
-            0.3127, 0.3291,
-            p.r.x, p.r.y,
-            p.g.x, p.g.y,
-            p.b.x, p.b.y);
-    }
-    else
+    if (!std::ifstream(approvedPath.c_str()))
     {
-        throw ImageApprovalsError("Unsupported ColorSpace");
+        throw ApprovalTests::ApprovalException("Approved file \"" + approvedPath + "\" does not exist");
     }
 
-    writePngComment(png, info);
+    comparator.contentsAreEquivalent(receivedPath, approvedPath);
 
-    rowPointers.reset(new png_const_bytep[sz.height]);
-    for (uint32_t y = 0; y < sz.height; ++y)
+    if (codec)
     {
-        rowPointers[y] = reinterpret_cast<const png_byte*>(image.getRowPointer(y));
+        std::remove(receivedPath.c_str());
     }
-
-    png_set_rows(png, info, const_cast<png_bytepp>(rowPointers.get()));
-
-    png_write_png(png, info, 0, nullptr);
 }
 
 } }
 
-#endif // ImageApprovals_CONFIG_WITH_LIBPNG
-
 #endif // ImageApprovals_CONFIG_IMPLEMENT
 
 #endif // IMAGEAPPROVALS_HPP_INCLUDED
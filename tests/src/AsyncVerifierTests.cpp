@@ -0,0 +1,58 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+#include <TestsConfig.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace ImageApprovals;
+
+TEST_CASE("AsyncVerifier")
+{
+    const auto& codec = ImageCodec::getBestCodec(".png");
+    const auto& format = PixelFormat::getGrayU8();
+    const auto& colorSpace = ColorSpace::getLinearSRgb();
+
+    std::vector<std::string> paths;
+
+    for (int i = 0; i < 5; ++i)
+    {
+        const std::vector<uint8_t> pixels(16, static_cast<uint8_t>(i));
+
+        paths.push_back(std::string(TEST_FILE("async_frame_")) + std::to_string(i));
+        codec.write(paths.back() + ".approved.png", ImageView(format, colorSpace, Size(4, 4), 4, pixels.data()));
+    }
+
+    {
+        // More frames than queue slots, so that verify has to wait for the workers
+        AsyncVerifier verifier(std::make_shared<BitwiseCompareStrategy>(), 2, 1);
+
+        std::vector<std::future<void>> results;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            // The frame is copied, so it can be destroyed right away
+            const std::vector<uint8_t> frame(16, static_cast<uint8_t>(i));
+            results.push_back(verifier.verify(ImageView(format, colorSpace, Size(4, 4), 4, frame.data()), paths[i]));
+        }
+
+        const std::vector<uint8_t> different(16, 100);
+        auto differentResult = verifier.verify(
+            std::make_shared<const Image>(ImageView(format, colorSpace, Size(4, 4), 4, different.data()).copy()), paths[4]);
+
+        verifier.join();
+
+        for (auto& result : results)
+        {
+            result.get();
+        }
+
+        REQUIRE_THROWS_AS(differentResult.get(), ApprovalTests::ApprovalMismatchException);
+    }
+
+    for (const auto& path : paths)
+    {
+        std::remove((path + ".received.png").c_str());
+        std::remove((path + ".approved.png").c_str());
+    }
+}
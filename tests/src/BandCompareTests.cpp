@@ -0,0 +1,192 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+#include <algorithm>
+#include <cstdint>
+
+using namespace ImageApprovals;
+
+namespace {
+
+// Serves regions of an image in memory and records how many rows were read
+class CountingReader : public ImageReader
+{
+public:
+    explicit CountingReader(const ImageView& image)
+        : m_image(image)
+    {}
+
+    const PixelFormat& getPixelFormat() const override { return m_image.getPixelFormat(); }
+    const ColorSpace& getColorSpace() const override { return m_image.getColorSpace(); }
+    Size getSize() const override { return m_image.getSize(); }
+
+    Image readRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) override
+    {
+        numReadRows += height;
+        return m_image.subView(x, y, width, height).copy();
+    }
+
+    uint32_t numReadRows = 0;
+
+private:
+    ImageView m_image;
+};
+
+Image makeImage(uint32_t height)
+{
+    return Image(PixelFormat::getGrayU8(), ColorSpace::getLinearSRgb(), Size(10, height), 1);
+}
+
+void fillImage(Image& image, uint8_t value)
+{
+    for (uint32_t y = 0; y < image.getSize().height; ++y)
+    {
+        std::fill(image.getRowPointer(y), image.getRowPointer(y) + image.getSize().width, value);
+    }
+}
+
+}
+
+TEST_CASE("Comparing images in bands")
+{
+    const Image left = makeImage(100);
+    Image right = makeImage(100);
+
+    // Bands of 2 rows of both images
+    const size_t bandBytes = 40;
+
+    SUBCASE("Equal images are read completely")
+    {
+        CountingReader leftReader(left), rightReader(right);
+
+        REQUIRE(BitwiseCompareStrategy().compare(leftReader, rightReader, bandBytes).passed);
+        REQUIRE_EQ(leftReader.numReadRows, 100u);
+        REQUIRE_EQ(rightReader.numReadRows, 100u);
+    }
+
+    SUBCASE("Bitwise comparison stops at the first different row")
+    {
+        right.getRowPointer(3)[0] = 1;
+        right.getRowPointer(50)[0] = 1;
+
+        CountingReader leftReader(left), rightReader(right);
+
+        const auto result = BitwiseCompareStrategy().compare(leftReader, rightReader, bandBytes);
+
+        REQUIRE_FALSE(result.passed);
+        REQUIRE_EQ(result.getRightImageInfo(), "different pixels in row 3");
+        REQUIRE_EQ(rightReader.numReadRows, 4u);
+    }
+
+    SUBCASE("Threshold comparison stops when the failure budget is exhausted")
+    {
+        // 10 of 1000 pixels may fail
+        const ThresholdCompareStrategy strategy(AbsThreshold(0.1), Percent(1.0));
+
+        for (uint32_t y = 0; y < 10; ++y)
+        {
+            right.getRowPointer(y)[0] = 255;
+        }
+
+        {
+            CountingReader leftReader(left), rightReader(right);
+
+            REQUIRE(strategy.compare(leftReader, rightReader, bandBytes).passed);
+            REQUIRE_EQ(rightReader.numReadRows, 100u);
+        }
+
+        right.getRowPointer(10)[0] = 255;
+
+        {
+            CountingReader leftReader(left), rightReader(right);
+
+            REQUIRE_FALSE(strategy.compare(leftReader, rightReader, bandBytes).passed);
+            REQUIRE_EQ(rightReader.numReadRows, 12u);
+        }
+    }
+
+    SUBCASE("Failed pixels are located in image coordinates")
+    {
+        for (uint32_t x = 2; x < 10; ++x)
+        {
+            right.getRowPointer(5)[x] = 255;
+        }
+        right.getRowPointer(97)[0] = 255;
+
+        const ThresholdCompareStrategy strategy(AbsThreshold(0.1), Percent(100.0));
+
+        CountingReader leftReader(left), rightReader(right);
+
+        const auto banded = strategy.compare(leftReader, rightReader, bandBytes);
+        const auto whole = strategy.compare(left, right);
+
+        REQUIRE(banded.failureMask);
+        REQUIRE(whole.failureMask);
+        REQUIRE_EQ(banded.failureMask->serialize(), whole.failureMask->serialize());
+
+        const auto& runs = banded.failureMask->getRuns();
+        REQUIRE_EQ(runs.size(), 2u);
+        REQUIRE_EQ(runs[0].y, 5u);
+        REQUIRE_EQ(runs[0].x, 2u);
+        REQUIRE_EQ(runs[0].length, 8u);
+        REQUIRE_EQ(runs[1].y, 97u);
+        REQUIRE_EQ(runs[1].x, 0u);
+        REQUIRE_EQ(runs[1].length, 1u);
+    }
+
+    SUBCASE("Tolerance masks apply to the rows of each band")
+    {
+        right.getRowPointer(5)[3] = 255;
+        right.getRowPointer(97)[0] = 255;
+
+        ToleranceMask mask(left.getSize());
+        mask.ignoreRegion(0, 5, 10, 1).ignoreRegion(0, 97, 1, 1);
+
+        CompareOptions options;
+        options.toleranceMask = &mask;
+
+        const ThresholdCompareStrategy strategy(AbsThreshold(0.1), Percent(0.0));
+
+        CountingReader leftReader(left), rightReader(right);
+
+        const auto result = strategy.compare(leftReader, rightReader, bandBytes, options);
+
+        REQUIRE(result.passed);
+        REQUIRE_EQ(result.statistics.numComparedPixels, 989u);
+    }
+
+    SUBCASE("Quick rejects sample a single band of the whole images")
+    {
+        fillImage(right, 255);
+
+        ThresholdCompareStrategy strategy(AbsThreshold(0.1), Percent(0.5));
+        strategy.setQuickRejectRowStep(8, 1);
+
+        CountingReader leftReader(left), rightReader(right);
+
+        const auto result = strategy.compare(leftReader, rightReader, SIZE_MAX);
+
+        REQUIRE_FALSE(result.passed);
+        REQUIRE(result.sampled);
+        REQUIRE_EQ(result.statistics.numComparedPixels, 120u);
+        REQUIRE(result.getRightImageInfo().find("at least 120 pixels") == 0);
+    }
+
+    SUBCASE("Quick rejects sample the first band")
+    {
+        fillImage(right, 255);
+
+        ThresholdCompareStrategy strategy(AbsThreshold(0.1), Percent(0.5));
+        strategy.setQuickRejectRowStep(8, 1);
+
+        CountingReader leftReader(left), rightReader(right);
+
+        const auto result = strategy.compare(leftReader, rightReader, bandBytes);
+
+        REQUIRE_FALSE(result.passed);
+        REQUIRE(result.sampled);
+        REQUIRE_EQ(result.statistics.numComparedPixels, 10u);
+        REQUIRE(result.failureMask->contains(0, 1));
+        REQUIRE_FALSE(result.failureMask->contains(0, 0));
+        REQUIRE_EQ(leftReader.numReadRows, 2u);
+    }
+}
@@ -0,0 +1,112 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+#include <TestsConfig.hpp>
+#include "Parallel.hpp"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ImageApprovals;
+
+namespace {
+
+bool fileExists(const std::string& path)
+{
+    return std::ifstream(path.c_str()).good();
+}
+
+}
+
+TEST_CASE("BatchVerifier")
+{
+    const auto& codec = ImageCodec::getBestCodec(".png");
+
+    const auto& format = PixelFormat::getGrayU8();
+    const auto& colorSpace = ColorSpace::getLinearSRgb();
+
+    std::vector<std::vector<uint8_t>> pixels;
+    std::vector<ImageView> images;
+    std::vector<std::string> paths;
+
+    for (int i = 0; i < 6; ++i)
+    {
+        pixels.emplace_back(16, static_cast<uint8_t>(i * 10));
+        paths.push_back(std::string(TEST_FILE("batch_")) + std::to_string(i));
+    }
+
+    for (const auto& imagePixels : pixels)
+    {
+        images.emplace_back(format, colorSpace, Size(4, 4), 4, imagePixels.data());
+    }
+
+    const std::vector<uint8_t> white(16, 255);
+
+    // Image 2 differs from its approved file, and image 4 has none
+    for (int i = 0; i < 6; ++i)
+    {
+        if (i == 2)
+        {
+            codec.write(paths[i] + ".approved.png", ImageView(format, colorSpace, Size(4, 4), 4, white.data()));
+        }
+        else if (i != 4)
+        {
+            codec.write(paths[i] + ".approved.png", images[i]);
+        }
+    }
+
+    BatchVerifier verifier(std::make_shared<BitwiseCompareStrategy>());
+    verifier.setMaxImagesInFlight(3);
+
+    for (int i = 0; i < 6; ++i)
+    {
+        verifier.add(images[i], paths[i]);
+    }
+
+    const auto failures = verifier.run();
+
+    REQUIRE_EQ(failures.size(), 2u);
+    REQUIRE_EQ(failures[0].approvedPath, paths[2] + ".approved.png");
+    REQUIRE_EQ(failures[1].approvedPath, paths[4] + ".approved.png");
+    REQUIRE(failures[1].message.find("does not exist") != std::string::npos);
+
+    REQUIRE_FALSE(fileExists(paths[0] + ".received.png"));
+    REQUIRE(fileExists(paths[2] + ".received.png"));
+
+    SUBCASE("Comparing existing files")
+    {
+        BatchVerifier filesVerifier;
+        filesVerifier.addFiles(paths[2] + ".received.png", paths[2] + ".approved.png");
+        filesVerifier.addFiles(paths[0] + ".approved.png", paths[0] + ".approved.png");
+
+        REQUIRE_THROWS_AS(filesVerifier.verify(), ApprovalTests::ApprovalException);
+        REQUIRE(fileExists(paths[2] + ".received.png"));
+    }
+
+    for (const auto& path : paths)
+    {
+        std::remove((path + ".received.png").c_str());
+        std::remove((path + ".approved.png").c_str());
+    }
+}
+
+TEST_CASE("Nested parallel work runs on the calling worker")
+{
+    std::atomic<int> numForeignThreads(0);
+
+    detail::parallelForEach(8, 4, [&](size_t) {
+        const auto worker = std::this_thread::get_id();
+
+        detail::parallelFor(1 << 16, 1, [&](size_t, size_t) {
+            numForeignThreads += (std::this_thread::get_id() != worker) ? 1 : 0;
+        });
+
+        detail::parallelInvoke(
+            [&]() { numForeignThreads += (std::this_thread::get_id() != worker) ? 1 : 0; },
+            [&]() { numForeignThreads += (std::this_thread::get_id() != worker) ? 1 : 0; });
+    });
+
+    REQUIRE_EQ(numForeignThreads.load(), 0);
+}
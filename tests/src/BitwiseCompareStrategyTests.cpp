@@ -27,4 +27,30 @@ TEST_CASE("BitwiseCompareStrategy")
 
         REQUIRE_FALSE(strategy.compare(left, right).passed);
     }
+
+    SUBCASE("Pixels with channels in different order")
+    {
+        const uint8_t rgba[]{ 1, 2, 3, 4, 5, 6, 7, 8 };
+        const uint8_t bgra[]{ 3, 2, 1, 4, 7, 6, 5, 8 };
+        const uint8_t argb[]{ 4, 1, 2, 3, 8, 5, 6, 7 };
+
+        const ImageView rgbaView(PixelFormat::getRgbAlphaU8(), colorSpace, Size(2, 1), 8, rgba);
+        const ImageView bgraView(PixelFormat::getBgrAlphaU8(), colorSpace, Size(2, 1), 8, bgra);
+        const ImageView argbView(PixelFormat::getAlphaRgbU8(), colorSpace, Size(2, 1), 8, argb);
+
+        REQUIRE(strategy.compare(rgbaView, bgraView).passed);
+        REQUIRE(strategy.compare(argbView, bgraView).passed);
+        REQUIRE_FALSE(strategy.compare(rgbaView, ImageView(PixelFormat::getRgbAlphaU8(), colorSpace, Size(2, 1), 8, bgra)).passed);
+        REQUIRE_FALSE(strategy.compare(rgbaView, ImageView(PixelFormat::getBgrU8(), colorSpace, Size(2, 1), 6, bgra)).passed);
+    }
+
+    SUBCASE("Straight and premultiplied pixels are not compared")
+    {
+        const uint8_t rgba[]{ 0, 0, 0, 255 };
+
+        const ImageView straightView(PixelFormat::getRgbAlphaU8(), colorSpace, Size(1, 1), 4, rgba);
+        const ImageView premultipliedView(PixelFormat::getRgbAlphaU8Premultiplied(), colorSpace, Size(1, 1), 4, rgba);
+
+        REQUIRE_FALSE(strategy.compare(straightView, premultipliedView).passed);
+    }
 }
\ No newline at end of file
@@ -2,6 +2,9 @@
 #include <ImageApprovals.hpp>
 #include <TestsConfig.hpp>
 
+#include <cstdio>
+#include <fstream>
+
 using namespace ImageApprovals;
 using namespace ApprovalTests;
 
@@ -37,6 +40,105 @@ TEST_CASE("Comparator")
             ApprovalMismatchException);
     }
 
+    SUBCASE("Comparing in bands gives the same results as comparing whole images")
+    {
+        const auto approvedPath = TEST_FILE("cornell.approved.png");
+        const auto receivedPath = TEST_FILE("cornell.received.png");
+
+        ImageComparator passing(std::make_shared<ThresholdCompareStrategy>(AbsThreshold(0.1), Percent(1.25)));
+        passing.setBandMemoryLimit(4096);
+
+        REQUIRE(passing.contentsAreEquivalent(receivedPath, approvedPath));
+
+        ImageComparator failing(std::make_shared<ThresholdCompareStrategy>(AbsThreshold(0.1), Percent(1.2)));
+        failing.setBandMemoryLimit(4096);
+
+        REQUIRE_THROWS_AS(
+            failing.contentsAreEquivalent(receivedPath, approvedPath),
+            ApprovalMismatchException);
+
+        ImageComparator bitwise(std::make_shared<BitwiseCompareStrategy>());
+        bitwise.setBandMemoryLimit(4096);
+
+        REQUIRE(bitwise.contentsAreEquivalent(approvedPath, approvedPath));
+        REQUIRE_THROWS_AS(
+            bitwise.contentsAreEquivalent(receivedPath, approvedPath),
+            ApprovalMismatchException);
+    }
+
+    SUBCASE("A diff image is written next to the received image on failure")
+    {
+        const auto approvedPath = TEST_FILE("cornell.approved.png");
+        const auto receivedPath = TEST_FILE("cornell.received.png");
+        const std::string diffPath = TEST_FILE("cornell.diff.png");
+
+        ImageComparator comparator(std::make_shared<ThresholdCompareStrategy>(AbsThreshold(0.1), Percent(1.2)));
+        comparator.setDiffImageAmplification(4.0f).setBandMemoryLimit(4096);
+
+        std::string message;
+
+        try
+        {
+            comparator.contentsAreEquivalent(receivedPath, approvedPath);
+        }
+        catch (const ApprovalMismatchException& exc)
+        {
+            message = exc.what();
+        }
+
+        REQUIRE(message.find("diff image: \"" + diffPath + "\"") != std::string::npos);
+
+        const auto& codec = ImageCodec::getBestCodec(diffPath);
+        const auto diff = codec.read(diffPath);
+        const auto approved = codec.read(approvedPath);
+        std::remove(diffPath.c_str());
+
+        REQUIRE(diff.getSize() == approved.getSize());
+        REQUIRE(&diff.getPixelFormat() == &PixelFormat::getRgbU8());
+    }
+
+    SUBCASE("A tolerance mask is read from next to the approved image")
+    {
+        const auto approvedPath = TEST_FILE("cornell.approved.png");
+        const auto receivedPath = TEST_FILE("cornell.received.png");
+        const std::string maskPath = TEST_FILE("cornell.mask.txt");
+
+        const auto approved = ImageCodec::getBestCodec(approvedPath).read(approvedPath);
+        const auto size = approved.getSize();
+
+        ImageComparator comparator(std::make_shared<ThresholdCompareStrategy>(AbsThreshold(0.1), Percent(1.2)));
+
+        {
+            std::ofstream maskFile(maskPath);
+            maskFile << ToleranceMask(size).ignoreRegion(0, 0, size.width, size.height).serialize();
+        }
+
+        const bool passed = comparator.contentsAreEquivalent(receivedPath, approvedPath);
+        std::remove(maskPath.c_str());
+
+        REQUIRE(passed);
+        REQUIRE_THROWS_AS(
+            comparator.contentsAreEquivalent(receivedPath, approvedPath),
+            ApprovalMismatchException);
+    }
+
+    SUBCASE("Errors reading the received image are reported first")
+    {
+        ImageComparator comparator;
+        std::string message;
+
+        try
+        {
+            comparator.contentsAreEquivalent(TEST_FILE("missing.received.png"), TEST_FILE("missing.approved.png"));
+        }
+        catch (const ApprovalException& exc)
+        {
+            message = exc.what();
+        }
+
+        REQUIRE(message.find("Failed to read received image") == 0);
+    }
+
     SUBCASE("Using FileApprover::verify with PNG")
     {
         auto comparator = ImageComparator::make<ThresholdCompareStrategy>(AbsThreshold(0.1), Percent(1.25));
@@ -0,0 +1,117 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+#include <TestsConfig.hpp>
+#include <cstring>
+
+using namespace doctest;
+using namespace ImageApprovals;
+
+TEST_CASE("convert")
+{
+    BitwiseCompareStrategy cmpStrategy;
+
+    const auto imgPath = TEST_FILE("cornell.approved.png");
+    const Image img = ImageCodec::getBestCodec(imgPath).read(imgPath);
+
+    SUBCASE("Round trip through linear floats is lossless")
+    {
+        const Image linear = convert(img, PixelFormat::getRgbAlphaF32(), ColorSpace::getLinearSRgb());
+
+        REQUIRE_EQ(linear.getPixelFormat(), PixelFormat::getRgbAlphaF32());
+        REQUIRE_EQ(linear.getColorSpace(), ColorSpace::getLinearSRgb());
+        REQUIRE_EQ(linear.getSize(), img.getSize());
+
+        const Image roundTrip = convert(linear, img.getPixelFormat(), img.getColorSpace());
+
+        REQUIRE(cmpStrategy.compare(img, roundTrip).passed);
+    }
+
+    SUBCASE("Same format and color space gives an exact copy")
+    {
+        const Image copy = convert(img.flippedVertically(), img.getPixelFormat(), img.getColorSpace());
+
+        REQUIRE(cmpStrategy.compare(img.flippedVertically(), copy).passed);
+    }
+
+    SUBCASE("Float images in sRGB can be written after conversion")
+    {
+        const Image floatImg = convert(img, PixelFormat::getRgbF32(), ColorSpace::getSRgb());
+
+        REQUIRE_THROWS_AS(ImageCodec::getBestCodec(floatImg), ImageApprovalsError);
+
+        const Image u8Img = convert(floatImg, PixelFormat::getRgbU8(), ColorSpace::getSRgb());
+
+        REQUIRE_EQ(ImageCodec::getBestCodec(u8Img).getFileExtensionWithDot(), ".png");
+        REQUIRE(cmpStrategy.compare(img, u8Img).passed);
+    }
+
+    SUBCASE("Destination size must match")
+    {
+        Image dst(PixelFormat::getRgbU8(), ColorSpace::getSRgb(), Size(1, 1));
+
+        REQUIRE_THROWS_AS(convert(img, dst), ImageApprovalsError);
+        REQUIRE_THROWS_AS(convert(ImageView(), PixelFormat::getRgbU8(), ColorSpace::getSRgb()), ImageApprovalsError);
+    }
+}
+
+TEST_CASE("convert pixel values")
+{
+    const uint8_t pixels[]{
+        0, 128, 255, 200,
+        10, 10, 10, 0
+    };
+
+    const ImageView src(PixelFormat::getRgbAlphaU8(), ColorSpace::getSRgb(), Size(2, 1), 8, pixels);
+
+    SUBCASE("sRGB to linear")
+    {
+        const Image dst = convert(src, PixelFormat::getRgbAlphaF32(), ColorSpace::getLinearSRgb());
+
+        const RGBA p = dst.getPixel(0, 0);
+        REQUIRE_EQ(p.r, 0.0f);
+        REQUIRE_EQ(p.g, Approx(0.2158605f));
+        REQUIRE_EQ(p.b, 1.0f);
+        REQUIRE_EQ(p.a, Approx(200.0f / 255.0f));
+    }
+
+    SUBCASE("RGBA to gray")
+    {
+        const Image dst = convert(src, PixelFormat::getGrayU8(), ColorSpace::getSRgb());
+
+        REQUIRE_EQ(dst.getRowPointer(0)[1], 10);
+    }
+
+    SUBCASE("Straight to premultiplied and back")
+    {
+        const Image premultiplied = convert(src, PixelFormat::getRgbAlphaU8Premultiplied(), ColorSpace::getSRgb());
+
+        const uint8_t expected[]{
+            0, 100, 200, 200,
+            0, 0, 0, 0
+        };
+
+        REQUIRE_EQ(std::memcmp(premultiplied.getRowPointer(0), expected, sizeof(expected)), 0);
+
+        const Image straight = convert(premultiplied, PixelFormat::getRgbAlphaU8(), ColorSpace::getSRgb());
+
+        REQUIRE_EQ(straight.getRowPointer(0)[1], 128);
+        REQUIRE_EQ(straight.getRowPointer(0)[4], 0);
+    }
+
+    SUBCASE("Gray to RGBA")
+    {
+        const uint8_t grayPixels[]{ 0, 77, 255, 1 };
+        const ImageView gray(PixelFormat::getGrayU8(), ColorSpace::getLinearSRgb(), Size(4, 1), 4, grayPixels);
+
+        const Image dst = convert(gray, PixelFormat::getRgbAlphaU8(), ColorSpace::getLinearSRgb());
+
+        const uint8_t expected[]{
+            0, 0, 0, 255,
+            77, 77, 77, 255,
+            255, 255, 255, 255,
+            1, 1, 1, 255
+        };
+
+        REQUIRE_EQ(std::memcmp(dst.getRowPointer(0), expected, sizeof(expected)), 0);
+    }
+}
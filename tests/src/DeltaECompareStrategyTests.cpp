@@ -0,0 +1,126 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+#include "ColorDifference.hpp"
+#include <vector>
+
+using namespace ImageApprovals;
+
+namespace {
+
+ImageView makeRgbView(const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height)
+{
+    return ImageView(PixelFormat::getRgbU8(), ColorSpace::getSRgb(), Size(width, height), width * 3, pixels.data());
+}
+
+}
+
+TEST_CASE("DeltaECompareStrategy")
+{
+    SUBCASE("CIEDE2000 matches the reference data of Sharma et al.")
+    {
+        struct Pair
+        {
+            detail::Lab left;
+            detail::Lab right;
+            double deltaE;
+        };
+
+        const Pair pairs[]{
+            { { 50.0f, 2.6772f, -79.7751f }, { 50.0f, 0.0f, -82.7485f }, 2.0425 },
+            { { 50.0f, 3.1571f, -77.2803f }, { 50.0f, 0.0f, -82.7485f }, 2.8615 },
+            { { 50.0f, 0.0f, 0.0f }, { 50.0f, -1.0f, 2.0f }, 2.3669 },
+            { { 50.0f, 2.5f, 0.0f }, { 73.0f, 25.0f, -18.0f }, 27.1492 },
+            { { 50.0f, 2.5f, 0.0f }, { 50.0f, 3.1736f, 0.5854f }, 1.0000 },
+            { { 60.2574f, -34.0099f, 36.2677f }, { 60.4626f, -34.1751f, 39.4387f }, 1.2644 },
+            { { 2.0776f, 0.0795f, -1.1350f }, { 0.9033f, -0.0636f, -0.5514f }, 0.9082 },
+        };
+
+        for (const Pair& pair : pairs)
+        {
+            REQUIRE(detail::deltaE2000(pair.left, pair.right) == doctest::Approx(pair.deltaE).epsilon(0.0005));
+            REQUIRE(detail::deltaE2000(pair.right, pair.left) == doctest::Approx(pair.deltaE).epsilon(0.0005));
+            REQUIRE(detail::deltaE2000(pair.left, pair.right) <= detail::deltaE2000Bound * detail::deltaE76(pair.left, pair.right));
+        }
+    }
+
+    SUBCASE("Conversion to Lab")
+    {
+        for (float x = 0.001f; x < 1.0f; x *= 1.1f)
+        {
+            REQUIRE(detail::fastCbrt(x) == doctest::Approx(std::cbrt(x)).epsilon(1e-5));
+        }
+
+        const detail::Lab white = detail::linearSRgbToLab(RGBA{ 1.0f, 1.0f, 1.0f, 1.0f });
+        REQUIRE(white.l == doctest::Approx(100.0).epsilon(1e-4));
+        REQUIRE(std::abs(white.a) < 0.01f);
+        REQUIRE(std::abs(white.b) < 0.01f);
+
+        const detail::Lab red = detail::linearSRgbToLab(RGBA{ 1.0f, 0.0f, 0.0f, 1.0f });
+        REQUIRE(red.l == doctest::Approx(53.24).epsilon(1e-3));
+        REQUIRE(red.a == doctest::Approx(80.09).epsilon(1e-3));
+        REQUIRE(red.b == doctest::Approx(67.20).epsilon(1e-3));
+    }
+
+    const uint32_t width = 20, height = 10;
+    std::vector<uint8_t> left(width * height * 3), right;
+
+    for (size_t i = 0; i < left.size(); ++i)
+    {
+        left[i] = static_cast<uint8_t>((i * 37) % 256);
+    }
+
+    right = left;
+
+    SUBCASE("Equal images pass")
+    {
+        REQUIRE(DeltaECompareStrategy(0.0, Percent(0.0)).compare(makeRgbView(left, width, height), makeRgbView(right, width, height)).passed);
+    }
+
+    SUBCASE("Small differences pass, large ones fail")
+    {
+        // A mid gray one step brighter is below a just noticeable difference
+        right[0] = right[1] = right[2] = 128;
+        left[0] = left[1] = left[2] = 129;
+
+        const DeltaECompareStrategy strategy(1.0, Percent(0.0));
+        REQUIRE(strategy.compare(makeRgbView(left, width, height), makeRgbView(right, width, height)).passed);
+
+        right[3 * 5 + 1] ^= 0x80;
+
+        const auto result = strategy.compare(makeRgbView(left, width, height), makeRgbView(right, width, height));
+        REQUIRE_FALSE(result.passed);
+        REQUIRE(result.getRightImageInfo() == "1 pixels (0.5%) differ by more than CIEDE2000 Delta E = 1");
+
+        REQUIRE(result.hasStatistics);
+        REQUIRE_EQ(result.statistics.numComparedPixels, 200u);
+        REQUIRE_EQ(result.statistics.numFailedPixels, 1u);
+        REQUIRE_GT(result.statistics.maxError, 1.0f);
+        REQUIRE_EQ(result.statistics.worstPixelX, 5u);
+        REQUIRE_EQ(result.statistics.worstPixelY, 0u);
+
+        REQUIRE(DeltaECompareStrategy(1.0, Percent(0.5)).compare(makeRgbView(left, width, height), makeRgbView(right, width, height)).passed);
+    }
+
+    SUBCASE("CIE76")
+    {
+        // Saturated blues differ less in CIEDE2000 than in CIE76
+        for (uint32_t i = 0; i < width * height; ++i)
+        {
+            left[i * 3 + 0] = 0;
+            left[i * 3 + 1] = 0;
+            left[i * 3 + 2] = 255;
+            right[i * 3 + 0] = 0;
+            right[i * 3 + 1] = 24;
+            right[i * 3 + 2] = 255;
+        }
+
+        const detail::Lab l = detail::linearSRgbToLab(RGBA{ 0.0f, 0.0f, 1.0f, 1.0f });
+        const detail::Lab r = detail::linearSRgbToLab(RGBA{ 0.0f, 0.0091f, 1.0f, 1.0f });
+        const double maxDeltaE = (detail::deltaE76(l, r) + detail::deltaE2000(l, r)) / 2.0;
+
+        REQUIRE(DeltaECompareStrategy(maxDeltaE, Percent(0.0)).compare(makeRgbView(left, width, height), makeRgbView(right, width, height)).passed);
+        REQUIRE_FALSE(DeltaECompareStrategy(maxDeltaE, Percent(0.0), DeltaEFormula::CIE76)
+                          .compare(makeRgbView(left, width, height), makeRgbView(right, width, height))
+                          .passed);
+    }
+}
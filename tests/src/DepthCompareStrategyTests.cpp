@@ -0,0 +1,81 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+#include <limits>
+#include <vector>
+
+using namespace ImageApprovals;
+
+namespace {
+
+ImageView makeDepthView(const std::vector<float>& values)
+{
+    return ImageView(
+        PixelFormat::getGrayF32(), ColorSpace::getLinearSRgb(),
+        Size(static_cast<uint32_t>(values.size()), 1), values.size() * sizeof(float),
+        reinterpret_cast<const uint8_t*>(values.data()));
+}
+
+}
+
+TEST_CASE("DepthCompareStrategy")
+{
+    const float inf = std::numeric_limits<float>::infinity();
+
+    const std::vector<float> left{ 1.0f, 10.0f, 100.0f, inf };
+
+    SUBCASE("Relative tolerance scales with depth")
+    {
+        DepthCompareStrategy strategy(RelThreshold(0.01));
+
+        REQUIRE(strategy.compare(makeDepthView(left), makeDepthView({ 1.005f, 10.05f, 100.5f, inf })).passed);
+        REQUIRE_FALSE(strategy.compare(makeDepthView(left), makeDepthView({ 1.0f, 10.0f, 102.0f, inf })).passed);
+        REQUIRE_FALSE(strategy.compare(makeDepthView(left), makeDepthView({ 1.0f, 10.0f, 100.0f, 5.0f })).passed);
+    }
+
+    SUBCASE("Range tolerance is the same at every depth")
+    {
+        DepthCompareStrategy strategy(RelThreshold(0.01), DepthRange(0.0f, 100.0f));
+
+        REQUIRE(strategy.compare(makeDepthView(left), makeDepthView({ 1.9f, 10.5f, 100.0f, inf })).passed);
+        REQUIRE_FALSE(strategy.compare(makeDepthView(left), makeDepthView({ 2.5f, 10.0f, 100.0f, inf })).passed);
+    }
+
+    SUBCASE("Far plane values are skipped")
+    {
+        DepthCompareStrategy strategy(RelThreshold(0.01), DepthRange(0.0f, 100.0f));
+
+        REQUIRE(strategy.compare(makeDepthView(left), makeDepthView({ 1.0f, 10.0f, 250.0f, 100.0f })).passed);
+        REQUIRE_FALSE(strategy.compare(makeDepthView(left), makeDepthView({ 1.0f, 10.0f, 50.0f, inf })).passed);
+    }
+
+    SUBCASE("Failed pixel percentage")
+    {
+        DepthCompareStrategy strategy(RelThreshold(0.01), Percent(30.0));
+
+        REQUIRE(strategy.compare(makeDepthView(left), makeDepthView({ 2.0f, 10.0f, 100.0f, inf })).passed);
+        REQUIRE_FALSE(strategy.compare(makeDepthView(left), makeDepthView({ 2.0f, 20.0f, 100.0f, inf })).passed);
+    }
+
+    SUBCASE("Statistics")
+    {
+        const auto result = DepthCompareStrategy(RelThreshold(0.01)).compare(makeDepthView(left), makeDepthView({ 1.0f, 10.0f, 102.0f, inf }));
+
+        REQUIRE_FALSE(result.passed);
+        REQUIRE(result.hasStatistics);
+        REQUIRE_EQ(result.statistics.numComparedPixels, 4u);
+        REQUIRE_EQ(result.statistics.numFailedPixels, 1u);
+        REQUIRE_EQ(result.statistics.maxError, 2.0f);
+        REQUIRE_EQ(result.statistics.worstPixelX, 2u);
+        REQUIRE_EQ(result.statistics.meanError, 0.5);
+    }
+
+    SUBCASE("Only single-channel float images are compared")
+    {
+        DepthCompareStrategy strategy;
+
+        const uint8_t gray[]{ 1, 2, 3, 4 };
+        const ImageView grayView(PixelFormat::getGrayU8(), ColorSpace::getLinearSRgb(), Size(4, 1), 4, gray);
+
+        REQUIRE_FALSE(strategy.compare(grayView, grayView).passed);
+    }
+}
@@ -2,6 +2,11 @@
 #include <ImageApprovals/ImageCodec.hpp>
 #include <TestsConfig.hpp>
 #include <ExrImageCodec.hpp>
+#include <ImageApprovals/CompareStrategy.hpp>
+#include <ImageApprovals/Errors.hpp>
+#include <cstdio>
+#include <cstring>
+#include <vector>
 
 using namespace ImageApprovals;
 
@@ -17,4 +22,153 @@ TEST_CASE("ExrImageCodec")
         REQUIRE_EQ(image.getColorSpace(), ColorSpace::getLinearSRgb());
         REQUIRE_EQ(image.getSize(), Size(178, 155));
     }
+
+    SUBCASE("Writing and reading single-channel images")
+    {
+        BitwiseCompareStrategy cmpStrategy;
+
+        const std::vector<float> depth{ 0.5f, 1.25f, 1000.0f, 3.0e7f, 0.001f, 7.0f };
+        const ImageView depthView(PixelFormat::getGrayF32(), ColorSpace::getLinearSRgb(), Size(3, 2), 12,
+                                  reinterpret_cast<const uint8_t*>(depth.data()));
+
+        const auto path = TEST_FILE("exr/depth.received.exr");
+
+        codec.write(path, depthView);
+
+        const Image image = codec.read(path);
+
+        REQUIRE_EQ(image.getPixelFormat(), PixelFormat::getGrayF32());
+        REQUIRE(cmpStrategy.compare(image, depthView).passed);
+
+        detail::ExrImageCodec("Z").write(path, depthView);
+        REQUIRE(cmpStrategy.compare(codec.read(path), depthView).passed);
+
+        // The rows of a bottom-up buffer are stored last to first
+        const std::vector<float> bottomUpDepth{ 3.0e7f, 0.001f, 7.0f, 0.5f, 1.25f, 1000.0f };
+        const ImageView bottomUpView
+            = ImageView(PixelFormat::getGrayF32(), ColorSpace::getLinearSRgb(), Size(3, 2), 12,
+                        reinterpret_cast<const uint8_t*>(bottomUpDepth.data())).flippedVertically();
+
+        REQUIRE(bottomUpView.isBottomUp());
+        codec.write(path, bottomUpView);
+
+        const Image topDown = codec.read(path);
+
+        float firstRow[3], secondRow[3];
+        std::memcpy(firstRow, topDown.getRowPointer(0), sizeof(firstRow));
+        std::memcpy(secondRow, topDown.getRowPointer(1), sizeof(secondRow));
+
+        REQUIRE_EQ(firstRow[0], 0.5f);
+        REQUIRE_EQ(firstRow[2], 1000.0f);
+        REQUIRE_EQ(secondRow[0], 3.0e7f);
+        REQUIRE_EQ(secondRow[2], 7.0f);
+    }
+
+    SUBCASE("Colors under zero alpha are kept")
+    {
+        const std::vector<float> approved{ 0.5f, 0.25f, 1.0f, 1.0f,  1.0f, 0.0f, 0.0f, 0.0f };
+        const std::vector<float> received{ 0.5f, 0.25f, 1.0f, 1.0f,  0.0f, 1.0f, 0.0f, 0.0f };
+
+        const auto approvedPath = TEST_FILE("exr/transparent.approved.exr");
+        const auto receivedPath = TEST_FILE("exr/transparent.received.exr");
+
+        codec.write(approvedPath, ImageView(PixelFormat::getRgbAlphaF32(), ColorSpace::getLinearSRgb(), Size(2, 1), 32,
+                                            reinterpret_cast<const uint8_t*>(approved.data())));
+        codec.write(receivedPath, ImageView(PixelFormat::getRgbAlphaF32(), ColorSpace::getLinearSRgb(), Size(2, 1), 32,
+                                            reinterpret_cast<const uint8_t*>(received.data())));
+
+        const Image approvedImage = codec.read(approvedPath);
+
+        REQUIRE_EQ(approvedImage.getPixelFormat(), PixelFormat::getRgbAlphaF32());
+        REQUIRE_FALSE(ThresholdCompareStrategy().compare(codec.read(receivedPath), approvedImage).passed);
+
+        std::remove(approvedPath);
+    }
+
+    SUBCASE("Premultiplied alpha storage")
+    {
+        const detail::ExrImageCodec premultipliedCodec("Y", detail::ExrAlphaStorage::Premultiplied);
+
+        const std::vector<float> straight{ 0.5f, 0.25f, 1.0f, 0.5f };
+        const ImageView view(PixelFormat::getRgbAlphaF32(), ColorSpace::getLinearSRgb(), Size(1, 1), 16,
+                             reinterpret_cast<const uint8_t*>(straight.data()));
+
+        const auto path = TEST_FILE("exr/premultiplied.received.exr");
+        premultipliedCodec.write(path, view);
+
+        // A straight codec reads the stored values as they are
+        float stored[4];
+        std::memcpy(stored, codec.read(path).getRowPointer(0), sizeof(stored));
+
+        REQUIRE_EQ(stored[0], 0.25f);
+        REQUIRE_EQ(stored[2], 0.5f);
+        REQUIRE_EQ(stored[3], 0.5f);
+
+        const Image image = premultipliedCodec.read(path);
+
+        REQUIRE_EQ(image.getPixelFormat(), PixelFormat::getRgbAlphaF32Premultiplied());
+        REQUIRE(ThresholdCompareStrategy().compare(image, view).passed);
+    }
+
+    SUBCASE("Reading regions of RGBA images")
+    {
+        BitwiseCompareStrategy cmpStrategy;
+
+        // Values are exact in half precision, and the image is not square, so that any mix-up of rows and columns shows
+        std::vector<float> pixels;
+        for (int i = 0; i < 5 * 3 * 4; ++i)
+        {
+            pixels.push_back(static_cast<float>(i) / 8.0f);
+        }
+
+        const ImageView view(PixelFormat::getRgbAlphaF32(), ColorSpace::getLinearSRgb(), Size(5, 3), 5 * 16,
+                             reinterpret_cast<const uint8_t*>(pixels.data()));
+
+        const std::string path = TEST_FILE("exr/regions.received.exr");
+        codec.write(path, view);
+
+        REQUIRE(cmpStrategy.compare(codec.read(path), view).passed);
+
+        const auto reader = codec.openReader(path);
+
+        REQUIRE_EQ(reader->getPixelFormat(), PixelFormat::getRgbAlphaF32());
+        REQUIRE_EQ(reader->getSize(), Size(5, 3));
+
+        REQUIRE(cmpStrategy.compare(reader->readRegion(1, 1, 3, 2), view.subView(1, 1, 3, 2)).passed);
+        REQUIRE(cmpStrategy.compare(reader->readRegion(0, 0, 5, 1), view.subView(0, 0, 5, 1)).passed);
+        REQUIRE_THROWS_AS(reader->readRegion(4, 0, 2, 1), ImageApprovalsError);
+
+        const std::string rowsPath = TEST_FILE("exr/rows.received.exr");
+
+        {
+            auto writer = codec.openRowWriter(rowsPath, view.getPixelFormat(), view.getColorSpace(), view.getSize());
+
+            // Rows 1 and 2 come from a bottom-up buffer, which stores them last to first
+            std::vector<float> bottomUpRows(pixels.begin() + 2 * 5 * 4, pixels.end());
+            bottomUpRows.insert(bottomUpRows.end(), pixels.begin() + 5 * 4, pixels.begin() + 2 * 5 * 4);
+
+            const ImageView bottomUpView
+                = ImageView(view.getPixelFormat(), view.getColorSpace(), Size(5, 2), 5 * 16,
+                            reinterpret_cast<const uint8_t*>(bottomUpRows.data())).flippedVertically();
+
+            writer->writeRows(view.subView(0, 0, 5, 1));
+            writer->writeRows(bottomUpView);
+            writer->finish();
+        }
+
+        const Image rowsImage = codec.read(rowsPath);
+
+        float lastPixel[4];
+        std::memcpy(lastPixel, rowsImage.getRowPointer(2) + 4 * 16, sizeof(lastPixel));
+
+        REQUIRE(cmpStrategy.compare(rowsImage, view).passed);
+        REQUIRE_EQ(lastPixel[3], pixels.back());
+
+        const std::vector<uint8_t> data = codec.encode(view);
+        REQUIRE(cmpStrategy.compare(codec.decode(data.data(), data.size()), view).passed);
+
+        // The offsets in the header point past the end of the truncated data
+        REQUIRE_THROWS(codec.decode(data.data(), data.size() / 2));
+        REQUIRE_THROWS(codec.decode(data.data(), 40));
+    }
 }
\ No newline at end of file
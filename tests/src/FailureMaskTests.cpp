@@ -0,0 +1,92 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+
+using namespace ImageApprovals;
+
+TEST_CASE("FailureMask")
+{
+    // 4 x 3 tiles of 4 x 4 pixels
+    FailureMask mask(Size(14, 10), 4);
+
+    mask.addRun(1, 2, 3);
+    mask.addRun(1, 5, 2);
+    mask.addRun(9, 13, 1);
+
+    SUBCASE("Adjacent runs are merged")
+    {
+        const auto& runs = mask.getRuns();
+
+        REQUIRE_EQ(runs.size(), 2u);
+        REQUIRE_EQ(runs[0].x, 2u);
+        REQUIRE_EQ(runs[0].length, 5u);
+        REQUIRE_EQ(mask.getNumFailedPixels(), 6u);
+        REQUIRE(mask.isComplete());
+    }
+
+    SUBCASE("Bounding box and tiles")
+    {
+        const auto box = mask.getBoundingBox();
+        REQUIRE_EQ(box.x, 2u);
+        REQUIRE_EQ(box.y, 1u);
+        REQUIRE_EQ(box.width, 12u);
+        REQUIRE_EQ(box.height, 9u);
+
+        const auto tiles = mask.getTiles();
+        REQUIRE_EQ(tiles.size(), 3u);
+        REQUIRE_EQ(tiles[0].column, 0u);
+        REQUIRE_EQ(tiles[0].numFailedPixels, 2u);
+        REQUIRE_EQ(tiles[1].column, 1u);
+        REQUIRE_EQ(tiles[1].numFailedPixels, 3u);
+        REQUIRE_EQ(tiles[2].column, 3u);
+        REQUIRE_EQ(tiles[2].row, 2u);
+        REQUIRE_EQ(tiles[2].numFailedPixels, 1u);
+    }
+
+    SUBCASE("Pixels can be looked up")
+    {
+        REQUIRE(mask.contains(2, 1));
+        REQUIRE(mask.contains(6, 1));
+        REQUIRE(mask.contains(13, 9));
+        REQUIRE_FALSE(mask.contains(1, 1));
+        REQUIRE_FALSE(mask.contains(7, 1));
+        REQUIRE_FALSE(mask.contains(2, 0));
+        REQUIRE_FALSE(mask.contains(12, 9));
+    }
+
+    SUBCASE("Serialized masks are read back")
+    {
+        const auto copy = FailureMask::deserialize(mask.serialize());
+
+        REQUIRE_EQ(copy.serialize(), mask.serialize());
+        REQUIRE_EQ(copy.getNumFailedPixels(), 6u);
+        REQUIRE_EQ(copy.getBoundingBox().width, 12u);
+        REQUIRE(copy.contains(4, 1));
+
+        REQUIRE_THROWS_AS(FailureMask::deserialize("failure-mask 14 10"), ImageApprovalsError);
+    }
+
+    SUBCASE("Runs out of order or outside of the image are rejected")
+    {
+        const std::string header = "failure-mask 14 10 4 6 1\nbounds 2 1 12 9\ntiles 0\nruns 2\n";
+
+        REQUIRE_NOTHROW(FailureMask::deserialize(header + "1 2 5\n9 13 1\n"));
+
+        REQUIRE_THROWS_AS(FailureMask::deserialize(header + "9 13 1\n1 2 5\n"), ImageApprovalsError);
+        REQUIRE_THROWS_AS(FailureMask::deserialize(header + "1 2 5\n1 6 1\n"), ImageApprovalsError);
+        REQUIRE_THROWS_AS(FailureMask::deserialize(header + "1 2 5\n9 13 2\n"), ImageApprovalsError);
+        REQUIRE_THROWS_AS(FailureMask::deserialize(header + "1 2 5\n10 0 1\n"), ImageApprovalsError);
+        REQUIRE_THROWS_AS(FailureMask::deserialize(header + "1 2 0\n9 13 1\n"), ImageApprovalsError);
+    }
+
+    SUBCASE("Runs over the limit are dropped, but still counted")
+    {
+        FailureMask limited(Size(14, 10), 4, 1);
+        limited.addRun(0, 0, 1);
+        limited.addRun(0, 2, 1);
+
+        REQUIRE_FALSE(limited.isComplete());
+        REQUIRE_EQ(limited.getRuns().size(), 1u);
+        REQUIRE_EQ(limited.getNumFailedPixels(), 2u);
+        REQUIRE_EQ(limited.getBoundingBox().width, 3u);
+    }
+}
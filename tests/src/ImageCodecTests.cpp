@@ -0,0 +1,147 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace ImageApprovals;
+
+namespace {
+
+class TestCodec : public ImageCodec
+{
+public:
+    TestCodec(std::string extension, int score)
+        : m_extension(std::move(extension)), m_score(score)
+    {}
+
+    std::string getFileExtensionWithDot() const override { return m_extension; }
+
+    int getScore(const std::string& extensionWithDot) const override
+    {
+        return (extensionWithDot == m_extension || extensionWithDot == ".tst2") ? m_score : -1;
+    }
+
+    int getScore(const PixelFormat& pf, const ColorSpace&) const override
+    {
+        return (pf == PixelFormat::getGrayU8()) ? m_score : -1;
+    }
+
+protected:
+    Image readFromStream(std::istream&, const std::string&) const override { return Image(); }
+    void writeToStream(const ImageView&, std::ostream&, const std::string&) const override {}
+
+private:
+    std::string m_extension;
+    int m_score;
+};
+
+class DecodingCodec : public TestCodec
+{
+public:
+    DecodingCodec()
+        : TestCodec(".tst", 1000)
+    {}
+
+    using ImageCodec::openReaderForStream;
+
+    mutable const uint8_t* decodedPixels = nullptr;
+
+protected:
+    Image readFromStream(std::istream&, const std::string&) const override
+    {
+        Image image(PixelFormat::getGrayU8(), ColorSpace::getSRgb(), Size(2, 2), 1);
+        image.getRowPointer(0)[1] = 1;
+        image.getRowPointer(1)[0] = 2;
+        image.getRowPointer(1)[1] = 3;
+
+        decodedPixels = image.getRowPointer(0);
+        return image;
+    }
+};
+
+}
+
+TEST_CASE("ImageCodec registry")
+{
+    const auto first = std::make_shared<TestCodec>(".tst", 1000);
+    const auto second = std::make_shared<TestCodec>(".tst", 1000);
+
+    const Image gray(PixelFormat::getGrayU8(), ColorSpace::getSRgb(), Size(1, 1), 1);
+
+    {
+        const auto firstDisposer = ImageCodec::registerCodec(first);
+
+        REQUIRE_EQ(&ImageCodec::getBestCodec("image.tst"), first.get());
+        REQUIRE_EQ(&ImageCodec::getBestCodec("image.tst2"), first.get());
+        REQUIRE_EQ(&ImageCodec::getBestCodec(gray), first.get());
+
+        {
+            // Among codecs with equal scores the one registered first wins
+            const auto secondDisposer = ImageCodec::registerCodec(second);
+
+            REQUIRE_EQ(&ImageCodec::getBestCodec("image.tst"), first.get());
+            REQUIRE_EQ(ImageCodec::getRegisteredExtensions().front(), ".tst");
+        }
+
+        ImageCodec::unregisterCodec(first);
+        REQUIRE_THROWS_AS(ImageCodec::getBestCodec("image.tst"), ImageApprovalsError);
+    }
+
+    SUBCASE("Concurrent lookups and registrations")
+    {
+        std::atomic<bool> done(false);
+        std::atomic<int> failures(0);
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i)
+        {
+            threads.emplace_back([&]()
+            {
+                while (!done)
+                {
+                    const ImageCodec* codec = &ImageCodec::getBestCodec(gray);
+                    if (codec == first.get())
+                    {
+                        ++failures;
+                    }
+                }
+            });
+        }
+
+        for (int i = 0; i < 100; ++i)
+        {
+            const auto disposer = ImageCodec::registerCodec(std::make_shared<TestCodec>(".tst", 1000));
+            REQUIRE_NE(&ImageCodec::getBestCodec("image.tst"), first.get());
+        }
+
+        done = true;
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        REQUIRE_EQ(failures.load(), 0);
+    }
+}
+
+TEST_CASE("Default ImageReader")
+{
+    const DecodingCodec codec;
+    const auto reader = codec.openReaderForStream(std::unique_ptr<std::istream>(new std::istringstream()), "image.tst");
+
+    REQUIRE_EQ(reader->getSize(), Size(2, 2));
+
+    const Image region = reader->readRegion(1, 1, 1, 1);
+    REQUIRE_EQ(region.getSize(), Size(1, 1));
+    REQUIRE_EQ(region.getRowPointer(0)[0], 3);
+
+    // The whole image is handed over without a copy
+    const Image whole = reader->readRegion(0, 0, 2, 2);
+    REQUIRE_EQ(whole.getRowPointer(0), codec.decodedPixels);
+    REQUIRE_EQ(whole.getRowPointer(1)[0], 2);
+    REQUIRE_EQ(reader->getSize(), Size(2, 2));
+
+    REQUIRE_THROWS_AS(reader->readRegion(0, 0, 1, 1), ImageApprovalsError);
+}
@@ -17,6 +17,15 @@ TEST_CASE("Image")
         REQUIRE_THROWS_AS(makeImage(Size(1, 1), 0), ImageApprovalsError);
     }
 
+    SUBCASE("Image constructor throws when the image cannot be addressed")
+    {
+        const Size hugeSize(0xFFFFFFFFu, 0xFFFFFFFFu);
+
+        REQUIRE_THROWS_AS(
+            Image(PixelFormat::getRgbAlphaF32(), ColorSpace::getLinearSRgb(), hugeSize),
+            ImageApprovalsError);
+    }
+
     SUBCASE("getPixelFormat/getColorSpace throws when called on an empty Image")
     {
         Image emptyImage;
@@ -15,4 +15,81 @@ TEST_CASE("ImageView::copy")
     Image imgCopy = img.copy();
 
     REQUIRE(cmpStrategy.compare(img, imgCopy).passed);
-}
\ No newline at end of file
+}
+
+TEST_CASE("ImageView::flippedVertically")
+{
+    BitwiseCompareStrategy cmpStrategy;
+
+    const auto imgPath = TEST_FILE("cornell.approved.png");
+
+    Image img = ImageCodec::getBestCodec(imgPath).read(imgPath);
+
+    const ImageView flippedView = img.flippedVertically();
+
+    REQUIRE(flippedView.isBottomUp());
+    REQUIRE_EQ(flippedView.getSize(), img.getSize());
+    REQUIRE_EQ(flippedView.getRowPointer(0), img.getRowPointer(img.getSize().height - 1));
+    REQUIRE_EQ(flippedView.getPixel(1, 2), img.getPixel(1, img.getSize().height - 3));
+
+    SUBCASE("Flipped view matches flipped image")
+    {
+        Image flippedImg = img.copy();
+        flippedImg.flipVertically();
+
+        REQUIRE(cmpStrategy.compare(flippedView, flippedImg).passed);
+        REQUIRE(cmpStrategy.compare(flippedView.copy(), flippedImg).passed);
+    }
+
+    SUBCASE("Flipping twice gives the original view")
+    {
+        const ImageView view = flippedView.flippedVertically();
+
+        REQUIRE_FALSE(view.isBottomUp());
+        REQUIRE_EQ(view.getRowPointer(0), img.getRowPointer(0));
+    }
+}
+
+TEST_CASE("ImageView::subView")
+{
+    BitwiseCompareStrategy cmpStrategy;
+
+    const auto imgPath = TEST_FILE("cornell.approved.png");
+
+    Image img = ImageCodec::getBestCodec(imgPath).read(imgPath);
+    const auto sz = img.getSize();
+
+    SUBCASE("Sub-view shares pixels with the image")
+    {
+        const ImageView view = img.subView(5, 7, 20, 10);
+
+        REQUIRE_EQ(view.getSize(), Size(20, 10));
+        REQUIRE_EQ(view.getRowStride(), img.getRowStride());
+        REQUIRE_EQ(view.getPixel(0, 0), img.getPixel(5, 7));
+        REQUIRE_EQ(view.getPixel(19, 9), img.getPixel(24, 16));
+
+        REQUIRE(cmpStrategy.compare(view, view.copy()).passed);
+    }
+
+    SUBCASE("Sub-view of a flipped view")
+    {
+        const ImageView view = img.flippedVertically().subView(0, 0, sz.width, 3);
+
+        REQUIRE(view.isBottomUp());
+        REQUIRE_EQ(view.getPixel(2, 0), img.getPixel(2, sz.height - 1));
+        REQUIRE_EQ(view.getPixel(2, 2), img.getPixel(2, sz.height - 3));
+    }
+
+    SUBCASE("Sub-view covering the whole image")
+    {
+        REQUIRE(cmpStrategy.compare(img.subView(0, 0, sz.width, sz.height), img).passed);
+    }
+
+    SUBCASE("Sub-view out of bounds")
+    {
+        REQUIRE_THROWS_AS(img.subView(1, 0, sz.width, 1), ImageApprovalsError);
+        REQUIRE_THROWS_AS(img.subView(0, 1, 1, sz.height), ImageApprovalsError);
+        REQUIRE_THROWS_AS(img.subView(sz.width + 1, 0, 0, 1), ImageApprovalsError);
+        REQUIRE_THROWS_AS(img.subView(0, 0xFFFFFFFFu, 1, 2), ImageApprovalsError);
+    }
+}
@@ -0,0 +1,160 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+#include <TestsConfig.hpp>
+#include <cstring>
+#include <vector>
+
+using namespace ImageApprovals;
+
+namespace {
+
+ImageView makeView(const PixelFormat& format, const Size& size, const std::vector<float>& values)
+{
+    const size_t rowStride = size.width * format.getPixelStride();
+    return ImageView(format, ColorSpace::getLinearSRgb(), size, rowStride,
+                     reinterpret_cast<const uint8_t*>(values.data()));
+}
+
+}
+
+TEST_CASE("LayeredImage")
+{
+    const std::vector<float> gray{ 0.0f, 0.25f, 0.5f, 1.0f };
+    const ImageView grayView = makeView(PixelFormat::getGrayF32(), Size(2, 2), gray);
+
+    LayeredImage image;
+    image.addLayer("depth", grayView, { "Z" });
+    image.addLayer("mask", Image(PixelFormat::getGrayF32(), ColorSpace::getLinearSRgb(), Size(1, 1)));
+
+    REQUIRE_EQ(image.getNumberOfLayers(), 2u);
+    REQUIRE_EQ(image.getLayer(0).image.getRowPointer(0), grayView.getRowPointer(0));
+    REQUIRE_EQ(image.getLayer(1).name, "mask");
+    REQUIRE(image.findLayer("depth") != nullptr);
+    REQUIRE(image.findLayer("normal") == nullptr);
+
+    REQUIRE_THROWS_AS(image.addLayer("depth", grayView), ImageApprovalsError);
+    REQUIRE_THROWS_AS(image.addLayer("normal", grayView, { "X", "Y" }), ImageApprovalsError);
+    REQUIRE_EQ(image.getNumberOfLayers(), 2u);
+}
+
+TEST_CASE("ExrImageCodec layers")
+{
+    const auto& codec = ImageCodec::getBestCodec(".exr");
+    BitwiseCompareStrategy cmpStrategy;
+
+    const std::vector<float> rgba{
+        1.0f, 0.0f, 0.0f, 1.0f,  0.0f, 1.0f, 0.0f, 0.5f,
+        0.0f, 0.0f, 1.0f, 0.0f,  0.2f, 0.4f, 0.6f, 0.8f
+    };
+    const std::vector<float> normals{
+        0.0f, 0.0f, 1.0f,  0.0f, 1.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,  0.6f, 0.0f, 0.8f
+    };
+    const std::vector<float> depth{ 1.0f, 2.0f, 3.0f, 4.0f };
+
+    const ImageView rgbaView = makeView(PixelFormat::getRgbAlphaF32(), Size(2, 2), rgba);
+    const ImageView normalView = makeView(PixelFormat::getRgbF32(), Size(2, 2), normals);
+
+    LayeredImage image;
+    image.addLayer("beauty", rgbaView);
+    image.addLayer("normal", normalView, { "X", "Y", "Z" });
+
+    const std::string path = TEST_FILE("exr/layers.received.exr");
+
+    SUBCASE("Layers of the same size")
+    {
+        image.addLayer("depth", makeView(PixelFormat::getGrayF32(), Size(2, 2), depth), { "Z" });
+    }
+
+    SUBCASE("Layers of different sizes")
+    {
+        image.addLayer("depth", makeView(PixelFormat::getGrayF32(), Size(4, 1), depth), { "Z" });
+    }
+
+    codec.writeLayers(path, image);
+    const LayeredImage read = codec.readLayers(path);
+
+    REQUIRE_EQ(read.getNumberOfLayers(), 3u);
+
+    for (size_t i = 0; i < image.getNumberOfLayers(); ++i)
+    {
+        const auto& layer = image.getLayer(i);
+        const auto* readLayer = read.findLayer(layer.name);
+
+        REQUIRE(readLayer != nullptr);
+        REQUIRE_EQ(readLayer->image.getPixelFormat(), layer.image.getPixelFormat());
+        REQUIRE(cmpStrategy.compare(readLayer->image, layer.image).passed);
+    }
+
+    const std::vector<std::string> normalChannels{ "X", "Y", "Z" };
+    REQUIRE(read.findLayer("normal")->channelNames == normalChannels);
+}
+
+TEST_CASE("ExrImageCodec layers without alpha")
+{
+    const auto& codec = ImageCodec::getBestCodec(".exr");
+
+    // The last components are not alpha, so a 0 must not hide the others
+    const std::vector<float> position{ 1.0f, 2.0f, 3.0f, 0.0f,  4.0f, 5.0f, 6.0f, 0.5f };
+    const std::vector<float> motion{ 0.25f, 0.0f,  -0.5f, 0.75f };
+
+    LayeredImage image;
+    image.addLayer("position", makeView(PixelFormat::getRgbAlphaF32Premultiplied(), Size(2, 1), position), { "X", "Y", "Z", "W" });
+    image.addLayer("motion", makeView(PixelFormat::getGrayAlphaF32(), Size(2, 1), motion), { "U", "V" });
+
+    const std::string path = TEST_FILE("exr/vectors.received.exr");
+
+    codec.writeLayers(path, image);
+    const LayeredImage read = codec.readLayers(path);
+
+    // Channels that match no pixel format are read as a layer each
+    REQUIRE_EQ(read.getNumberOfLayers(), 6u);
+
+    const auto requireChannel = [&read](const std::string& name, float first, float second) {
+        const auto* layer = read.findLayer(name);
+
+        REQUIRE(layer != nullptr);
+        REQUIRE_EQ(layer->image.getPixelFormat(), PixelFormat::getGrayF32());
+
+        float values[2];
+        std::memcpy(values, layer->image.getRowPointer(0), sizeof(values));
+
+        REQUIRE_EQ(values[0], first);
+        REQUIRE_EQ(values[1], second);
+    };
+
+    requireChannel("position.X", 1.0f, 4.0f);
+    requireChannel("position.Y", 2.0f, 5.0f);
+    requireChannel("position.Z", 3.0f, 6.0f);
+    requireChannel("position.W", 0.0f, 0.5f);
+    requireChannel("motion.U", 0.25f, -0.5f);
+    requireChannel("motion.V", 0.0f, 0.75f);
+}
+
+TEST_CASE("LayeredImageComparator")
+{
+    const std::vector<float> approvedPixels{ 0.0f, 0.0f, 0.0f, 0.0f };
+    const std::vector<float> receivedPixels{ 0.0f, 0.0f, 0.0f, 0.1f };
+
+    LayeredImage approved;
+    approved.addLayer("", makeView(PixelFormat::getGrayF32(), Size(2, 2), approvedPixels));
+
+    LayeredImage received;
+    received.addLayer("", makeView(PixelFormat::getGrayF32(), Size(2, 2), receivedPixels));
+
+    const auto& codec = ImageCodec::getBestCodec(".exr");
+
+    const std::string approvedPath = TEST_FILE("exr/comparator_layers.approved.exr");
+    const std::string receivedPath = TEST_FILE("exr/comparator_layers.received.exr");
+
+    codec.writeLayers(approvedPath, approved);
+    codec.writeLayers(receivedPath, received);
+
+    LayeredImageComparator comparator;
+    REQUIRE_THROWS_AS(comparator.contentsAreEquivalent(receivedPath, approvedPath), ApprovalTests::ApprovalMismatchException);
+
+    comparator.setLayerStrategy("", std::make_shared<ThresholdCompareStrategy>(AbsThreshold(0.2)));
+    REQUIRE(comparator.contentsAreEquivalent(receivedPath, approvedPath));
+
+    remove(approvedPath.c_str());
+}
@@ -113,6 +113,66 @@ TEST_CASE("PixelFormat::decode")
         REQUIRE_EQ(value, ApproxRGBA(0.0f, 0.4980392f, 1.0f, 0.78431372f));
     }
 
+    SUBCASE("BgraU8")
+    {
+        const PixelFormat& fmt = PixelFormat::getBgrAlphaU8();
+
+        const uint8_t pixel[]{
+            255,
+            127,
+            0,
+            200
+        };
+
+        RGBA value;
+        REQUIRE_EQ(fmt.decode(pixel, pixel + 4, value), pixel + 4);
+        REQUIRE_EQ(value, ApproxRGBA(0.0f, 0.4980392f, 1.0f, 0.78431372f));
+    }
+
+    SUBCASE("ArgbU8")
+    {
+        const PixelFormat& fmt = PixelFormat::getAlphaRgbU8();
+
+        const uint8_t pixel[]{
+            200,
+            0,
+            127,
+            255
+        };
+
+        RGBA value;
+        REQUIRE_EQ(fmt.decode(pixel, pixel + 4, value), pixel + 4);
+        REQUIRE_EQ(value, ApproxRGBA(0.0f, 0.4980392f, 1.0f, 0.78431372f));
+    }
+
+    SUBCASE("RgbaU8Premultiplied")
+    {
+        const PixelFormat& fmt = PixelFormat::getRgbAlphaU8Premultiplied();
+
+        const uint8_t pixel[]{
+            0,
+            51,
+            102,
+            102
+        };
+
+        RGBA value;
+        REQUIRE_EQ(fmt.decode(pixel, pixel + 4, value), pixel + 4);
+        REQUIRE_EQ(value, ApproxRGBA(0.0f, 0.5f, 1.0f, 0.4f));
+    }
+
+    SUBCASE("GrayU16")
+    {
+        const PixelFormat& fmt = PixelFormat::getGrayU16();
+
+        const uint16_t pixel[]{ 13107 };
+        const auto begin = reinterpret_cast<const uint8_t*>(pixel);
+
+        RGBA value;
+        REQUIRE_EQ(fmt.decode(begin, begin + 2, value), begin + 2);
+        REQUIRE_EQ(value, ApproxRGBA(0.2f, 0.2f, 0.2f, 1.0f));
+    }
+
     SUBCASE("RgbaF32")
     {
         const PixelFormat& fmt = PixelFormat::getRgbAlphaF32();
@@ -149,4 +209,67 @@ TEST_CASE("PixelFormat::decode")
         REQUIRE_THROWS_AS(fmt.decode(pixel + 2, pixel, value), ImageApprovalsError);
         REQUIRE_NOTHROW(fmt.decode(pixel, pixel + 6, value));
     }
+}
+
+namespace {
+
+struct CheckTraits
+{
+    const PixelFormat& format;
+
+    template<typename Traits>
+    bool operator()(Traits) const
+    {
+        REQUIRE_EQ(Traits::getPixelFormat(), format);
+        REQUIRE_EQ(Traits::numChannels, format.getNumberOfChannels());
+        REQUIRE_EQ(Traits::pixelStride, format.getPixelStride());
+        REQUIRE_EQ(std::string(Traits::getName()), format.getName());
+
+        const uint8_t bytes[16]{ 0, 0, 128, 63, 0, 0, 0, 63, 0, 0, 0, 0, 0, 0, 64, 64 };
+
+        RGBA expected;
+        format.decode(bytes, bytes + sizeof(bytes), expected);
+        REQUIRE_EQ(Traits::decode(bytes), expected);
+
+        return true;
+    }
+};
+
+}
+
+TEST_CASE("PixelFormatTraits")
+{
+    const PixelFormat* formats[]{
+        &PixelFormat::getGrayU8(),
+        &PixelFormat::getGrayAlphaU8(),
+        &PixelFormat::getRgbU8(),
+        &PixelFormat::getRgbAlphaU8(),
+        &PixelFormat::getBgrU8(),
+        &PixelFormat::getBgrAlphaU8(),
+        &PixelFormat::getAlphaRgbU8(),
+        &PixelFormat::getGrayAlphaU8Premultiplied(),
+        &PixelFormat::getRgbAlphaU8Premultiplied(),
+        &PixelFormat::getBgrAlphaU8Premultiplied(),
+        &PixelFormat::getAlphaRgbU8Premultiplied(),
+        &PixelFormat::getGrayU16(),
+        &PixelFormat::getGrayAlphaU16(),
+        &PixelFormat::getRgbU16(),
+        &PixelFormat::getRgbAlphaU16(),
+        &PixelFormat::getRgbAlphaU16Premultiplied(),
+        &PixelFormat::getGrayF32(),
+        &PixelFormat::getGrayAlphaF32(),
+        &PixelFormat::getRgbF32(),
+        &PixelFormat::getRgbAlphaF32(),
+        &PixelFormat::getRgbAlphaF32Premultiplied()
+    };
+
+    for (const PixelFormat* format : formats)
+    {
+        REQUIRE(dispatchPixelFormat(*format, CheckTraits{ *format }));
+    }
+
+    REQUIRE_FALSE(RgbU8Traits::hasAlpha);
+    REQUIRE(GrayAlphaU8Traits::hasAlpha);
+    REQUIRE(GrayAlphaU8Traits::isGray);
+    REQUIRE_EQ(RgbAlphaF32Traits::alphaIndex, 3);
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #include <doctest/doctest.h>
 #include <ImageApprovals/ImageCodec.hpp>
+#include <ImageApprovals/CompareStrategy.hpp>
+#include <ImageApprovals/Errors.hpp>
 #include <TestsConfig.hpp>
 #include <PngImageCodec.hpp>
+#include <vector>
 
 using namespace ImageApprovals;
 
@@ -38,4 +41,117 @@ TEST_CASE("PngCodec")
 
         REQUIRE_EQ(img.getColorSpace(), ColorSpace::getSRgb());
     }
+
+    SUBCASE("Writing BGR, BGRA and ARGB pixels")
+    {
+        BitwiseCompareStrategy cmpStrategy;
+
+        const auto path = TEST_FILE("png/channel_order.received.png");
+
+        const std::vector<uint8_t> rgba{ 10, 20, 30, 40, 50, 60, 70, 80 };
+        const std::vector<uint8_t> bgra{ 30, 20, 10, 40, 70, 60, 50, 80 };
+        const std::vector<uint8_t> argb{ 40, 10, 20, 30, 80, 50, 60, 70 };
+        const std::vector<uint8_t> bgr{ 30, 20, 10, 70, 60, 50 };
+
+        const auto& cs = ColorSpace::getSRgb();
+        const ImageView rgbaView(PixelFormat::getRgbAlphaU8(), cs, Size(2, 1), 8, rgba.data());
+
+        codec.write(path, ImageView(PixelFormat::getBgrAlphaU8(), cs, Size(2, 1), 8, bgra.data()));
+        REQUIRE(cmpStrategy.compare(codec.read(path), rgbaView).passed);
+
+        codec.write(path, ImageView(PixelFormat::getAlphaRgbU8(), cs, Size(2, 1), 8, argb.data()));
+        REQUIRE(cmpStrategy.compare(codec.read(path), rgbaView).passed);
+
+        codec.write(path, ImageView(PixelFormat::getBgrU8(), cs, Size(2, 1), 6, bgr.data()));
+        const Image rgbImg = codec.read(path);
+        REQUIRE_EQ(rgbImg.getPixelFormat(), PixelFormat::getRgbU8());
+        const std::vector<uint8_t> rgb{ 10, 20, 30, 50, 60, 70 };
+        REQUIRE(cmpStrategy.compare(rgbImg, ImageView(PixelFormat::getRgbU8(), cs, Size(2, 1), 6, rgb.data())).passed);
+    }
+
+    SUBCASE("Writing and reading 16-bit pixels")
+    {
+        BitwiseCompareStrategy cmpStrategy;
+
+        const auto path = TEST_FILE("png/rgba16.received.png");
+
+        const std::vector<uint16_t> rgba{ 1, 256, 4097, 65535, 0, 65534, 32768, 0 };
+
+        const auto& cs = ColorSpace::getLinearSRgb();
+        const ImageView view(PixelFormat::getRgbAlphaU16(), cs, Size(2, 1), 16, reinterpret_cast<const uint8_t*>(rgba.data()));
+
+        codec.write(path, view);
+
+        const Image img = codec.read(path);
+        REQUIRE_EQ(img.getPixelFormat(), PixelFormat::getRgbAlphaU16());
+        REQUIRE(cmpStrategy.compare(img, view).passed);
+    }
+
+    SUBCASE("Writing premultiplied pixels")
+    {
+        BitwiseCompareStrategy cmpStrategy;
+
+        const auto path = TEST_FILE("png/premultiplied.received.png");
+
+        const std::vector<uint8_t> premultiplied{ 0, 51, 102, 102, 0, 0, 0, 0 };
+        const std::vector<uint8_t> straight{ 0, 128, 255, 102, 0, 0, 0, 0 };
+
+        const auto& cs = ColorSpace::getSRgb();
+
+        codec.write(path, ImageView(PixelFormat::getRgbAlphaU8Premultiplied(), cs, Size(2, 1), 8, premultiplied.data()));
+        REQUIRE(cmpStrategy.compare(codec.read(path), ImageView(PixelFormat::getRgbAlphaU8(), cs, Size(2, 1), 8, straight.data())).passed);
+    }
+
+    SUBCASE("Writing and reading in batches of rows")
+    {
+        BitwiseCompareStrategy cmpStrategy;
+
+        const Image source = codec.read(TEST_FILE("png/paint.png"));
+        const auto sz = source.getSize();
+        const auto path = TEST_FILE("png/rows.received.png");
+
+        {
+            auto writer = codec.openRowWriter(path, source.getPixelFormat(), source.getColorSpace(), sz);
+
+            writer->writeRows(source.subView(0, 0, sz.width, 3));
+            REQUIRE_THROWS_AS(writer->finish(), ImageApprovalsError);
+
+            writer->writeRows(source.subView(0, 3, sz.width, sz.height - 3));
+            writer->finish();
+        }
+
+        REQUIRE(cmpStrategy.compare(codec.read(path), source).passed);
+
+        const auto reader = codec.openReader(path);
+
+        REQUIRE_EQ(reader->getSize(), sz);
+        REQUIRE(cmpStrategy.compare(reader->readRegion(0, 5, sz.width, 2), source.subView(0, 5, sz.width, 2)).passed);
+        REQUIRE(cmpStrategy.compare(reader->readRegion(1, 2, 2, 4), source.subView(1, 2, 2, 4)).passed);
+    }
+
+    SUBCASE("Encoding and decoding in memory")
+    {
+        BitwiseCompareStrategy cmpStrategy;
+
+        const Image source = codec.read(TEST_FILE("png/paint.png"));
+
+        const std::vector<uint8_t> data = codec.encode(source);
+        REQUIRE(cmpStrategy.compare(codec.decode(data.data(), data.size()), source).passed);
+
+        std::vector<uint8_t> buffer{ 1, 2, 3 };
+        codec.encode(source, buffer);
+        REQUIRE(buffer == data);
+
+        REQUIRE_THROWS_AS(codec.decode(data.data(), data.size() / 2), ImageApprovalsError);
+    }
+
+    SUBCASE("Reading interlaced images in regions")
+    {
+        BitwiseCompareStrategy cmpStrategy;
+
+        const Image source = codec.read(TEST_FILE("png/basi4a08.png"));
+        const auto reader = codec.openReader(TEST_FILE("png/basi4a08.png"));
+
+        REQUIRE(cmpStrategy.compare(reader->readRegion(4, 8, 16, 8), source.subView(4, 8, 16, 8)).passed);
+    }
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <QGuiApplication>
 #include <QImage>
 #include <iterator>
+#include <utility>
+#include <vector>
 
 #define ImageApprovals_CONFIG_QT5
 #include <ImageApprovals.hpp>
@@ -57,4 +59,65 @@ TEST_CASE_FIXTURE(QGuiFixture, "ImageView from QImage")
 
         FileApprover::verify(receivedPath, approvedPath);
     }
+
+    SUBCASE("Native formats are viewed without conversion")
+    {
+        const std::vector<std::pair<QImage::Format, const PixelFormat*>> formats{
+            { QImage::Format_RGBA8888_Premultiplied, &PixelFormat::getRgbAlphaU8Premultiplied() },
+            { QImage::Format_RGBA64, &PixelFormat::getRgbAlphaU16() },
+            { QImage::Format_RGBA64_Premultiplied, &PixelFormat::getRgbAlphaU16Premultiplied() },
+            { QImage::Format_Grayscale16, &PixelFormat::getGrayU16() },
+        };
+
+        for (const auto& format : formats)
+        {
+            const QImage image(4, 2, format.first);
+            const ImageView view = makeView(image);
+
+            REQUIRE_EQ(view.getPixelFormat(), *format.second);
+            REQUIRE_EQ(view.getRowPointer(0), image.constBits());
+        }
+    }
+
+    SUBCASE("Format_ARGB32 and Format_RGB32 have host byte order")
+    {
+        BitwiseCompareStrategy strategy;
+
+        QImage rgba(4, 2, QImage::Format::Format_RGBA8888);
+        QImage argb(4, 2, QImage::Format::Format_ARGB32);
+        QImage rgb32(4, 2, QImage::Format::Format_RGB32);
+
+        for (int y = 0; y < rgba.height(); ++y)
+        {
+            for (int x = 0; x < rgba.width(); ++x)
+            {
+                const QColor color(x * 60, y * 120, 200);
+
+                rgba.setPixelColor(x, y, color);
+                argb.setPixelColor(x, y, color);
+                rgb32.setPixelColor(x, y, color);
+            }
+        }
+
+        REQUIRE(strategy.compare(makeView(rgba), makeView(argb)).passed);
+        REQUIRE(strategy.compare(makeView(rgba), makeView(rgb32)).passed);
+    }
+
+    SUBCASE("Format_ARGB32_Premultiplied")
+    {
+        ThresholdCompareStrategy strategy(AbsThreshold(0.004), Percent(0.0), AlphaComparison::Premultiplied);
+
+        QImage rgba(4, 1, QImage::Format::Format_RGBA8888);
+        QImage premultiplied(4, 1, QImage::Format::Format_ARGB32_Premultiplied);
+
+        for (int x = 0; x < rgba.width(); ++x)
+        {
+            const QColor color(255, 127, 0, x * 85);
+
+            rgba.setPixelColor(x, 0, color);
+            premultiplied.setPixelColor(x, 0, color);
+        }
+
+        REQUIRE(strategy.compare(makeView(rgba), makeView(premultiplied)).passed);
+    }
 }
\ No newline at end of file
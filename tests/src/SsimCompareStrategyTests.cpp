@@ -0,0 +1,126 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+#include <cstring>
+
+using namespace ImageApprovals;
+
+namespace {
+
+ImageView makeGrayView(const float* pixels, uint32_t width, uint32_t height)
+{
+    return ImageView(
+        PixelFormat::getGrayF32(), ColorSpace::getLinearSRgb(), Size(width, height),
+        width * sizeof(float), reinterpret_cast<const uint8_t*>(pixels));
+}
+
+}
+
+TEST_CASE("SsimCompareStrategy")
+{
+    SUBCASE("SSIM of a single window")
+    {
+        const float leftPixels[]{ 0.0f, 1.0f, 0.0f, 1.0f };
+        const float rightPixels[]{ 0.0f, 1.0f, 1.0f, 0.0f };
+
+        // Equal means and variances, no covariance: (0.5 + C1) * C2 / ((0.5 + C1) * (0.5 + C2))
+        const auto result = SsimCompareStrategy(0.5, -1.0, 2).compare(makeGrayView(leftPixels, 2, 2), makeGrayView(rightPixels, 2, 2));
+
+        REQUIRE_FALSE(result.passed);
+        REQUIRE(result.getRightImageInfo().find("mean SSIM = 0.00179") == 0);
+    }
+
+    const uint32_t width = 64, height = 48;
+    std::vector<float> left(width * height), right;
+
+    // Smooth gradients with a checkerboard detail
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            left[y * width + x] = 0.3f * x / width + 0.3f * y / height + (((x / 4 + y / 4) % 2) ? 0.2f : 0.0f);
+        }
+    }
+
+    right = left;
+
+    SUBCASE("Equal images pass")
+    {
+        REQUIRE(SsimCompareStrategy(1.0, 1.0).compare(makeGrayView(left.data(), width, height), makeGrayView(right.data(), width, height)).passed);
+    }
+
+    SUBCASE("Slight noise passes, lost structure does not")
+    {
+        for (size_t i = 0; i < right.size(); ++i)
+        {
+            right[i] += ((i * 7919) % 5) * 0.001f;
+        }
+
+        const SsimCompareStrategy strategy(0.98);
+        REQUIRE(strategy.compare(makeGrayView(left.data(), width, height), makeGrayView(right.data(), width, height)).passed);
+
+        // The checkerboard is gone
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                right[y * width + x] = 0.3f * x / width + 0.3f * y / height + 0.1f;
+            }
+        }
+
+        REQUIRE_FALSE(strategy.compare(makeGrayView(left.data(), width, height), makeGrayView(right.data(), width, height)).passed);
+    }
+
+    SUBCASE("A local artifact fails the window minimum before the mean")
+    {
+        for (uint32_t y = 20; y < 24; ++y)
+        {
+            for (uint32_t x = 30; x < 34; ++x)
+            {
+                right[y * width + x] = 1.0f - left[y * width + x];
+            }
+        }
+
+        const auto leftView = makeGrayView(left.data(), width, height);
+        const auto rightView = makeGrayView(right.data(), width, height);
+
+        REQUIRE(SsimCompareStrategy(0.9).compare(leftView, rightView).passed);
+
+        const auto result = SsimCompareStrategy(0.9, 0.5).compare(leftView, rightView);
+        REQUIRE_FALSE(result.passed);
+        REQUIRE(result.getRightImageInfo().find("lowest window SSIM") != std::string::npos);
+    }
+
+    SUBCASE("Color images are compared by luma")
+    {
+        Image leftImage(PixelFormat::getRgbAlphaU8(), ColorSpace::getSRgb(), Size(16, 16));
+        Image rightImage(PixelFormat::getRgbAlphaU8(), ColorSpace::getSRgb(), Size(16, 16));
+
+        for (uint32_t y = 0; y < 16; ++y)
+        {
+            for (uint32_t x = 0; x < 16; ++x)
+            {
+                const uint8_t value = static_cast<uint8_t>((x + y) * 8);
+                const uint8_t pixel[]{ value, value, value, 255 };
+
+                std::memcpy(leftImage.getRowPointer(y) + 4 * x, pixel, 4);
+                std::memcpy(rightImage.getRowPointer(y) + 4 * x, pixel, 4);
+            }
+        }
+
+        const SsimCompareStrategy strategy(0.99);
+        REQUIRE(strategy.compare(leftImage, rightImage).passed);
+
+        // Fully transparent pixels compare as black
+        for (uint32_t y = 0; y < 16; ++y)
+        {
+            std::memset(rightImage.getRowPointer(y), 0, 4 * 8);
+        }
+
+        REQUIRE_FALSE(strategy.compare(leftImage, rightImage).passed);
+    }
+
+    SUBCASE("Window size must not be zero")
+    {
+        REQUIRE_THROWS_AS(SsimCompareStrategy(0.9, -1.0, 0), ImageApprovalsError);
+    }
+}
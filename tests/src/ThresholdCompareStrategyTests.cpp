@@ -1,5 +1,7 @@
 #include <doctest/doctest.h>
 #include <ImageApprovals.hpp>
+#include <algorithm>
+#include <cmath>
 
 using namespace ImageApprovals;
 
@@ -56,4 +58,194 @@ TEST_CASE("ThresholdImageComparator")
         Image right(format, colorSpace, size, 1);
         REQUIRE(comparator.compare(left, right).passed);
     }
-}
\ No newline at end of file
+
+    SUBCASE("Images have channels in different order")
+    {
+        const uint8_t rgb[]{ 0, 100, 200 };
+        const uint8_t bgr[]{ 200, 100, 0 };
+        const uint8_t bgrDifferent[]{ 200, 100, 50 };
+
+        const ImageView rgbView(format, colorSpace, Size(1, 1), 3, rgb);
+
+        REQUIRE(comparator.compare(rgbView, ImageView(PixelFormat::getBgrU8(), colorSpace, Size(1, 1), 3, bgr)).passed);
+        REQUIRE_FALSE(comparator.compare(rgbView, ImageView(PixelFormat::getBgrU8(), colorSpace, Size(1, 1), 3, bgrDifferent)).passed);
+        REQUIRE_FALSE(comparator.compare(rgbView, ImageView(PixelFormat::getBgrAlphaU8(), colorSpace, Size(1, 1), 4, bgr)).passed);
+    }
+}
+
+TEST_CASE("ThresholdImageComparator with alpha")
+{
+    const auto& colorSpace = ColorSpace::getSRgb();
+    const Size size{ 2, 1 };
+
+    const uint8_t straight[]{
+        255, 0, 0, 128,
+        0, 0, 0, 0
+    };
+
+    const uint8_t garbageUnderZeroAlpha[]{
+        255, 0, 0, 128,
+        200, 100, 0, 0
+    };
+
+    const uint8_t premultiplied[]{
+        0, 0, 128, 128,
+        0, 0, 0, 0
+    };
+
+    const ImageView straightView(PixelFormat::getRgbAlphaU8(), colorSpace, size, 8, straight);
+    const ImageView garbageView(PixelFormat::getRgbAlphaU8(), colorSpace, size, 8, garbageUnderZeroAlpha);
+    const ImageView premultipliedView(PixelFormat::getBgrAlphaU8Premultiplied(), colorSpace, size, 8, premultiplied);
+
+    SUBCASE("Straight comparison counts colors of transparent pixels")
+    {
+        ThresholdCompareStrategy comparator(AbsThreshold(0.004), Percent(0.0));
+
+        REQUIRE_FALSE(comparator.compare(straightView, garbageView).passed);
+    }
+
+    SUBCASE("Premultiplied comparison ignores colors of transparent pixels")
+    {
+        ThresholdCompareStrategy comparator(AbsThreshold(0.004), Percent(0.0), AlphaComparison::Premultiplied);
+
+        REQUIRE(comparator.compare(straightView, garbageView).passed);
+        REQUIRE(comparator.compare(garbageView, premultipliedView).passed);
+        REQUIRE(comparator.compare(premultipliedView, straightView).passed);
+    }
+
+    SUBCASE("Premultiplied pixels are unpremultiplied for straight comparison")
+    {
+        ThresholdCompareStrategy comparator(AbsThreshold(0.004), Percent(0.0));
+
+        REQUIRE(comparator.compare(straightView, premultipliedView).passed);
+        REQUIRE(comparator.compare(premultipliedView, premultipliedView).passed);
+    }
+
+    SUBCASE("Premultiplied images are compared as stored")
+    {
+        // Additive colors are kept under zero alpha
+        const uint8_t glowing[]{
+            0, 0, 128, 128,
+            0, 100, 200, 0
+        };
+
+        const ImageView glowingView(PixelFormat::getBgrAlphaU8Premultiplied(), colorSpace, size, 8, glowing);
+
+        REQUIRE_FALSE(ThresholdCompareStrategy(AbsThreshold(0.004), Percent(0.0)).compare(premultipliedView, glowingView).passed);
+        REQUIRE_FALSE(ThresholdCompareStrategy(AbsThreshold(0.004), Percent(0.0), AlphaComparison::Premultiplied)
+            .compare(premultipliedView, glowingView).passed);
+    }
+}
+
+TEST_CASE("ThresholdCompareStrategy statistics")
+{
+    const auto& format = PixelFormat::getGrayF32();
+    const auto& colorSpace = ColorSpace::getLinearSRgb();
+
+    const float leftPixels[]{ 0.0f, 0.5f, 0.25f, 1.0f };
+    const float rightPixels[]{ 0.0f, 0.5f, 0.75f, 0.9f };
+
+    const ImageView left(format, colorSpace, Size(2, 2), 8, reinterpret_cast<const uint8_t*>(leftPixels));
+    const ImageView right(format, colorSpace, Size(2, 2), 8, reinterpret_cast<const uint8_t*>(rightPixels));
+
+    const auto result = ThresholdCompareStrategy(AbsThreshold(0.2), Percent(10.0)).compare(left, right);
+
+    REQUIRE_FALSE(result.passed);
+    REQUIRE(result.hasStatistics);
+
+    const auto& stats = result.statistics;
+    REQUIRE_EQ(stats.numComparedPixels, 4u);
+    REQUIRE_EQ(stats.numFailedPixels, 1u);
+    REQUIRE_EQ(stats.maxError, doctest::Approx(0.5));
+    REQUIRE_EQ(stats.worstPixelX, 0u);
+    REQUIRE_EQ(stats.worstPixelY, 1u);
+    REQUIRE_EQ(stats.channelMaxErrors.r, doctest::Approx(0.5));
+    REQUIRE_EQ(stats.channelMaxErrors.a, 0.0f);
+    REQUIRE_EQ(stats.meanError, doctest::Approx(0.15));
+    REQUIRE_EQ(stats.rmsError, doctest::Approx(std::sqrt(0.26 / 4)));
+    REQUIRE_EQ(stats.psnr, doctest::Approx(-20.0 * std::log10(std::sqrt(0.26 / 4))));
+
+    REQUIRE(result.getRightImageInfo().find("at (0, 1)") != std::string::npos);
+
+    const auto equal = ThresholdCompareStrategy().compare(left, left);
+    REQUIRE(equal.passed);
+    REQUIRE(equal.hasStatistics);
+    REQUIRE_EQ(equal.statistics.maxError, 0.0f);
+    REQUIRE(std::isinf(equal.statistics.psnr));
+
+    SUBCASE("Diff images are only allocated for differences")
+    {
+        const ThresholdCompareStrategy strategy(AbsThreshold(0.2), Percent(10.0));
+
+        DiffImageRenderer equalDiff(Size(2, 2), 1.0f);
+        REQUIRE(strategy.compare(left, left, &equalDiff).passed);
+        REQUIRE_FALSE(equalDiff.isRendered());
+        REQUIRE(ImageView(equalDiff.getImage()).isEmpty());
+
+        DiffImageRenderer diff(Size(2, 2), 1.0f);
+        REQUIRE_FALSE(strategy.compare(left, right, &diff).passed);
+        REQUIRE(diff.isRendered());
+
+        const uint8_t expected[]{ 0, 0, 0, 0, 0, 0, 128, 128, 128, 26, 26, 26 };
+        REQUIRE(std::equal(expected, expected + 6, diff.getImage().getRowPointer(0)));
+        REQUIRE(std::equal(expected + 6, expected + 12, diff.getImage().getRowPointer(1)));
+    }
+}
+
+TEST_CASE("ThresholdCompareStrategy quick reject")
+{
+    const auto& format = PixelFormat::getGrayU8();
+    const auto& colorSpace = ColorSpace::getLinearSRgb();
+    const Size size(64, 64);
+
+    const Image left(format, colorSpace, size, 1);
+    Image right(format, colorSpace, size, 1);
+
+    // 40 of 4096 pixels may fail
+    const ThresholdCompareStrategy full(AbsThreshold(0.1), Percent(1.0));
+
+    ThresholdCompareStrategy sampling(AbsThreshold(0.1), Percent(1.0));
+    sampling.setQuickRejectRowStep(8, 0);
+
+    SUBCASE("Gross differences are rejected from the sampled rows")
+    {
+        for (uint32_t y = 0; y < size.height; ++y)
+        {
+            std::fill(right.getRowPointer(y), right.getRowPointer(y) + 32, uint8_t(255));
+        }
+
+        const auto result = sampling.compare(left, right);
+
+        REQUIRE_FALSE(result.passed);
+        REQUIRE(result.sampled);
+        REQUIRE_FALSE(full.compare(left, right).passed);
+        REQUIRE_FALSE(full.compare(left, right).sampled);
+        REQUIRE_EQ(result.statistics.numComparedPixels, 8u * 64u);
+        REQUIRE_EQ(result.statistics.worstPixelY, 4u);
+        REQUIRE(result.failureMask->contains(0, 12));
+        REQUIRE(result.getRightImageInfo().find("at least 256 pixels") == 0);
+    }
+
+    SUBCASE("Differences missed by the sampled rows are found in full")
+    {
+        std::fill(right.getRowPointer(0), right.getRowPointer(0) + 64, uint8_t(255));
+
+        const auto result = sampling.compare(left, right);
+
+        REQUIRE_FALSE(result.passed);
+        REQUIRE_FALSE(full.compare(left, right).passed);
+        REQUIRE_EQ(result.statistics.numComparedPixels, 4096u);
+        REQUIRE_EQ(result.statistics.numFailedPixels, 64u);
+    }
+
+    SUBCASE("Passing images are compared in full")
+    {
+        std::fill(right.getRowPointer(4), right.getRowPointer(4) + 40, uint8_t(255));
+
+        const auto result = sampling.compare(left, right);
+
+        REQUIRE(result.passed);
+        REQUIRE(full.compare(left, right).passed);
+        REQUIRE_EQ(result.statistics.numComparedPixels, 4096u);
+    }
+}
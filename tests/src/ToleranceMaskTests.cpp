@@ -0,0 +1,139 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+
+using namespace ImageApprovals;
+
+TEST_CASE("ToleranceMask")
+{
+    ToleranceMask mask(Size(10, 4));
+
+    mask.setRegionThreshold(0, 0, 10, 4, AbsThreshold(0.5));
+    mask.ignoreRegion(2, 1, 3, 2);
+
+    SUBCASE("Regions split the spans they overlap")
+    {
+        const auto& spans = mask.getRowSpans(1);
+
+        REQUIRE_EQ(spans.size(), 3u);
+        REQUIRE_EQ(spans[0].x, 0u);
+        REQUIRE_EQ(spans[0].length, 2u);
+        REQUIRE_EQ(spans[0].threshold, 0.5f);
+        REQUIRE_EQ(spans[1].x, 2u);
+        REQUIRE_EQ(spans[1].length, 3u);
+        REQUIRE(spans[1].isIgnored());
+        REQUIRE_EQ(spans[2].x, 5u);
+        REQUIRE_EQ(spans[2].length, 5u);
+
+        REQUIRE_EQ(mask.getRowSpans(0).size(), 1u);
+        REQUIRE_EQ(mask.getNumIgnoredPixels(), 6u);
+    }
+
+    SUBCASE("Regions are clipped to the image")
+    {
+        mask.ignoreRegion(8, 3, 100, 100);
+
+        REQUIRE_EQ(mask.getRowSpans(3).back().x, 8u);
+        REQUIRE_EQ(mask.getRowSpans(3).back().length, 2u);
+        REQUIRE_EQ(mask.getNumIgnoredPixels(), 8u);
+    }
+
+    SUBCASE("Serialized masks merge equal rows and are read back")
+    {
+        const auto text = mask.serialize();
+
+        REQUIRE_EQ(text,
+            "tolerance-mask 10 4\n"
+            "threshold 0 0 10 1 0.5\n"
+            "threshold 0 1 2 2 0.5\n"
+            "ignore 2 1 3 2\n"
+            "threshold 5 1 5 2 0.5\n"
+            "threshold 0 3 10 1 0.5\n");
+
+        REQUIRE_EQ(ToleranceMask::deserialize(text).serialize(), text);
+        REQUIRE_THROWS_AS(ToleranceMask::deserialize("tolerance-mask 10 4\nignore 1 2"), ImageApprovalsError);
+    }
+
+    SUBCASE("Invalid masks are rejected with the line")
+    {
+        auto getError = [](const std::string& text) {
+            try
+            {
+                ToleranceMask::deserialize(text);
+            }
+            catch (const ImageApprovalsError& error)
+            {
+                return std::string(error.what());
+            }
+
+            return std::string();
+        };
+
+        REQUIRE(getError("tolerance-mask 1 4000000000").find("line 1: size") != std::string::npos);
+        REQUIRE(getError("tolerance-mask 0 4").find("line 1: size") != std::string::npos);
+        REQUIRE(getError("tolerance-mask 10 4\n\nignore -5 0 2 2").find("line 3: \"-5\"") != std::string::npos);
+        REQUIRE(getError("tolerance-mask 10 4\nignore 1 0 2 2 x").find("line 2: expected") != std::string::npos);
+        REQUIRE(getError("tolerance-mask 10 4\nignore 9 0 2 2").find("line 2: region") != std::string::npos);
+        REQUIRE(getError("tolerance-mask 10 4\nthreshold 0 0 2 2 0.5x").find("line 2: \"0.5x\"") != std::string::npos);
+        REQUIRE(getError("tolerance-mask 10 4\nthreshold 0 0 2 2 -1").find("line 2: \"-1\"") != std::string::npos);
+        REQUIRE(getError("").find("expected \"tolerance-mask") != std::string::npos);
+        REQUIRE(getError("tolerance-mask 10 4\nignore 8 3 2 1\n").empty());
+    }
+}
+
+TEST_CASE("ThresholdCompareStrategy with a tolerance mask")
+{
+    const auto& format = PixelFormat::getGrayU8();
+    const auto& colorSpace = ColorSpace::getLinearSRgb();
+
+    const Image left(format, colorSpace, Size(10, 4), 1);
+    Image right(format, colorSpace, Size(10, 4), 1);
+
+    // A very different block, and a slightly different pixel
+    right.getRowPointer(1)[2] = 255;
+    right.getRowPointer(2)[4] = 255;
+    right.getRowPointer(3)[9] = 51;
+
+    const ThresholdCompareStrategy strategy(AbsThreshold(0.1), Percent(0.0));
+
+    ToleranceMask mask(Size(10, 4));
+    mask.ignoreRegion(2, 1, 3, 2);
+    mask.setRegionThreshold(9, 3, 1, 1, AbsThreshold(0.25));
+
+    CompareOptions options;
+    options.toleranceMask = &mask;
+
+    SUBCASE("Ignored pixels and pixels within their own threshold pass")
+    {
+        REQUIRE_FALSE(strategy.compare(left, right).passed);
+
+        const auto result = strategy.compare(left, right, options);
+
+        REQUIRE(result.passed);
+        REQUIRE_EQ(result.statistics.numComparedPixels, 34u);
+        REQUIRE_EQ(result.statistics.numFailedPixels, 0u);
+    }
+
+    SUBCASE("Pixels outside of ignored regions still fail")
+    {
+        right.getRowPointer(0)[0] = 255;
+
+        const auto result = strategy.compare(left, right, options);
+
+        REQUIRE_FALSE(result.passed);
+        REQUIRE_EQ(result.statistics.numFailedPixels, 1u);
+        REQUIRE(result.failureMask->contains(0, 0));
+    }
+
+    SUBCASE("Masks must have the size of the images")
+    {
+        ToleranceMask smaller(Size(10, 3));
+        options.toleranceMask = &smaller;
+
+        REQUIRE_THROWS_AS(strategy.compare(left, right, options), ImageApprovalsError);
+    }
+
+    SUBCASE("Strategies without tolerance mask support reject masks")
+    {
+        REQUIRE_THROWS_AS(BitwiseCompareStrategy().compare(left, right, options), ImageApprovalsError);
+    }
+}
@@ -0,0 +1,83 @@
+#include <doctest/doctest.h>
+#include <ImageApprovals.hpp>
+#include <cmath>
+#include <vector>
+
+using namespace ImageApprovals;
+
+namespace {
+
+const uint32_t width = 16, height = 8;
+
+ImageView makeGrayView(const std::vector<uint8_t>& pixels)
+{
+    return ImageView(PixelFormat::getGrayU8(), ColorSpace::getSRgb(), Size(width, height), width, pixels.data());
+}
+
+void fillColumn(std::vector<uint8_t>& pixels, uint32_t x, uint8_t value)
+{
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        pixels[y * width + x] = value;
+    }
+}
+
+}
+
+TEST_CASE("YiqCompareStrategy")
+{
+    // Black on the left half, white on the right half
+    std::vector<uint8_t> left(width * height, 0);
+    for (uint32_t x = width / 2; x < width; ++x)
+    {
+        fillColumn(left, x, 255);
+    }
+
+    std::vector<uint8_t> right = left;
+
+    const YiqCompareStrategy strategy(0.1, Percent(0.0));
+
+    SUBCASE("Equal images pass")
+    {
+        REQUIRE(strategy.compare(makeGrayView(left), makeGrayView(right)).passed);
+    }
+
+    SUBCASE("Small color differences pass")
+    {
+        right[3] = 12;
+        REQUIRE(strategy.compare(makeGrayView(left), makeGrayView(right)).passed);
+    }
+
+    SUBCASE("Anti-aliased edges are ignored")
+    {
+        fillColumn(right, width / 2, 128);
+        fillColumn(right, width / 2 - 1, 64);
+
+        REQUIRE(strategy.compare(makeGrayView(left), makeGrayView(right)).passed);
+    }
+
+    SUBCASE("Other differences fail")
+    {
+        // A line in a flat area has no brighter neighbour
+        fillColumn(right, width - 3, 128);
+        right[2 * width + 2] = 255;
+
+        const auto result = strategy.compare(makeGrayView(left), makeGrayView(right));
+        REQUIRE_FALSE(result.passed);
+        REQUIRE(result.getRightImageInfo() == "9 pixels (7.03125%) differ by more than YIQ delta 0.1, 0 anti-aliased pixels ignored");
+
+        // The distance of black and white, relative to the largest possible distance
+        REQUIRE(result.hasStatistics);
+        REQUIRE_EQ(result.statistics.numFailedPixels, 9u);
+        REQUIRE_EQ(result.statistics.maxError, doctest::Approx(std::sqrt(0.5053 * 255.0 * 255.0 / 35215.0)).epsilon(1e-4));
+        REQUIRE_EQ(result.statistics.worstPixelX, 2u);
+        REQUIRE_EQ(result.statistics.worstPixelY, 2u);
+
+        fillColumn(right, width / 2, 128);
+
+        REQUIRE(strategy.compare(makeGrayView(left), makeGrayView(right)).getRightImageInfo()
+                == "9 pixels (7.03125%) differ by more than YIQ delta 0.1, 8 anti-aliased pixels ignored");
+
+        REQUIRE(YiqCompareStrategy(0.1, Percent(7.1)).compare(makeGrayView(left), makeGrayView(right)).passed);
+    }
+}